@@ -0,0 +1,904 @@
+// === This file implements the benchmarks for the revLANG infrastructure.
+
+#include "AnalysisManager.h"
+#include "Bitcode.h"
+#include "CFGTraversal.h"
+#include "CodeGen.h"
+#include "DataFlow.h"
+#include "ExecutionEngine.h"
+#include "FlatFunction.h"
+#include "JIT.h"
+#include "LoopInfo.h"
+#include "MappedFile.h"
+#include "ModuleGenerator.h"
+#include "OutputStream.h"
+#include "Parser.h"
+#include "PassManager.h"
+#include "Passes.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+using Clock = std::chrono::steady_clock;
+
+// The allocations made so far, counted by the operator new below.
+static std::atomic<uint64_t> NumOfAllocs{0};
+static std::atomic<uint64_t> NumOfAllocBytes{0};
+
+// The replacements are kept out of line. Once the operator delete is
+// inlined, the compiler sees the free() of a pointer from the operator new,
+// and takes it for a mismatch (-Wmismatched-new-delete).
+#if defined(__GNUC__)
+#define REVLANG_NOINLINE __attribute__((noinline))
+#else
+#define REVLANG_NOINLINE
+#endif
+
+REVLANG_NOINLINE void *operator new(size_t size) {
+  NumOfAllocs.fetch_add(1, std::memory_order_relaxed);
+  NumOfAllocBytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+REVLANG_NOINLINE void *operator new[](size_t size) {
+  return operator new(size);
+}
+REVLANG_NOINLINE void operator delete(void *ptr) noexcept { std::free(ptr); }
+REVLANG_NOINLINE void operator delete[](void *ptr) noexcept { std::free(ptr); }
+REVLANG_NOINLINE void operator delete(void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+REVLANG_NOINLINE void operator delete[](void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+// Returns the peak resident set size of the process, in KB.
+static long getPeakRSS() {
+  struct rusage Usage;
+  getrusage(RUSAGE_SELF, &Usage);
+#ifdef __APPLE__
+  return Usage.ru_maxrss / 1024;
+#else
+  return Usage.ru_maxrss;
+#endif
+}
+
+// Returns the time elapsed since the start, in milliseconds.
+static double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+static size_t fileSize(const std::string &filename) {
+  std::ifstream File(filename, std::ios::binary | std::ios::ate);
+  return File ? static_cast<size_t>(File.tellg()) : 0;
+}
+
+// The results of the microbenchmarks, and of the whole benchmarks (with the
+// ops of 1), for the machine-readable report.
+struct Measurement {
+  std::string Benchmark;
+  std::string Name;
+  uint64_t NumOfOps;
+  double NsPerOp;
+  double AllocsPerOp;
+  double BytesPerOp;
+  // The peak RSS of the process so far, in KB.
+  long PeakRSS;
+};
+static std::vector<Measurement> Measurements;
+static const char *CurrentBenchmark = "";
+
+// This measures the time and the allocations of a number of the same ops.
+class OpTimer {
+  Clock::time_point Start;
+  uint64_t StartAllocs;
+  uint64_t StartBytes;
+
+public:
+  OpTimer() { restart(); }
+
+  void restart() {
+    StartAllocs = NumOfAllocs.load(std::memory_order_relaxed);
+    StartBytes = NumOfAllocBytes.load(std::memory_order_relaxed);
+    Start = Clock::now();
+  }
+
+  // Reports the numOfOps ops done since the (re)start.
+  void stop(const char *Name, uint64_t numOfOps) {
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - Start)
+                    .count();
+    double ops = numOfOps ? double(numOfOps) : 1.0;
+    Measurement R{CurrentBenchmark,
+                  Name,
+                  numOfOps,
+                  ns / ops,
+                  (NumOfAllocs.load(std::memory_order_relaxed) - StartAllocs) /
+                      ops,
+                  (NumOfAllocBytes.load(std::memory_order_relaxed) -
+                   StartBytes) /
+                      ops,
+                  getPeakRSS()};
+    std::printf("  %-18s %12.1f ns/op %10.2f allocs/op %12.1f B/op "
+                "(%llu ops)\n",
+                Name, R.NsPerOp, R.AllocsPerOp, R.BytesPerOp,
+                static_cast<unsigned long long>(numOfOps));
+    Measurements.push_back(std::move(R));
+  }
+};
+
+// The shape of the generated modules (see the command line options).
+static GeneratorOptions GenOpts;
+
+// Builds a module with numOfFns functions of numOfBBs blocks each. The
+// blocks form a chain, and each of them has an ADD, a LOAD and a STORE.
+static std::unique_ptr<Module> buildModule(unsigned numOfFns,
+                                           unsigned numOfBBs,
+                                           unsigned numOfVars) {
+  auto M = Module::create("bench.revLang", /*useArena=*/true);
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 0; i < numOfVars; ++i)
+    GVs.push_back(GlobalVariable::create(i, M.get()).release());
+
+  for (unsigned f = 0; f < numOfFns; ++f) {
+    auto *F = Function::create("fn" + std::to_string(f), M.get()).release();
+    BasicBlock *Prev = nullptr;
+    for (unsigned b = 0; b < numOfBBs; ++b) {
+      auto *BB =
+          BasicBlock::create("bb." + std::to_string(b), F, !Prev).release();
+      if (Prev)
+        Prev->addSuccessor(b % 2 ? "true" : "false", BB);
+      OperandsTy AddOps{GVs[b % numOfVars], GVs[(b + 1) % numOfVars],
+                        GVs[(b + 2) % numOfVars]};
+      Add::create(AddOps, BB);
+      OperandsTy LoadOps{GVs[b % numOfVars]};
+      Load::create(LoadOps, BB);
+      OperandsTy StoreOps{GVs[(b + 3) % numOfVars], GVs[b % numOfVars]};
+      Store::create(StoreOps, BB);
+      Prev = BB;
+    }
+  }
+  return M;
+}
+
+// Compares the load time and the size of the bitcode and the textual form.
+static void benchBitcode() {
+  const std::string TextFile = "revLANG-bench.revLang";
+  const std::string BitcodeFile = "revLANG-bench.rvbc";
+  auto M = buildModule(100, 2000, 1000);
+
+  {
+    std::string errMsg;
+    FDOutputStream OS(TextFile, errMsg);
+    M->print(OS);
+  }
+  auto start = Clock::now();
+  M->writeBitcode(BitcodeFile);
+  double writeMs = msSince(start);
+
+  std::string errMsg;
+  start = Clock::now();
+  auto TextM = parseRevLangFile(TextFile, errMsg);
+  double textMs = msSince(start);
+  start = Clock::now();
+  auto BitcodeM = readBitcodeFile(BitcodeFile, errMsg);
+  double bitcodeMs = msSince(start);
+  if (!TextM || !BitcodeM)
+    std::cerr << "  error: " << errMsg << '\n';
+
+  // The read-only view doesn't materialize the functions.
+  start = Clock::now();
+  MappedFile File;
+  BitcodeView View;
+  if (!File.open(BitcodeFile, errMsg) || !View.init(File.getBuffer(), errMsg))
+    std::cerr << "  error: " << errMsg << '\n';
+  double viewMs = msSince(start);
+
+  std::printf("  text:    %10zu bytes, load %8.2f ms\n", fileSize(TextFile),
+              textMs);
+  std::printf("  bitcode: %10zu bytes, load %8.2f ms, write %8.2f ms\n",
+              fileSize(BitcodeFile), bitcodeMs, writeMs);
+  std::printf("  bitcode view:            open %8.2f ms\n", viewMs);
+
+  std::remove(TextFile.c_str());
+  std::remove(BitcodeFile.c_str());
+}
+
+// Measures the creation and the lookup of the named functions and blocks.
+static void benchSymbols() {
+  const unsigned NumOfBBs = 200000;
+  auto M = Module::create("bench.revLang", /*useArena=*/true);
+  std::vector<std::string> Names;
+  for (unsigned b = 0; b < NumOfBBs; ++b)
+    Names.push_back("bb." + std::to_string(b));
+
+  auto start = Clock::now();
+  auto *F = Function::create("fn", M.get()).release();
+  std::vector<BasicBlock *> BBs;
+  for (unsigned b = 0; b < NumOfBBs; ++b)
+    BBs.push_back(BasicBlock::create(Names[b], F, !b).release());
+  double createMs = msSince(start);
+
+  start = Clock::now();
+  for (unsigned b = 0; b + 1 < NumOfBBs; ++b) {
+    BBs[b]->addSuccessor("true", BBs[b + 1]);
+    BBs[b]->addSuccessor("false", BBs[(b * 7) % NumOfBBs]);
+  }
+  double addSuccMs = msSince(start);
+
+  start = Clock::now();
+  size_t found = 0;
+  for (unsigned b = 0; b < NumOfBBs; ++b)
+    found += F->getBasicBlock(Names[(b * 7919) % NumOfBBs]) != nullptr;
+  double lookupMs = msSince(start);
+
+  std::printf("  create %u bbs: %8.2f ms\n", NumOfBBs, createMs);
+  std::printf("  add %u edges:  %8.2f ms\n", 2 * (NumOfBBs - 1), addSuccMs);
+  std::printf("  lookup %zu bbs: %8.2f ms\n", found, lookupMs);
+}
+
+// Measures the printing of a big module in the textual form.
+static void benchPrint() {
+  auto M = buildModule(100, 2000, 1000);
+
+  std::string Str;
+  auto start = Clock::now();
+  {
+    StringOutputStream OS(Str);
+    M->print(OS);
+  }
+  double stringMs = msSince(start);
+
+  const std::string TextFile = "revLANG-bench.revLang";
+  std::string errMsg;
+  start = Clock::now();
+  {
+    FDOutputStream OS(TextFile, errMsg);
+    M->print(OS);
+    if (!OS.close())
+      std::cerr << "  error: could not write " << TextFile << '\n';
+  }
+  double fileMs = msSince(start);
+
+  std::printf("  print %zu bytes: string %8.2f ms, file %8.2f ms\n",
+              Str.size(), stringMs, fileMs);
+  std::remove(TextFile.c_str());
+}
+
+// Measures the throughput of the interpreter on a loop of 16 bbs, and of
+// the native code (see the JIT.h).
+static void benchInterpreter() {
+  const unsigned NumOfBBs = 16;
+  const uint64_t NumOfIterations = 1000000;
+  auto M = Module::create("bench.revLang", /*useArena=*/true);
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 0; i < 8; ++i)
+    GVs.push_back(GlobalVariable::create(i, M.get()).release());
+  auto *F = Function::create("fn", M.get()).release();
+  std::vector<BasicBlock *> BBs;
+  for (unsigned b = 0; b < NumOfBBs; ++b) {
+    BBs.push_back(
+        BasicBlock::create("bb." + std::to_string(b), F, !b).release());
+    if (b)
+      BBs[b - 1]->addSuccessor("", BBs[b]);
+    Add::create({GVs[b % 8], GVs[(b + 1) % 8], GVs[(b + 2) % 8]}, BBs[b]);
+    Load::create({GVs[b % 8]}, BBs[b]);
+    Store::create({GVs[(b + 3) % 8], GVs[(b + 4) % 8]}, BBs[b]);
+  }
+  auto *Exit = BasicBlock::create("exit", F).release();
+  BBs.back()->addSuccessor("loop", BBs.front());
+  BBs.back()->addSuccessor("exit", Exit);
+
+  JITCache JIT(*M);
+  for (bool native : {false, true}) {
+    if (native && !JITCache::isSupported())
+      break;
+    ExecutionEngine EE(*M);
+    EE.setJIT(native ? &JIT : nullptr);
+    uint64_t iteration = 0;
+    EE.setBranchDecision([&iteration, NumOfIterations](const BranchState &) {
+      // The tags are sorted: "exit", "loop".
+      return ++iteration < NumOfIterations ? 1 : 0;
+    });
+    std::string errMsg;
+    auto start = Clock::now();
+    if (!EE.run(*F, errMsg))
+      std::cerr << "  error: " << errMsg << '\n';
+    double runMs = msSince(start);
+
+    uint64_t numOfBlocks = EE.getNumOfExecutedBlocks();
+    std::printf("  %s run %llu bbs: %8.2f ms (%.1f M bbs/s)\n",
+                native ? "native" : "bytecode",
+                static_cast<unsigned long long>(numOfBlocks), runMs,
+                numOfBlocks / runMs / 1000);
+  }
+}
+
+// Measures the batch runs of a loop over many lanes, each with its own trip
+// count, against running the lanes one at a time.
+static void benchBatch() {
+  const unsigned NumOfBBs = 16;
+  const size_t NumOfLanes = 64 * 1024;
+  auto M = Module::create("bench.revLang", /*useArena=*/true);
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 0; i < 8; ++i)
+    GVs.push_back(GlobalVariable::create(i, M.get()).release());
+  // !5 is the counter, !6 is -1 and !7 is 0.
+  auto *F = Function::create("fn", M.get()).release();
+  std::vector<BasicBlock *> BBs;
+  for (unsigned b = 0; b < NumOfBBs; ++b) {
+    BBs.push_back(
+        BasicBlock::create("bb." + std::to_string(b), F, !b).release());
+    if (b)
+      BBs[b - 1]->addSuccessor("", BBs[b]);
+    Add::create({GVs[b % 5], GVs[(b + 1) % 5], GVs[(b + 2) % 5]}, BBs[b]);
+    Store::create({GVs[(b + 3) % 5], GVs[(b + 4) % 5]}, BBs[b]);
+  }
+  Add::create({GVs[5], GVs[5], GVs[6], GVs[7]}, BBs.back());
+  Load::create({GVs[5]}, BBs.back());
+  auto *Exit = BasicBlock::create("exit", F).release();
+  BBs.back()->addSuccessor("true", BBs.front());
+  BBs.back()->addSuccessor("false", Exit);
+
+  ExecutionEngine EE(*M);
+  std::string errMsg;
+  // The trip counts are the same within a tile (uniform), or they differ
+  // from lane to lane (divergent).
+  for (bool divergent : {false, true}) {
+    auto counterOf = [divergent](size_t lane) {
+      size_t group = divergent ? lane : lane / ExecutionBatch::TileSize;
+      return int64_t(group % 64) + 1;
+    };
+    const char *kind = divergent ? "divergent" : "uniform";
+
+    uint64_t numOfBlocks = 0;
+    auto start = Clock::now();
+    for (size_t lane = 0; lane < NumOfLanes; ++lane) {
+      EE.resetValues();
+      EE.setValue(*GVs[0], lane);
+      EE.setValue(*GVs[5], counterOf(lane));
+      EE.setValue(*GVs[6], -1);
+      if (!EE.run(*F, errMsg))
+        std::cerr << "  error: " << errMsg << '\n';
+      numOfBlocks += EE.getNumOfExecutedBlocks();
+    }
+    double runMs = msSince(start);
+    std::printf("  run %zu %s lanes:   %8.2f ms (%.1f M bbs/s)\n",
+                NumOfLanes, kind, runMs, numOfBlocks / runMs / 1000);
+
+    ExecutionBatch Batch(*M, NumOfLanes);
+    start = Clock::now();
+    for (size_t lane = 0; lane < NumOfLanes; ++lane) {
+      Batch.getColumn(0)[lane] = lane;
+      Batch.getColumn(5)[lane] = counterOf(lane);
+      Batch.getColumn(6)[lane] = -1;
+    }
+    if (!EE.runBatch(*F, Batch, errMsg))
+      std::cerr << "  error: " << errMsg << '\n';
+    double batchMs = msSince(start);
+    std::printf("  batch %zu %s lanes: %8.2f ms (%.1f M bbs/s)\n",
+                NumOfLanes, kind, batchMs,
+                EE.getNumOfExecutedBlocks() / batchMs / 1000);
+  }
+}
+
+// Measures the removal of all the blocks of a big function.
+static void benchBlockRemoval() {
+  const unsigned NumOfBBs = 100000;
+  auto M = Module::create("bench.revLang", /*useArena=*/true);
+  auto *F = Function::create("fn", M.get()).release();
+  std::vector<BasicBlock *> BBs;
+  for (unsigned b = 0; b < NumOfBBs; ++b)
+    BBs.push_back(
+        BasicBlock::create("bb." + std::to_string(b), F, !b).release());
+  for (unsigned b = 0; b + 1 < NumOfBBs; ++b) {
+    BBs[b]->addSuccessor("true", BBs[b + 1]);
+    BBs[b]->addSuccessor("false", BBs[(b * 7) % NumOfBBs]);
+  }
+
+  // The handles don't own the bbs, since the Module uses the arena.
+  auto start = Clock::now();
+  for (auto *BB : BBs)
+    F->removeBasicBlock(IRPtr<BasicBlock>(BB, IRDeleter<BasicBlock>(true)));
+  double removeMs = msSince(start);
+
+  std::printf("  remove %u bbs: %8.2f ms\n", NumOfBBs, removeMs);
+}
+
+// Walks the CFG of the function, and sums the ids of the operands.
+class WalkPass : public FunctionPass {
+public:
+  std::string_view getName() const override { return "walk"; }
+  bool runOnFunction(Function &F, ModuleUpdates &) override {
+    volatile uint64_t sum = 0;
+    for (int repeat = 0; repeat < 8; ++repeat)
+      for (BasicBlock *BB : depth_first(F))
+        for (const Instruction *I : BB->getInstructions())
+          for (const GlobalVariable *GV : I->getOps())
+            sum = sum + GV->getID();
+    return false;
+  }
+};
+
+// Removes all the LOADs.
+class RemoveLoadsPass : public FunctionPass {
+public:
+  std::string_view getName() const override { return "remove-loads"; }
+  bool runOnFunction(Function &F, ModuleUpdates &) override {
+    for (const auto &BB : F.getBasicBlocks()) {
+      std::vector<Instruction *> Loads;
+      for (auto *I : BB.second->getInstructions())
+        if (isa<Load>(I))
+          Loads.push_back(I);
+      for (auto *I : Loads)
+        BB.second->removeInstruction(
+            IRPtr<Instruction>(I, IRDeleter<Instruction>(true)));
+    }
+    return true;
+  }
+};
+
+// Measures the function passes on one thread and on all of them.
+static void benchPasses() {
+  unsigned numOfThreads = ThreadPool::getDefaultNumOfThreads();
+  for (unsigned threads : {1u, numOfThreads}) {
+    auto M = buildModule(64, 5000, 1000);
+    PassManager PM(threads);
+    PM.addPass(std::make_unique<WalkPass>());
+    PM.addPass(std::make_unique<RemoveLoadsPass>());
+    PM.run(*M);
+    StdOutputStream OS(std::cout);
+    PM.printTimings(OS);
+    if (numOfThreads == 1)
+      break;
+  }
+}
+
+// Builds a function of numOfBBs blocks with a STORE, an ADD and another
+// STORE each, of the pseudo-random vars. The blocks form a chain, and each
+// 8th of them loops back.
+static Function *buildDataFlowFunction(Module &M, unsigned numOfBBs,
+                                       unsigned numOfVars) {
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 0; i < numOfVars; ++i)
+    GVs.push_back(GlobalVariable::create(i, &M).release());
+  auto *F = Function::create("fn", &M).release();
+  std::vector<BasicBlock *> BBs;
+  uint32_t seed = 1;
+  auto nextVar = [&]() {
+    seed = seed * 1103515245 + 12345;
+    return GVs[(seed >> 8) % numOfVars];
+  };
+  for (unsigned b = 0; b < numOfBBs; ++b) {
+    auto *BB = BasicBlock::create("bb." + std::to_string(b), F, !b).release();
+    if (b)
+      BBs.back()->addSuccessor(b % 8 == 0 ? "false" : "", BB);
+    if (b % 8 == 7 && b + 1 < numOfBBs) {
+      BB->addSuccessor("true", BBs[b - 4]);
+      Load::create({nextVar()}, BB);
+    }
+    BBs.push_back(BB);
+    Store::create({nextVar(), nextVar()}, BB);
+    Add::create({nextVar(), nextVar(), nextVar()}, BB);
+    Store::create({nextVar(), nextVar()}, BB);
+  }
+  return F;
+}
+
+// Measures the dataflow analyses and the DSE on the large functions. The
+// reaching stores are dense over the STOREs, so they get a smaller one.
+static void benchDataFlow() {
+  for (unsigned numOfBBs : {20000u, 100000u}) {
+    const unsigned NumOfVars = 10000;
+    auto M = Module::create("bench.revLang", /*useArena=*/true);
+    Function *F = buildDataFlowFunction(*M, numOfBBs, NumOfVars);
+    std::printf("  %u bbs, %u vars:\n", numOfBBs, NumOfVars);
+
+    auto start = Clock::now();
+    {
+      LiveVariables LV(*F);
+    }
+    std::printf("    liveness:        %8.2f ms\n", msSince(start));
+
+    if (numOfBBs <= 20000) {
+      start = Clock::now();
+      ReachingStores RS(*F);
+      std::printf("    reaching stores: %8.2f ms (%zu stores)\n",
+                  msSince(start), RS.getNumOfStores());
+    }
+
+    size_t numOfInstrs = 0;
+    for (const auto &BB : F->getBasicBlocks())
+      numOfInstrs += BB.second->getNumOfInstrs();
+    PassManager PM;
+    PM.addPass(createDeadStoreElimPass());
+    start = Clock::now();
+    PM.run(*M);
+    double dseMs = msSince(start);
+    for (const auto &BB : F->getBasicBlocks())
+      numOfInstrs -= BB.second->getNumOfInstrs();
+    std::printf("    dse:             %8.2f ms (%zu removed)\n", dseMs,
+                numOfInstrs);
+  }
+}
+
+// Measures the dominator tree, the dominance frontiers and the loops of a
+// large function.
+static void benchDominators() {
+  const unsigned NumOfBBs = 1000000;
+  auto M = Module::create("bench.revLang", /*useArena=*/true);
+  Function *F = buildDataFlowFunction(*M, NumOfBBs, 100);
+
+  AnalysisManager AM;
+  auto start = Clock::now();
+  AM.getResult<DominatorTreeAnalysis>(*F);
+  std::printf("  dominator tree of %u bbs: %8.2f ms\n", NumOfBBs,
+              msSince(start));
+  start = Clock::now();
+  AM.getResult<DominanceFrontierAnalysis>(*F);
+  std::printf("  dominance frontiers:       %8.2f ms\n", msSince(start));
+  start = Clock::now();
+  size_t numOfLoops = AM.getResult<LoopAnalysis>(*F).getNumOfLoops();
+  std::printf("  loops:                     %8.2f ms (%zu loops)\n",
+              msSince(start), numOfLoops);
+}
+
+// Measures the value numbering of a large function over a few vars, so
+// many of the values repeat.
+static void benchGVN() {
+  const unsigned NumOfBBs = 1000000;
+  auto M = Module::create("bench.revLang", /*useArena=*/true);
+  Function *F = buildDataFlowFunction(*M, NumOfBBs, 16);
+  size_t numOfInstrs = 0;
+  for (const auto &BB : F->getBasicBlocks())
+    numOfInstrs += BB.second->getNumOfInstrs();
+
+  PassManager PM;
+  PM.addPass(createGVNPass());
+  auto start = Clock::now();
+  PM.run(*M);
+  double gvnMs = msSince(start);
+  size_t numOfRemoved = numOfInstrs;
+  for (const auto &BB : F->getBasicBlocks())
+    numOfRemoved -= BB.second->getNumOfInstrs();
+  std::printf("  gvn of %zu instrs: %8.2f ms (%.1f M instrs/s, %zu removed)\n",
+              numOfInstrs, gvnMs, numOfInstrs / gvnMs / 1000, numOfRemoved);
+}
+
+// Measures the linking of many small modules, one by one and at once.
+static void benchLink() {
+  const unsigned NumOfShards = 2000;
+  auto buildShards = [&]() {
+    std::vector<std::unique_ptr<Module>> Shards;
+    for (unsigned i = 0; i < NumOfShards; ++i) {
+      Shards.push_back(Module::create("shard.revLang", /*useArena=*/true));
+      buildDataFlowFunction(*Shards.back(), 200, 64);
+    }
+    return Shards;
+  };
+  LinkOptions Opts;
+  Opts.Functions = LinkOptions::FnClash::Rename;
+  std::string errMsg;
+
+  auto Shards = buildShards();
+  auto M = Module::create("bench.revLang", /*useArena=*/true);
+  auto start = Clock::now();
+  for (auto &Shard : Shards)
+    M->link(std::move(*Shard), errMsg, Opts);
+  std::printf("  link of %u modules, one by one: %8.2f ms\n", NumOfShards,
+              msSince(start));
+
+  for (unsigned numOfThreads : {1u, 0u}) {
+    Shards = buildShards();
+    M = Module::create("bench.revLang", /*useArena=*/true);
+    Opts.NumOfThreads = numOfThreads;
+    start = Clock::now();
+    M->link(std::move(Shards), errMsg, Opts);
+    std::printf("  link of %u modules at once (%s): %8.2f ms\n", NumOfShards,
+                numOfThreads ? "1 thread" : "all threads", msSince(start));
+  }
+}
+
+// Compares the deep and the copy-on-write clones of a large function, where
+// each of the latter changes a single bb.
+static void benchClone() {
+  const unsigned NumOfClones = 200;
+  for (bool copyOnWrite : {false, true}) {
+    auto M = Module::create("bench.revLang", /*useArena=*/true);
+    Function *F = buildDataFlowFunction(*M, 10000, 64);
+    GlobalVariable *GV = M->getVarWithID(0);
+    auto start = Clock::now();
+    for (unsigned i = 0; i < NumOfClones; ++i) {
+      Function *Clone =
+          F->clone("clone." + std::to_string(i), copyOnWrite).release();
+      Load::create({GV}, Clone->getEntryBB());
+    }
+    std::printf("  %u %s clones of 10000 bbs: %8.2f ms (%zu uses of a var)\n",
+                NumOfClones, copyOnWrite ? "copy-on-write" : "deep",
+                msSince(start), GV->getNumUses());
+  }
+}
+
+// Measures the basic operations on the generated modules: the creation of
+// the functions and the bbs, the edges, the validation, the printing, and
+// the removal of the bbs.
+static void benchMicro() {
+  const unsigned NumOfFns = GenOpts.NumOfFns;
+  const unsigned NumOfBBs = GenOpts.NumOfBBs;
+  std::vector<std::string> FnNames, BBNames;
+  for (unsigned f = 0; f < NumOfFns; ++f)
+    FnNames.push_back("fn" + std::to_string(f));
+  for (unsigned b = 0; b < NumOfBBs; ++b)
+    BBNames.push_back("bb." + std::to_string(b));
+
+  // The bare CFGs, with the edges of the generated ones.
+  auto M = Module::create("bench.revLang", /*useArena=*/true);
+  std::vector<std::vector<BasicBlock *>> BBs(NumOfFns);
+  OpTimer T;
+  for (unsigned f = 0; f < NumOfFns; ++f) {
+    auto *F = Function::create(FnNames[f], M.get()).release();
+    for (unsigned b = 0; b < NumOfBBs; ++b)
+      BBs[f].push_back(BasicBlock::create(BBNames[b], F, !b).release());
+  }
+  T.stop("create", uint64_t(NumOfFns) * (NumOfBBs + 1));
+
+  auto Generated = generateModule(GenOpts);
+  std::vector<std::pair<BasicBlock *, BasicBlock *>> Edges;
+  std::vector<std::string_view> Tags;
+  for (unsigned f = 0; f < NumOfFns; ++f) {
+    const Function *G = Generated->getFunction(FnNames[f]);
+    for (unsigned b = 0; b < NumOfBBs; ++b)
+      for (const auto &S : G->getBasicBlock(BBNames[b])->getSuccessors()) {
+        Edges.emplace_back(BBs[f][b], BBs[f][S.second->getNumber()]);
+        Tags.push_back(Generated->getSymbols().getString(S.first));
+      }
+  }
+  T.restart();
+  for (size_t e = 0; e < Edges.size(); ++e)
+    Edges[e].first->addSuccessor(Tags[e], Edges[e].second);
+  T.stop("addSuccessor", Edges.size());
+
+  T.restart();
+  size_t numOfValid = 0;
+  for (const auto &F : M->getFunctions())
+    numOfValid += F.second->isValid();
+  T.stop("isValid", NumOfFns);
+  if (numOfValid != NumOfFns)
+    std::cerr << "  error: the generated functions are not valid\n";
+
+  T.restart();
+  for (unsigned f = 0; f < NumOfFns; ++f) {
+    Function *F = BBs[f].front()->getParent();
+    // The handles don't own the bbs, since the Module uses the arena.
+    for (auto *BB : BBs[f])
+      F->removeBasicBlock(IRPtr<BasicBlock>(BB, IRDeleter<BasicBlock>(true)));
+  }
+  T.stop("removeBasicBlock", uint64_t(NumOfFns) * NumOfBBs);
+
+  // The dump() prints the same to the stdout.
+  std::string Str;
+  T.restart();
+  {
+    StringOutputStream OS(Str);
+    Generated->print(OS);
+  }
+  T.stop("Module::dump", 1);
+
+  T.restart();
+  for (const auto &F : Generated->getFunctions()) {
+    Str.clear();
+    StringOutputStream OS(Str);
+    F.second->printCFGAsDOT(OS);
+  }
+  T.stop("printCFGAsDOT", NumOfFns);
+}
+
+// Measures the generation of the modules.
+static void benchGenerate() {
+  OpTimer T;
+  auto M = generateModule(GenOpts);
+  T.stop("generateModule", uint64_t(GenOpts.NumOfFns) * GenOpts.NumOfBBs);
+}
+
+// Measures the verification of a generated module, on a single thread and
+// on all of them.
+static void benchVerify() {
+  auto M = generateModule(GenOpts);
+  std::vector<VerifierDiagnostic> Diags;
+  for (unsigned numOfThreads : {1u, 0u}) {
+    OpTimer T;
+    bool ok = M->verify(Diags, numOfThreads);
+    T.stop(numOfThreads ? "verify (1 thread)" : "verify (all threads)",
+           uint64_t(GenOpts.NumOfFns) * GenOpts.NumOfBBs);
+    if (!ok)
+      std::cerr << "  error: the generated module is not valid\n";
+  }
+}
+
+// Compares the flat form of the generated functions (see the
+// FlatFunction.h) with the Functions: the scans of all the operands, the
+// copies, and the round trips through the bytes.
+static void benchFlat() {
+  auto M = generateModule(GenOpts);
+  std::vector<const Function *> Fns;
+  for (const auto &F : M->getFunctions())
+    Fns.push_back(F.second);
+  uint64_t numOfOps = 0;
+  for (const Function *F : Fns)
+    for (const auto &BB : F->getBasicBlocks())
+      for (const Instruction *I : BB.second->instructions())
+        numOfOps += I->getNumOfOps();
+
+  OpTimer T;
+  std::vector<FlatFunction> Flats;
+  for (const Function *F : Fns)
+    Flats.push_back(FlatFunction::build(*F));
+  T.stop("build", Fns.size());
+
+  // The sums of the operand ids keep the scans from being optimized out.
+  T.restart();
+  uint64_t sum = 0;
+  for (const Function *F : Fns)
+    for (const auto &BB : F->getBasicBlocks())
+      for (const Instruction *I : BB.second->instructions())
+        for (const GlobalVariable *GV : I->getOps())
+          sum += GV->getID();
+  T.stop("scan Function", numOfOps);
+  T.restart();
+  uint64_t flatSum = 0;
+  for (const FlatFunction &Flat : Flats)
+    for (uint32_t id : Flat.getOperandIDs())
+      flatSum += id;
+  T.stop("scan FlatFunction", numOfOps);
+  if (sum != flatSum)
+    std::cerr << "  error: the scans differ\n";
+
+  auto Copy = Module::create("copy.revLang", /*useArena=*/true);
+  T.restart();
+  for (size_t f = 0; f < Fns.size(); ++f)
+    Flats[f].materialize(*Copy);
+  T.stop("materialize", Fns.size());
+
+  T.restart();
+  std::vector<FlatFunction> Copies = Flats;
+  T.stop("copy FlatFunction", Fns.size());
+
+  std::string Bytes, errMsg;
+  T.restart();
+  for (const FlatFunction &Flat : Flats)
+    Flat.serialize(Bytes);
+  T.stop("serialize", Fns.size());
+  FlatFunction Read;
+  T.restart();
+  for (const FlatFunction &Flat : Flats) {
+    Bytes.clear();
+    Flat.serialize(Bytes);
+    if (!Read.deserialize(Bytes, errMsg) || Read != Flat)
+      std::cerr << "  error: " << errMsg << '\n';
+  }
+  T.stop("serialize+deserialize", Fns.size());
+}
+
+static const struct {
+  const char *Name;
+  void (*Run)();
+} Benchmarks[] = {
+    {"bitcode", benchBitcode},
+    {"symbols", benchSymbols},
+    {"print", benchPrint},
+    {"blockremoval", benchBlockRemoval},
+    {"interpreter", benchInterpreter},
+    {"batch", benchBatch},
+    {"passes", benchPasses},
+    {"dataflow", benchDataFlow},
+    {"dominators", benchDominators},
+    {"gvn", benchGVN},
+    {"link", benchLink},
+    {"clone", benchClone},
+    {"micro", benchMicro},
+    {"generate", benchGenerate},
+    {"verify", benchVerify},
+    {"flat", benchFlat},
+};
+
+// Writes the measurements as JSON.
+static bool writeJSON(const std::string &filename) {
+  std::ofstream File(filename);
+  File << "{\n  \"seed\": " << GenOpts.Seed << ",\n  \"results\": [";
+  for (size_t i = 0; i < Measurements.size(); ++i) {
+    const Measurement &R = Measurements[i];
+    File << (i ? ",\n" : "\n") << "    {\"benchmark\": \"" << R.Benchmark
+         << "\", \"name\": \"" << R.Name << "\", \"ops\": " << R.NumOfOps
+         << ", \"ns_per_op\": " << R.NsPerOp
+         << ", \"allocs_per_op\": " << R.AllocsPerOp
+         << ", \"bytes_per_op\": " << R.BytesPerOp
+         << ", \"peak_rss_kb\": " << R.PeakRSS << "}";
+  }
+  File << "\n  ]\n}\n";
+  return bool(File);
+}
+
+static void printUsage() {
+  std::cerr << "usage: revLANG-bench [--json <file>] [--seed <n>] "
+               "[--fns <n>] [--bbs <n>] [--branching <n>] [--tags <n>] "
+               "[--instrs <n>] [--vars <n>] [<benchmark name>...]\n";
+}
+
+int main(int argc, char **argv) {
+  std::string JSONFile;
+  std::vector<std::string> Selected;
+  for (int i = 1; i < argc; ++i) {
+    std::string Arg = argv[i];
+    if (Arg.size() < 2 || Arg.compare(0, 2, "--")) {
+      Selected.push_back(Arg);
+      continue;
+    }
+    if (i + 1 == argc) {
+      printUsage();
+      return 1;
+    }
+    const char *Value = argv[++i];
+    if (Arg == "--json") {
+      JSONFile = Value;
+      continue;
+    }
+    unsigned long long n = std::strtoull(Value, nullptr, 10);
+    if (Arg == "--seed")
+      GenOpts.Seed = n;
+    else if (Arg == "--fns")
+      GenOpts.NumOfFns = n;
+    else if (Arg == "--bbs")
+      GenOpts.NumOfBBs = n;
+    else if (Arg == "--branching")
+      GenOpts.Branching = n;
+    else if (Arg == "--tags")
+      GenOpts.NumOfTags = n;
+    else if (Arg == "--instrs")
+      GenOpts.NumOfInstrs = n;
+    else if (Arg == "--vars")
+      GenOpts.NumOfVars = n;
+    else {
+      printUsage();
+      return 1;
+    }
+  }
+  if (!GenOpts.NumOfFns || !GenOpts.NumOfBBs || !GenOpts.NumOfVars) {
+    std::cerr << "error: the generated modules must not be empty\n";
+    return 1;
+  }
+
+  // Run the benchmarks given on the command line, or all of them. Each of
+  // them is measured as a whole, too.
+  for (const auto &B : Benchmarks) {
+    bool selected = Selected.empty();
+    for (const auto &Name : Selected)
+      selected |= Name == B.Name;
+    if (!selected)
+      continue;
+    std::cout << B.Name << ":\n";
+    std::cout.flush();
+    CurrentBenchmark = B.Name;
+    OpTimer T;
+    B.Run();
+    std::fflush(stdout);
+    T.stop("total", 1);
+  }
+  if (!JSONFile.empty() && !writeJSON(JSONFile)) {
+    std::cerr << "error: could not write " << JSONFile << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+// === This implements the generator of the synthetic revLANG modules.
+
+#include "ModuleGenerator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <random>
+#include <string>
+#include <vector>
+
+std::unique_ptr<Module> generateModule(const GeneratorOptions &Opts) {
+  assert(Opts.NumOfVars && "The instructions need the vars");
+  assert(Opts.LoadWeight + Opts.StoreWeight + Opts.AddWeight &&
+         "The instruction mix is empty");
+  // NOTE: The numbers are taken from the engine directly, since the
+  // std distributions differ between the standard libraries.
+  std::mt19937_64 Rand(Opts.Seed);
+  auto below = [&Rand](uint64_t n) { return Rand() % n; };
+
+  auto M = Module::create("generated.revLang", /*useArena=*/true);
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 0; i < Opts.NumOfVars; ++i)
+    GVs.push_back(GlobalVariable::create(i, M.get()).release());
+  auto randomVar = [&]() { return GVs[below(GVs.size())]; };
+
+  std::vector<std::string> TagPool;
+  for (unsigned t = 0; t < Opts.NumOfTags; ++t)
+    TagPool.push_back("t" + std::to_string(t));
+  unsigned maxSuccs = Opts.NumOfTags ? std::min(Opts.Branching, Opts.NumOfTags)
+                                     : std::min(Opts.Branching, 1u);
+  unsigned totalWeight = Opts.LoadWeight + Opts.StoreWeight + Opts.AddWeight;
+
+  std::vector<BasicBlock *> BBs;
+  OperandsTy Ops;
+  // NOTE: The handles don't own the objects within the arena.
+  for (unsigned f = 0; f < Opts.NumOfFns; ++f) {
+    auto *F = Function::create("fn" + std::to_string(f), M.get()).release();
+    BBs.clear();
+    for (unsigned b = 0; b < Opts.NumOfBBs; ++b)
+      BBs.push_back(
+          BasicBlock::create("bb." + std::to_string(b), F, !b).release());
+
+    for (unsigned b = 0; b < Opts.NumOfBBs; ++b) {
+      BasicBlock *BB = BBs[b];
+      if (b + 1 < Opts.NumOfBBs && maxSuccs) {
+        unsigned numOfSuccs = 1 + below(maxSuccs);
+        // The skewed tags are taken from the start of the pool, so the
+        // first ones are the most common.
+        size_t firstTag =
+            Opts.Tags == TagDistribution::Uniform && Opts.NumOfTags
+                ? below(Opts.NumOfTags)
+                : 0;
+        for (unsigned s = 0; s < numOfSuccs; ++s) {
+          BasicBlock *Succ = s ? BBs[below(Opts.NumOfBBs)] : BBs[b + 1];
+          BB->addSuccessor(Opts.NumOfTags ? std::string_view(
+                                                TagPool[(firstTag + s) %
+                                                        Opts.NumOfTags])
+                                          : std::string_view(),
+                           Succ);
+        }
+      }
+
+      for (unsigned i = 0; i < Opts.NumOfInstrs; ++i) {
+        unsigned kind = below(totalWeight);
+        Ops.clear();
+        if (kind < Opts.LoadWeight) {
+          Ops.push_back(randomVar());
+          Load::create(Ops, BB).release();
+        } else if (kind < Opts.LoadWeight + Opts.StoreWeight) {
+          Ops.push_back(randomVar());
+          Ops.push_back(randomVar());
+          Store::create(Ops, BB).release();
+        } else {
+          unsigned numOfSummands =
+              2 + below(std::max(Opts.MaxSummands, 2u) - 1);
+          for (unsigned o = 0; o <= numOfSummands; ++o)
+            Ops.push_back(randomVar());
+          Add::create(Ops, BB).release();
+        }
+      }
+    }
+  }
+  return M;
+}
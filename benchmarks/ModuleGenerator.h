@@ -0,0 +1,50 @@
+//=== A generator of the large synthetic revLANG modules for the benchmarks.
+
+#ifndef REVLANG_MODULEGENERATOR_H
+#define REVLANG_MODULEGENERATOR_H
+
+#include "CodeGen.h"
+
+#include <cstdint>
+#include <memory>
+
+// How the tags of the edges are picked from the pool of the tags.
+enum class TagDistribution : uint8_t {
+  // Each tag is equally likely.
+  Uniform,
+  // The first tags of the pool are the most common ones, as the "true" and
+  // the "false" are in the real code.
+  Skewed
+};
+
+// The shape of a generated module. The same options (and the seed) give
+// the same module.
+struct GeneratorOptions {
+  uint64_t Seed = 1;
+  unsigned NumOfFns = 100;
+  // The number of the bbs of each function.
+  unsigned NumOfBBs = 1000;
+  // Each bb has up to this many successors (at least one, except for the
+  // last bb). The first one is the next bb, so all the bbs are reachable,
+  // and the other ones are random.
+  unsigned Branching = 2;
+  // The size of the pool of the tags ("t0", "t1", ...). With no tags, each
+  // bb has a single untagged successor.
+  unsigned NumOfTags = 2;
+  TagDistribution Tags = TagDistribution::Skewed;
+  // The instruction mix: the number of the instructions per bb, and the
+  // relative weights of the kinds.
+  unsigned NumOfInstrs = 3;
+  unsigned LoadWeight = 1;
+  unsigned StoreWeight = 1;
+  unsigned AddWeight = 1;
+  // The ADDs have from 2 up to this many summands.
+  unsigned MaxSummands = 2;
+  unsigned NumOfVars = 1000;
+};
+
+// Generates a module owning its objects (see the Module::create()), whose
+// functions are named "fn0", "fn1", ...
+std::unique_ptr<Module> generateModule(const GeneratorOptions &Opts);
+
+#endif // REVLANG_MODULEGENERATOR_H
@@ -0,0 +1,105 @@
+//=== The cache of the analyses of the revLANG functions.
+
+#ifndef REVLANG_ANALYSISMANAGER_H
+#define REVLANG_ANALYSISMANAGER_H
+
+#include "CodeGen.h"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+// The parts of a function the result of an analysis depends on.
+enum class AnalysisDeps : uint8_t {
+  // The bbs and the edges (see the Function::getCFGEpoch()).
+  CFG,
+  // The instructions, too (see the Function::getEpoch()).
+  All
+};
+
+// This caches the results of the analyses of the functions. An analysis is
+// described by a class like:
+//   struct DominatorTreeAnalysis {
+//     using Result = DominatorTree;
+//     static constexpr AnalysisDeps Deps = AnalysisDeps::CFG;
+//     static Result run(const Function &F, AnalysisManager &AM);
+//   };
+// The result is computed on its first request, and it is kept until the
+// parts of the function it depends on change. So e.g. the dominator tree
+// survives the edits of the instructions. The run() may request the other
+// analyses.
+//
+// The manager is not thread-safe, so each thread should use its own one.
+class AnalysisManager {
+  struct ResultBase {
+    virtual ~ResultBase() {}
+  };
+  template <typename ResultT> struct ResultModel : ResultBase {
+    ResultT Result;
+    explicit ResultModel(ResultT &&result) : Result(std::move(result)) {}
+  };
+  struct Entry {
+    uint64_t Epoch = 0;
+    std::unique_ptr<ResultBase> Result;
+  };
+  // The analyses are keyed by the addresses of their IDs (see the getID()).
+  // NOTE: The unordered_map never moves its entries, so the references to
+  // them stay valid while the run() adds the other ones.
+  std::unordered_map<const Function *,
+                     std::unordered_map<const void *, Entry>>
+      Entries;
+  size_t NumOfRuns = 0;
+
+  template <typename AnalysisT> static const void *getID() {
+    static const char ID = 0;
+    return &ID;
+  }
+  template <typename AnalysisT> static uint64_t getEpoch(const Function &F) {
+    return AnalysisT::Deps == AnalysisDeps::CFG ? F.getCFGEpoch()
+                                                : F.getEpoch();
+  }
+
+public:
+  // Returns the result of the analysis of the F, computing it if there is
+  // none or it is stale.
+  template <typename AnalysisT>
+  const typename AnalysisT::Result &getResult(const Function &F) {
+    using ResultT = typename AnalysisT::Result;
+    Entry &E = Entries[&F][getID<AnalysisT>()];
+    uint64_t epoch = getEpoch<AnalysisT>(F);
+    if (!E.Result || E.Epoch != epoch) {
+      E.Result.reset();
+      E.Result =
+          std::make_unique<ResultModel<ResultT>>(AnalysisT::run(F, *this));
+      E.Epoch = epoch;
+      ++NumOfRuns;
+    }
+    return static_cast<ResultModel<ResultT> *>(E.Result.get())->Result;
+  }
+
+  // Returns the result of the analysis of the F, or nullptr if there is none
+  // or it is stale.
+  template <typename AnalysisT>
+  const typename AnalysisT::Result *getCachedResult(const Function &F) const {
+    using ResultT = typename AnalysisT::Result;
+    auto FnEntries = Entries.find(&F);
+    if (FnEntries == Entries.end())
+      return nullptr;
+    auto E = FnEntries->second.find(getID<AnalysisT>());
+    if (E == FnEntries->second.end() || !E->second.Result ||
+        E->second.Epoch != getEpoch<AnalysisT>(F))
+      return nullptr;
+    return &static_cast<ResultModel<ResultT> *>(E->second.Result.get())
+                ->Result;
+  }
+
+  // Drops the results for the F, e.g. before the F is removed.
+  void invalidate(const Function &F) { Entries.erase(&F); }
+  void clear() { Entries.clear(); }
+
+  // Returns the number of the results computed so far.
+  size_t getNumOfRuns() const { return NumOfRuns; }
+};
+
+#endif // REVLANG_ANALYSISMANAGER_H
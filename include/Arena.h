@@ -0,0 +1,109 @@
+//=== A slab allocator used by the Module to own the revLANG IR objects.
+
+#ifndef REVLANG_ARENA_H
+#define REVLANG_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// This allocates objects of a single kind from big fixed-size slabs.
+// Allocation is a pointer bump, and all the objects are destroyed
+// (and the slabs freed) in one go when the allocator goes away, so
+// there is no per-object malloc/free traffic.
+template <typename T, size_t SlabBytes = 64 * 1024>
+class SlabAllocator {
+  static constexpr size_t ObjectsPerSlab =
+      sizeof(T) >= SlabBytes ? 1 : SlabBytes / sizeof(T);
+
+  struct Slab {
+    alignas(T) unsigned char Storage[sizeof(T) * ObjectsPerSlab];
+  };
+
+  std::vector<std::unique_ptr<Slab>> Slabs;
+  // The number of constructed objects in the last slab.
+  size_t NumInLastSlab = ObjectsPerSlab;
+
+  T *objectAt(Slab &S, size_t idx) {
+    return reinterpret_cast<T *>(&S.Storage[sizeof(T) * idx]);
+  }
+
+public:
+  SlabAllocator() = default;
+  SlabAllocator(const SlabAllocator &) = delete;
+  SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+  ~SlabAllocator() {
+    for (size_t i = 0; i < Slabs.size(); ++i) {
+      size_t numOfObjs =
+          i + 1 == Slabs.size() ? NumInLastSlab : ObjectsPerSlab;
+      for (size_t j = 0; j < numOfObjs; ++j)
+        objectAt(*Slabs[i], j)->~T();
+    }
+  }
+
+  // Constructs a new object in the arena.
+  template <typename... ArgsTy> T *create(ArgsTy &&... args) {
+    if (NumInLastSlab == ObjectsPerSlab) {
+      Slabs.emplace_back(new Slab);
+      NumInLastSlab = 0;
+    }
+    T *obj = new (objectAt(*Slabs.back(), NumInLastSlab))
+        T(std::forward<ArgsTy>(args)...);
+    ++NumInLastSlab;
+    return obj;
+  }
+
+  // Returns the number of objects allocated so far.
+  size_t size() const {
+    if (Slabs.empty())
+      return 0;
+    return (Slabs.size() - 1) * ObjectsPerSlab + NumInLastSlab;
+  }
+};
+
+// This hands out raw memory from big slabs, for the arrays that don't have
+// a fixed size (e.g. the operands of the instructions). The memory is
+// freed in one go when the allocator goes away, and no destructors are run.
+class BumpAllocator {
+  static constexpr size_t SlabBytes = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> Slabs;
+  char *Cur = nullptr;
+  char *End = nullptr;
+
+public:
+  BumpAllocator() = default;
+  BumpAllocator(const BumpAllocator &) = delete;
+  BumpAllocator &operator=(const BumpAllocator &) = delete;
+
+  void *allocate(size_t size, size_t align) {
+    size_t adjust = (align - reinterpret_cast<uintptr_t>(Cur) % align) % align;
+    if (!Cur || size + adjust > static_cast<size_t>(End - Cur)) {
+      // The big requests get a slab on their own.
+      size_t slabSize = std::max(SlabBytes, size + align);
+      Slabs.emplace_back(new char[slabSize]);
+      Cur = Slabs.back().get();
+      End = Cur + slabSize;
+      adjust = (align - reinterpret_cast<uintptr_t>(Cur) % align) % align;
+    }
+    void *mem = Cur + adjust;
+    Cur += adjust + size;
+    return mem;
+  }
+
+  // Allocates an uninitialized array of T. The destructors are never run,
+  // so T must be trivially destructible.
+  template <typename T> T *allocateArray(size_t n) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "The destructors are not run");
+    return static_cast<T *>(allocate(sizeof(T) * n, alignof(T)));
+  }
+};
+
+#endif // REVLANG_ARENA_H
@@ -0,0 +1,50 @@
+//=== A non-owning view of a contiguous array (like the C++20 std::span).
+
+#ifndef REVLANG_ARRAYREF_H
+#define REVLANG_ARRAYREF_H
+
+#include <cassert>
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+
+// This is cheap to copy and it should be passed by value. It doesn't own
+// the elements, so the underlying storage must outlive it.
+template <typename T> class ArrayRef {
+  const T *Data = nullptr;
+  size_t Length = 0;
+
+public:
+  using iterator = const T *;
+
+  ArrayRef() = default;
+  ArrayRef(const T *data, size_t length) : Data(data), Length(length) {}
+  ArrayRef(const std::vector<T> &vec) : Data(vec.data()), Length(vec.size()) {}
+  // The list must outlive the ArrayRef, which is the case when it is
+  // passed as an argument, e.g. Load::create({GV}, BB).
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winit-list-lifetime"
+#endif
+  ArrayRef(std::initializer_list<T> list)
+      : Data(list.begin()), Length(list.size()) {}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+  template <size_t N> ArrayRef(const T (&arr)[N]) : Data(arr), Length(N) {}
+
+  iterator begin() const { return Data; }
+  iterator end() const { return Data + Length; }
+  const T *data() const { return Data; }
+  size_t size() const { return Length; }
+  bool empty() const { return !Length; }
+
+  const T &operator[](size_t idx) const {
+    assert(idx < Length && "Out of bounds");
+    return Data[idx];
+  }
+  const T &front() const { return (*this)[0]; }
+  const T &back() const { return (*this)[Length - 1]; }
+};
+
+#endif // REVLANG_ARRAYREF_H
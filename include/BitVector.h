@@ -0,0 +1,140 @@
+//=== A dense set of bits, e.g. for the visited sets of the CFG walks.
+
+#ifndef REVLANG_BITVECTOR_H
+#define REVLANG_BITVECTOR_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// This is a fixed-size array of bits, stored 64 per word. Unlike the
+// std::vector<bool>, the count() and the comparisons go a word at a time.
+class BitVector {
+  static constexpr unsigned BitsPerWord = 64;
+
+  std::vector<uint64_t> Words;
+  size_t Size = 0;
+
+  static size_t numOfWords(size_t size) {
+    return (size + BitsPerWord - 1) / BitsPerWord;
+  }
+
+  // Zeros the unused bits of the last word, so count() stays correct.
+  void clearUnusedBits() {
+    if (Size % BitsPerWord)
+      Words.back() &= (uint64_t(1) << (Size % BitsPerWord)) - 1;
+  }
+
+public:
+  BitVector() = default;
+  explicit BitVector(size_t size, bool value = false)
+      : Words(numOfWords(size), value ? ~uint64_t(0) : 0), Size(size) {
+    clearUnusedBits();
+  }
+
+  size_t size() const { return Size; }
+  bool empty() const { return !Size; }
+
+  // Grows (or shrinks) the vector. The new bits are set to the value.
+  void resize(size_t size, bool value = false) {
+    size_t oldSize = Size;
+    Words.resize(numOfWords(size), value ? ~uint64_t(0) : 0);
+    Size = size;
+    if (value && oldSize < size && oldSize % BitsPerWord)
+      Words[oldSize / BitsPerWord] |= ~uint64_t(0) << (oldSize % BitsPerWord);
+    clearUnusedBits();
+  }
+
+  bool test(size_t idx) const {
+    assert(idx < Size && "Out of bounds");
+    return Words[idx / BitsPerWord] >> (idx % BitsPerWord) & 1;
+  }
+  bool operator[](size_t idx) const { return test(idx); }
+
+  void set(size_t idx) {
+    assert(idx < Size && "Out of bounds");
+    Words[idx / BitsPerWord] |= uint64_t(1) << (idx % BitsPerWord);
+  }
+  void reset(size_t idx) {
+    assert(idx < Size && "Out of bounds");
+    Words[idx / BitsPerWord] &= ~(uint64_t(1) << (idx % BitsPerWord));
+  }
+  // Sets the bit, and returns its previous value.
+  bool testAndSet(size_t idx) {
+    bool wasSet = test(idx);
+    set(idx);
+    return wasSet;
+  }
+
+  // Sets all the bits to the value.
+  void assign(bool value) {
+    std::fill(Words.begin(), Words.end(), value ? ~uint64_t(0) : 0);
+    clearUnusedBits();
+  }
+
+  // Returns the number of the set bits.
+  size_t count() const {
+    size_t res = 0;
+    for (uint64_t word : Words)
+      res += __builtin_popcountll(word);
+    return res;
+  }
+
+  // Returns the index of the first set bit, or -1 if there is none.
+  ptrdiff_t findFirst() const {
+    for (size_t i = 0; i < Words.size(); ++i)
+      if (Words[i])
+        return i * BitsPerWord + __builtin_ctzll(Words[i]);
+    return -1;
+  }
+
+  // Returns the index of the first set bit after the idx, or -1 if there is
+  // none.
+  ptrdiff_t findNext(size_t idx) const {
+    if (++idx >= Size)
+      return -1;
+    size_t i = idx / BitsPerWord;
+    uint64_t word = Words[i] & (~uint64_t(0) << (idx % BitsPerWord));
+    while (!word) {
+      if (++i == Words.size())
+        return -1;
+      word = Words[i];
+    }
+    return i * BitsPerWord + __builtin_ctzll(word);
+  }
+
+  // The set operations. The vectors must be of the same size.
+  BitVector &operator|=(const BitVector &other) {
+    assert(Size == other.Size && "The sizes differ");
+    for (size_t i = 0; i < Words.size(); ++i)
+      Words[i] |= other.Words[i];
+    return *this;
+  }
+  BitVector &operator&=(const BitVector &other) {
+    assert(Size == other.Size && "The sizes differ");
+    for (size_t i = 0; i < Words.size(); ++i)
+      Words[i] &= other.Words[i];
+    return *this;
+  }
+  // Resets the bits set in the other.
+  BitVector &reset(const BitVector &other) {
+    assert(Size == other.Size && "The sizes differ");
+    for (size_t i = 0; i < Words.size(); ++i)
+      Words[i] &= ~other.Words[i];
+    return *this;
+  }
+
+  void swap(BitVector &other) {
+    Words.swap(other.Words);
+    std::swap(Size, other.Size);
+  }
+
+  bool operator==(const BitVector &other) const {
+    return Size == other.Size && Words == other.Words;
+  }
+  bool operator!=(const BitVector &other) const { return !(*this == other); }
+};
+
+#endif // REVLANG_BITVECTOR_H
@@ -0,0 +1,76 @@
+//=== The binary form (bitcode) of the revLANG IR.
+//
+// All the integers are LEB128 varints, and the layout of the file is:
+//   magic ('R' 'V' 'B' 'C'), version
+//   string table: num of strings, (length, bytes)*
+//   module ID (string index)
+//   vars: num of vars, (var ID - previous var ID)*
+//   functions: num of fns, (size of the fn record in bytes, fn record)*
+// where a fn record is:
+//   name (string index), num of bbs, entry bb index + 1 (0 for no entry)
+//   bbs: (name (string index), num of instrs, instr*)*
+//   edges: num of edges, (from bb index, tag (string index), to bb index)*
+// and an instr is the opcode (0 LOAD, 1 STORE, 2 ADD), the num of operands
+// (for the ADD only) and the operands (as indices into the var table).
+//
+// The fn records are prefixed with their size, so a reader can skip the
+// functions it doesn't need.
+
+#ifndef REVLANG_BITCODE_H
+#define REVLANG_BITCODE_H
+
+#include "CodeGen.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+constexpr char BitcodeMagic[4] = {'R', 'V', 'B', 'C'};
+constexpr unsigned BitcodeVersion = 1;
+
+// This is a read-only view of a bitcode buffer. Only the string table and
+// the function index are decoded up front, and all the names are pointing
+// into the buffer, so the buffer (e.g. a MappedFile) must outlive the view.
+class BitcodeView {
+public:
+  struct FunctionInfo {
+    std::string_view Name;
+    uint64_t NumOfBBs;
+    // The encoded fn record.
+    std::string_view Record;
+  };
+
+private:
+  std::vector<std::string_view> Strings;
+  std::string_view ModuleID;
+  uint64_t NumOfVars = 0;
+  // The encoded var table.
+  std::string_view Vars;
+  std::vector<FunctionInfo> Functions;
+
+public:
+  // Decodes the header and the index. On failure, returns false and
+  // sets the errMsg.
+  bool init(std::string_view buffer, std::string &errMsg);
+
+  std::string_view getModuleID() const { return ModuleID; }
+  uint64_t getNumberOfVars() const { return NumOfVars; }
+  const std::vector<FunctionInfo> &getFunctions() const { return Functions; }
+
+  // Builds the whole Module out of the view. The Module owns all the
+  // objects (it uses the arena). On failure, returns nullptr and sets
+  // the errMsg.
+  std::unique_ptr<Module> materialize(std::string &errMsg) const;
+};
+
+// Reads the module from an in-memory bitcode buffer.
+std::unique_ptr<Module> readBitcodeBuffer(std::string_view buffer,
+                                          std::string &errMsg);
+
+// Maps the bitcode file and reads the module from it.
+std::unique_ptr<Module> readBitcodeFile(const std::string &filename,
+                                        std::string &errMsg);
+
+#endif // REVLANG_BITCODE_H
@@ -0,0 +1,142 @@
+//=== The depth-first walks over the CFG of a function.
+//
+// The walks start from the entry bb, and visit each reachable bb once:
+//   for (BasicBlock *BB : depth_first(*F))   // preorder
+//   for (BasicBlock *BB : post_order(*F))    // postorder
+//   ReversePostOrderTraversal RPOT(*F);      // reverse postorder
+//   for (BasicBlock *BB : RPOT)
+// The DFS uses an explicit stack, so the long chains don't overflow the
+// call stack, and the visited set is a bitvector indexed by the bb numbers
+// (see the BasicBlock::getNumber()). The CFG must not be changed while
+// it is being walked.
+
+#ifndef REVLANG_CFGTRAVERSAL_H
+#define REVLANG_CFGTRAVERSAL_H
+
+#include "BitVector.h"
+#include "CodeGen.h"
+
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// This walks the CFG in the preorder (if PostOrder is false) or in the
+// postorder. The top of the stack is the current bb.
+template <bool PostOrder> class DFSIterator {
+  using StackEntry = std::pair<BasicBlock *, BasicBlock::succ_iterator>;
+
+  BitVector Visited;
+  std::vector<StackEntry> Stack;
+
+  void push(BasicBlock *BB) {
+    REVLANG_STAT_ADD(DFSNodesVisited, 1);
+    Visited.set(BB->getNumber());
+    Stack.push_back({BB, BB->succ_begin()});
+  }
+
+  // Pushes the next unvisited successor of the top of the stack. Returns
+  // false if there is none left.
+  bool pushNextSuccessor() {
+    auto &Top = Stack.back();
+    while (Top.second != Top.first->succ_end()) {
+      BasicBlock *Succ = *Top.second;
+      ++Top.second;
+      if (!Visited.test(Succ->getNumber())) {
+        push(Succ);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Goes down until the top of the stack has no unvisited successors.
+  void descend() {
+    while (pushNextSuccessor())
+      ;
+  }
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = BasicBlock *;
+  using difference_type = ptrdiff_t;
+  using pointer = BasicBlock **;
+  using reference = BasicBlock *;
+
+  // The end iterator.
+  DFSIterator() = default;
+  explicit DFSIterator(const Function &F) {
+    if (!F.getEntryBB())
+      return;
+    Visited.resize(F.getMaxBBNumber());
+    Stack.reserve(64);
+    push(F.getEntryBB());
+    if (PostOrder)
+      descend();
+  }
+
+  BasicBlock *operator*() const { return Stack.back().first; }
+
+  DFSIterator &operator++() {
+    if (PostOrder) {
+      Stack.pop_back();
+      if (!Stack.empty())
+        descend();
+      return *this;
+    }
+    while (!Stack.empty() && !pushNextSuccessor())
+      Stack.pop_back();
+    return *this;
+  }
+
+  // Returns true if the bb has been reached so far.
+  bool isVisited(const BasicBlock *BB) const {
+    return BB->getNumber() < Visited.size() && Visited.test(BB->getNumber());
+  }
+
+  bool operator==(const DFSIterator &other) const {
+    if (Stack.size() != other.Stack.size())
+      return false;
+    return Stack.empty() || Stack.back().first == other.Stack.back().first;
+  }
+  bool operator!=(const DFSIterator &other) const { return !(*this == other); }
+};
+
+using df_iterator = DFSIterator</*PostOrder=*/false>;
+using po_iterator = DFSIterator</*PostOrder=*/true>;
+
+template <typename IteratorTy> struct DFSRange {
+  IteratorTy Begin, End;
+  IteratorTy begin() const { return Begin; }
+  IteratorTy end() const { return End; }
+};
+
+// The bbs reachable from the entry bb, in the preorder.
+inline DFSRange<df_iterator> depth_first(const Function &F) {
+  return {df_iterator(F), df_iterator()};
+}
+
+// The bbs reachable from the entry bb, in the postorder.
+inline DFSRange<po_iterator> post_order(const Function &F) {
+  return {po_iterator(F), po_iterator()};
+}
+
+// This holds the bbs reachable from the entry bb, in the reverse
+// postorder (i.e. each bb comes before its successors, except for the
+// back edges). It is computed once, so it can be iterated many times.
+class ReversePostOrderTraversal {
+  std::vector<BasicBlock *> Blocks;
+
+public:
+  explicit ReversePostOrderTraversal(const Function &F) {
+    Blocks.reserve(F.getNumberOfBBs());
+    for (BasicBlock *BB : post_order(F))
+      Blocks.push_back(BB);
+  }
+
+  using iterator = std::vector<BasicBlock *>::const_reverse_iterator;
+  iterator begin() const { return Blocks.rbegin(); }
+  iterator end() const { return Blocks.rend(); }
+  size_t size() const { return Blocks.size(); }
+};
+
+#endif // REVLANG_CFGTRAVERSAL_H
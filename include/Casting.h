@@ -0,0 +1,52 @@
+//=== The LLVM-style isa<>, cast<> and dyn_cast<> for the revLANG IR.
+//
+// The classes taking a part in this should have the static classof()
+// method, that checks the kind of the object, e.g.
+//   static bool classof(const Instruction *I) {
+//     return I->getOpCodeKind() == Instruction::OpCodeKind::Load;
+//   }
+// so there is no need for the C++ RTTI.
+
+#ifndef REVLANG_CASTING_H
+#define REVLANG_CASTING_H
+
+#include <cassert>
+#include <type_traits>
+
+// Returns true if the Val is an instance of the To.
+template <typename To, typename From> bool isa(const From *Val) {
+  assert(Val && "isa<> used on a null pointer");
+  return To::classof(Val);
+}
+
+template <typename To, typename From,
+          typename = std::enable_if_t<!std::is_pointer<From>::value>>
+bool isa(const From &Val) {
+  return To::classof(&Val);
+}
+
+// Casts the Val to the To. The Val must be an instance of the To.
+template <typename To, typename From>
+std::conditional_t<std::is_const<From>::value, const To *, To *>
+cast(From *Val) {
+  assert(isa<To>(Val) && "cast<> to an incompatible type");
+  return static_cast<
+      std::conditional_t<std::is_const<From>::value, const To *, To *>>(Val);
+}
+
+template <typename To, typename From,
+          typename = std::enable_if_t<!std::is_pointer<From>::value>>
+std::conditional_t<std::is_const<From>::value, const To &, To &>
+cast(From &Val) {
+  return *cast<To>(&Val);
+}
+
+// Casts the Val to the To, or returns nullptr if the Val is not an
+// instance of the To.
+template <typename To, typename From>
+std::conditional_t<std::is_const<From>::value, const To *, To *>
+dyn_cast(From *Val) {
+  return isa<To>(Val) ? cast<To>(Val) : nullptr;
+}
+
+#endif // REVLANG_CASTING_H
@@ -1,8 +1,22 @@
 //=== Classes to represent a module; functions; basic blocks; instructions.
 
+#ifndef REVLANG_CODEGEN_H
+#define REVLANG_CODEGEN_H
+
+#include "ArrayRef.h"
+#include "Casting.h"
+#include "Statistics.h"
+#include "SymbolTable.h"
+
+#include <cassert>
+#include <cstdint>
+#include <iosfwd>
+#include <iterator>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 class BasicBlock;
@@ -10,148 +24,558 @@ class GlobalVariable;
 class Function;
 class Module;
 class Instruction;
+class IRArena;
+class ModuleLocks;
+class OutputStream;
 
 // Symbol tables for representing the named language items.
-// Since we are going to iterate through the items, we are using
-// the map. We can use std::unordered_map<> (hash_map) for checking if the
-// named item is already there and for iteration the std::map<> (which
-// is a red-black-tree), since it keeps the order. But, for
-// the purpose of this exercise I pay the O(logN) price, and I'll use
-// the std::map<> only.
+// The names (fn names, bb names and successor tags) are interned within
+// the Module, so the tables are keyed by small integer symbols. Checking if
+// the named item is already there is a hash table probe, and the iteration
+// goes through a dense vector (see the SymbolTable.h). Since the iteration
+// order depends on the order of the edits, the printers sort the items
+// by their names.
 
 // This key represents the fn name and the value is the Function pointer.
-using FunctionList = std::map<std::string, Function *>;
+using FunctionList = SymbolTable<Function *>;
 // This key represents the bb name and the value is the BasicBlock pointer.
-using BasicBlockList = std::map<std::string, BasicBlock *>;
+using BasicBlockList = SymbolTable<BasicBlock *>;
 // This key represents the tag and the value is the BasicBlock pointer.
-using SuccessorBBList = std::map<std::string, BasicBlock *>;
+using SuccessorBBList = SymbolTable<BasicBlock *>;
+// This represents the blocks branching to a block. There is an entry per
+// edge, so a block reaching the same block via two tags is there twice.
+using PredecessorBBList = std::vector<BasicBlock *>;
 // This key represents the var id and the value is the GlobalVariable pointer.
 using GlobalVarList = std::map<unsigned, GlobalVariable *>;
+// This maps the vars of a module to the vars of another one.
+using GlobalVarMap =
+    std::unordered_map<const GlobalVariable *, GlobalVariable *>;
 
 // This represents the type for list of instructions.
 using InstrustionList = std::vector<Instruction *>;
-// This represents the type for list of operands.
+// This represents the type for list of operands, used for building the
+// instructions. The instructions themselves store the operands inline.
 using OperandsTy = std::vector<GlobalVariable *>;
+// This represents the view of the operands of an instruction.
+using OperandsRef = ArrayRef<GlobalVariable *>;
+
+// This is the deleter for the handles returned by the create() factories.
+// When the Module owns an arena, the objects are carved out of it and the
+// Module releases all of them at once, so dropping such a handle is a no-op.
+template <typename T> struct IRDeleter {
+  bool ArenaOwned = false;
+
+  IRDeleter() = default;
+  explicit IRDeleter(bool arenaOwned) : ArenaOwned(arenaOwned) {}
+  template <typename U>
+  IRDeleter(const IRDeleter<U> &other) : ArenaOwned(other.ArenaOwned) {}
+  // Lets the std::make_unique<>()'d objects to be passed in as well.
+  template <typename U> IRDeleter(const std::default_delete<U> &) {}
+
+  void operator()(T *ptr) const {
+    if (!ArenaOwned)
+      delete ptr;
+  }
+};
+
+// A handle to an IR object returned by the create() factories.
+template <typename T> using IRPtr = std::unique_ptr<T, IRDeleter<T>>;
+
+// This represents an operand of an instruction, i.e. a use of a var.
+// The uses of a var are linked into an intrusive list hanging off the
+// GlobalVariable, so the var knows all the instructions referring to it.
+class Use {
+  GlobalVariable *Val = nullptr;
+  Use *Next = nullptr;
+  // This points to the Next of the previous use (or to the head of the
+  // list), so a use unlinks itself in O(1).
+  Use **Prev = nullptr;
+  Instruction *User = nullptr;
+
+  friend class GlobalVariable;
+  friend class Instruction;
+
+  void addToList(Use **head);
+  void removeFromList();
+
+public:
+  Use() = default;
+  // The use is linked into the list, so it cannot be copied.
+  Use(const Use &) = delete;
+  Use &operator=(const Use &) = delete;
+
+  GlobalVariable *get() const { return Val; }
+  Instruction *getUser() const { return User; }
+  Use *getNext() const { return Next; }
+  // Makes this use refer to the GV, updating both of the use lists.
+  void set(GlobalVariable *GV);
+};
+
+// This walks the use list of a var.
+class use_iterator {
+  Use *U = nullptr;
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = Use;
+  using difference_type = ptrdiff_t;
+  using pointer = Use *;
+  using reference = Use &;
+
+  use_iterator() = default;
+  explicit use_iterator(Use *u) : U(u) {}
+  Use &operator*() const { return *U; }
+  Use *operator->() const { return U; }
+  use_iterator &operator++() {
+    U = U->getNext();
+    return *this;
+  }
+  use_iterator operator++(int) {
+    use_iterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+  bool operator==(const use_iterator &other) const { return U == other.U; }
+  bool operator!=(const use_iterator &other) const { return U != other.U; }
+};
 
 // This represents global variables.
 class GlobalVariable {
   Module *Parent;
   unsigned ID;
+  // The head of the list of the uses of this var.
+  Use *UseList = nullptr;
+
+  friend class Module;
+  friend class Use;
+
 public:
   GlobalVariable(unsigned id, Module *parent);
 
   // Creates a new GlobalVariable.
-  static std::unique_ptr<GlobalVariable> create(unsigned id, Module *parent);
+  static IRPtr<GlobalVariable> create(unsigned id, Module *parent);
 
   void setParent(Module *parent);
   Module *getParent() const;
   unsigned getID() const { return ID; }
 
+  // The uses of the var, i.e. the operands of the instructions referring
+  // to it (in no particular order). The instructions add their uses when
+  // they are created, and drop them in BasicBlock::removeInstruction().
+  use_iterator use_begin() const { return use_iterator(UseList); }
+  use_iterator use_end() const { return use_iterator(); }
+  struct UseRange {
+    use_iterator Begin, End;
+    use_iterator begin() const { return Begin; }
+    use_iterator end() const { return End; }
+  };
+  UseRange uses() const { return {use_begin(), use_end()}; }
+  bool hasUses() const { return UseList != nullptr; }
+  // This walks the use list, so it is linear in the number of the uses.
+  size_t getNumUses() const;
+
+  // Makes all the instructions using this var use the GV instead.
+  void replaceAllUsesWith(GlobalVariable *GV);
+
+  void print(OutputStream &OS) const;
   // Prints the var to stdout.
   void dump() const;
 };
 
+// This is a view of the operands of an instruction, yielding the vars.
+class OperandRange {
+  const Use *Ops = nullptr;
+  size_t Length = 0;
+
+public:
+  class iterator {
+    const Use *U;
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = GlobalVariable *;
+    using difference_type = ptrdiff_t;
+    using pointer = GlobalVariable **;
+    using reference = GlobalVariable *;
+
+    explicit iterator(const Use *u) : U(u) {}
+    GlobalVariable *operator*() const { return U->get(); }
+    iterator &operator++() {
+      ++U;
+      return *this;
+    }
+    difference_type operator-(const iterator &other) const {
+      return U - other.U;
+    }
+    bool operator==(const iterator &other) const { return U == other.U; }
+    bool operator!=(const iterator &other) const { return U != other.U; }
+  };
+
+  OperandRange(const Use *ops, size_t length) : Ops(ops), Length(length) {}
+
+  iterator begin() const { return iterator(Ops); }
+  iterator end() const { return iterator(Ops + Length); }
+  size_t size() const { return Length; }
+  bool empty() const { return !Length; }
+
+  GlobalVariable *operator[](size_t idx) const {
+    assert(idx < Length && "Out of bounds");
+    return Ops[idx].get();
+  }
+  GlobalVariable *front() const { return (*this)[0]; }
+  GlobalVariable *back() const { return (*this)[Length - 1]; }
+};
+
 // This represents an Instruction.
 class Instruction {
+public:
+  // The kind of the instruction. The passes should dispatch on this (e.g.
+  // via the isa<>/dyn_cast<> or the InstVisitor), instead of comparing
+  // the opcode names.
+  enum class OpCodeKind : uint8_t { Load, Store, Add };
+
 protected:
-  OperandsTy Ops;
-  std::string OpCode;
+  // This points to the operands stored within the subclass (or, for the
+  // ADDs with many operands, to an array allocated on the side).
+  Use *Ops = nullptr;
   BasicBlock *Parent;
+  unsigned NumOfOps = 0;
+  OpCodeKind OpCode;
+  // The instructions of the arena go away with the whole Module (the vars
+  // included), so they don't unlink their uses then.
+  bool ArenaOwned;
+
+  friend class BasicBlock;
+
+  Instruction(OpCodeKind opCode, BasicBlock *parent);
+  // Makes the storage (of at least ops.size() uses) the operands, and
+  // links them into the use lists of the ops.
+  void initOps(Use *storage, OperandsRef ops);
+
 public:
-  virtual ~Instruction() {}
-  OperandsTy& getOps() const { return const_cast<OperandsTy&>(Ops); }
-  const std::string& getOpCode() const { return OpCode; }
-  virtual void dump() const = 0;
+  // The Ops points into the object itself, so it cannot be copied.
+  Instruction(const Instruction &) = delete;
+  Instruction &operator=(const Instruction &) = delete;
+  virtual ~Instruction();
+
+  OperandRange getOps() const { return OperandRange(Ops, NumOfOps); }
+  size_t getNumOfOps() const { return NumOfOps; }
+  GlobalVariable *getOperand(unsigned idx) const {
+    assert(idx < NumOfOps && "Out of bounds");
+    return Ops[idx].get();
+  }
+  void setOperand(unsigned idx, GlobalVariable *GV);
+  Use &getOperandUse(unsigned idx) const {
+    assert(idx < NumOfOps && "Out of bounds");
+    return Ops[idx];
+  }
+  // Returns the index of the use within the operands.
+  unsigned getOperandNo(const Use &U) const {
+    assert(&U >= Ops && &U < Ops + NumOfOps && "Not an operand");
+    return &U - Ops;
+  }
+  // Unlinks the operands from the use lists of the vars.
+  void dropAllReferences();
+  OpCodeKind getOpCodeKind() const { return OpCode; }
+  // Returns the name of the opcode (e.g. "LOAD"), used for the printing.
+  std::string_view getOpCode() const { return getOpCodeName(OpCode); }
+  static std::string_view getOpCodeName(OpCodeKind opCode);
+  BasicBlock *getParent() const { return Parent; }
+  virtual void print(OutputStream &OS) const = 0;
+  // Prints the instruction to stdout.
+  void dump() const;
 };
 
 // This represents a LOAD instruciton.
 // It has a single operand representing the load address.
 class Load : public Instruction {
+  Use InlineOps[1];
+
 public:
-  Load (OperandsTy& ops, BasicBlock *parent);
-  void dump() const override;
+  Load (OperandsRef ops, BasicBlock *parent);
+  // Creates a new Load (within the Module arena, if there is one).
+  static IRPtr<Load> create(OperandsRef ops, BasicBlock *parent);
+  void print(OutputStream &OS) const override;
+
+  static bool classof(const Instruction *I) {
+    return I->getOpCodeKind() == OpCodeKind::Load;
+  }
 };
 
 // This represents a STORE instruciton.
 // It has two arguments; the first is the value to store in memory,
 // and the second is the address.
 class Store : public Instruction {
+  Use InlineOps[2];
+
 public:
-  Store (OperandsTy& ops, BasicBlock *parent);
-  void dump() const override;
+  Store (OperandsRef ops, BasicBlock *parent);
+  // Creates a new Store (within the Module arena, if there is one).
+  static IRPtr<Store> create(OperandsRef ops, BasicBlock *parent);
+  void print(OutputStream &OS) const override;
+
+  static bool classof(const Instruction *I) {
+    return I->getOpCodeKind() == OpCodeKind::Store;
+  }
 };
 
 // This represents an ADD instruciton.
-// It has 3 or more operands.
+// It has 3 or more operands. Up to NumOfInlineOps of them are stored
+// inline; the rest goes to an array allocated from the Module arena (or
+// from the heap, if there is no arena).
 class Add : public Instruction {
 public:
-  Add (OperandsTy& ops, BasicBlock *parent);
-  void dump() const override;
+  static constexpr unsigned NumOfInlineOps = 4;
+
+private:
+  Use InlineOps[NumOfInlineOps];
+  bool OwnsOps = false;
+
+public:
+  Add (OperandsRef ops, BasicBlock *parent);
+  ~Add() override;
+  // Creates a new Add (within the Module arena, if there is one).
+  static IRPtr<Add> create(OperandsRef ops, BasicBlock *parent);
+  void print(OutputStream &OS) const override;
+
+  static bool classof(const Instruction *I) {
+    return I->getOpCodeKind() == OpCodeKind::Add;
+  }
 };
 
 // This represents a basic block on the revLANG IR level.
 class BasicBlock {
   InstrustionList Instructions;
   SuccessorBBList Successors;
-  std::string BasicBlockID;
+  // This is kept in sync by the addSuccessor()/removeSuccessor().
+  PredecessorBBList Predecessors;
+  Symbol BasicBlockID;
   Function *Parent;
+  // The dense number of the bb within the function (see the
+  // Function::getMaxBBNumber()).
+  unsigned Number = 0;
+  // See the getEpoch().
+  uint64_t Epoch;
+  // While this bb is a copy-on-write clone (see the Function::clone()),
+  // this is the bb whose instructions it shares, and its own list is
+  // empty. The Sharers are the clones sharing the instructions of this bb.
+  BasicBlock *SharedWith = nullptr;
+  std::vector<BasicBlock *> Sharers;
+
+  friend class Function;
+  friend class GlobalVariable;
+  friend class Instruction;
+
+  // Gives the bb (and its clones) a new epoch, after a change of its
+  // instructions. The changes of the edges go through the bumpCFGEpoch().
+  void bumpEpoch();
+  void bumpCFGEpoch();
+  // This must be called before the instructions of the bb change, so
+  // the shared ones are copied first.
+  void prepareForWrite() {
+    if (SharedWith || !Sharers.empty())
+      unshareInstructions();
+  }
+  // Stops sharing the instructions of the SharedWith, copying them if
+  // the copyInstrs is set.
+  void stopSharing(bool copyInstrs);
+  // Appends the copies of the instructions of the BB, with the vars
+  // mapped by the VarMap, if it is given.
+  void copyInstructionsFrom(const BasicBlock *BB, const GlobalVarMap *VarMap);
 
   void setParent(Function *parent);
-  Function *getParent() const;
+  // Removes a single edge coming from the bb.
+  void removePredecessor(BasicBlock *bb);
 
  public:
   // A name for the function must be provided when doing the construction.
   // The creation should be handled via the factory method.
-  BasicBlock(std::string basicBlockID, Function *parent);
+  BasicBlock(std::string_view basicBlockID, Function *parent);
+  ~BasicBlock();
+  void print(OutputStream &OS) const;
   // Prints the BB to stdout.
   void dump() const;
 
   // Creates a new BasicBlock.
-  static std::unique_ptr<BasicBlock> create(std::string basicBlockID, Function *parent,
-                            bool isEntryBasicBlock = false);
+  static IRPtr<BasicBlock> create(std::string_view basicBlockID,
+                                  Function *parent,
+                                  bool isEntryBasicBlock = false);
 
-  const std::string& getBBID() const;
+  std::string_view getBBID() const;
+  Symbol getBBSymbol() const { return BasicBlockID; }
+  unsigned getNumber() const { return Number; }
+  Function *getParent() const;
 
-  // This should do all the cleanups.
-  void removeInstruction(std::unique_ptr<Instruction> instr);
+  // This should do all the cleanups. It also drops the uses of the vars.
+  // On a copy-on-write clone, the instr may be the shared one, and its
+  // copy is removed.
+  void removeInstruction(IRPtr<Instruction> instr);
+  // Removes all the instructions (as the removeInstruction() does), in
+  // linear time. The instructions are not freed.
+  void removeAllInstructions();
+  // Removes the instructions the pred returns true for (as the
+  // removeInstruction() does), in linear time. The pred is called on the
+  // instructions in their order. The instructions are not freed. On a
+  // copy-on-write clone, the pred gets the copies, so it should go by the
+  // position rather than by the address of the shared ones.
+  template <typename PredTy> void removeInstructionsIf(PredTy pred) {
+    prepareForWrite();
+    size_t numOfKept = 0;
+    for (Instruction *I : Instructions) {
+      if (pred(I))
+        I->dropAllReferences();
+      else
+        Instructions[numOfKept++] = I;
+    }
+    if (numOfKept != Instructions.size()) {
+      REVLANG_STAT_ADD(InstrsRemoved, Instructions.size() - numOfKept);
+      bumpEpoch();
+    }
+    Instructions.resize(numOfKept);
+  }
+  // Moves all the instructions of the bb to the end of this one.
+  void moveInstructionsFrom(BasicBlock *bb);
 
+  // Removes all the edges to the bb.
   void removeSuccessor(BasicBlock *bb);
+  // Makes all the edges to the oldBB go to the newBB, keeping the tags.
+  void replaceSuccessor(BasicBlock *oldBB, BasicBlock *newBB);
 
   // Add successor bb.
-  void addSuccessor(const std::string &tag, BasicBlock *bb);
+  void addSuccessor(std::string_view tag, BasicBlock *bb);
+  // Returns the successor with the tag (or nullptr, if there is none).
+  BasicBlock *getSuccessor(std::string_view tag) const;
   SuccessorBBList& getSuccessors() const;
   size_t getNumOfSuccessors() const;
 
+  const PredecessorBBList &getPredecessors() const { return Predecessors; }
+  size_t getNumOfPredecessors() const { return Predecessors.size(); }
+
+  // The edge iterators, for the analyses that don't care about the tags.
+  class succ_iterator {
+    SuccessorBBList::const_iterator I;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = BasicBlock *;
+    using difference_type = ptrdiff_t;
+    using pointer = BasicBlock **;
+    using reference = BasicBlock *;
+
+    explicit succ_iterator(SuccessorBBList::const_iterator i) : I(i) {}
+    BasicBlock *operator*() const { return I->second; }
+    succ_iterator &operator++() {
+      ++I;
+      return *this;
+    }
+    bool operator==(const succ_iterator &other) const { return I == other.I; }
+    bool operator!=(const succ_iterator &other) const { return I != other.I; }
+  };
+  using pred_iterator = PredecessorBBList::const_iterator;
+
+  template <typename IteratorTy> struct EdgeRange {
+    IteratorTy Begin, End;
+    IteratorTy begin() const { return Begin; }
+    IteratorTy end() const { return End; }
+  };
+
+  succ_iterator succ_begin() const {
+    return succ_iterator(Successors.begin());
+  }
+  succ_iterator succ_end() const { return succ_iterator(Successors.end()); }
+  EdgeRange<succ_iterator> successors() const {
+    return {succ_begin(), succ_end()};
+  }
+  pred_iterator pred_begin() const { return Predecessors.begin(); }
+  pred_iterator pred_end() const { return Predecessors.end(); }
+  EdgeRange<pred_iterator> predecessors() const {
+    return {pred_begin(), pred_end()};
+  }
+
   // Add the instruction.
   void addInstruction(Instruction *inst);
+  // The instructions may be changed via the returned list, so the bb
+  // stops sharing them first (see the instructions()).
   InstrustionList& getInstructions() const;
+  // Returns the instructions for reading only. Unlike the
+  // getInstructions(), this doesn't copy the instructions shared by a
+  // copy-on-write clone, so they belong to (i.e. their getParent() is) the
+  // bb the clone was made from. They must not be changed.
+  const InstrustionList &instructions() const {
+    return SharedWith ? SharedWith->Instructions : Instructions;
+  }
 
   size_t getNumOfInstrs() const;
+
+  // Returns true if the bb shares the instructions with another one (as a
+  // copy-on-write clone, or as the bb the clones were made from).
+  bool sharesInstructions() const { return SharedWith || !Sharers.empty(); }
+  // Makes this bb and its clones own their instructions, copying them.
+  void unshareInstructions();
+
+  // The epoch of the bb changes on each change of its instructions (or of
+  // their operands) or of its successors (see the Function::getEpoch()).
+  uint64_t getEpoch() const { return Epoch; }
 };
 
 // This represents a function on the revLANG IR level. A function contains one
 // or more basic blocks. One of them is the entry basic block.
 class Function {
   BasicBlockList BasicBlocks;
-  std::string FunctionID;
+  Symbol FunctionID;
   Module *Parent;
   BasicBlock *EntryBB = nullptr;
+  // The number to be given to the next bb added.
+  unsigned NextBBNumber = 0;
+  // The last epoch given to the function or its bbs (see the getEpoch()).
+  uint64_t LastEpoch;
+  uint64_t CFGEpoch;
+  // The result of the last isValid(), and the CFG epoch it was checked at.
+  mutable uint64_t ValidatedCFGEpoch = 0;
+  mutable bool WasValid = false;
+
+  friend class BasicBlock;
+  friend class Module;
 
   void setParent(Module *parent);
-  Module *getParent() const;
+  // Maps the names of the bbs and the tags to the symbols of another
+  // module (by the old symbol), after the function is moved into it.
+  void remapSymbols(const std::vector<Symbol> &SymMap);
+  // Copies the function into the M (see the clone()), mapping the vars
+  // by the VarMap, if it is given.
+  Function *cloneInto(Module &M, std::string_view newName,
+                      const GlobalVarMap *VarMap, bool copyOnWrite);
+  uint64_t getNewEpoch() { return ++LastEpoch; }
+  // Gives the CFG a new epoch, after a change of the bbs or the edges.
+  void bumpCFGEpoch() { CFGEpoch = getNewEpoch(); }
 
  public:
   // A name for the function must be provided when doing the construction.
-  Function(std::string functionID, Module *parent);
+  Function(std::string_view functionID, Module *parent);
+  ~Function();
+  void print(OutputStream &OS) const;
   // Prints the function to stdout.
   void dump() const;
 
-  // This should be called from Function::Create().
-  void addBasicBlock(const std::string &bbName, BasicBlock *bb);
+  // This should be called from BasicBlock::create().
+  void addBasicBlock(BasicBlock *bb);
   BasicBlockList& getBasicBlocks() const;
+  // Returns the bb with the name (or nullptr, if there is none).
+  BasicBlock *getBasicBlock(std::string_view bbName) const;
 
   // Creates a new Function.
-  static std::unique_ptr<Function> create(std::string functionID, Module *parent);
+  static IRPtr<Function> create(std::string_view functionID, Module *parent);
+  // Creates a copy of the function (its bbs, edges and instructions)
+  // within the same module, named newName. The bbs get the same names,
+  // but they are numbered densely. With the copyOnWrite, the bbs of the
+  // copy share the instructions of this function until either of them
+  // changes them (see the BasicBlock::instructions()), so the copies
+  // don't take the memory for the instructions they don't change. The
+  // module must own its objects (see the Module::create()).
+  IRPtr<Function> clone(std::string_view newName, bool copyOnWrite = false);
+  // Makes the bbs of the function (and their clones) own their
+  // instructions (see the BasicBlock::unshareInstructions()).
+  void unshareInstructions();
 
   // Sets entry BB.
   void setEntryBB(BasicBlock *bb);
@@ -160,23 +584,104 @@ class Function {
 
   // Gets the num of bbs.
   size_t getNumberOfBBs() const;
+  // The bbs are numbered densely in [0, getMaxBBNumber()), so the analyses
+  // can keep the per-bb data in the vectors (or the bitvectors). The
+  // removed bbs leave holes in the numbering, until renumberBlocks().
+  unsigned getMaxBBNumber() const { return NextBBNumber; }
+  void renumberBlocks();
+  // The epochs tell the analyses if their results are stale (see the
+  // AnalysisManager.h). They only grow, and they are unique across the
+  // functions, so a result is never taken for a new function at the
+  // address of a removed one.
+  //
+  // The epoch of the function changes on each change of the function, i.e.
+  // of its bbs, edges or instructions (see also the BasicBlock::getEpoch()).
+  uint64_t getEpoch() const { return LastEpoch; }
+  // The epoch of the CFG changes whenever a bb or an edge is added or
+  // removed (or the entry bb or the numbering changes).
+  uint64_t getCFGEpoch() const { return CFGEpoch; }
   // Checks if the function is empty.
   // If it is empty, it should be optimized out.
   bool empty() const;
 
-  const std::string& getFnID() const;
+  std::string_view getFnID() const;
+  Symbol getFnSymbol() const { return FunctionID; }
+  Module *getParent() const;
 
-  // This removes the BB from the function.
-  void removeBasicBlock(std::unique_ptr<BasicBlock> bb);
+  // This removes the BB from the function, together with all the edges
+  // from and to it. This touches the neighbours of the BB only.
+  void removeBasicBlock(IRPtr<BasicBlock> bb);
 
   // This prints .dot file that represents the function.
-  void printCFGAsDOT(const std::string& filename) const;
+  // Returns false on I/O errors.
+  bool printCFGAsDOT(OutputStream &OS) const;
+  bool printCFGAsDOT(const std::string& filename) const;
 
-  // Return true if the function is valid.
+  // Return true if the function is valid. This is linear in the size of
+  // the CFG, but it is O(1) if the CFG hasn't changed since the last call.
   bool isValid() const;
-  // An DFS algorithm to traverse all the nodes from entry bb,
-  // by following the links (tags).
-  void traverse(BasicBlock *bb, std::map<BasicBlock *, bool> &visited) const;
+};
+
+// The policies of the Module::link().
+struct LinkOptions {
+  // What to do with a linked function whose name is already taken.
+  enum class FnClash : uint8_t {
+    // Fail, without changing any of the modules.
+    Error,
+    // Keep the function that is already there, and drop the linked one.
+    KeepDest,
+    // Replace the function that is already there by the linked one.
+    KeepSrc,
+    // Give the linked function a fresh name (e.g. "foo.1").
+    Rename
+  };
+  // What to do with a linked var whose ID is already taken.
+  enum class VarClash : uint8_t {
+    // It is the same var, so its uses are remapped to the one that is
+    // already there.
+    Merge,
+    // It is another var, so it gets a fresh ID (above all the others).
+    Rename
+  };
+
+  FnClash Functions = FnClash::Error;
+  VarClash Vars = VarClash::Merge;
+  // The number of the threads for linking many modules at once (0 means
+  // all the hardware threads).
+  unsigned NumOfThreads = 1;
+};
+
+// A problem found by the Module::verify().
+struct VerifierDiagnostic {
+  enum class Kind : uint8_t {
+    // An object doesn't point to the parent it is found within.
+    BadParent,
+    // An object is not found under its own name (or id).
+    BadName,
+    // The bb numbers are out of range or repeated.
+    BadNumber,
+    // The function has the bbs, but the entry bb is not one of them.
+    NoEntry,
+    // A successor is not a bb of the function, or its tag is unknown.
+    DanglingSuccessor,
+    // The predecessors don't match the successors.
+    BadPredecessors,
+    // The bb is not reachable from the entry bb.
+    Unreachable,
+    // The instruction has a wrong number of operands.
+    BadArity,
+    // The operand is not a var of the module.
+    BadOperand,
+    // The use lists of the vars don't match the operands.
+    BadUseList
+  };
+  Kind K;
+  // The function and the bb with the problem (empty if not applicable).
+  std::string FnName;
+  std::string BBName;
+  std::string Message;
+
+  void print(OutputStream &OS) const;
 };
 
 // This class represents a Module for a revLANG compilation unit. It is a top
@@ -186,30 +691,110 @@ class Module {
   std::string ModuleID;
   FunctionList Functions;
   GlobalVarList GlobalVariables;
+  // The names of the functions, the basic blocks and the successor tags.
+  StringInterner Symbols;
+  // If set, all the functions, basic blocks, variables and instructions
+  // created within this module live here, and they are freed together
+  // with the module.
+  std::unique_ptr<IRArena> Arena;
+  // Set while the functions are changed in parallel.
+  std::unique_ptr<ModuleLocks> Locks;
+  // The arenas of the modules linked into this one, which still hold the
+  // objects moved from them.
+  std::vector<std::unique_ptr<IRArena>> LinkedArenas;
+  // See the getVarsEpoch().
+  uint64_t VarsEpoch = 0;
+
+  // Takes over the arenas of the Src.
+  void takeArenas(Module &Src);
+  bool linkModules(const std::vector<Module *> &Srcs, std::string &errMsg,
+                   const LinkOptions &Opts);
 
  public:
   // A name for the module must be provided when doing the construction.
-  Module(std::string moduleID);
+  Module(std::string moduleID, bool useArena = false);
+  ~Module();
+  // Prints the module in the textual form (see the Parser.h).
+  void print(OutputStream &OS) const;
   // Prints the module to stdout.
   void dump() const;
 
-  static std::unique_ptr<Module> create(const std::string &filename) {
-    auto M = std::make_unique<Module>(filename);
+  // Creates a new Module. When the arena is used, the handles returned by
+  // the create() factories don't own the objects, so there is no need to
+  // keep them alive or to tear them down in any particular order.
+  static std::unique_ptr<Module> create(const std::string &filename,
+                                        bool useArena = false) {
+    auto M = std::make_unique<Module>(filename, useArena);
     return M;
   }
 
+  IRArena *getArena() const { return Arena.get(); }
+
+  // Creates a copy of the module, i.e. of its vars and functions. The
+  // copy owns all of its objects (in the arena), whatever the mode of
+  // this module is. The copy doesn't share anything with this module.
+  std::unique_ptr<Module> clone() const;
+
+  // Makes the parts of the module shared by its functions (the arena, the
+  // names and the use lists of the vars) safe to change from many threads
+  // at once, or turns it back off. Then, different functions may be
+  // changed in parallel (see the PassManager.h), but adding or removing
+  // the functions and the vars is still not safe.
+  void setConcurrent(bool concurrent);
+  ModuleLocks *getLocks() const { return Locks.get(); }
+  const std::string &getModuleID() const { return ModuleID; }
+
+  // Writes the module in the binary form (see the Bitcode.h).
+  // Returns false on I/O errors.
+  bool writeBitcode(std::ostream &OS) const;
+  bool writeBitcode(const std::string &filename) const;
+
   // This should be called from Function::create().
-  void addFunction(const std::string& fnName, Function *f);
+  void addFunction(Function *f);
   FunctionList& getFunctions() const;
+  // Returns the function with the name (or nullptr, if there is none).
+  Function *getFunction(std::string_view fnName) const;
+
+  StringInterner &getSymbols() const;
 
   // This should be called from GlobalVariable::create().
   void addGlobalVar(unsigned id, GlobalVariable *GV);
   GlobalVarList& getGlobalVars() const;
   GlobalVariable* getVarWithID(unsigned id) const;
+  // This changes whenever a var is added to or removed from the Module, so
+  // the numberings of the vars can be kept up to date (see the VarSlots
+  // within the ExecutionEngine.h).
+  uint64_t getVarsEpoch() const { return VarsEpoch; }
+  // This removes the var from the Module. It must not have any uses.
+  void removeGlobalVar(IRPtr<GlobalVariable> GV);
 
   // Returns the number of functions within this Module.
   size_t getNumberOfFns() const;
 
   // This removes the function from the Module.
-  void removeFunction(std::unique_ptr<Function> f);
+  void removeFunction(IRPtr<Function> f);
+
+  // Moves the functions and the vars of the Src into this module (see the
+  // LinkOptions). Nothing is copied, so the pointers to the moved objects
+  // stay valid, and this module keeps the arena of the Src alive. The Src
+  // is left empty. The dropped functions are left out of both of the
+  // modules, without the instructions. Returns false (with the errMsg) on
+  // a name clash under the FnClash::Error, and then nothing is changed.
+  bool link(Module &&Src, std::string &errMsg,
+            const LinkOptions &Opts = LinkOptions());
+  // Links the Srcs in their order, as the link() of each of them would,
+  // but the names and the operands of their functions are remapped in
+  // parallel, a src per task.
+  bool link(std::vector<std::unique_ptr<Module>> Srcs, std::string &errMsg,
+            const LinkOptions &Opts = LinkOptions());
+
+  // Checks all the invariants of the IR (which the asserts check in the
+  // debug builds only), and appends a diagnostic for each problem found.
+  // The functions are checked in parallel, on the numOfThreads threads (0
+  // means all the hardware threads); the diagnostics don't depend on it.
+  // Returns true if the module is fine.
+  bool verify(std::vector<VerifierDiagnostic> &Diags,
+              unsigned numOfThreads = 0) const;
 };
+
+#endif // REVLANG_CODEGEN_H
@@ -0,0 +1,170 @@
+//=== The bit-vector dataflow analyses over the revLANG functions.
+
+#ifndef REVLANG_DATAFLOW_H
+#define REVLANG_DATAFLOW_H
+
+#include "AnalysisManager.h"
+#include "BitVector.h"
+#include "CodeGen.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// This solves a dataflow problem over the CFG of a function, where the
+// facts are the bits of a BitVector (e.g. one bit per var), and the values
+// meet by the union. The worklist is walked in the reverse postorder (or
+// in the postorder, for the backward problems), so the acyclic parts take
+// a single visit. Each bb keeps a single vector: the value at its end (or
+// at its start, for the backward problems), and the other one is computed
+// on the demand. So the memory is (the number of the bbs) * (the number of
+// the facts) bits.
+//
+// The bbs not reachable from the entry bb are not analyzed, and all their
+// values are empty.
+class BitVectorDataFlow {
+public:
+  enum class Direction { Forward, Backward };
+
+private:
+  const Function &F;
+  Direction Dir;
+  size_t NumOfFacts = 0;
+  // The bbs in the order of the visits.
+  std::vector<BasicBlock *> Order;
+  // The index within the Order, by the bb number (or -1).
+  std::vector<int32_t> Positions;
+  // The values after the transfer, by the position within the Order.
+  std::vector<BitVector> Results;
+  // The value of the unreachable bbs.
+  BitVector Empty;
+
+  // Computes the value before the transfer through the (reachable) bb.
+  void meet(const BasicBlock *BB, BitVector &Value) const;
+
+protected:
+  BitVectorDataFlow(const Function &f, Direction dir);
+  // The results may be moved (e.g. into the AnalysisManager).
+  BitVectorDataFlow(BitVectorDataFlow &&) = default;
+  virtual ~BitVectorDataFlow() {}
+
+  // Applies the effects of the bb to the value, in the direction of the
+  // analysis.
+  virtual void transfer(const BasicBlock *BB, BitVector &Value) const = 0;
+  // Sets the value at the start of the entry bb (or at the end of the bbs
+  // without successors, for the backward problems).
+  virtual void initBoundary(BitVector &Value) const = 0;
+
+  // Solves the problem over the facts in [0, numOfFacts). This should be
+  // called once the subclass is ready.
+  void solve(size_t numOfFacts);
+
+public:
+  const Function &getFunction() const { return F; }
+  size_t getNumOfFacts() const { return NumOfFacts; }
+  bool isReachable(const BasicBlock *BB) const {
+    return Positions[BB->getNumber()] >= 0;
+  }
+
+  // Returns the value after the transfer through the bb, i.e. at the end of
+  // the bb for the forward problems, and at its start for the backward ones.
+  const BitVector &getResult(const BasicBlock *BB) const;
+  // Returns the value before the transfer, i.e. the meet over the
+  // predecessors (or the successors, for the backward problems).
+  BitVector getMeet(const BasicBlock *BB) const;
+};
+
+// Returns the var written by the instruction, or nullptr for the LOADs.
+GlobalVariable *getWrittenVar(const Instruction *I);
+
+// The live vars, i.e. the ones that may be read before they are written
+// again. The facts are the indices of the vars of the module in the order
+// of their ids (see the getVarIndex()), so the sparse ids don't take the
+// bits. The vars are globals, so all of them are live at the returns. The
+// LOADs read their var (the default branch decisions depend on it), so
+// they are the uses, too. The custom branch decisions reading the other
+// vars (see the ExecutionEngine.h) are not taken into the account.
+class LiveVariables : public BitVectorDataFlow {
+  // The vars read before they are written within the bb, and the vars
+  // written within it, by the bb number.
+  std::vector<std::vector<uint32_t>> Uses;
+  std::vector<std::vector<uint32_t>> Defs;
+  // The ids of the vars of the module, sorted, unless they are the
+  // [0, the number of the vars) already.
+  std::vector<unsigned> IDs;
+
+  void transfer(const BasicBlock *BB, BitVector &Value) const override;
+  void initBoundary(BitVector &Value) const override;
+
+public:
+  explicit LiveVariables(const Function &F);
+
+  const BitVector &getLiveIn(const BasicBlock *BB) const {
+    return getResult(BB);
+  }
+  BitVector getLiveOut(const BasicBlock *BB) const { return getMeet(BB); }
+
+  // Returns the fact of the var.
+  uint32_t getVarIndex(const GlobalVariable *GV) const {
+    if (IDs.empty())
+      return GV->getID();
+    return std::lower_bound(IDs.begin(), IDs.end(), GV->getID()) - IDs.begin();
+  }
+
+  // Updates the live vars from after the instruction to before it.
+  void stepBackward(const Instruction *I, BitVector &Live) const;
+};
+
+// The STOREs that may reach a point, i.e. the ones whose value the var may
+// still hold there. Any write of the var (a STORE or an ADD) kills the
+// STOREs into it. The facts are the indices of the STOREs (see the
+// getStore()).
+class ReachingStores : public BitVectorDataFlow {
+  std::vector<const Store *> Stores;
+  // The vars written by the function, numbered densely.
+  std::unordered_map<const GlobalVariable *, uint32_t> WrittenVars;
+  // The indices of the STOREs into each var, by the number of the var.
+  std::vector<std::vector<uint32_t>> StoresOf;
+  // The numbers of the vars written within the bb, and the last STOREs into
+  // them (if the last write is a STORE), by the bb number.
+  std::vector<std::vector<uint32_t>> Kills;
+  std::vector<std::vector<uint32_t>> Gens;
+
+  void transfer(const BasicBlock *BB, BitVector &Value) const override;
+  void initBoundary(BitVector &Value) const override;
+
+public:
+  explicit ReachingStores(const Function &F);
+
+  size_t getNumOfStores() const { return Stores.size(); }
+  const Store *getStore(size_t idx) const { return Stores[idx]; }
+
+  const BitVector &getReachingOut(const BasicBlock *BB) const {
+    return getResult(BB);
+  }
+  BitVector getReachingIn(const BasicBlock *BB) const { return getMeet(BB); }
+
+  // Returns the STOREs into the GV that may reach the instruction.
+  std::vector<const Store *> getReachingStores(const Instruction *I,
+                                               const GlobalVariable *GV) const;
+};
+
+// The analyses for the AnalysisManager.
+struct LiveVariablesAnalysis {
+  using Result = LiveVariables;
+  static constexpr AnalysisDeps Deps = AnalysisDeps::All;
+  static Result run(const Function &F, AnalysisManager &) {
+    return LiveVariables(F);
+  }
+};
+
+struct ReachingStoresAnalysis {
+  using Result = ReachingStores;
+  static constexpr AnalysisDeps Deps = AnalysisDeps::All;
+  static Result run(const Function &F, AnalysisManager &) {
+    return ReachingStores(F);
+  }
+};
+
+#endif // REVLANG_DATAFLOW_H
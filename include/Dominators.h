@@ -0,0 +1,101 @@
+//=== The dominator tree and the dominance frontiers of the revLANG functions.
+
+#ifndef REVLANG_DOMINATORS_H
+#define REVLANG_DOMINATORS_H
+
+#include "AnalysisManager.h"
+#include "CodeGen.h"
+
+#include <cstdint>
+#include <vector>
+
+// This represents the dominator tree of a function. The bb A dominates the
+// bb B if each path from the entry bb to the B goes through the A. The tree
+// is built by the Cooper-Harvey-Kennedy algorithm over the reverse
+// postorder, so it takes a few linear sweeps on the usual CFGs.
+//
+// The bbs not reachable from the entry bb are not in the tree. The data is
+// kept by the bb numbers, so the tree is stale once the CFG changes (see
+// the Function::getCFGEpoch()).
+class DominatorTree {
+  const Function &F;
+  uint64_t CFGEpoch;
+  // The reachable bbs, in the reverse postorder.
+  std::vector<BasicBlock *> RPO;
+  // These are by the bb number.
+  std::vector<BasicBlock *> IDoms;
+  std::vector<std::vector<BasicBlock *>> Children;
+  // The preorder and the postorder numbers of the bb within the tree (or
+  // 0, for the unreachable bbs), so the dominates() is O(1).
+  std::vector<uint32_t> DFSIn;
+  std::vector<uint32_t> DFSOut;
+
+public:
+  explicit DominatorTree(const Function &F);
+
+  const Function &getFunction() const { return F; }
+  // The epoch of the CFG the tree was built for.
+  uint64_t getCFGEpoch() const { return CFGEpoch; }
+  BasicBlock *getRoot() const { return F.getEntryBB(); }
+  const std::vector<BasicBlock *> &getReversePostOrder() const { return RPO; }
+
+  bool isReachable(const BasicBlock *BB) const {
+    return DFSIn[BB->getNumber()] != 0;
+  }
+  // Returns the immediate dominator of the bb (or nullptr, for the entry
+  // and the unreachable bbs).
+  BasicBlock *getIDom(const BasicBlock *BB) const {
+    return IDoms[BB->getNumber()];
+  }
+  // Returns the bbs immediately dominated by the bb.
+  const std::vector<BasicBlock *> &getChildren(const BasicBlock *BB) const {
+    return Children[BB->getNumber()];
+  }
+
+  // Returns true if the A dominates the B. Each bb dominates itself. This
+  // is false if either of them is unreachable.
+  bool dominates(const BasicBlock *A, const BasicBlock *B) const;
+  bool properlyDominates(const BasicBlock *A, const BasicBlock *B) const {
+    return A != B && dominates(A, B);
+  }
+  // Returns the closest bb dominating both the A and the B (or nullptr, if
+  // either of them is unreachable).
+  BasicBlock *findNearestCommonDominator(const BasicBlock *A,
+                                         const BasicBlock *B) const;
+};
+
+// This represents the dominance frontiers of the bbs, i.e. for each bb A,
+// the bbs B such that the A dominates a predecessor of the B, but does not
+// properly dominate the B itself. These are the places where the values
+// written within the A meet the other ones.
+class DominanceFrontier {
+  // These are by the bb number.
+  std::vector<std::vector<BasicBlock *>> Frontiers;
+
+public:
+  explicit DominanceFrontier(const DominatorTree &DT);
+
+  // Returns the frontier of the bb (in no particular order).
+  const std::vector<BasicBlock *> &getFrontier(const BasicBlock *BB) const {
+    return Frontiers[BB->getNumber()];
+  }
+};
+
+// The analyses for the AnalysisManager.
+struct DominatorTreeAnalysis {
+  using Result = DominatorTree;
+  static constexpr AnalysisDeps Deps = AnalysisDeps::CFG;
+  static Result run(const Function &F, AnalysisManager &) {
+    return DominatorTree(F);
+  }
+};
+
+struct DominanceFrontierAnalysis {
+  using Result = DominanceFrontier;
+  static constexpr AnalysisDeps Deps = AnalysisDeps::CFG;
+  static Result run(const Function &F, AnalysisManager &AM) {
+    return DominanceFrontier(AM.getResult<DominatorTreeAnalysis>(F));
+  }
+};
+
+#endif // REVLANG_DOMINATORS_H
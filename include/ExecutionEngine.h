@@ -0,0 +1,236 @@
+//=== The interpreter for the revLANG functions.
+
+#ifndef REVLANG_EXECUTIONENGINE_H
+#define REVLANG_EXECUTIONENGINE_H
+
+#include "ArrayRef.h"
+#include "CodeGen.h"
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The semantics of the instructions, on the 64-bit (wrapping) values of
+// the vars:
+//   LOAD var !a                 reads !a; it is the branch condition.
+//   STORE var !a, var !b        stores the value of !a into !b.
+//   var !a = ADD var !b, ...    stores the sum of the !b, ... into !a.
+// A bb without successors returns from the function, and a bb with a
+// single successor jumps to it. Otherwise, the branch decision picks the
+// successor.
+
+// This numbers the vars of a module densely, in the order of their ids.
+// The values of the vars are indexed by these slots rather than by the
+// ids, so a module with the sparse ids doesn't need the values for the
+// ids in between. The slots are valid until a var is added or removed
+// (see the Module::getVarsEpoch()).
+class VarSlots {
+  // The ids of the vars, by the slot. It is empty when the ids are dense
+  // already, i.e. when the slot of each var is its id.
+  std::vector<unsigned> IDs;
+  size_t NumOfSlots = 0;
+  uint64_t Epoch = 0;
+
+public:
+  VarSlots() = default;
+  explicit VarSlots(const Module &M);
+
+  size_t size() const { return NumOfSlots; }
+  // The Module::getVarsEpoch() these were built for.
+  uint64_t getEpoch() const { return Epoch; }
+
+  // Returns the slot of the var with the id, or the size() if there is no
+  // such var.
+  uint32_t getSlot(unsigned id) const;
+  uint32_t getSlot(const GlobalVariable &GV) const {
+    return getSlot(GV.getID());
+  }
+  unsigned getID(uint32_t slot) const {
+    assert(slot < NumOfSlots && "Out of bounds");
+    return IDs.empty() ? slot : IDs[slot];
+  }
+};
+
+// This is what the branch decision gets to see.
+struct BranchState {
+  const BasicBlock *BB;
+  // The tags of the successors of the bb, sorted by the name.
+  ArrayRef<std::string_view> Tags;
+  // The value read by the last LOAD (or 0, if there was none).
+  int64_t LastLoaded;
+  // The values of the vars, indexed by the Slots.
+  ArrayRef<int64_t> Vars;
+  const VarSlots *Slots;
+
+  int64_t getValue(const GlobalVariable &GV) const {
+    uint32_t slot = Slots->getSlot(GV);
+    return slot < Vars.size() ? Vars[slot] : 0;
+  }
+};
+
+// Returns the index of the tag (within the BranchState::Tags) of the
+// successor to go to, or anything out of the range to return from the
+// function.
+using BranchDecision = std::function<size_t(const BranchState &)>;
+
+// This holds the values of the vars for many independent runs (the
+// lanes). Each var is a column of the values of all the lanes, so the
+// batch runs go over the contiguous memory.
+class ExecutionBatch {
+  size_t NumOfLanes;
+  // The columns are padded to a multiple of the TileSize.
+  size_t Stride;
+  // There is a column per var, at its slot.
+  VarSlots Slots;
+  std::vector<int64_t> Values;
+
+public:
+  // The lanes are run in the tiles of this many lanes.
+  static constexpr size_t TileSize = 256;
+
+  // Creates a batch for the vars of the module, set to 0. The batch can be
+  // run until a var is added to or removed from the module.
+  ExecutionBatch(const Module &M, size_t numOfLanes);
+
+  size_t getNumOfLanes() const { return NumOfLanes; }
+  size_t getNumOfVars() const { return Slots.size(); }
+  const VarSlots &getSlots() const { return Slots; }
+
+  // Returns the values of the var at the slot, for all the lanes.
+  int64_t *getSlotColumn(uint32_t slot) {
+    assert(slot < Slots.size() && "Unknown var");
+    return Values.data() + slot * Stride;
+  }
+  const int64_t *getSlotColumn(uint32_t slot) const {
+    assert(slot < Slots.size() && "Unknown var");
+    return Values.data() + slot * Stride;
+  }
+  // Returns the values of the var with the id, for all the lanes.
+  int64_t *getColumn(unsigned id) { return getSlotColumn(Slots.getSlot(id)); }
+  const int64_t *getColumn(unsigned id) const {
+    return getSlotColumn(Slots.getSlot(id));
+  }
+
+  int64_t getValue(const GlobalVariable &GV, size_t lane) const {
+    assert(lane < NumOfLanes && "Out of bounds");
+    return getColumn(GV.getID())[lane];
+  }
+  void setValue(const GlobalVariable &GV, size_t lane, int64_t value) {
+    assert(lane < NumOfLanes && "Out of bounds");
+    getColumn(GV.getID())[lane] = value;
+  }
+};
+
+// This is what the batch branch decision gets to see. It covers a tile of
+// the lanes, i.e. [FirstLane, FirstLane + ExecutionBatch::TileSize).
+struct BatchBranchState {
+  const BasicBlock *BB;
+  // The tags of the successors of the bb, sorted by the name.
+  ArrayRef<std::string_view> Tags;
+  size_t FirstLane;
+  // Non-zero for the lanes of the tile reaching the branch.
+  const uint8_t *Active;
+  // The values read by the last LOAD, per lane of the tile.
+  const int64_t *LastLoaded;
+  const ExecutionBatch *Batch;
+};
+
+// Sets the Choices[i] to the index of the tag of the successor to go to,
+// for each active lane i of the tile. Anything out of the range returns
+// from the function.
+using BatchBranchDecision =
+    std::function<void(const BatchBranchState &, uint32_t *Choices)>;
+
+class CompiledFunction;
+class BatchFunction;
+class JITCache;
+
+// This runs the functions of a Module. Each function is lowered into a
+// compact bytecode on its first run (and on the first run after a change
+// of the function or of the vars of the module): the vars become their
+// slots within the flat array of the values (see the VarSlots), and the
+// successors become the offsets within the code. The bytecode is then run
+// by a direct-threaded loop (or by a switch, on the compilers without the
+// computed gotos). The batch runs (see the runBatch()) use a separate
+// lowering. The single runs may use the native code instead (see the
+// setJIT()).
+class ExecutionEngine {
+  Module &M;
+  // The values of the vars, indexed by the Slots.
+  VarSlots Slots;
+  std::vector<int64_t> Vars;
+  std::unordered_map<const Function *, std::unique_ptr<CompiledFunction>>
+      Compiled;
+  std::unordered_map<const Function *, std::unique_ptr<BatchFunction>>
+      BatchCompiled;
+  JITCache *JIT = nullptr;
+  BranchDecision Decide;
+  BatchBranchDecision BatchDecide;
+  uint64_t MaxBlocks = UINT64_MAX;
+  uint64_t NumOfExecutedBlocks = 0;
+
+  const CompiledFunction &getCompiled(const Function &F);
+  const BatchFunction &getBatchCompiled(const Function &F,
+                                        const VarSlots &BatchSlots);
+  // Renumbers the values, if the vars of the module have changed.
+  void updateSlots();
+
+public:
+  explicit ExecutionEngine(Module &m);
+  ~ExecutionEngine();
+
+  // Sets the branch decision. By default, the "true" successor is taken
+  // if the last LOAD read a non-zero value and the "false" one otherwise
+  // (or the first one, if there is no such tag).
+  void setBranchDecision(BranchDecision decide) { Decide = std::move(decide); }
+  // Makes the run() use the native code of the JIT (see the JIT.h), which
+  // must be of the same module, instead of the bytecode. The JIT may be
+  // shared by many engines, so each function is compiled once. The
+  // nullptr goes back to the bytecode.
+  void setJIT(JITCache *jit);
+  JITCache *getJIT() const { return JIT; }
+  // Sets the max number of the bbs a single run may execute.
+  void setBlockLimit(uint64_t maxBlocks) { MaxBlocks = maxBlocks; }
+
+  int64_t getValue(const GlobalVariable &GV) const;
+  void setValue(const GlobalVariable &GV, int64_t value);
+  // The values of all the vars, indexed by the getSlots().
+  ArrayRef<int64_t> getValues() const { return Vars; }
+  const VarSlots &getSlots() const { return Slots; }
+  // Sets all the vars to 0.
+  void resetValues();
+
+  // Runs the function from its entry bb. Returns false if it cannot be run
+  // (e.g. there is no entry bb) or if it hits the block limit, and the
+  // errMsg describes the problem. The vars keep their values between runs.
+  bool run(const Function &F, std::string &errMsg);
+  // The number of the bbs executed by the last run (summed over the lanes,
+  // for the batch runs).
+  uint64_t getNumOfExecutedBlocks() const { return NumOfExecutedBlocks; }
+
+  // Sets the branch decision for the batch runs. The default one is the
+  // same as for the single runs.
+  void setBatchBranchDecision(BatchBranchDecision decide) {
+    BatchDecide = std::move(decide);
+  }
+  // Runs the function for all the lanes of the batch. The lanes are run
+  // together, a tile at a time: each bb is executed for all the lanes of
+  // the tile reaching it, and the lanes taking different successors are
+  // tracked by the lane masks. The block limit applies to the number of
+  // the bbs executed for a tile. Returns false (with the errMsg set) if
+  // the function cannot be run or it hits the block limit.
+  bool runBatch(const Function &F, ExecutionBatch &Batch,
+                std::string &errMsg);
+
+  // Drops the bytecode of the function. The bytecode is lowered again
+  // anyway, once the function has changed (see the Function::getEpoch()),
+  // so this just frees the memory, e.g. before the function is removed.
+  void invalidate(const Function &F);
+};
+
+#endif // REVLANG_EXECUTIONENGINE_H
@@ -0,0 +1,207 @@
+//=== The compact, index-based form of a revLANG function.
+//
+// A FlatFunction keeps the whole function in a few flat arrays (the
+// struct-of-arrays layout), addressed by the 32-bit indices instead of the
+// pointers:
+//   the bbs:     name, first instr, first edge (by the bb index)
+//   the edges:   tag, target bb index (the edges of a bb are adjacent)
+//   the instrs:  opcode, first operand (the instrs of a bb are adjacent)
+//   the operands: var id (the operands of an instr are adjacent)
+// The first instr (edge, operand) of the next bb (instr) ends the range, so
+// there is one more entry than there are bbs (instrs). The names are the
+// indices into the name table of the function itself, so the form doesn't
+// depend on the Module it was built from.
+//
+// The form is read-only: it is built from a Function (see the build()), and
+// a Function is built back from it (see the materialize()). It doesn't have
+// the use lists, so a scan of the whole function goes over the contiguous
+// memory, and it is copied (or written out) as a few arrays. The FlatBlock
+// and the FlatInstr are the views, which mirror the reading API of the
+// BasicBlock and the Instruction.
+
+#ifndef REVLANG_FLATFUNCTION_H
+#define REVLANG_FLATFUNCTION_H
+
+#include "ArrayRef.h"
+#include "CodeGen.h"
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class FlatFunction;
+
+// This is a view of an instruction of a FlatFunction, i.e. the function
+// and the index of the instruction.
+class FlatInstr {
+  const FlatFunction *F;
+  uint32_t Idx;
+
+public:
+  FlatInstr(const FlatFunction *f, uint32_t idx) : F(f), Idx(idx) {}
+
+  uint32_t getIndex() const { return Idx; }
+  Instruction::OpCodeKind getOpCodeKind() const;
+  // The operands, as the var ids.
+  ArrayRef<uint32_t> getOperandIDs() const;
+  size_t getNumOfOps() const { return getOperandIDs().size(); }
+  uint32_t getOperandID(unsigned idx) const { return getOperandIDs()[idx]; }
+
+  bool operator==(const FlatInstr &other) const {
+    return F == other.F && Idx == other.Idx;
+  }
+  bool operator!=(const FlatInstr &other) const { return !(*this == other); }
+};
+
+// This is a view of a bb of a FlatFunction.
+class FlatBlock {
+  const FlatFunction *F;
+  uint32_t Idx;
+
+public:
+  FlatBlock(const FlatFunction *f, uint32_t idx) : F(f), Idx(idx) {}
+
+  // The index of the bb, which is its number within the FlatFunction (the
+  // bbs are in the order of their numbers, without the holes).
+  uint32_t getIndex() const { return Idx; }
+  std::string_view getBBID() const;
+
+  size_t getNumOfInstrs() const;
+  FlatInstr getInstr(size_t idx) const;
+
+  size_t getNumOfSuccessors() const;
+  // The tag and the target of the idx-th edge. The edges are sorted by
+  // the tag.
+  std::string_view getSuccessorTag(size_t idx) const;
+  FlatBlock getSuccessor(size_t idx) const;
+
+  bool operator==(const FlatBlock &other) const {
+    return F == other.F && Idx == other.Idx;
+  }
+  bool operator!=(const FlatBlock &other) const { return !(*this == other); }
+};
+
+class FlatFunction {
+public:
+  // The index of nothing, e.g. of the entry bb of a function without one.
+  static constexpr uint32_t InvalidIndex = ~0u;
+
+private:
+  // The name table: the names are the ranges of the NameChars, and the
+  // NameOffsets has one more entry than there are names.
+  std::string NameChars;
+  std::vector<uint32_t> NameOffsets{0};
+  uint32_t FnName = 0;
+  uint32_t EntryBlock = InvalidIndex;
+
+  std::vector<uint32_t> BlockNames;
+  std::vector<uint32_t> BlockInstrs{0};
+  std::vector<uint32_t> BlockEdges{0};
+
+  std::vector<uint32_t> EdgeTags;
+  std::vector<uint32_t> EdgeTargets;
+
+  std::vector<Instruction::OpCodeKind> InstrOpCodes;
+  std::vector<uint32_t> InstrOps{0};
+
+  std::vector<uint32_t> Operands;
+
+  friend class FlatBlock;
+  friend class FlatInstr;
+
+  uint32_t addName(std::string_view name);
+
+public:
+  // Builds the form of the function.
+  static FlatFunction build(const Function &F);
+
+  // Creates the function within the M (with the name of this one, if the
+  // newName is empty), along with the vars it uses which the M doesn't
+  // have. The M must use the arena, and it must not have a function with
+  // the name.
+  IRPtr<Function> materialize(Module &M, std::string_view newName = {}) const;
+
+  std::string_view getName() const { return getString(FnName); }
+  std::string_view getString(uint32_t idx) const {
+    assert(idx + 1 < NameOffsets.size() && "Unknown name");
+    return std::string_view(NameChars).substr(
+        NameOffsets[idx], NameOffsets[idx + 1] - NameOffsets[idx]);
+  }
+
+  size_t getNumOfBlocks() const { return BlockNames.size(); }
+  size_t getNumOfInstrs() const { return InstrOpCodes.size(); }
+  size_t getNumOfEdges() const { return EdgeTargets.size(); }
+  size_t getNumOfOps() const { return Operands.size(); }
+
+  FlatBlock getBlock(uint32_t idx) const {
+    assert(idx < getNumOfBlocks() && "Out of bounds");
+    return FlatBlock(this, idx);
+  }
+  bool hasEntryBlock() const { return EntryBlock != InvalidIndex; }
+  FlatBlock getEntryBlock() const { return getBlock(EntryBlock); }
+  FlatInstr getInstr(uint32_t idx) const {
+    assert(idx < getNumOfInstrs() && "Out of bounds");
+    return FlatInstr(this, idx);
+  }
+
+  // The whole arrays, for the scans over all the instructions (or all the
+  // operands) of the function.
+  ArrayRef<Instruction::OpCodeKind> getOpCodes() const {
+    return InstrOpCodes;
+  }
+  ArrayRef<uint32_t> getOperandIDs() const { return Operands; }
+
+  // Appends the form to the Out, as the arrays in the host byte order
+  // (so it is meant for the caches, not for the exchange; see the
+  // Bitcode.h for that).
+  void serialize(std::string &Out) const;
+  // Reads the form written by the serialize(), checking all the indices.
+  // On failure, returns false and sets the errMsg.
+  bool deserialize(std::string_view In, std::string &errMsg);
+
+  bool operator==(const FlatFunction &other) const;
+  bool operator!=(const FlatFunction &other) const {
+    return !(*this == other);
+  }
+};
+
+inline Instruction::OpCodeKind FlatInstr::getOpCodeKind() const {
+  return F->InstrOpCodes[Idx];
+}
+
+inline ArrayRef<uint32_t> FlatInstr::getOperandIDs() const {
+  uint32_t first = F->InstrOps[Idx];
+  return ArrayRef<uint32_t>(F->Operands.data() + first,
+                            F->InstrOps[Idx + 1] - first);
+}
+
+inline std::string_view FlatBlock::getBBID() const {
+  return F->getString(F->BlockNames[Idx]);
+}
+
+inline size_t FlatBlock::getNumOfInstrs() const {
+  return F->BlockInstrs[Idx + 1] - F->BlockInstrs[Idx];
+}
+
+inline FlatInstr FlatBlock::getInstr(size_t idx) const {
+  assert(idx < getNumOfInstrs() && "Out of bounds");
+  return FlatInstr(F, F->BlockInstrs[Idx] + idx);
+}
+
+inline size_t FlatBlock::getNumOfSuccessors() const {
+  return F->BlockEdges[Idx + 1] - F->BlockEdges[Idx];
+}
+
+inline std::string_view FlatBlock::getSuccessorTag(size_t idx) const {
+  assert(idx < getNumOfSuccessors() && "Out of bounds");
+  return F->getString(F->EdgeTags[F->BlockEdges[Idx] + idx]);
+}
+
+inline FlatBlock FlatBlock::getSuccessor(size_t idx) const {
+  assert(idx < getNumOfSuccessors() && "Out of bounds");
+  return FlatBlock(F, F->EdgeTargets[F->BlockEdges[Idx] + idx]);
+}
+
+#endif // REVLANG_FLATFUNCTION_H
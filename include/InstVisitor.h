@@ -0,0 +1,57 @@
+//=== The switch-based visitor over the revLANG instructions.
+//
+// Derive from it (CRTP) and override the visitX() methods of interest:
+//   struct CountLoads : public InstVisitor<CountLoads> {
+//     unsigned NumOfLoads = 0;
+//     void visitLoad(Load &I) { ++NumOfLoads; }
+//   };
+//   CountLoads().visit(*F);
+// The dispatch is a switch on the opcode kind, and the calls are resolved
+// statically, so there are no virtual calls on the way.
+
+#ifndef REVLANG_INSTVISITOR_H
+#define REVLANG_INSTVISITOR_H
+
+#include "CodeGen.h"
+
+template <typename SubClass, typename RetTy = void> class InstVisitor {
+  SubClass &derived() { return *static_cast<SubClass *>(this); }
+
+public:
+  RetTy visit(Instruction &I) {
+    switch (I.getOpCodeKind()) {
+    case Instruction::OpCodeKind::Load:
+      return derived().visitLoad(cast<Load>(I));
+    case Instruction::OpCodeKind::Store:
+      return derived().visitStore(cast<Store>(I));
+    case Instruction::OpCodeKind::Add:
+      return derived().visitAdd(cast<Add>(I));
+    }
+    assert(false && "Unknown opcode");
+    return RetTy();
+  }
+  RetTy visit(Instruction *I) { return visit(*I); }
+
+  // Visits all the instructions of the bb (in order). The visitX() methods
+  // may change the instructions, so the bb of a copy-on-write clone stops
+  // sharing them first (see the BasicBlock::getInstructions()).
+  void visit(BasicBlock &BB) {
+    for (auto *I : BB.getInstructions())
+      visit(*I);
+  }
+
+  // Visits all the instructions of the function (the bbs are visited in no
+  // particular order).
+  void visit(Function &F) {
+    for (const auto &BB : F.getBasicBlocks())
+      visit(*BB.second);
+  }
+
+  // By default, all of these go to the visitInstruction().
+  RetTy visitLoad(Load &I) { return derived().visitInstruction(I); }
+  RetTy visitStore(Store &I) { return derived().visitInstruction(I); }
+  RetTy visitAdd(Add &I) { return derived().visitInstruction(I); }
+  RetTy visitInstruction(Instruction &) { return RetTy(); }
+};
+
+#endif // REVLANG_INSTVISITOR_H
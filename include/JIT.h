@@ -0,0 +1,128 @@
+//=== The native code generator for the revLANG functions.
+//
+// The JITCache lowers a function straight to the x86-64 machine code, e.g.:
+//   JITCache JIT(*M);
+//   ExecutionEngine EE(*M);
+//   EE.setJIT(&JIT);
+//   EE.run(*F, errMsg);
+// The semantics are the ones of the interpreter (see the
+// ExecutionEngine.h), which the native code is tested against.
+
+#ifndef REVLANG_JIT_H
+#define REVLANG_JIT_H
+
+#include "ExecutionEngine.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class JITFunction;
+
+// The state of a native run, shared by the code and the runtime hooks.
+// Each instruction reads and writes the vars here, in the memory. Only the
+// last loaded value and the number of the executed bbs are kept in the
+// registers while the code runs: the former is written back before the
+// code calls a hook, and both of them at the exit.
+struct JITContext {
+  // The values of the vars, indexed by the Slots. The code addresses the
+  // vars relative to this.
+  int64_t *Vars;
+  size_t NumOfVars;
+  const VarSlots *Slots = nullptr;
+  int64_t LastLoaded = 0;
+  uint64_t NumOfBlocks = 0;
+  uint64_t MaxBlocks = UINT64_MAX;
+  // The branch decision (if it is empty, the default one is taken).
+  const BranchDecision *Decide = nullptr;
+  const JITFunction *Fn = nullptr;
+};
+
+// This represents a bb with two or more successors. The code calls the
+// branch hook there, which picks the successor by the tag.
+struct JITBranchSite {
+  const BasicBlock *BB;
+  // The tags are sorted, and the targets are in the same order.
+  std::vector<std::string_view> Tags;
+  // The addresses of the code of the successors.
+  std::vector<const void *> Targets;
+  // The default decision.
+  uint32_t TrueIdx = 0;
+  uint32_t FalseIdx = 0;
+};
+
+// This represents the native code of a function, within its own
+// executable mapping.
+class JITFunction {
+  void *Code = nullptr;
+  size_t CodeSize = 0;
+  size_t MappedSize = 0;
+  std::vector<JITBranchSite> Sites;
+  // The epoch of the function this was compiled from, and the one of the
+  // vars of the module.
+  uint64_t Epoch = 0;
+  uint64_t VarsEpoch = 0;
+
+  friend class JITCache;
+
+public:
+  JITFunction() = default;
+  JITFunction(const JITFunction &) = delete;
+  JITFunction &operator=(const JITFunction &) = delete;
+  ~JITFunction();
+
+  // Runs the code from the entry bb. Returns false if it hit the block
+  // limit.
+  bool run(JITContext &Ctx) const;
+
+  const JITBranchSite &getSite(uint32_t idx) const { return Sites[idx]; }
+  size_t getCodeSize() const { return CodeSize; }
+  uint64_t getEpoch() const { return Epoch; }
+};
+
+// This holds the native code of the functions of a Module. A function is
+// compiled on its first use, and again only once it has changed (see the
+// Function::getEpoch()) or the vars of the module have, so the unchanged
+// functions are never recompiled, whichever ExecutionEngine runs them. The
+// cache is not thread-safe.
+class JITCache {
+  Module &M;
+  // The code addresses the vars by these, which are the same as the ones
+  // of the engines running it (see the ExecutionEngine::getSlots()).
+  VarSlots Slots;
+  std::unordered_map<const Function *, std::unique_ptr<JITFunction>>
+      Functions;
+  uint64_t NumOfCompilations = 0;
+
+  std::unique_ptr<JITFunction> compile(const Function &F,
+                                       std::string &errMsg);
+
+public:
+  explicit JITCache(Module &m);
+  ~JITCache();
+
+  // Returns true if the native code can be generated on this host.
+  static bool isSupported();
+
+  Module &getModule() const { return M; }
+
+  // Returns the code of the function, compiling it if needed. Returns
+  // nullptr (with the errMsg set) if it cannot be compiled, e.g. on an
+  // unsupported host or if the function has no entry bb.
+  const JITFunction *getCompiled(const Function &F, std::string &errMsg);
+
+  // Drops the code of the function, e.g. before the function is removed.
+  void invalidate(const Function &F);
+
+  // The number of the functions compiled so far (counting the
+  // recompilations of the changed ones).
+  uint64_t getNumOfCompilations() const { return NumOfCompilations; }
+  // The bytes of the code of all the cached functions.
+  size_t getCodeSize() const;
+};
+
+#endif // REVLANG_JIT_H
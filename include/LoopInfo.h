@@ -0,0 +1,91 @@
+//=== The natural loops of the revLANG functions.
+
+#ifndef REVLANG_LOOPINFO_H
+#define REVLANG_LOOPINFO_H
+
+#include "Dominators.h"
+
+#include <memory>
+#include <vector>
+
+// This represents a natural loop, i.e. a header bb together with the bbs
+// that reach a back edge to it (an edge from a bb dominated by the header)
+// without going through the header. The loops nest: the bbs of the inner
+// loops are the bbs of the outer ones, too.
+class Loop {
+  BasicBlock *Header;
+  Loop *ParentLoop = nullptr;
+  std::vector<Loop *> SubLoops;
+  // The header comes first, and the rest is in the reverse postorder.
+  std::vector<BasicBlock *> Blocks;
+  // The bbs within the loop branching to the header.
+  std::vector<BasicBlock *> Latches;
+  unsigned Depth = 1;
+
+  friend class LoopInfo;
+
+public:
+  explicit Loop(BasicBlock *header) : Header(header) {}
+
+  BasicBlock *getHeader() const { return Header; }
+  // Returns the innermost loop containing this one (or nullptr).
+  Loop *getParentLoop() const { return ParentLoop; }
+  const std::vector<Loop *> &getSubLoops() const { return SubLoops; }
+  const std::vector<BasicBlock *> &getBlocks() const { return Blocks; }
+  size_t getNumOfBlocks() const { return Blocks.size(); }
+  // The top level loops are at the depth 1.
+  unsigned getLoopDepth() const { return Depth; }
+
+  // Returns true if the L is this loop or is nested within it.
+  bool contains(const Loop *L) const;
+  const std::vector<BasicBlock *> &getLatches() const { return Latches; }
+};
+
+// This finds the natural loops of a function, and tells the innermost loop
+// of each bb. It takes a linear time, given the dominator tree. As the
+// dominator tree, it is stale once the CFG changes.
+class LoopInfo {
+  // All the loops, the inner ones first.
+  std::vector<std::unique_ptr<Loop>> Loops;
+  std::vector<Loop *> TopLevelLoops;
+  // The innermost loop of each bb (or nullptr), by the bb number.
+  std::vector<Loop *> LoopFor;
+
+public:
+  explicit LoopInfo(const DominatorTree &DT);
+
+  // Returns the loops that are not nested within the other ones.
+  const std::vector<Loop *> &getTopLevelLoops() const {
+    return TopLevelLoops;
+  }
+  size_t getNumOfLoops() const { return Loops.size(); }
+
+  // Returns the innermost loop containing the bb (or nullptr).
+  Loop *getLoopFor(const BasicBlock *BB) const {
+    return LoopFor[BB->getNumber()];
+  }
+  // Returns the number of the loops containing the bb.
+  unsigned getLoopDepth(const BasicBlock *BB) const {
+    const Loop *L = getLoopFor(BB);
+    return L ? L->getLoopDepth() : 0;
+  }
+  bool isLoopHeader(const BasicBlock *BB) const {
+    const Loop *L = getLoopFor(BB);
+    return L && L->getHeader() == BB;
+  }
+  // Returns true if the bb is within the L (or within a loop nested in it).
+  bool contains(const Loop *L, const BasicBlock *BB) const {
+    return L->contains(getLoopFor(BB));
+  }
+};
+
+// The analysis for the AnalysisManager.
+struct LoopAnalysis {
+  using Result = LoopInfo;
+  static constexpr AnalysisDeps Deps = AnalysisDeps::CFG;
+  static Result run(const Function &F, AnalysisManager &AM) {
+    return LoopInfo(AM.getResult<DominatorTreeAnalysis>(F));
+  }
+};
+
+#endif // REVLANG_LOOPINFO_H
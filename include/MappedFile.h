@@ -0,0 +1,28 @@
+//=== A read-only memory-mapped file.
+
+#ifndef REVLANG_MAPPEDFILE_H
+#define REVLANG_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// This maps the whole file into the memory, so the readers can go through
+// it without copying it into a buffer first.
+class MappedFile {
+  const char *Data = nullptr;
+  size_t Size = 0;
+
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  // Maps the file. On failure, returns false and sets the errMsg.
+  bool open(const std::string &filename, std::string &errMsg);
+
+  std::string_view getBuffer() const { return std::string_view(Data, Size); }
+};
+
+#endif // REVLANG_MAPPEDFILE_H
@@ -0,0 +1,132 @@
+//=== The buffered output streams used by the printers.
+
+#ifndef REVLANG_OUTPUTSTREAM_H
+#define REVLANG_OUTPUTSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// This collects the output in a big buffer, and hands it to the sink in
+// large chunks. The integers are formatted by hand, so there are no
+// locales nor format strings on the way. The subclasses decide where
+// the bytes go, and they must flush() in their destructors.
+class OutputStream {
+  std::unique_ptr<char[]> Buffer;
+  char *Cur;
+  char *End;
+  bool Error = false;
+
+  void writeSlow(const char *data, size_t size);
+
+protected:
+  // Writes the bytes to the sink. Returns false on I/O errors.
+  virtual bool writeImpl(const char *data, size_t size) = 0;
+  void setError() { Error = true; }
+
+public:
+  static constexpr size_t DefaultBufferSize = 64 * 1024;
+
+  explicit OutputStream(size_t bufferSize = DefaultBufferSize);
+  OutputStream(const OutputStream &) = delete;
+  OutputStream &operator=(const OutputStream &) = delete;
+  virtual ~OutputStream() {}
+
+  OutputStream &write(const char *data, size_t size) {
+    if (size <= static_cast<size_t>(End - Cur)) {
+      std::memcpy(Cur, data, size);
+      Cur += size;
+    } else {
+      writeSlow(data, size);
+    }
+    return *this;
+  }
+
+  OutputStream &operator<<(char c) {
+    if (Cur == End)
+      flush();
+    *Cur++ = c;
+    return *this;
+  }
+  OutputStream &operator<<(std::string_view str) {
+    return write(str.data(), str.size());
+  }
+  OutputStream &operator<<(const char *str) {
+    return *this << std::string_view(str);
+  }
+  OutputStream &operator<<(const std::string &str) {
+    return write(str.data(), str.size());
+  }
+  OutputStream &operator<<(uint64_t value);
+  OutputStream &operator<<(int64_t value);
+  OutputStream &operator<<(unsigned value) {
+    return *this << static_cast<uint64_t>(value);
+  }
+  OutputStream &operator<<(int value) {
+    return *this << static_cast<int64_t>(value);
+  }
+
+  // Hands the buffered bytes to the sink.
+  void flush();
+
+  // Returns true if any of the writes to the sink failed.
+  bool hasError() const { return Error; }
+};
+
+// This writes to a std::ostream (e.g. the std::cout).
+class StdOutputStream : public OutputStream {
+  std::ostream &OS;
+
+  bool writeImpl(const char *data, size_t size) override;
+
+public:
+  explicit StdOutputStream(std::ostream &os) : OS(os) {}
+  ~StdOutputStream() override { flush(); }
+};
+
+// This writes to a file descriptor, e.g. to the stdout or to a file.
+class FDOutputStream : public OutputStream {
+  int FD = -1;
+  bool ShouldClose = false;
+
+  bool writeImpl(const char *data, size_t size) override;
+
+public:
+  // The fd is not closed when the stream goes away.
+  explicit FDOutputStream(int fd) : FD(fd) {}
+  // Creates (or truncates) the file. On failure, the errMsg is set and
+  // isOpen() returns false.
+  FDOutputStream(const std::string &filename, std::string &errMsg);
+  ~FDOutputStream() override;
+
+  bool isOpen() const { return FD >= 0; }
+  // Flushes and closes the file. Returns false if any of the writes (or
+  // the close itself) failed.
+  bool close();
+};
+
+// This appends to a string.
+class StringOutputStream : public OutputStream {
+  std::string &Str;
+
+  bool writeImpl(const char *data, size_t size) override {
+    Str.append(data, size);
+    return true;
+  }
+
+public:
+  explicit StringOutputStream(std::string &str) : Str(str) {}
+  ~StringOutputStream() override { flush(); }
+
+  // Flushes and returns the string.
+  std::string &str() {
+    flush();
+    return Str;
+  }
+};
+
+#endif // REVLANG_OUTPUTSTREAM_H
@@ -0,0 +1,31 @@
+//=== The parser for the textual form of the revLANG IR (.revLang files).
+
+#ifndef REVLANG_PARSER_H
+#define REVLANG_PARSER_H
+
+#include "CodeGen.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Parses a file in the format printed by Module::dump() into a new Module.
+// The file is memory-mapped and it is streamed into the IR objects in a
+// single pass (there is no intermediate AST). The returned Module owns all
+// the objects (it uses the arena). On failure, this returns nullptr and
+// the errMsg describes the problem.
+//
+// NOTE: The printed form marks the entry basic block with a '; Entry' after
+// its label. If no bb of a function is marked (e.g. in a hand-written file),
+// the only bb without predecessors is the entry, and if there is none or
+// more than one, the file is rejected.
+std::unique_ptr<Module> parseRevLangFile(const std::string &filename,
+                                         std::string &errMsg);
+
+// The same as above, but it parses an in-memory buffer. The bufferName is
+// used within the error messages only.
+std::unique_ptr<Module>
+parseRevLangBuffer(std::string_view buffer, std::string &errMsg,
+                   const std::string &bufferName = "<buffer>");
+
+#endif // REVLANG_PARSER_H
@@ -0,0 +1,119 @@
+//=== The passes over the revLANG modules, and the manager running them.
+
+#ifndef REVLANG_PASSMANAGER_H
+#define REVLANG_PASSMANAGER_H
+
+#include "CodeGen.h"
+
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+class OutputStream;
+class ThreadPool;
+
+// This is the base of all the passes.
+class Pass {
+public:
+  enum class PassKind { Module, Function };
+
+private:
+  PassKind Kind;
+
+protected:
+  explicit Pass(PassKind kind) : Kind(kind) {}
+
+public:
+  virtual ~Pass() {}
+
+  PassKind getKind() const { return Kind; }
+  // The name of the pass, e.g. for the timing report.
+  virtual std::string_view getName() const = 0;
+};
+
+// This runs on the whole module, alone.
+class ModulePass : public Pass {
+public:
+  ModulePass() : Pass(PassKind::Module) {}
+
+  // Returns true if the module was changed.
+  virtual bool runOnModule(Module &M) = 0;
+
+  static bool classof(const Pass *P) {
+    return P->getKind() == PassKind::Module;
+  }
+};
+
+// This collects the changes of the module requested by a function pass
+// (e.g. removing the function). They are applied once the pass is done
+// with all the functions, in the order of the function names, so the
+// result doesn't depend on the number of the threads.
+class ModuleUpdates {
+  std::vector<std::function<void(Module &)>> Updates;
+
+public:
+  void defer(std::function<void(Module &)> update) {
+    Updates.push_back(std::move(update));
+  }
+  bool empty() const { return Updates.empty(); }
+
+  // Applies the updates in the order they were deferred.
+  void apply(Module &M);
+};
+
+// This runs on each function of the module. The functions are independent,
+// so the pass may run on many of them in parallel (see the
+// Module::setConcurrent() for what is safe to change). Thus, the pass must
+// not keep the state of a run in its members, and the changes outside of
+// the function must go through the Updates.
+class FunctionPass : public Pass {
+public:
+  FunctionPass() : Pass(PassKind::Function) {}
+
+  // Returns true if the function (or the module, via the Updates) was
+  // changed.
+  virtual bool runOnFunction(Function &F, ModuleUpdates &Updates) = 0;
+
+  static bool classof(const Pass *P) {
+    return P->getKind() == PassKind::Function;
+  }
+};
+
+// The wall time of a pass, within a PassManager::run().
+struct PassTiming {
+  std::string_view Name;
+  double WallMs;
+  bool Changed;
+};
+
+// This runs the passes in the order they were added. The function passes
+// run on the functions in parallel, over a pool of the threads, and each
+// pass is done with all the functions before the next one starts.
+class PassManager {
+  std::vector<std::unique_ptr<Pass>> Passes;
+  std::unique_ptr<ThreadPool> Pool;
+  std::vector<PassTiming> Timings;
+
+  bool runFunctionPass(FunctionPass &P, Module &M);
+
+public:
+  // The numOfThreads is the number of the threads the function passes run
+  // on (0 means as many as there are hardware threads).
+  explicit PassManager(unsigned numOfThreads = 1);
+  ~PassManager();
+
+  void addPass(std::unique_ptr<Pass> P) { Passes.push_back(std::move(P)); }
+  size_t getNumOfPasses() const { return Passes.size(); }
+  unsigned getNumOfThreads() const;
+
+  // Runs all the passes on the module. Returns true if any of them changed
+  // it.
+  bool run(Module &M);
+
+  // The timings of the last run, one per pass.
+  const std::vector<PassTiming> &getTimings() const { return Timings; }
+  void printTimings(OutputStream &OS) const;
+};
+
+#endif // REVLANG_PASSMANAGER_H
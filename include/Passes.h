@@ -0,0 +1,53 @@
+//=== The passes over the revLANG IR that come with the infrastructure.
+
+#ifndef REVLANG_PASSES_H
+#define REVLANG_PASSES_H
+
+#include "PassManager.h"
+
+#include <memory>
+
+// The passes never free the IR objects they remove. Those are owned by the
+// arena of the module, or by the handles returned by the create() factories.
+
+//
+// The cleanup passes. Each of them runs in linear time.
+//
+
+// Removes the bbs that are not reachable from the entry bb.
+std::unique_ptr<FunctionPass> createUnreachableBlockElimPass();
+
+// Merges each bb into its predecessor, if that is its only predecessor and
+// the bb is its only (untagged) successor.
+std::unique_ptr<FunctionPass> createMergeBlocksPass();
+
+// Removes the bbs without instructions and with a single successor, by
+// making their predecessors go to that successor instead.
+std::unique_ptr<FunctionPass> createEmptyBlockElimPass();
+
+// Removes the functions that don't do anything, i.e. the ones without the
+// bbs or with just an empty entry bb.
+std::unique_ptr<FunctionPass> createEmptyFunctionElimPass();
+
+// Adds all the cleanup passes, in the order they work best in.
+void addCleanupPasses(PassManager &PM);
+
+//
+// The scalar passes. These are built on the dataflow analyses (see the
+// DataFlow.h).
+//
+
+// Removes the STOREs and the ADDs writing a var that is not live after
+// them, and the STOREs of a var into itself. This makes a single sweep, so
+// the writes that become dead only by the removal may be left until the
+// next run.
+std::unique_ptr<FunctionPass> createDeadStoreElimPass();
+
+// Removes the LOADs, the STOREs and the ADDs that write a value the var (or
+// the last loaded value) already holds, e.g. the repeated ADDs of the same
+// vars. The sums are numbered by a hash of the value numbers of their
+// operands, and the values flow down the dominator tree into the bbs with
+// a single predecessor. This takes a linear time.
+std::unique_ptr<FunctionPass> createGVNPass();
+
+#endif // REVLANG_PASSES_H
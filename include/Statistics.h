@@ -0,0 +1,180 @@
+//=== The counters, the timers and the gauges of the revLANG infrastructure.
+//
+// The hot paths bump them via the macros below, e.g.:
+//   REVLANG_STAT_ADD(EdgesAdded, 1);
+//   REVLANG_TIME_SCOPE(IsValid);
+// Each thread has its own values, so the bumps don't contend, and they are
+// summed up only when the report is taken (see the Statistics::collect()).
+// The REVLANG_ENABLE_STATS CMake option (on by default) builds them in;
+// without it, the macros expand to nothing.
+
+#ifndef REVLANG_STATISTICS_H
+#define REVLANG_STATISTICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+class OutputStream;
+
+enum class StatCounter : uint8_t {
+  BBsCreated,
+  EdgesAdded,
+  EdgesRemoved,
+  InstrsRemoved,
+  // The bbs pushed by the depth-first walks (see the CFGTraversal.h).
+  DFSNodesVisited,
+  NumOfCounters
+};
+
+enum class StatTimer : uint8_t {
+  IsValid,
+  // The Module::print(), so the Module::dump() too.
+  Dump,
+  PrintCFGAsDOT,
+  NumOfTimers
+};
+
+// The live objects of a kind, and the bytes they take (just the objects
+// themselves, not the memory they point to).
+enum class StatGauge : uint8_t {
+  Module,
+  Function,
+  BasicBlock,
+  Instruction,
+  NumOfGauges
+};
+
+// This represents the values of the statistics, summed over the threads.
+struct StatsReport {
+  static constexpr size_t NumOfCounters =
+      static_cast<size_t>(StatCounter::NumOfCounters);
+  static constexpr size_t NumOfTimers =
+      static_cast<size_t>(StatTimer::NumOfTimers);
+  static constexpr size_t NumOfGauges =
+      static_cast<size_t>(StatGauge::NumOfGauges);
+
+  struct TimerValue {
+    uint64_t NumOfCalls = 0;
+    uint64_t Nanoseconds = 0;
+  };
+  struct GaugeValue {
+    int64_t NumOfObjects = 0;
+    int64_t Bytes = 0;
+  };
+
+  uint64_t Counters[NumOfCounters] = {};
+  TimerValue Timers[NumOfTimers];
+  GaugeValue Gauges[NumOfGauges];
+
+  uint64_t get(StatCounter C) const {
+    return Counters[static_cast<size_t>(C)];
+  }
+  const TimerValue &get(StatTimer T) const {
+    return Timers[static_cast<size_t>(T)];
+  }
+  const GaugeValue &get(StatGauge G) const {
+    return Gauges[static_cast<size_t>(G)];
+  }
+
+  // Prints the report as a table, or as a JSON object.
+  void print(OutputStream &OS) const;
+  void printJSON(OutputStream &OS) const;
+};
+
+class Statistics {
+  // The values of a thread. Only the thread itself writes them, so the
+  // bumps are plain loads and stores (they are atomic just so the report
+  // may read them meanwhile).
+  struct ThreadStats {
+    std::atomic<uint64_t> Counters[StatsReport::NumOfCounters] = {};
+    std::atomic<uint64_t> TimerCalls[StatsReport::NumOfTimers] = {};
+    std::atomic<uint64_t> TimerNanoseconds[StatsReport::NumOfTimers] = {};
+    std::atomic<int64_t> GaugeObjects[StatsReport::NumOfGauges] = {};
+    std::atomic<int64_t> GaugeBytes[StatsReport::NumOfGauges] = {};
+
+    // These register the values for the report, and fold them into the
+    // values of the finished threads at the exit.
+    ThreadStats();
+    ~ThreadStats();
+    void addTo(StatsReport &R) const;
+  };
+  struct Registry;
+  static Registry &getRegistry();
+
+  static ThreadStats &getThreadStats() {
+    thread_local ThreadStats Stats;
+    return Stats;
+  }
+  template <typename T> static void bump(std::atomic<T> &V, T n) {
+    V.store(V.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+public:
+  static constexpr bool isEnabled() {
+#ifdef REVLANG_ENABLE_STATS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  static void add(StatCounter C, uint64_t n) {
+    bump(getThreadStats().Counters[static_cast<size_t>(C)], n);
+  }
+  static void addTime(StatTimer T, uint64_t ns) {
+    ThreadStats &S = getThreadStats();
+    bump(S.TimerCalls[static_cast<size_t>(T)], uint64_t(1));
+    bump(S.TimerNanoseconds[static_cast<size_t>(T)], ns);
+  }
+  static void addLive(StatGauge G, int64_t numOfObjects, int64_t bytes) {
+    ThreadStats &S = getThreadStats();
+    bump(S.GaugeObjects[static_cast<size_t>(G)], numOfObjects);
+    bump(S.GaugeBytes[static_cast<size_t>(G)], bytes);
+  }
+
+  // Returns the values summed over all the threads so far (the running
+  // ones and the finished ones).
+  static StatsReport collect();
+
+  static const char *getName(StatCounter C);
+  static const char *getName(StatTimer T);
+  static const char *getName(StatGauge G);
+};
+
+// This adds the time of its scope to the timer.
+class ScopedStatTimer {
+  StatTimer T;
+  std::chrono::steady_clock::time_point Start;
+
+public:
+  explicit ScopedStatTimer(StatTimer t)
+      : T(t), Start(std::chrono::steady_clock::now()) {}
+  ~ScopedStatTimer() {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - Start)
+                  .count();
+    Statistics::addTime(T, static_cast<uint64_t>(ns));
+  }
+  ScopedStatTimer(const ScopedStatTimer &) = delete;
+  ScopedStatTimer &operator=(const ScopedStatTimer &) = delete;
+};
+
+#ifdef REVLANG_ENABLE_STATS
+#define REVLANG_STAT_ADD(Name, n) Statistics::add(StatCounter::Name, (n))
+#define REVLANG_TIME_SCOPE(Name)                                              \
+  ScopedStatTimer RevLangStatTimer(StatTimer::Name)
+// These count the object of the kind created or destroyed.
+#define REVLANG_GAUGE_INC(Kind, bytes)                                        \
+  Statistics::addLive(StatGauge::Kind, 1, int64_t(bytes))
+#define REVLANG_GAUGE_DEC(Kind, bytes)                                        \
+  Statistics::addLive(StatGauge::Kind, -1, -int64_t(bytes))
+#else
+#define REVLANG_STAT_ADD(Name, n) ((void)0)
+#define REVLANG_TIME_SCOPE(Name) ((void)0)
+#define REVLANG_GAUGE_INC(Kind, bytes) ((void)0)
+#define REVLANG_GAUGE_DEC(Kind, bytes) ((void)0)
+#endif
+
+#endif // REVLANG_STATISTICS_H
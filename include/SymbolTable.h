@@ -0,0 +1,223 @@
+//=== The string interner and the symbol tables for the named IR items.
+
+#ifndef REVLANG_SYMBOLTABLE_H
+#define REVLANG_SYMBOLTABLE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The interned name. It is an index into the StringInterner.
+using Symbol = uint32_t;
+constexpr Symbol InvalidSymbol = ~0u;
+
+// This maps the names (fn names, bb names and successor tags) to the small
+// integers, so the rest of the IR deals with the integers only. The text
+// of each name is stored once, and it never moves, so the views returned
+// by getString() stay valid as long as the interner lives.
+class StringInterner {
+  // The text of the names, allocated in big chunks.
+  std::vector<std::unique_ptr<char[]>> Chunks;
+  size_t ChunkUsed = 0;
+  size_t ChunkSize = 0;
+
+  // The index is the Symbol.
+  std::vector<std::string_view> Strings;
+  std::vector<uint32_t> Hashes;
+  // Open addressing (linear probing) hash table of the Symbols.
+  std::vector<Symbol> Slots;
+
+  // Set while the names may be added from many threads at once.
+  std::unique_ptr<std::shared_mutex> Lock;
+
+  size_t findSlot(std::string_view str, uint32_t hash) const;
+  void grow();
+  std::string_view store(std::string_view str);
+  Symbol internImpl(std::string_view str);
+  Symbol lookupImpl(std::string_view str) const;
+  std::string_view getStringLocked(Symbol sym) const;
+
+public:
+  StringInterner() = default;
+  StringInterner(const StringInterner &) = delete;
+  StringInterner &operator=(const StringInterner &) = delete;
+
+  // Returns the symbol for the name, adding it if needed.
+  Symbol intern(std::string_view str);
+  // Returns the symbol for the name, or InvalidSymbol if it isn't there.
+  Symbol lookup(std::string_view str) const;
+
+  std::string_view getString(Symbol sym) const {
+    if (Lock)
+      return getStringLocked(sym);
+    return Strings[sym];
+  }
+  size_t size() const { return Strings.size(); }
+
+  // Makes the interner safe to use from many threads at once (or turns
+  // it back off). This must not be called while the interner is in use.
+  void setConcurrent(bool concurrent);
+};
+
+// This maps the symbols to the values. The entries are kept in a dense
+// vector (iterated in the insertion order, except that an erase moves the
+// last entry into the hole), and they are found via an open addressing
+// hash table. The small tables (e.g. the successors) skip the hash table
+// and just scan the entries.
+template <typename ValueTy> class SymbolTable {
+public:
+  using Entry = std::pair<Symbol, ValueTy>;
+
+private:
+  static constexpr size_t SmallSize = 8;
+  static constexpr uint32_t EmptySlot = ~0u;
+
+  std::vector<Entry> Entries;
+  // The indices into the Entries. It is empty for the small tables.
+  std::vector<uint32_t> Slots;
+
+  size_t slotFor(Symbol sym) const {
+    return (static_cast<uint64_t>(sym) * 0x9E3779B97F4A7C15ull >> 32) &
+           (Slots.size() - 1);
+  }
+
+  // Returns the slot holding the sym, or the empty slot it would go to.
+  size_t findSlot(Symbol sym) const {
+    size_t slot = slotFor(sym);
+    while (Slots[slot] != EmptySlot && Entries[Slots[slot]].first != sym)
+      slot = (slot + 1) & (Slots.size() - 1);
+    return slot;
+  }
+
+  void rehash(size_t numOfSlots) {
+    Slots.assign(numOfSlots, EmptySlot);
+    for (uint32_t i = 0; i < Entries.size(); ++i)
+      Slots[findSlot(Entries[i].first)] = i;
+  }
+
+  // Returns the index of the entry, or -1.
+  ptrdiff_t find(Symbol sym) const {
+    if (Slots.empty()) {
+      for (size_t i = 0; i < Entries.size(); ++i)
+        if (Entries[i].first == sym)
+          return i;
+      return -1;
+    }
+    uint32_t idx = Slots[findSlot(sym)];
+    return idx == EmptySlot ? -1 : static_cast<ptrdiff_t>(idx);
+  }
+
+public:
+  using const_iterator = typename std::vector<Entry>::const_iterator;
+  const_iterator begin() const { return Entries.begin(); }
+  const_iterator end() const { return Entries.end(); }
+
+  size_t size() const { return Entries.size(); }
+  bool empty() const { return Entries.empty(); }
+  size_t count(Symbol sym) const { return find(sym) >= 0; }
+
+  // Returns the value for the sym, or the default value if it isn't there.
+  ValueTy lookup(Symbol sym) const {
+    ptrdiff_t idx = find(sym);
+    return idx < 0 ? ValueTy() : Entries[idx].second;
+  }
+
+  // Adds the entry. Returns false if the sym is already there.
+  bool insert(Symbol sym, ValueTy value) {
+    if (find(sym) >= 0)
+      return false;
+    Entries.emplace_back(sym, std::move(value));
+    if (Entries.size() > SmallSize && Entries.size() * 2 > Slots.size())
+      rehash(std::max<size_t>(Slots.size() * 2, 32));
+    else if (!Slots.empty())
+      Slots[findSlot(sym)] = Entries.size() - 1;
+    return true;
+  }
+
+  // Replaces the value of the entry, which must be there. The entries
+  // don't move.
+  void assign(Symbol sym, ValueTy value) {
+    ptrdiff_t idx = find(sym);
+    assert(idx >= 0 && "No entry for the symbol");
+    Entries[idx].second = std::move(value);
+  }
+
+  // Removes the entry. Returns false if the sym wasn't there.
+  bool erase(Symbol sym) {
+    ptrdiff_t idx = find(sym);
+    if (idx < 0)
+      return false;
+
+    size_t hole = Slots.empty() ? 0 : findSlot(sym);
+    size_t last = Entries.size() - 1;
+    if (static_cast<size_t>(idx) != last) {
+      // Move the last entry into the hole.
+      if (!Slots.empty())
+        Slots[findSlot(Entries[last].first)] = idx;
+      Entries[idx] = std::move(Entries[last]);
+    }
+    Entries.pop_back();
+
+    if (!Slots.empty()) {
+      // Backward shift deletion, so there are no tombstones.
+      size_t mask = Slots.size() - 1;
+      for (size_t slot = (hole + 1) & mask; Slots[slot] != EmptySlot;
+           slot = (slot + 1) & mask) {
+        size_t home = slotFor(Entries[Slots[slot]].first);
+        // Move the entry only if its home isn't within (hole, slot].
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+          Slots[hole] = Slots[slot];
+          hole = slot;
+        }
+      }
+      Slots[hole] = EmptySlot;
+    }
+    return true;
+  }
+
+  void reserve(size_t size) {
+    Entries.reserve(size);
+    if (size > SmallSize) {
+      size_t numOfSlots = 32;
+      while (numOfSlots < size * 2)
+        numOfSlots *= 2;
+      if (numOfSlots > Slots.size())
+        rehash(numOfSlots);
+    }
+  }
+
+  void clear() {
+    Entries.clear();
+    Slots.clear();
+  }
+
+  // Replaces each sym by the SymMap[sym] (e.g. the symbol of the same name
+  // within another interner), keeping the order of the entries. The map
+  // must not give two of the syms the same symbol.
+  void remapSymbols(const std::vector<Symbol> &SymMap) {
+    for (auto &E : Entries)
+      E.first = SymMap[E.first];
+    if (!Slots.empty())
+      rehash(Slots.size());
+  }
+
+  // Returns the entries ordered by their names. This is for the printing
+  // only, where the output should not depend on the order of the edits.
+  std::vector<const Entry *> sorted(const StringInterner &Names) const {
+    std::vector<const Entry *> Res;
+    Res.reserve(Entries.size());
+    for (const auto &E : Entries)
+      Res.push_back(&E);
+    std::sort(Res.begin(), Res.end(), [&Names](const Entry *a, const Entry *b) {
+      return Names.getString(a->first) < Names.getString(b->first);
+    });
+    return Res;
+  }
+};
+
+#endif // REVLANG_SYMBOLTABLE_H
@@ -0,0 +1,63 @@
+//=== A work-stealing thread pool for running the independent tasks.
+
+#ifndef REVLANG_THREADPOOL_H
+#define REVLANG_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// This runs the loops of the independent iterations over a fixed set of
+// threads. Each thread has its own deque of the iterations: it takes them
+// from the back of its own deque, and once that is empty, it steals from
+// the front of the deques of the others. So, the threads done with the
+// cheap iterations help with the expensive ones.
+class ThreadPool {
+  struct Worker {
+    std::mutex Lock;
+    std::deque<size_t> Tasks;
+  };
+
+  std::vector<std::thread> Threads;
+  // The Workers[0] is the thread calling the parallelFor().
+  std::vector<std::unique_ptr<Worker>> Workers;
+
+  std::mutex Lock;
+  std::condition_variable WakeUp;
+  std::condition_variable AllDone;
+  // The loop being run, and the number of its iterations not done yet.
+  const std::function<void(size_t)> *Job = nullptr;
+  std::atomic<size_t> NumOfPending{0};
+  uint64_t Generation = 0;
+  bool ShuttingDown = false;
+
+  bool takeTask(unsigned self, size_t &task);
+  void runTasks(unsigned self);
+  void workerMain(unsigned self);
+
+public:
+  // The calling thread counts as one of the threads, so the pool with a
+  // single thread runs everything inline.
+  explicit ThreadPool(unsigned numOfThreads);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  unsigned getNumOfThreads() const { return Workers.size(); }
+
+  // Runs the fn(i) for all the i in [0, n), and waits for all of them.
+  // The iterations may run in any order and on any of the threads.
+  void parallelFor(size_t n, const std::function<void(size_t)> &fn);
+
+  // Returns the number of the hardware threads (at least 1).
+  static unsigned getDefaultNumOfThreads();
+};
+
+#endif // REVLANG_THREADPOOL_H
@@ -0,0 +1,259 @@
+// === This contains the dataflow solver and the analyses (see the DataFlow.h).
+
+#include "DataFlow.h"
+#include "CFGTraversal.h"
+#include "Casting.h"
+
+#include <algorithm>
+
+BitVectorDataFlow::BitVectorDataFlow(const Function &f, Direction dir)
+    : F(f), Dir(dir), Positions(f.getMaxBBNumber(), -1) {}
+
+void BitVectorDataFlow::meet(const BasicBlock *BB, BitVector &Value) const {
+  Value.assign(false);
+  if (Dir == Direction::Forward) {
+    if (BB == F.getEntryBB())
+      initBoundary(Value);
+    for (BasicBlock *Pred : BB->predecessors()) {
+      int32_t pos = Positions[Pred->getNumber()];
+      if (pos >= 0)
+        Value |= Results[pos];
+    }
+    return;
+  }
+
+  if (!BB->getNumOfSuccessors())
+    initBoundary(Value);
+  for (BasicBlock *Succ : BB->successors())
+    Value |= Results[Positions[Succ->getNumber()]];
+}
+
+void BitVectorDataFlow::solve(size_t numOfFacts) {
+  NumOfFacts = numOfFacts;
+  Empty = BitVector(NumOfFacts);
+  if (!F.getEntryBB())
+    return;
+
+  for (BasicBlock *BB : post_order(F))
+    Order.push_back(BB);
+  if (Dir == Direction::Forward)
+    std::reverse(Order.begin(), Order.end());
+  for (size_t i = 0; i < Order.size(); ++i)
+    Positions[Order[i]->getNumber()] = i;
+  Results.assign(Order.size(), BitVector(NumOfFacts));
+
+  // The worklist is a bitvector over the positions, walked round and round
+  // in the order, so the changes go along the edges within a single sweep,
+  // and only the back edges take another one.
+  BitVector Pending(Order.size(), true);
+  BitVector Value(NumOfFacts);
+  ptrdiff_t pos = Pending.findFirst();
+  while (pos >= 0) {
+    Pending.reset(pos);
+    const BasicBlock *BB = Order[pos];
+    meet(BB, Value);
+    transfer(BB, Value);
+    if (Value != Results[pos]) {
+      Results[pos].swap(Value);
+      if (Dir == Direction::Forward) {
+        for (BasicBlock *Succ : BB->successors())
+          Pending.set(Positions[Succ->getNumber()]);
+      } else {
+        for (BasicBlock *Pred : BB->predecessors()) {
+          int32_t predPos = Positions[Pred->getNumber()];
+          if (predPos >= 0)
+            Pending.set(predPos);
+        }
+      }
+    }
+    pos = Pending.findNext(pos);
+    if (pos < 0)
+      pos = Pending.findFirst();
+  }
+}
+
+const BitVector &BitVectorDataFlow::getResult(const BasicBlock *BB) const {
+  assert(BB->getParent() == &F && "The bb is not within the function");
+  int32_t pos = Positions[BB->getNumber()];
+  return pos >= 0 ? Results[pos] : Empty;
+}
+
+BitVector BitVectorDataFlow::getMeet(const BasicBlock *BB) const {
+  assert(BB->getParent() == &F && "The bb is not within the function");
+  BitVector Value(NumOfFacts);
+  if (isReachable(BB))
+    meet(BB, Value);
+  return Value;
+}
+
+GlobalVariable *getWrittenVar(const Instruction *I) {
+  if (isa<Store>(I))
+    return I->getOperand(1);
+  if (isa<Add>(I))
+    return I->getOperand(0);
+  return nullptr;
+}
+
+// Calls the Fn on each var read by the instruction.
+template <typename FnTy> static void forEachReadVar(const Instruction *I,
+                                                     FnTy Fn) {
+  switch (I->getOpCodeKind()) {
+  case Instruction::OpCodeKind::Load:
+  case Instruction::OpCodeKind::Store:
+    Fn(I->getOperand(0));
+    break;
+  case Instruction::OpCodeKind::Add:
+    for (unsigned i = 1; i < I->getNumOfOps(); ++i)
+      Fn(I->getOperand(i));
+    break;
+  }
+}
+
+LiveVariables::LiveVariables(const Function &F)
+    : BitVectorDataFlow(F, Direction::Backward), Uses(F.getMaxBBNumber()),
+      Defs(F.getMaxBBNumber()) {
+  // The ids are usually dense, and then they are the facts themselves.
+  const auto &GVs = F.getParent()->getGlobalVars();
+  size_t numOfVars = GVs.size();
+  if (!GVs.empty() && size_t(GVs.rbegin()->first) + 1 != numOfVars) {
+    IDs.reserve(numOfVars);
+    for (const auto &GV : GVs)
+      IDs.push_back(GV.first);
+  }
+
+  // These are cleared after each bb, by the vars set.
+  BitVector Used(numOfVars), Defined(numOfVars);
+  for (const auto &Entry : F.getBasicBlocks()) {
+    const BasicBlock *BB = Entry.second;
+    auto &BBUses = Uses[BB->getNumber()];
+    auto &BBDefs = Defs[BB->getNumber()];
+    for (const Instruction *I : BB->instructions()) {
+      forEachReadVar(I, [&](const GlobalVariable *GV) {
+        uint32_t idx = getVarIndex(GV);
+        if (!Defined.test(idx) && !Used.testAndSet(idx))
+          BBUses.push_back(idx);
+      });
+      if (const GlobalVariable *GV = getWrittenVar(I)) {
+        uint32_t idx = getVarIndex(GV);
+        if (!Defined.testAndSet(idx))
+          BBDefs.push_back(idx);
+      }
+    }
+    for (uint32_t id : BBUses)
+      Used.reset(id);
+    for (uint32_t id : BBDefs)
+      Defined.reset(id);
+  }
+
+  solve(numOfVars);
+}
+
+void LiveVariables::transfer(const BasicBlock *BB, BitVector &Value) const {
+  for (uint32_t id : Defs[BB->getNumber()])
+    Value.reset(id);
+  for (uint32_t id : Uses[BB->getNumber()])
+    Value.set(id);
+}
+
+void LiveVariables::initBoundary(BitVector &Value) const { Value.assign(true); }
+
+void LiveVariables::stepBackward(const Instruction *I,
+                                 BitVector &Live) const {
+  if (const GlobalVariable *GV = getWrittenVar(I))
+    Live.reset(getVarIndex(GV));
+  forEachReadVar(I,
+                 [&](const GlobalVariable *GV) { Live.set(getVarIndex(GV)); });
+}
+
+ReachingStores::ReachingStores(const Function &F)
+    : BitVectorDataFlow(F, Direction::Forward),
+      Kills(F.getMaxBBNumber()), Gens(F.getMaxBBNumber()) {
+  // The vars are numbered as they are first written, so the sparse ids
+  // don't take the space.
+  auto getVarNumber = [this](const GlobalVariable *GV) {
+    auto Res = WrittenVars.emplace(GV, WrittenVars.size());
+    if (Res.second)
+      StoresOf.emplace_back();
+    return Res.first->second;
+  };
+  // This is cleared after each bb, by the vars killed.
+  BitVector Written;
+  for (const auto &Entry : F.getBasicBlocks()) {
+    const BasicBlock *BB = Entry.second;
+    const auto &Instrs = BB->instructions();
+    // The STOREs of the bb get the consecutive indices.
+    for (const Instruction *I : Instrs)
+      if (const auto *S = dyn_cast<Store>(I)) {
+        StoresOf[getVarNumber(S->getOperand(1))].push_back(Stores.size());
+        Stores.push_back(S);
+      }
+
+    // Only the last write of each var within the bb counts.
+    auto &BBKills = Kills[BB->getNumber()];
+    auto &BBGens = Gens[BB->getNumber()];
+    uint32_t storeIdx = Stores.size();
+    for (auto I = Instrs.rbegin(); I != Instrs.rend(); ++I) {
+      const GlobalVariable *GV = getWrittenVar(*I);
+      if (!GV)
+        continue;
+      bool isStore = isa<Store>(*I);
+      storeIdx -= isStore;
+      uint32_t var = getVarNumber(GV);
+      if (var >= Written.size())
+        Written.resize(WrittenVars.size());
+      if (Written.testAndSet(var))
+        continue;
+      BBKills.push_back(var);
+      if (isStore)
+        BBGens.push_back(storeIdx);
+    }
+    for (uint32_t var : BBKills)
+      Written.reset(var);
+  }
+
+  solve(Stores.size());
+}
+
+void ReachingStores::transfer(const BasicBlock *BB, BitVector &Value) const {
+  for (uint32_t var : Kills[BB->getNumber()])
+    for (uint32_t idx : StoresOf[var])
+      Value.reset(idx);
+  for (uint32_t idx : Gens[BB->getNumber()])
+    Value.set(idx);
+}
+
+void ReachingStores::initBoundary(BitVector &) const {
+  // Nothing within the function reaches its start.
+}
+
+std::vector<const Store *>
+ReachingStores::getReachingStores(const Instruction *I,
+                                  const GlobalVariable *GV) const {
+  std::vector<const Store *> Result;
+  const BasicBlock *BB = I->getParent();
+  if (!isReachable(BB))
+    return Result;
+
+  // The last write of the GV before the I (within the bb) is the only one.
+  const Instruction *LastWrite = nullptr;
+  for (const Instruction *Prev : BB->instructions()) {
+    if (Prev == I)
+      break;
+    if (getWrittenVar(Prev) == GV)
+      LastWrite = Prev;
+  }
+  if (LastWrite) {
+    if (const auto *S = dyn_cast<Store>(LastWrite))
+      Result.push_back(S);
+    return Result;
+  }
+
+  BitVector In = getReachingIn(BB);
+  auto Var = WrittenVars.find(GV);
+  if (Var == WrittenVars.end())
+    return Result;
+  for (uint32_t idx : StoresOf[Var->second])
+    if (In.test(idx))
+      Result.push_back(Stores[idx]);
+  return Result;
+}
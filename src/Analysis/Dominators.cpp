@@ -0,0 +1,116 @@
+// === This contains the dominator analyses (see the Dominators.h).
+
+#include "Dominators.h"
+#include "CFGTraversal.h"
+
+#include <utility>
+
+DominatorTree::DominatorTree(const Function &f)
+    : F(f), CFGEpoch(f.getCFGEpoch()), IDoms(f.getMaxBBNumber()),
+      Children(f.getMaxBBNumber()), DFSIn(f.getMaxBBNumber()),
+      DFSOut(f.getMaxBBNumber()) {
+  if (!F.getEntryBB())
+    return;
+  for (BasicBlock *BB : ReversePostOrderTraversal(F))
+    RPO.push_back(BB);
+
+  // The idoms are kept as the positions within the RPO while they are
+  // computed, so the intersect() can walk up by comparing them.
+  const int32_t Undefined = -1;
+  std::vector<int32_t> Positions(F.getMaxBBNumber(), Undefined);
+  for (size_t i = 0; i < RPO.size(); ++i)
+    Positions[RPO[i]->getNumber()] = i;
+  std::vector<int32_t> IDomPos(RPO.size(), Undefined);
+  IDomPos[0] = 0;
+  auto intersect = [&IDomPos](int32_t a, int32_t b) {
+    while (a != b) {
+      while (a > b)
+        a = IDomPos[a];
+      while (b > a)
+        b = IDomPos[b];
+    }
+    return a;
+  };
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 1; i < RPO.size(); ++i) {
+      int32_t newIDom = Undefined;
+      for (BasicBlock *Pred : RPO[i]->predecessors()) {
+        int32_t pos = Positions[Pred->getNumber()];
+        if (pos == Undefined || IDomPos[pos] == Undefined)
+          continue;
+        newIDom = newIDom == Undefined ? pos : intersect(pos, newIDom);
+      }
+      if (IDomPos[i] != newIDom) {
+        IDomPos[i] = newIDom;
+        changed = true;
+      }
+    }
+  }
+
+  for (size_t i = 1; i < RPO.size(); ++i) {
+    BasicBlock *IDom = RPO[IDomPos[i]];
+    IDoms[RPO[i]->getNumber()] = IDom;
+    Children[IDom->getNumber()].push_back(RPO[i]);
+  }
+
+  // Number the tree, without the recursion (the trees may be deep).
+  uint32_t number = 0;
+  std::vector<std::pair<const BasicBlock *, size_t>> Stack;
+  Stack.push_back({RPO[0], 0});
+  DFSIn[RPO[0]->getNumber()] = ++number;
+  while (!Stack.empty()) {
+    auto &Top = Stack.back();
+    const auto &TopChildren = Children[Top.first->getNumber()];
+    if (Top.second == TopChildren.size()) {
+      DFSOut[Top.first->getNumber()] = ++number;
+      Stack.pop_back();
+      continue;
+    }
+    const BasicBlock *Child = TopChildren[Top.second++];
+    DFSIn[Child->getNumber()] = ++number;
+    Stack.push_back({Child, 0});
+  }
+}
+
+bool DominatorTree::dominates(const BasicBlock *A, const BasicBlock *B) const {
+  assert(A->getParent() == &F && B->getParent() == &F &&
+         "The bbs are not within the function");
+  if (!isReachable(A) || !isReachable(B))
+    return false;
+  return DFSIn[A->getNumber()] <= DFSIn[B->getNumber()] &&
+         DFSOut[B->getNumber()] <= DFSOut[A->getNumber()];
+}
+
+BasicBlock *
+DominatorTree::findNearestCommonDominator(const BasicBlock *A,
+                                          const BasicBlock *B) const {
+  if (!isReachable(A) || !isReachable(B))
+    return nullptr;
+  while (!dominates(A, B))
+    A = getIDom(A);
+  return const_cast<BasicBlock *>(A);
+}
+
+DominanceFrontier::DominanceFrontier(const DominatorTree &DT)
+    : Frontiers(DT.getFunction().getMaxBBNumber()) {
+  // Each predecessor of the bb, and its dominators up to the idom of the
+  // bb, have the bb within their frontiers. All the bbs added for a bb are
+  // added in a row, so checking the last one is enough to skip the dups.
+  for (BasicBlock *BB : DT.getReversePostOrder()) {
+    BasicBlock *IDom = DT.getIDom(BB);
+    for (BasicBlock *Pred : BB->predecessors()) {
+      if (!DT.isReachable(Pred))
+        continue;
+      for (BasicBlock *Runner = Pred; Runner != IDom;
+           Runner = DT.getIDom(Runner)) {
+        auto &Frontier = Frontiers[Runner->getNumber()];
+        if (!Frontier.empty() && Frontier.back() == BB)
+          break;
+        Frontier.push_back(BB);
+      }
+    }
+  }
+}
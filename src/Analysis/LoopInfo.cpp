@@ -0,0 +1,83 @@
+// === This contains the loop analysis (see the LoopInfo.h).
+
+#include "LoopInfo.h"
+#include "BitVector.h"
+
+bool Loop::contains(const Loop *L) const {
+  for (; L; L = L->ParentLoop)
+    if (L == this)
+      return true;
+  return false;
+}
+
+// Returns the outermost loop the L is nested in.
+static Loop *getOutermostLoop(Loop *L) {
+  while (Loop *Parent = L->getParentLoop())
+    L = Parent;
+  return L;
+}
+
+LoopInfo::LoopInfo(const DominatorTree &DT)
+    : LoopFor(DT.getFunction().getMaxBBNumber()) {
+  const auto &RPO = DT.getReversePostOrder();
+
+  // The header dominates the bbs of its loop, so it comes before them in
+  // the reverse postorder. Walking the headers backward finds the inner
+  // loops first, and the outer ones just take them as the subloops.
+  std::vector<BasicBlock *> Worklist;
+  // The latches of the header at hand, by the bb number.
+  BitVector IsLatch(DT.getFunction().getMaxBBNumber());
+  for (auto H = RPO.rbegin(); H != RPO.rend(); ++H) {
+    BasicBlock *Header = *H;
+    // NOTE: A bb branching to the header via two tags is its pred twice.
+    for (BasicBlock *Pred : Header->predecessors())
+      if (DT.dominates(Header, Pred) && !IsLatch.test(Pred->getNumber())) {
+        IsLatch.set(Pred->getNumber());
+        Worklist.push_back(Pred);
+      }
+    if (Worklist.empty())
+      continue;
+
+    Loops.push_back(std::make_unique<Loop>(Header));
+    Loop *L = Loops.back().get();
+    L->Latches = Worklist;
+    for (BasicBlock *Latch : Worklist)
+      IsLatch.reset(Latch->getNumber());
+    // Go backward from the latches up to the header. The bbs of the inner
+    // loops are skipped over, by going straight to their headers.
+    while (!Worklist.empty()) {
+      BasicBlock *BB = Worklist.back();
+      Worklist.pop_back();
+      Loop *&BBLoop = LoopFor[BB->getNumber()];
+      if (!BBLoop) {
+        BBLoop = L;
+        if (BB == Header)
+          continue;
+        for (BasicBlock *Pred : BB->predecessors())
+          if (DT.isReachable(Pred))
+            Worklist.push_back(Pred);
+        continue;
+      }
+
+      Loop *SubLoop = getOutermostLoop(BBLoop);
+      if (SubLoop == L)
+        continue;
+      SubLoop->ParentLoop = L;
+      L->SubLoops.push_back(SubLoop);
+      for (BasicBlock *Pred : SubLoop->Header->predecessors())
+        if (DT.isReachable(Pred) && !SubLoop->contains(getLoopFor(Pred)))
+          Worklist.push_back(Pred);
+    }
+  }
+
+  // The outer loops come after the inner ones.
+  for (auto L = Loops.rbegin(); L != Loops.rend(); ++L) {
+    if (Loop *Parent = (*L)->ParentLoop)
+      (*L)->Depth = Parent->Depth + 1;
+    else
+      TopLevelLoops.push_back(L->get());
+  }
+  for (BasicBlock *BB : RPO)
+    for (Loop *L = getLoopFor(BB); L; L = L->ParentLoop)
+      L->Blocks.push_back(BB);
+}
@@ -0,0 +1,239 @@
+// === This contains the implementation of the bitcode reader.
+
+#include "Bitcode.h"
+#include "MappedFile.h"
+
+#include <cstring>
+
+namespace {
+
+// This decodes the varints and the byte ranges out of a buffer. Once
+// something goes wrong, all the reads return zeros, and hasError() is true.
+class BitcodeCursor {
+  const unsigned char *Cur;
+  const unsigned char *End;
+  bool Error = false;
+
+public:
+  BitcodeCursor(std::string_view buffer)
+      : Cur(reinterpret_cast<const unsigned char *>(buffer.data())),
+        End(Cur + buffer.size()) {}
+
+  bool hasError() const { return Error; }
+  bool atEnd() const { return Cur == End; }
+  size_t remaining() const { return End - Cur; }
+
+  uint64_t readVarint() {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64 && Cur != End; shift += 7) {
+      unsigned char byte = *Cur++;
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+    Error = true;
+    Cur = End;
+    return 0;
+  }
+
+  std::string_view readBytes(uint64_t size) {
+    if (size > remaining()) {
+      Error = true;
+      Cur = End;
+      return std::string_view();
+    }
+    std::string_view bytes(reinterpret_cast<const char *>(Cur), size);
+    Cur += size;
+    return bytes;
+  }
+};
+
+bool malformed(std::string &errMsg, const std::string &what) {
+  errMsg = "malformed bitcode: " + what;
+  return false;
+}
+
+} // end anonymous namespace
+
+bool BitcodeView::init(std::string_view buffer, std::string &errMsg) {
+  if (buffer.size() < sizeof(BitcodeMagic) ||
+      std::memcmp(buffer.data(), BitcodeMagic, sizeof(BitcodeMagic)))
+    return malformed(errMsg, "invalid magic");
+
+  BitcodeCursor C(buffer.substr(sizeof(BitcodeMagic)));
+  if (C.readVarint() != BitcodeVersion)
+    return malformed(errMsg, "unsupported version");
+
+  // Each string takes at least a byte, so this bounds the reserve().
+  uint64_t numOfStrings = C.readVarint();
+  if (numOfStrings > C.remaining())
+    return malformed(errMsg, "invalid string table");
+  Strings.clear();
+  Strings.reserve(numOfStrings);
+  for (uint64_t i = 0; i < numOfStrings && !C.hasError(); ++i)
+    Strings.push_back(C.readBytes(C.readVarint()));
+
+  uint64_t moduleID = C.readVarint();
+  if (C.hasError() || moduleID >= Strings.size())
+    return malformed(errMsg, "invalid module ID");
+  ModuleID = Strings[moduleID];
+
+  // The var table is decoded by the materialize() only, but we need to
+  // find its end.
+  NumOfVars = C.readVarint();
+  if (NumOfVars > C.remaining())
+    return malformed(errMsg, "invalid var table");
+  std::string_view rest = buffer.substr(buffer.size() - C.remaining());
+  for (uint64_t i = 0; i < NumOfVars; ++i)
+    C.readVarint();
+  Vars = rest.substr(0, rest.size() - C.remaining());
+
+  uint64_t numOfFns = C.readVarint();
+  if (C.hasError() || numOfFns > C.remaining())
+    return malformed(errMsg, "invalid function table");
+  Functions.clear();
+  Functions.reserve(numOfFns);
+  for (uint64_t i = 0; i < numOfFns; ++i) {
+    FunctionInfo Info;
+    Info.Record = C.readBytes(C.readVarint());
+    BitcodeCursor RecC(Info.Record);
+    uint64_t name = RecC.readVarint();
+    Info.NumOfBBs = RecC.readVarint();
+    if (C.hasError() || RecC.hasError() || name >= Strings.size())
+      return malformed(errMsg, "invalid function record");
+    Info.Name = Strings[name];
+    Functions.push_back(Info);
+  }
+
+  if (!C.atEnd())
+    return malformed(errMsg, "unexpected data after the functions");
+  return true;
+}
+
+std::unique_ptr<Module> BitcodeView::materialize(std::string &errMsg) const {
+  auto M = Module::create(std::string(ModuleID), /*useArena=*/true);
+
+  // The operands are referring to the vars by their index in the table.
+  std::vector<GlobalVariable *> VarsByIndex;
+  VarsByIndex.reserve(NumOfVars);
+  BitcodeCursor VarsC(Vars);
+  uint64_t id = 0;
+  for (uint64_t i = 0; i < NumOfVars; ++i) {
+    uint64_t delta = VarsC.readVarint();
+    // The delta is checked before the sum, so the sum cannot wrap around.
+    if ((i && !delta) || delta > UINT32_MAX - id) {
+      malformed(errMsg, "invalid var ID");
+      return nullptr;
+    }
+    id += delta;
+    VarsByIndex.push_back(
+        GlobalVariable::create(static_cast<unsigned>(id), M.get()).release());
+  }
+
+  std::vector<BasicBlock *> BBs;
+  OperandsTy Ops;
+  for (const auto &Info : Functions) {
+    std::string fnName(Info.Name);
+    if (M->getFunction(Info.Name)) {
+      malformed(errMsg, "redefinition of function '" + fnName + "'");
+      return nullptr;
+    }
+    // The handles don't own the objects, since the Module uses the arena.
+    auto *F = Function::create(Info.Name, M.get()).release();
+
+    BitcodeCursor C(Info.Record);
+    C.readVarint();
+    C.readVarint();
+    uint64_t entry = C.readVarint();
+    // Each bb takes at least two bytes.
+    if (Info.NumOfBBs > C.remaining() || entry > Info.NumOfBBs) {
+      malformed(errMsg, "invalid basic blocks in '" + fnName + "'");
+      return nullptr;
+    }
+
+    BBs.clear();
+    BBs.reserve(Info.NumOfBBs);
+    for (uint64_t i = 0; i < Info.NumOfBBs; ++i) {
+      uint64_t name = C.readVarint();
+      if (C.hasError() || name >= Strings.size()) {
+        malformed(errMsg, "invalid basic block in '" + fnName + "'");
+        return nullptr;
+      }
+      if (F->getBasicBlock(Strings[name])) {
+        malformed(errMsg, "redefinition of basic block '" +
+                              std::string(Strings[name]) + "'");
+        return nullptr;
+      }
+      auto *BB = BasicBlock::create(Strings[name], F, entry == i + 1).release();
+      BBs.push_back(BB);
+
+      uint64_t numOfInstrs = C.readVarint();
+      for (uint64_t j = 0; j < numOfInstrs && !C.hasError(); ++j) {
+        uint64_t opcode = C.readVarint();
+        uint64_t numOfOps = opcode == 0 ? 1 : opcode == 1 ? 2 : C.readVarint();
+        if (opcode > 2 || (opcode == 2 && numOfOps < 3) ||
+            numOfOps > C.remaining()) {
+          malformed(errMsg, "invalid instruction in '" + fnName + "'");
+          return nullptr;
+        }
+        Ops.clear();
+        for (uint64_t k = 0; k < numOfOps; ++k) {
+          uint64_t var = C.readVarint();
+          if (var >= VarsByIndex.size()) {
+            malformed(errMsg, "invalid operand in '" + fnName + "'");
+            return nullptr;
+          }
+          Ops.push_back(VarsByIndex[var]);
+        }
+        if (opcode == 0)
+          Load::create(Ops, BB);
+        else if (opcode == 1)
+          Store::create(Ops, BB);
+        else
+          Add::create(Ops, BB);
+      }
+    }
+
+    uint64_t numOfEdges = C.readVarint();
+    for (uint64_t i = 0; i < numOfEdges && !C.hasError(); ++i) {
+      uint64_t from = C.readVarint();
+      uint64_t tag = C.readVarint();
+      uint64_t to = C.readVarint();
+      if (from >= BBs.size() || to >= BBs.size() || tag >= Strings.size()) {
+        malformed(errMsg, "invalid edge in '" + fnName + "'");
+        return nullptr;
+      }
+      if (BBs[from]->getSuccessor(Strings[tag])) {
+        malformed(errMsg, "duplicate successor tag in '" + fnName + "'");
+        return nullptr;
+      }
+      BBs[from]->addSuccessor(Strings[tag], BBs[to]);
+    }
+
+    if (C.hasError() || !C.atEnd()) {
+      malformed(errMsg, "invalid function record '" + fnName + "'");
+      return nullptr;
+    }
+  }
+
+  return M;
+}
+
+std::unique_ptr<Module> readBitcodeBuffer(std::string_view buffer,
+                                          std::string &errMsg) {
+  BitcodeView View;
+  if (!View.init(buffer, errMsg))
+    return nullptr;
+  return View.materialize(errMsg);
+}
+
+std::unique_ptr<Module> readBitcodeFile(const std::string &filename,
+                                        std::string &errMsg) {
+  MappedFile File;
+  if (!File.open(filename, errMsg))
+    return nullptr;
+  auto M = readBitcodeBuffer(File.getBuffer(), errMsg);
+  if (!M)
+    errMsg = filename + ": " + errMsg;
+  return M;
+}
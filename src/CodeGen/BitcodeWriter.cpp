@@ -0,0 +1,140 @@
+// === This contains the implementation of the bitcode writer.
+
+#include "Bitcode.h"
+
+#include <cassert>
+#include <fstream>
+#include <ostream>
+#include <unordered_map>
+
+namespace {
+
+void emitVarint(std::string &buf, uint64_t value) {
+  while (value >= 0x80) {
+    buf.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  buf.push_back(static_cast<char>(value));
+}
+
+class BitcodeWriter {
+  const Module &M;
+
+  // The names are pointing into the IR objects, which are alive while
+  // writing.
+  std::vector<std::string_view> Strings;
+  std::unordered_map<std::string_view, uint64_t> StringIDs;
+  std::unordered_map<const GlobalVariable *, uint64_t> VarIndices;
+  std::unordered_map<const BasicBlock *, uint64_t> BBIndices;
+
+  uint64_t getStringID(std::string_view str) {
+    auto Res = StringIDs.insert({str, Strings.size()});
+    if (Res.second)
+      Strings.push_back(str);
+    return Res.first->second;
+  }
+
+  void writeInstruction(std::string &buf, const Instruction &I) {
+    auto Ops = I.getOps();
+    switch (I.getOpCodeKind()) {
+    case Instruction::OpCodeKind::Load:
+      emitVarint(buf, 0);
+      break;
+    case Instruction::OpCodeKind::Store:
+      emitVarint(buf, 1);
+      break;
+    case Instruction::OpCodeKind::Add:
+      emitVarint(buf, 2);
+      emitVarint(buf, Ops.size());
+      break;
+    }
+    for (const auto *Op : Ops)
+      emitVarint(buf, VarIndices.at(Op));
+  }
+
+  void writeFunction(std::string &buf, const Function &F) {
+    auto &BBs = F.getBasicBlocks();
+    BBIndices.clear();
+    for (const auto &BB : BBs)
+      BBIndices.insert({BB.second, BBIndices.size()});
+
+    std::string Rec;
+    emitVarint(Rec, getStringID(F.getFnID()));
+    emitVarint(Rec, BBs.size());
+    emitVarint(Rec, F.getEntryBB() ? BBIndices.at(F.getEntryBB()) + 1 : 0);
+
+    uint64_t numOfEdges = 0;
+    for (const auto &BB : BBs) {
+      emitVarint(Rec, getStringID(BB.second->getBBID()));
+      emitVarint(Rec, BB.second->getNumOfInstrs());
+      for (const auto *I : BB.second->instructions())
+        writeInstruction(Rec, *I);
+      numOfEdges += BB.second->getNumOfSuccessors();
+    }
+
+    emitVarint(Rec, numOfEdges);
+    for (const auto &BB : BBs) {
+      for (const auto &S : BB.second->getSuccessors()) {
+        assert(BBIndices.count(S.second) && "Dangling successor");
+        emitVarint(Rec, BBIndices.at(BB.second));
+        emitVarint(Rec, getStringID(M.getSymbols().getString(S.first)));
+        emitVarint(Rec, BBIndices.at(S.second));
+      }
+    }
+
+    emitVarint(buf, Rec.size());
+    buf += Rec;
+  }
+
+public:
+  BitcodeWriter(const Module &m) : M(m) {}
+
+  std::string write() {
+    // The string table goes first, but we know all the strings once the
+    // rest is encoded.
+    std::string Body;
+    emitVarint(Body, getStringID(M.getModuleID()));
+
+    auto &GVs = M.getGlobalVars();
+    emitVarint(Body, GVs.size());
+    uint64_t prevID = 0;
+    for (const auto &GV : GVs) {
+      emitVarint(Body, GV.first - prevID);
+      prevID = GV.first;
+      VarIndices.insert({GV.second, VarIndices.size()});
+    }
+
+    auto &Fns = M.getFunctions();
+    emitVarint(Body, Fns.size());
+    for (const auto &F : Fns)
+      writeFunction(Body, *F.second);
+
+    std::string Out(BitcodeMagic, sizeof(BitcodeMagic));
+    emitVarint(Out, BitcodeVersion);
+    emitVarint(Out, Strings.size());
+    for (auto str : Strings) {
+      emitVarint(Out, str.size());
+      Out.append(str.data(), str.size());
+    }
+    Out += Body;
+    return Out;
+  }
+};
+
+} // end anonymous namespace
+
+bool Module::writeBitcode(std::ostream &OS) const {
+  std::string Out = BitcodeWriter(*this).write();
+  OS.write(Out.data(), Out.size());
+  return static_cast<bool>(OS);
+}
+
+bool Module::writeBitcode(const std::string &filename) const {
+  std::ofstream File(filename, std::ios::binary);
+  if (!File)
+    return false;
+  if (!writeBitcode(File))
+    return false;
+  File.close();
+  return static_cast<bool>(File);
+}
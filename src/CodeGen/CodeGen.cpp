@@ -1,11 +1,90 @@
 // === This contains the implementation of the revLANG IR constructs.
 
 #include "CodeGen.h"
+#include "Arena.h"
+#include "CFGTraversal.h"
+#include "OutputStream.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+//
+// The Module arena. There is a slab allocator per kind of the IR object.
+//
+
+class IRArena {
+public:
+  SlabAllocator<GlobalVariable> GlobalVariables;
+  SlabAllocator<Function> Functions;
+  SlabAllocator<BasicBlock> BasicBlocks;
+  SlabAllocator<Load> Loads;
+  SlabAllocator<Store> Stores;
+  SlabAllocator<Add> Adds;
+  // The operands of the ADDs that don't fit into the inline storage.
+  BumpAllocator Operands;
+};
+
+// Returns the arena of the module the bb belongs to (if any).
+static IRArena *getArenaFor(BasicBlock *bb) {
+  return bb->getParent()->getParent()->getArena();
+}
+
+//
+// The locks used while the functions are changed in parallel. They are
+// taken in this order: the Arena, the (interner's) names, the UseLists.
+//
+
+class ModuleLocks {
+public:
+  static constexpr unsigned NumOfUseListShards = 64;
+
+  std::mutex Arena;
+  // The use lists of the vars, sharded by the var id.
+  std::mutex UseLists[NumOfUseListShards];
+};
+
+static std::unique_lock<std::mutex> lockArena(const Module *M) {
+  if (auto *Locks = M->getLocks())
+    return std::unique_lock<std::mutex>(Locks->Arena);
+  return std::unique_lock<std::mutex>();
+}
+
+// Returns the lock of the use list of the var (or nullptr).
+static std::mutex *getUseListLock(const GlobalVariable *GV) {
+  if (auto *Locks = GV->getParent()->getLocks())
+    return &Locks->UseLists[GV->getID() % ModuleLocks::NumOfUseListShards];
+  return nullptr;
+}
+
+static std::unique_lock<std::mutex> lockUseList(const GlobalVariable *GV) {
+  if (auto *Lock = getUseListLock(GV))
+    return std::unique_lock<std::mutex>(*Lock);
+  return std::unique_lock<std::mutex>();
+}
+
+// Locks the use lists of both of the vars. They may share the lock, and
+// the locks are taken in the order of their addresses.
+static std::pair<std::unique_lock<std::mutex>, std::unique_lock<std::mutex>>
+lockUseLists(const GlobalVariable *A, const GlobalVariable *B) {
+  std::mutex *First = getUseListLock(A);
+  std::mutex *Second = getUseListLock(B);
+  if (First == Second)
+    Second = nullptr;
+  else if (First && Second && Second < First)
+    std::swap(First, Second);
+  std::pair<std::unique_lock<std::mutex>, std::unique_lock<std::mutex>> Res;
+  if (First)
+    Res.first = std::unique_lock<std::mutex>(*First);
+  if (Second)
+    Res.second = std::unique_lock<std::mutex>(*Second);
+  return Res;
+}
 
 //
 // Implementation of the GlobalVariable class.
@@ -17,9 +96,13 @@ GlobalVariable::GlobalVariable(unsigned id, Module *parent) {
   ID = id;
 }
 
-std::unique_ptr<GlobalVariable> GlobalVariable::create(unsigned id,
-                                           Module *parent) {
-  auto GV = std::make_unique<GlobalVariable>(id, parent);
+IRPtr<GlobalVariable> GlobalVariable::create(unsigned id, Module *parent) {
+  IRPtr<GlobalVariable> GV;
+  if (auto *arena = parent->getArena())
+    GV = IRPtr<GlobalVariable>(arena->GlobalVariables.create(id, parent),
+                               IRDeleter<GlobalVariable>(true));
+  else
+    GV = IRPtr<GlobalVariable>(new GlobalVariable(id, parent));
   parent->addGlobalVar(id, GV.get());
   return GV;
 }
@@ -32,70 +115,258 @@ Module *GlobalVariable::getParent() const {
   return Parent;
 }
 
+size_t GlobalVariable::getNumUses() const {
+  return std::distance(use_begin(), use_end());
+}
+
+void GlobalVariable::replaceAllUsesWith(GlobalVariable *GV) {
+  assert(GV != this && "Cannot replace the var with itself");
+  if (!UseList)
+    return;
+  auto Locks = lockUseLists(this, GV);
+  // The uses are rewritten in place, and then the whole list is spliced
+  // into the list of the GV, so the uses are not unlinked one by one.
+  Use *Last = UseList;
+  for (Use *U = UseList; U; U = U->Next) {
+    U->Val = GV;
+    U->User->getParent()->bumpEpoch();
+    Last = U;
+  }
+  Last->Next = GV->UseList;
+  if (GV->UseList)
+    GV->UseList->Prev = &Last->Next;
+  UseList->Prev = &GV->UseList;
+  GV->UseList = UseList;
+  UseList = nullptr;
+}
+
+void GlobalVariable::print(OutputStream &OS) const {
+  OS << "var !" << ID << '\n';
+}
+
 void GlobalVariable::dump() const {
-  std::cout << "var !" << ID << "\n";
+  StdOutputStream OS(std::cout);
+  print(OS);
+}
+
+//
+// Implementation of the Use class.
+//
+
+void Use::addToList(Use **head) {
+  Next = *head;
+  if (Next)
+    Next->Prev = &Next;
+  Prev = head;
+  *head = this;
+}
+
+void Use::removeFromList() {
+  *Prev = Next;
+  if (Next)
+    Next->Prev = Prev;
+  Next = nullptr;
+  Prev = nullptr;
+}
+
+void Use::set(GlobalVariable *GV) {
+  if (Val) {
+    auto Lock = lockUseList(Val);
+    removeFromList();
+  }
+  Val = GV;
+  if (GV) {
+    auto Lock = lockUseList(GV);
+    addToList(&GV->UseList);
+  }
 }
 
 //
 // Implementation of the Instructions classes.
 //
 
-Load::Load (OperandsTy& ops, BasicBlock *parent) {
+std::string_view Instruction::getOpCodeName(OpCodeKind opCode) {
+  switch (opCode) {
+  case OpCodeKind::Load:
+    return "LOAD";
+  case OpCodeKind::Store:
+    return "STORE";
+  case OpCodeKind::Add:
+    return "ADD";
+  }
+  assert(false && "Unknown opcode");
+  return "";
+}
+
+void Instruction::dump() const {
+  StdOutputStream OS(std::cout);
+  print(OS);
+}
+
+#ifdef REVLANG_ENABLE_STATS
+// The size of the objects of the kind, for the statistics.
+static size_t getInstrSize(Instruction::OpCodeKind kind) {
+  switch (kind) {
+  case Instruction::OpCodeKind::Load:
+    return sizeof(Load);
+  case Instruction::OpCodeKind::Store:
+    return sizeof(Store);
+  case Instruction::OpCodeKind::Add:
+    return sizeof(Add);
+  }
+  return 0;
+}
+#endif
+
+Instruction::Instruction(OpCodeKind opCode, BasicBlock *parent)
+    : Parent(parent), OpCode(opCode), 
+      ArenaOwned(getArenaFor(parent) != nullptr) {
+  REVLANG_GAUGE_INC(Instruction, getInstrSize(opCode));
+}
+
+Instruction::~Instruction() {
+  // This is a no-op for the instructions removed from their bbs.
+  if (!ArenaOwned)
+    dropAllReferences();
+  REVLANG_GAUGE_DEC(Instruction, getInstrSize(OpCode));
+}
+
+void Instruction::initOps(Use *storage, OperandsRef ops) {
+  Ops = storage;
+  NumOfOps = ops.size();
+  for (unsigned i = 0; i < NumOfOps; ++i) {
+    Ops[i].User = this;
+    Ops[i].set(ops[i]);
+  }
+}
+
+void Instruction::setOperand(unsigned idx, GlobalVariable *GV) {
+  assert(idx < NumOfOps && "Out of bounds");
+  Parent->prepareForWrite();
+  Ops[idx].set(GV);
+  Parent->bumpEpoch();
+}
+
+void Instruction::dropAllReferences() {
+  for (unsigned i = 0; i < NumOfOps; ++i)
+    Ops[i].set(nullptr);
+}
+
+Load::Load (OperandsRef ops, BasicBlock *parent)
+    : Instruction(OpCodeKind::Load, parent) {
   assert(ops.size() == 1 && "Load must have 1 operand");
-  // Set up the parent fields.
-  Ops = ops;
-  Parent = parent;
-  OpCode = "LOAD";
+  initOps(InlineOps, ops);
   Parent->addInstruction(this);
 }
 
-void Load::dump() const {
-  std::cout << "    ";
-  std::cout << OpCode << " ";
-  std::cout << "var !" << Ops[0]->getID() << '\n';
+IRPtr<Load> Load::create(OperandsRef ops, BasicBlock *parent) {
+  if (auto *arena = getArenaFor(parent)) {
+    // The clones sharing the instructions take their copies first, since
+    // they are allocated from the same arena.
+    parent->unshareInstructions();
+    auto Lock = lockArena(parent->getParent()->getParent());
+    return IRPtr<Load>(arena->Loads.create(ops, parent),
+                       IRDeleter<Load>(true));
+  }
+  return IRPtr<Load>(new Load(ops, parent));
 }
 
-Store::Store (OperandsTy& ops, BasicBlock *parent) {
+void Load::print(OutputStream &OS) const {
+  OS << "    " << getOpCode() << " var !" << Ops[0].get()->getID() << '\n';
+}
+
+Store::Store (OperandsRef ops, BasicBlock *parent)
+    : Instruction(OpCodeKind::Store, parent) {
   assert(ops.size() == 2 && "Store must have 2 operands");
-  // Set up the parent fields.
-  Ops = ops;
-  Parent = parent;
-  OpCode = "STORE";
+  initOps(InlineOps, ops);
   Parent->addInstruction(this);
 }
 
-void Store::dump() const {
-  std::cout << "    ";
-  std::cout << OpCode << " ";
-  std::cout << "var !" << Ops[0]->getID() << ", "
-            << "var !" << Ops[1]->getID() << '\n';
+IRPtr<Store> Store::create(OperandsRef ops, BasicBlock *parent) {
+  if (auto *arena = getArenaFor(parent)) {
+    // The clones sharing the instructions take their copies first, since
+    // they are allocated from the same arena.
+    parent->unshareInstructions();
+    auto Lock = lockArena(parent->getParent()->getParent());
+    return IRPtr<Store>(arena->Stores.create(ops, parent),
+                        IRDeleter<Store>(true));
+  }
+  return IRPtr<Store>(new Store(ops, parent));
+}
+
+void Store::print(OutputStream &OS) const {
+  OS << "    " << getOpCode() << " var !" << Ops[0].get()->getID()
+     << ", var !" << Ops[1].get()->getID() << '\n';
 }
 
-Add::Add (OperandsTy& ops, BasicBlock *parent) {
+Add::Add (OperandsRef ops, BasicBlock *parent)
+    : Instruction(OpCodeKind::Add, parent) {
   assert(ops.size() >= 3 && "Add must have 3+ operands");
-  // Set up the parent fields.
-  Ops = ops;
-  Parent = parent;
-  OpCode = "ADD";
+  Use *storage = InlineOps;
+  if (ops.size() > NumOfInlineOps) {
+    if (auto *arena = getArenaFor(parent)) {
+      storage = arena->Operands.allocateArray<Use>(ops.size());
+      std::uninitialized_default_construct_n(storage, ops.size());
+    } else {
+      storage = new Use[ops.size()];
+      OwnsOps = true;
+    }
+  }
+  initOps(storage, ops);
   Parent->addInstruction(this);
 }
 
-void Add::dump() const {
-  std::cout << "    ";
-  std::cout << "var !" << Ops[0]->getID();
-  std::cout << " = " << OpCode << " ";
-  unsigned numOfOps = Ops.size();
-  for (int i = 1; i < numOfOps - 1; ++i)
-    std::cout << "var !" << Ops[i]->getID() << ", ";
-  std::cout << "var !" << Ops[numOfOps - 1]->getID() << '\n';
+Add::~Add() {
+  if (OwnsOps) {
+    dropAllReferences();
+    delete[] Ops;
+    NumOfOps = 0;
+  }
+}
+
+IRPtr<Add> Add::create(OperandsRef ops, BasicBlock *parent) {
+  // NOTE: The lock covers the operands allocated by the constructor, too.
+  if (auto *arena = getArenaFor(parent)) {
+    // The clones sharing the instructions take their copies first, since
+    // they are allocated from the same arena.
+    parent->unshareInstructions();
+    auto Lock = lockArena(parent->getParent()->getParent());
+    return IRPtr<Add>(arena->Adds.create(ops, parent), IRDeleter<Add>(true));
+  }
+  return IRPtr<Add>(new Add(ops, parent));
+}
+
+void Add::print(OutputStream &OS) const {
+  OS << "    var !" << Ops[0].get()->getID() << " = " << getOpCode() << ' ';
+  for (unsigned i = 1; i < NumOfOps - 1; ++i)
+    OS << "var !" << Ops[i].get()->getID() << ", ";
+  OS << "var !" << Ops[NumOfOps - 1].get()->getID() << '\n';
 }
 
 //
 // Implementation of the BasicBlock class.
 //
 
-BasicBlock::BasicBlock(std::string basicBlockID, Function *parent)
-    : BasicBlockID(basicBlockID), Parent(parent) {}
+BasicBlock::BasicBlock(std::string_view basicBlockID, Function *parent)
+    : BasicBlockID(parent->getParent()->getSymbols().intern(basicBlockID)),
+      Parent(parent), Epoch(parent->getNewEpoch()) {
+  REVLANG_STAT_ADD(BBsCreated, 1);
+  REVLANG_GAUGE_INC(BasicBlock, sizeof(BasicBlock));
+}
+
+BasicBlock::~BasicBlock() { REVLANG_GAUGE_DEC(BasicBlock, sizeof(BasicBlock)); }
+
+void BasicBlock::bumpEpoch() {
+  Epoch = Parent->getNewEpoch();
+  // The clones see the change as well (e.g. of the replaceAllUsesWith()).
+  for (BasicBlock *BB : Sharers)
+    BB->Epoch = BB->Parent->getNewEpoch();
+}
+
+void BasicBlock::bumpCFGEpoch() {
+  Parent->bumpCFGEpoch();
+  Epoch = Parent->getCFGEpoch();
+}
 
 size_t BasicBlock::getNumOfSuccessors() const {
   return Successors.size();
@@ -105,19 +376,27 @@ SuccessorBBList& BasicBlock::getSuccessors() const {
   return const_cast<SuccessorBBList &>(Successors);
 }
 
-void BasicBlock::dump() const {
+void BasicBlock::print(OutputStream &OS) const {
   if (getNumOfSuccessors()) {
-    std::cout << ' ' << "; Successors: ";
-    auto successors = getSuccessors();
-    for (const auto& s : successors)
-      std::cout << s.second->getBBID() << "(tag: " << s.first << ") ";
-    std::cout << '\n';
+    OS << " ; Successors: ";
+    auto &Names = Parent->getParent()->getSymbols();
+    for (const auto *s : Successors.sorted(Names))
+      OS << s->second->getBBID() << "(tag: " << Names.getString(s->first)
+         << ") ";
+    OS << '\n';
   }
-  std::cout << ' ' << BasicBlockID << ":\n";
+  OS << ' ' << getBBID() << ':';
+  if (Parent->getEntryBB() == this)
+    OS << " ; Entry";
+  OS << '\n';
+
+  for (const auto *i : instructions())
+    i->print(OS);
+}
 
-  auto instrs = getInstructions();
-  for (const auto *i : instrs)
-    i->dump();
+void BasicBlock::dump() const {
+  StdOutputStream OS(std::cout);
+  print(OS);
 }
 
 // Could be used if we are changing the function (e.g. attributes,
@@ -125,89 +404,269 @@ void BasicBlock::dump() const {
 void BasicBlock::setParent(Function *parent) { Parent = parent; }
 Function *BasicBlock::getParent() const { return Parent; }
 
-std::unique_ptr<BasicBlock> BasicBlock::create(std::string basicBlockID,
-                                               Function *parent,
-                                               bool isEntryBasicBlock) {
-  auto BB = std::make_unique<BasicBlock>(basicBlockID, parent);
+IRPtr<BasicBlock> BasicBlock::create(std::string_view basicBlockID,
+                                     Function *parent,
+                                     bool isEntryBasicBlock) {
+  IRPtr<BasicBlock> BB;
+  if (auto *arena = parent->getParent()->getArena()) {
+    auto Lock = lockArena(parent->getParent());
+    BB = IRPtr<BasicBlock>(arena->BasicBlocks.create(basicBlockID, parent),
+                           IRDeleter<BasicBlock>(true));
+  } else {
+    BB = IRPtr<BasicBlock>(new BasicBlock(basicBlockID, parent));
+  }
   if (isEntryBasicBlock)
     parent->setEntryBB(BB.get());
-  parent->addBasicBlock(basicBlockID, BB.get());
+  parent->addBasicBlock(BB.get());
   return BB;
 }
 
-const std::string& BasicBlock::getBBID() const { return BasicBlockID; }
-
-void BasicBlock::removeInstruction(std::unique_ptr<Instruction> instr) {
-  Instructions.erase(
-    std::remove(Instructions.begin(), Instructions.end(), instr.get()),
-    Instructions.end());
+std::string_view BasicBlock::getBBID() const {
+  return Parent->getParent()->getSymbols().getString(BasicBlockID);
+}
+
+void BasicBlock::removeInstruction(IRPtr<Instruction> instr) {
+  Instruction *I = instr.get();
+  if (SharedWith) {
+    // The instr is one of the shared list (e.g. from the instructions()),
+    // so its copy at the same place is removed, once the bb has its own.
+    const auto &Shared = SharedWith->Instructions;
+    size_t idx = std::find(Shared.begin(), Shared.end(), I) - Shared.begin();
+    assert(idx < Shared.size() && "Not an instruction of the bb");
+    if (idx == Shared.size())
+      return;
+    prepareForWrite();
+    I = Instructions[idx];
+  } else {
+    prepareForWrite();
+  }
+  I->dropAllReferences();
+  Instructions.erase(std::remove(Instructions.begin(), Instructions.end(), I),
+                     Instructions.end());
+  REVLANG_STAT_ADD(InstrsRemoved, 1);
+  bumpEpoch();
+}
+
+void BasicBlock::removeAllInstructions() {
+  // The shared instructions are not copied just to be removed.
+  if (SharedWith)
+    stopSharing(/*copyInstrs=*/false);
+  prepareForWrite();
+  for (auto *I : Instructions)
+    I->dropAllReferences();
+  REVLANG_STAT_ADD(InstrsRemoved, Instructions.size());
+  Instructions.clear();
+  bumpEpoch();
+}
+
+void BasicBlock::moveInstructionsFrom(BasicBlock *bb) {
+  assert(bb != this && "Moving the instructions onto themselves");
+  prepareForWrite();
+  bb->prepareForWrite();
+  for (auto *I : bb->Instructions)
+    I->Parent = this;
+  Instructions.insert(Instructions.end(), bb->Instructions.begin(),
+                      bb->Instructions.end());
+  bb->Instructions.clear();
+  bumpEpoch();
+  bb->bumpEpoch();
+}
+
+void BasicBlock::replaceSuccessor(BasicBlock *oldBB, BasicBlock *newBB) {
+  assert(Parent == newBB->getParent() && "The parent should be the same");
+  for (size_t i = 0; i < Successors.size(); ++i) {
+    Symbol tag = Successors.begin()[i].first;
+    if (Successors.begin()[i].second != oldBB)
+      continue;
+    Successors.assign(tag, newBB);
+    oldBB->removePredecessor(this);
+    newBB->Predecessors.push_back(this);
+    REVLANG_STAT_ADD(EdgesRemoved, 1);
+    REVLANG_STAT_ADD(EdgesAdded, 1);
+    bumpCFGEpoch();
+  }
 }
 
 void BasicBlock::removeSuccessor(BasicBlock *bb) {
-  auto getBBAsSucc =
-      std::find_if(Successors.begin(), Successors.end(),
-                   [bb](const auto &BB) { return BB.second == bb; });
-  if (getBBAsSucc != Successors.end())
-    Successors.erase(getBBAsSucc->first);
+  // NOTE: The erase() moves the last entry into the hole, so the same
+  // index is checked again.
+  for (size_t i = 0; i < Successors.size();) {
+    const auto &S = Successors.begin()[i];
+    if (S.second != bb) {
+      ++i;
+      continue;
+    }
+    Successors.erase(S.first);
+    bb->removePredecessor(this);
+    REVLANG_STAT_ADD(EdgesRemoved, 1);
+    bumpCFGEpoch();
+  }
+}
+
+void BasicBlock::removePredecessor(BasicBlock *bb) {
+  // NOTE: The callers tend to remove the last predecessor (e.g. the
+  // Function::removeBasicBlock()), so the search goes from the back.
+  auto Pred = std::find(Predecessors.rbegin(), Predecessors.rend(), bb);
+  assert(Pred != Predecessors.rend() && "Not a predecessor");
+  *Pred = Predecessors.back();
+  Predecessors.pop_back();
 }
 
-void BasicBlock::addSuccessor(const std::string &tag, BasicBlock *bb) {
-  assert(!Successors.count(tag) && "The successor with the tag already exists");
+void BasicBlock::addSuccessor(std::string_view tag, BasicBlock *bb) {
   assert(Parent == bb->getParent() && "The parent should be the same");
-  Successors[tag] = bb;
+  bool added =
+      Successors.insert(Parent->getParent()->getSymbols().intern(tag), bb);
+  assert(added && "The successor with the tag already exists");
+  (void)added;
+  bb->Predecessors.push_back(this);
+  REVLANG_STAT_ADD(EdgesAdded, 1);
+  bumpCFGEpoch();
+}
+
+BasicBlock *BasicBlock::getSuccessor(std::string_view tag) const {
+  Symbol sym = Parent->getParent()->getSymbols().lookup(tag);
+  return sym == InvalidSymbol ? nullptr : Successors.lookup(sym);
 }
 
 void BasicBlock::addInstruction(Instruction *inst) {
+  prepareForWrite();
   Instructions.push_back(inst);
+  bumpEpoch();
 }
 
 InstrustionList& BasicBlock::getInstructions() const {
+  // NOTE: This changes the bb (and its clones) only if they share the
+  // instructions, which is not visible otherwise.
+  const_cast<BasicBlock *>(this)->prepareForWrite();
   return const_cast<InstrustionList&>(Instructions);
 }
 
 size_t BasicBlock::getNumOfInstrs() const {
-  return Instructions.size();
+  return instructions().size();
+}
+
+void BasicBlock::copyInstructionsFrom(const BasicBlock *BB,
+                                      const GlobalVarMap *VarMap) {
+  const auto &Instrs = BB->instructions();
+  Instructions.reserve(Instructions.size() + Instrs.size());
+  OperandsTy Ops;
+  for (const Instruction *I : Instrs) {
+    Ops.clear();
+    for (GlobalVariable *Op : I->getOps())
+      Ops.push_back(VarMap ? VarMap->find(Op)->second : Op);
+    // NOTE: The handles don't own the objects within the arena.
+    switch (I->getOpCodeKind()) {
+    case Instruction::OpCodeKind::Load:
+      Load::create(Ops, this).release();
+      break;
+    case Instruction::OpCodeKind::Store:
+      Store::create(Ops, this).release();
+      break;
+    case Instruction::OpCodeKind::Add:
+      Add::create(Ops, this).release();
+      break;
+    }
+  }
+}
+
+void BasicBlock::stopSharing(bool copyInstrs) {
+  BasicBlock *Src = SharedWith;
+  auto &SrcSharers = Src->Sharers;
+  SrcSharers.erase(std::find(SrcSharers.begin(), SrcSharers.end(), this));
+  SharedWith = nullptr;
+  if (copyInstrs)
+    copyInstructionsFrom(Src, nullptr);
+  // The instructions are other objects now.
+  bumpEpoch();
+}
+
+void BasicBlock::unshareInstructions() {
+  if (SharedWith)
+    stopSharing(/*copyInstrs=*/true);
+  while (!Sharers.empty())
+    Sharers.back()->stopSharing(/*copyInstrs=*/true);
 }
 
 //
 // Implementation of the Function.
 //
 
-Function::Function(std::string functionID, Module *parent)
-    : FunctionID(functionID), Parent(parent) {}
+// Each function counts its epochs from its own serial number (in the high
+// bits), so the epochs are unique across the functions, and there is no
+// shared counter to update while the functions are changed in parallel.
+static std::atomic<uint64_t> NextFunctionSerial{1};
 
-void Function::dump() const {
-  std::cout << "def " << FunctionID << "():\n";
+Function::Function(std::string_view functionID, Module *parent)
+    : FunctionID(parent->getSymbols().intern(functionID)), Parent(parent),
+      LastEpoch(NextFunctionSerial.fetch_add(1, std::memory_order_relaxed)
+                << 32),
+      CFGEpoch(LastEpoch) {
+  REVLANG_GAUGE_INC(Function, sizeof(Function));
+}
+
+Function::~Function() { REVLANG_GAUGE_DEC(Function, sizeof(Function)); }
+
+void Function::print(OutputStream &OS) const {
+  OS << "def " << getFnID() << "():\n";
 
   // If the function is empty, it should be deleted.
   if (empty()) {
-    std::cout << "  empty function\n\n";
+    OS << "  empty function\n\n";
     return;
   }
 
-  auto BBs = getBasicBlocks();
   // Print all the bbs.
-  for (const auto &BB : BBs)
-    BB.second->dump();
+  for (const auto *BB : BasicBlocks.sorted(Parent->getSymbols()))
+    BB->second->print(OS);
 
   // NOTE: Use '\n', since it is faster than "\n".
-  std::cout << '\n';
+  OS << '\n';
+}
+
+void Function::dump() const {
+  StdOutputStream OS(std::cout);
+  print(OS);
 }
 
 bool Function::empty() const {
   return getNumberOfBBs() == 0;
 }
 
-// Could be used if we are changing the module, e.g. LTO.
+// This is used when the function is linked into another module.
 void Function::setParent(Module *parent) { Parent = parent; }
 Module *Function::getParent() const { return Parent; }
 
-void Function::setEntryBB(BasicBlock *bb) { EntryBB = bb; }
+void Function::setEntryBB(BasicBlock *bb) {
+  EntryBB = bb;
+  bumpCFGEpoch();
+}
 BasicBlock *Function::getEntryBB() const { return EntryBB; }
 
-void Function::addBasicBlock(const std::string &bbName, BasicBlock *bb) {
-  assert(!BasicBlocks.count(bbName) && "The basic block already exists");
-  BasicBlocks[bbName] = bb;
+void Function::addBasicBlock(BasicBlock *bb) {
+  bool added = BasicBlocks.insert(bb->getBBSymbol(), bb);
+  assert(added && "The basic block already exists");
+  (void)added;
+  bb->Number = NextBBNumber++;
+  bumpCFGEpoch();
+}
+
+void Function::renumberBlocks() {
+  NextBBNumber = 0;
+  for (auto &BB : BasicBlocks)
+    BB.second->Number = NextBBNumber++;
+  bumpCFGEpoch();
+}
+
+void Function::remapSymbols(const std::vector<Symbol> &SymMap) {
+  BasicBlocks.remapSymbols(SymMap);
+  for (auto &Entry : BasicBlocks) {
+    BasicBlock *BB = Entry.second;
+    BB->BasicBlockID = Entry.first;
+    BB->Successors.remapSymbols(SymMap);
+  }
+  // The vars may have been renumbered as well, so the results keyed by
+  // them (e.g. the lowered functions) are stale.
+  bumpCFGEpoch();
 }
 BasicBlockList &Function::getBasicBlocks() const {
   // According to the type deduction rules when dealing with templates,
@@ -216,91 +675,163 @@ BasicBlockList &Function::getBasicBlocks() const {
   return const_cast<BasicBlockList &>(BasicBlocks);
 }
 
-std::unique_ptr<Function> Function::create(std::string functionID,
-                                           Module *parent) {
-  auto F = std::make_unique<Function>(functionID, parent);
-  parent->addFunction(functionID, F.get());
+BasicBlock *Function::getBasicBlock(std::string_view bbName) const {
+  Symbol sym = Parent->getSymbols().lookup(bbName);
+  return sym == InvalidSymbol ? nullptr : BasicBlocks.lookup(sym);
+}
+
+IRPtr<Function> Function::create(std::string_view functionID,
+                                 Module *parent) {
+  IRPtr<Function> F;
+  if (auto *arena = parent->getArena())
+    F = IRPtr<Function>(arena->Functions.create(functionID, parent),
+                        IRDeleter<Function>(true));
+  else
+    F = IRPtr<Function>(new Function(functionID, parent));
+  parent->addFunction(F.get());
   return F;
 }
 
+IRPtr<Function> Function::clone(std::string_view newName, bool copyOnWrite) {
+  assert(Parent->getArena() && "The clones are owned by the arena only");
+  return IRPtr<Function>(cloneInto(*Parent, newName, nullptr, copyOnWrite),
+                         IRDeleter<Function>(true));
+}
+
+Function *Function::cloneInto(Module &M, std::string_view newName,
+                              const GlobalVarMap *VarMap, bool copyOnWrite) {
+  assert((!copyOnWrite || &M == Parent) &&
+         "The instructions are shared within the module only");
+  auto &Names = Parent->getSymbols();
+  auto &NewNames = M.getSymbols();
+  // NOTE: The handles don't own the objects within the arena.
+  Function *NewF = Function::create(newName, &M).release();
+
+  // The bbs are created first, so the edges are mapped by the bb numbers.
+  std::vector<BasicBlock *> NewBBs(NextBBNumber);
+  NewF->BasicBlocks.reserve(BasicBlocks.size());
+  for (const auto &Entry : BasicBlocks)
+    NewBBs[Entry.second->Number] =
+        BasicBlock::create(Names.getString(Entry.first), NewF,
+                           Entry.second == EntryBB)
+            .release();
+
+  for (const auto &Entry : BasicBlocks) {
+    const BasicBlock *BB = Entry.second;
+    BasicBlock *NewBB = NewBBs[BB->Number];
+    NewBB->Successors.reserve(BB->Successors.size());
+    for (const auto &S : BB->Successors) {
+      Symbol Tag = &M == Parent ? S.first
+                                : NewNames.intern(Names.getString(S.first));
+      NewBB->Successors.insert(Tag, NewBBs[S.second->Number]);
+    }
+    REVLANG_STAT_ADD(EdgesAdded, BB->Successors.size());
+    // The predecessors are kept in the same order, too.
+    NewBB->Predecessors.reserve(BB->Predecessors.size());
+    for (const BasicBlock *Pred : BB->Predecessors)
+      NewBB->Predecessors.push_back(NewBBs[Pred->Number]);
+
+    if (!copyOnWrite) {
+      NewBB->copyInstructionsFrom(BB, VarMap);
+      continue;
+    }
+    // A clone of a clone shares the instructions of the original.
+    BasicBlock *Src = BB->SharedWith ? BB->SharedWith : Entry.second;
+    NewBB->SharedWith = Src;
+    Src->Sharers.push_back(NewBB);
+  }
+  NewF->bumpCFGEpoch();
+  return NewF;
+}
+
+void Function::unshareInstructions() {
+  for (auto &Entry : BasicBlocks)
+    if (Entry.second->sharesInstructions())
+      Entry.second->unshareInstructions();
+}
+
 size_t Function::getNumberOfBBs() const { return BasicBlocks.size(); }
 
-const std::string& Function::getFnID() const { return FunctionID; }
+std::string_view Function::getFnID() const {
+  return Parent->getSymbols().getString(FunctionID);
+}
 
-void Function::removeBasicBlock(std::unique_ptr<BasicBlock> bb) {
+void Function::removeBasicBlock(IRPtr<BasicBlock> bb) {
   assert(!bb->getNumOfInstrs() && "Delete the instructions first");
 
-  // Avoid dangling ptrs by removing this bb from successor list
-  // if any.
-  for (auto& basibBlock : BasicBlocks)
-    basibBlock.second->removeSuccessor(bb.get());
+  // Avoid dangling ptrs by removing the edges from and to this bb. The
+  // bb may be its own predecessor, so the lists are re-read each time.
+  while (bb->getNumOfPredecessors())
+    bb->getPredecessors().back()->removeSuccessor(bb.get());
+  while (bb->getNumOfSuccessors())
+    bb->removeSuccessor(bb->getSuccessors().begin()->second);
 
-  auto bbName = bb->getBBID();
-  BasicBlocks.erase(bbName);
+  if (EntryBB == bb.get())
+    EntryBB = nullptr;
+  BasicBlocks.erase(bb->getBBSymbol());
+  bumpCFGEpoch();
 }
 
-void Function::printCFGAsDOT(const std::string& filename) const {
-  // TODO: Check for errors, such as if the file was opened
-  // successfully, etc.
-
-  // Create and open the file.
-  std::ofstream MyDotFile(filename);
-
+bool Function::printCFGAsDOT(OutputStream &OS) const {
+  REVLANG_TIME_SCOPE(PrintCFGAsDOT);
   // We want the following shape of the file:
   //   digraph fnName {
   //     bb0 -> bb1 ["tag1"];
   //     bb0 -> bb2 ["tag2"];
   //     bb2 -> bb1;
   //   }
-  MyDotFile << "digraph " << FunctionID << " {\n";
-  auto BBs = getBasicBlocks();
+  OS << "digraph " << getFnID() << " {\n";
+  auto &Names = Parent->getSymbols();
+  auto BBs = BasicBlocks.sorted(Names);
   for (auto BB = BBs.rbegin(); BB != BBs.rend(); BB++) {
-    auto successors = BB->second->getSuccessors();
-    for (const auto& s : successors)
-      MyDotFile << "  " << BB->first << " -> " << s.second->getBBID()
-                << "[ label = \"" << s.first << "\"];\n";
+    auto successors = (*BB)->second->getSuccessors().sorted(Names);
+    for (const auto *s : successors)
+      OS << "  " << Names.getString((*BB)->first) << " -> "
+         << s->second->getBBID() << "[ label = \"" << Names.getString(s->first)
+         << "\"];\n";
   }
 
-  MyDotFile << "}\n";
-  // Close the file.
-  MyDotFile.close();
+  OS << "}\n";
+  OS.flush();
+  return !OS.hasError();
 }
 
-void Function::traverse(BasicBlock *bb,
-                        std::map<BasicBlock *, bool> &visited) const {
-  visited[bb] = true;
-
-  auto successors = bb->getSuccessors();
-  for (const auto &s : successors) {
-    if (!visited[s.second])
-      traverse(s.second, visited);
-  }
+bool Function::printCFGAsDOT(const std::string& filename) const {
+  std::string errMsg;
+  FDOutputStream MyDotFile(filename, errMsg);
+  if (!MyDotFile.isOpen())
+    return false;
+  printCFGAsDOT(MyDotFile);
+  return MyDotFile.close();
 }
 
 bool Function::isValid() const {
+  REVLANG_TIME_SCOPE(IsValid);
+  // The checks below depend on the CFG only.
+  if (ValidatedCFGEpoch == CFGEpoch)
+    return WasValid;
+  ValidatedCFGEpoch = CFGEpoch;
+  WasValid = false;
+
   // I) Function must have an entry bb.
   if (!EntryBB)
     return false;
 
   // II) Each basic block is reachable from the entry point by traversing
   // the links from a basic block to its successors.
-  // For this, I'll be using a simple DFS algorithm.
-
-  std::map<BasicBlock *, bool> visited;
-  auto BBs = getBasicBlocks();
-  for (auto BB = BBs.rbegin(); BB != BBs.rend(); BB++)
-    visited.insert({BB->second, false});
-  traverse(EntryBB, visited);
-  auto notVisittedBB =
-      std::find_if(visited.begin(), visited.end(),
-                   [](const auto &bb) { return bb.second == false; });
-  if (notVisittedBB != visited.end())
+  size_t numOfReachable = 0;
+  for (auto *BB : depth_first(*this)) {
+    (void)BB;
+    ++numOfReachable;
+  }
+  if (numOfReachable != BasicBlocks.size())
     return false;
 
   // III) Each basic block has, at most, one successor per tag.
   // This is ensured by the assert() which will be triggered
   // in non-release builds.
 
+  WasValid = true;
   return true;
 }
 
@@ -308,27 +839,70 @@ bool Function::isValid() const {
 // Implementation of the Module class.
 //
 
-Module::Module(std::string moduleID) : ModuleID(moduleID) {}
+Module::Module(std::string moduleID, bool useArena) : ModuleID(moduleID) {
+  REVLANG_GAUGE_INC(Module, sizeof(Module));
+  if (useArena)
+    Arena = std::make_unique<IRArena>();
+}
 
-void Module::dump() const {
-  std::cout << "ModuleID: " << ModuleID << "\n\n";
+// NOTE: This is out of line, since the IRArena is complete here only.
+Module::~Module() { REVLANG_GAUGE_DEC(Module, sizeof(Module)); }
+
+void Module::takeArenas(Module &Src) {
+  if (Src.Arena)
+    LinkedArenas.push_back(std::move(Src.Arena));
+  for (auto &A : Src.LinkedArenas)
+    LinkedArenas.push_back(std::move(A));
+  Src.LinkedArenas.clear();
+}
+
+std::unique_ptr<Module> Module::clone() const {
+  auto M = Module::create(ModuleID, /*useArena=*/true);
+  // The vars of the copy, by the vars of this module. They are not looked
+  // up by the id, since the ids may be sparse (up to UINT32_MAX).
+  GlobalVarMap VarMap;
+  VarMap.reserve(GlobalVariables.size());
+  for (const auto &Entry : GlobalVariables)
+    VarMap.emplace(Entry.second,
+                   GlobalVariable::create(Entry.first, M.get()).release());
+  for (const auto &Entry : Functions)
+    Entry.second->cloneInto(*M, Symbols.getString(Entry.first), &VarMap,
+                            /*copyOnWrite=*/false);
+  return M;
+}
+
+void Module::setConcurrent(bool concurrent) {
+  Symbols.setConcurrent(concurrent);
+  if (concurrent && !Locks)
+    Locks = std::make_unique<ModuleLocks>();
+  else if (!concurrent)
+    Locks.reset();
+}
+
+void Module::print(OutputStream &OS) const {
+  REVLANG_TIME_SCOPE(Dump);
+  OS << "ModuleID: " << ModuleID << "\n\n";
 
   // Print global vars.
-  auto GVs = getGlobalVars();
-  for (const auto &GV : GVs)
-    GV.second->dump();
+  for (const auto &GV : GlobalVariables)
+    GV.second->print(OS);
 
-  std::cout << '\n';
+  OS << '\n';
 
   // Print functions.
-  auto Fns = getFunctions();
-  for (const auto &F : Fns)
-    F.second->dump();
+  for (const auto *F : Functions.sorted(Symbols))
+    F->second->print(OS);
 }
 
-void Module::addFunction(const std::string &fnName, Function *f) {
-  assert(!Functions.count(fnName) && "The function already exists");
-  Functions[fnName] = f;
+void Module::dump() const {
+  StdOutputStream OS(std::cout);
+  print(OS);
+}
+
+void Module::addFunction(Function *f) {
+  bool added = Functions.insert(f->getFnSymbol(), f);
+  assert(added && "The function already exists");
+  (void)added;
 }
 
 FunctionList &Module::getFunctions() const {
@@ -338,9 +912,19 @@ FunctionList &Module::getFunctions() const {
   return const_cast<FunctionList &>(Functions);
 }
 
+Function *Module::getFunction(std::string_view fnName) const {
+  Symbol sym = Symbols.lookup(fnName);
+  return sym == InvalidSymbol ? nullptr : Functions.lookup(sym);
+}
+
+StringInterner &Module::getSymbols() const {
+  return const_cast<StringInterner &>(Symbols);
+}
+
 void Module::addGlobalVar(unsigned id, GlobalVariable *GV) {
   assert(!GlobalVariables.count(id) && "The variable already exists");
   GlobalVariables[id] = GV;
+  ++VarsEpoch;
 }
 GlobalVarList& Module::getGlobalVars() const {
   return const_cast<GlobalVarList &>(GlobalVariables);
@@ -351,10 +935,15 @@ GlobalVariable* Module::getVarWithID(unsigned id) const {
   return const_cast<GlobalVarList&>(GlobalVariables)[id];
 }
 
+void Module::removeGlobalVar(IRPtr<GlobalVariable> GV) {
+  assert(!GV->hasUses() && "Remove the uses first");
+  GlobalVariables.erase(GV->getID());
+  ++VarsEpoch;
+}
+
 size_t Module::getNumberOfFns() const { return Functions.size(); }
 
-void Module::removeFunction(std::unique_ptr<Function> f) {
+void Module::removeFunction(IRPtr<Function> f) {
   assert(f->empty() && "Delete the basic blocks first");
-  auto fnName = f->getFnID();
-  Functions.erase(fnName);
+  Functions.erase(f->getFnSymbol());
 }
@@ -0,0 +1,305 @@
+// === This contains the building and the serialization of the FlatFunction.
+
+#include "FlatFunction.h"
+
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+constexpr char FlatMagic[4] = {'R', 'V', 'F', 'F'};
+constexpr uint32_t FlatVersion = 1;
+
+template <typename T> void writeValue(std::string &Out, T value) {
+  Out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// An array is its length, and then its elements.
+template <typename T>
+void writeArray(std::string &Out, const T *data, size_t size) {
+  writeValue(Out, static_cast<uint32_t>(size));
+  Out.append(reinterpret_cast<const char *>(data), size * sizeof(T));
+}
+
+// This reads the values written above, until the input runs out.
+class FlatReader {
+  std::string_view In;
+  bool Failed = false;
+
+public:
+  explicit FlatReader(std::string_view in) : In(in) {}
+
+  bool failed() const { return Failed; }
+  bool atEnd() const { return In.empty(); }
+
+  template <typename T> T readValue() {
+    T value{};
+    if (In.size() < sizeof(T)) {
+      Failed = true;
+      return value;
+    }
+    std::memcpy(&value, In.data(), sizeof(T));
+    In.remove_prefix(sizeof(T));
+    return value;
+  }
+  template <typename ContainerTy> void readArray(ContainerTy &Res) {
+    using T = typename ContainerTy::value_type;
+    uint32_t size = readValue<uint32_t>();
+    if (Failed || In.size() / sizeof(T) < size) {
+      Failed = true;
+      return;
+    }
+    Res.resize(size);
+    if (size)
+      std::memcpy(&Res[0], In.data(), size * sizeof(T));
+    In.remove_prefix(size * sizeof(T));
+  }
+};
+
+// Checks that the Begins are the ranges of the [0, end), i.e. they start
+// with 0, end with the end, and don't decrease.
+bool areRanges(const std::vector<uint32_t> &Begins, size_t numOfRanges,
+               size_t end) {
+  if (Begins.size() != numOfRanges + 1 || Begins.front() != 0 ||
+      Begins.back() != end)
+    return false;
+  for (size_t i = 0; i < numOfRanges; ++i)
+    if (Begins[i] > Begins[i + 1])
+      return false;
+  return true;
+}
+
+} // end anonymous namespace
+
+uint32_t FlatFunction::addName(std::string_view name) {
+  NameChars.append(name);
+  NameOffsets.push_back(NameChars.size());
+  return NameOffsets.size() - 2;
+}
+
+FlatFunction FlatFunction::build(const Function &F) {
+  const StringInterner &Names = F.getParent()->getSymbols();
+  FlatFunction Res;
+  // The local names, by the symbols of the module.
+  std::unordered_map<Symbol, uint32_t> NameMap;
+  auto getName = [&](Symbol sym) {
+    auto It = NameMap.find(sym);
+    if (It != NameMap.end())
+      return It->second;
+    uint32_t idx = Res.addName(Names.getString(sym));
+    NameMap.emplace(sym, idx);
+    return idx;
+  };
+  Res.FnName = getName(F.getFnSymbol());
+
+  // The bbs go in the order of their numbers, and the indices skip the
+  // holes in the numbering.
+  std::vector<const BasicBlock *> ByNumber(F.getMaxBBNumber());
+  for (const auto &Entry : F.getBasicBlocks())
+    ByNumber[Entry.second->getNumber()] = Entry.second;
+  std::vector<uint32_t> Indices(ByNumber.size(), InvalidIndex);
+  uint32_t numOfBlocks = 0;
+  for (size_t n = 0; n < ByNumber.size(); ++n)
+    if (ByNumber[n])
+      Indices[n] = numOfBlocks++;
+
+  Res.BlockNames.reserve(numOfBlocks);
+  Res.BlockInstrs.reserve(numOfBlocks + 1);
+  Res.BlockEdges.reserve(numOfBlocks + 1);
+  for (const BasicBlock *BB : ByNumber) {
+    if (!BB)
+      continue;
+    Res.BlockNames.push_back(getName(BB->getBBSymbol()));
+    for (const Instruction *I : BB->instructions()) {
+      Res.InstrOpCodes.push_back(I->getOpCodeKind());
+      for (const GlobalVariable *GV : I->getOps())
+        Res.Operands.push_back(GV->getID());
+      Res.InstrOps.push_back(Res.Operands.size());
+    }
+    Res.BlockInstrs.push_back(Res.InstrOpCodes.size());
+    auto addEdge = [&](const SuccessorBBList::Entry &S) {
+      Res.EdgeTags.push_back(getName(S.first));
+      Res.EdgeTargets.push_back(Indices[S.second->getNumber()]);
+    };
+    // Most of the bbs have a single successor, which needs no sorting.
+    if (BB->getNumOfSuccessors() == 1)
+      addEdge(*BB->getSuccessors().begin());
+    else
+      for (const auto *S : BB->getSuccessors().sorted(Names))
+        addEdge(*S);
+    Res.BlockEdges.push_back(Res.EdgeTargets.size());
+  }
+  if (const BasicBlock *Entry = F.getEntryBB())
+    Res.EntryBlock = Indices[Entry->getNumber()];
+  return Res;
+}
+
+IRPtr<Function> FlatFunction::materialize(Module &M,
+                                          std::string_view newName) const {
+  assert(M.getArena() && "The functions are owned by the arena only");
+  std::string_view name = newName.empty() ? getName() : newName;
+  assert(!M.getFunction(name) && "The function is already there");
+  // NOTE: The handles don't own the objects within the arena.
+  auto *F = Function::create(name, &M).release();
+
+  std::vector<BasicBlock *> BBs;
+  BBs.reserve(getNumOfBlocks());
+  for (uint32_t b = 0; b < getNumOfBlocks(); ++b)
+    BBs.push_back(BasicBlock::create(getString(BlockNames[b]), F,
+                                     b == EntryBlock)
+                      .release());
+
+  // The vars, by the id (the ones the M doesn't have are created).
+  std::unordered_map<uint32_t, GlobalVariable *> Vars;
+  auto getVar = [&](uint32_t id) {
+    GlobalVariable *&GV = Vars[id];
+    if (!GV) {
+      auto It = M.getGlobalVars().find(id);
+      GV = It != M.getGlobalVars().end()
+               ? It->second
+               : GlobalVariable::create(id, &M).release();
+    }
+    return GV;
+  };
+
+  OperandsTy Ops;
+  for (uint32_t b = 0; b < getNumOfBlocks(); ++b) {
+    BasicBlock *BB = BBs[b];
+    for (uint32_t e = BlockEdges[b]; e < BlockEdges[b + 1]; ++e)
+      BB->addSuccessor(getString(EdgeTags[e]), BBs[EdgeTargets[e]]);
+    for (uint32_t i = BlockInstrs[b]; i < BlockInstrs[b + 1]; ++i) {
+      Ops.clear();
+      for (uint32_t id : getInstr(i).getOperandIDs())
+        Ops.push_back(getVar(id));
+      switch (InstrOpCodes[i]) {
+      case Instruction::OpCodeKind::Load:
+        Load::create(Ops, BB).release();
+        break;
+      case Instruction::OpCodeKind::Store:
+        Store::create(Ops, BB).release();
+        break;
+      case Instruction::OpCodeKind::Add:
+        Add::create(Ops, BB).release();
+        break;
+      }
+    }
+  }
+  return IRPtr<Function>(F, IRDeleter<Function>(true));
+}
+
+void FlatFunction::serialize(std::string &Out) const {
+  Out.append(FlatMagic, sizeof(FlatMagic));
+  writeValue(Out, FlatVersion);
+  writeValue(Out, FnName);
+  writeValue(Out, EntryBlock);
+  writeArray(Out, NameChars.data(), NameChars.size());
+  writeArray(Out, NameOffsets.data(), NameOffsets.size());
+  writeArray(Out, BlockNames.data(), BlockNames.size());
+  writeArray(Out, BlockInstrs.data(), BlockInstrs.size());
+  writeArray(Out, BlockEdges.data(), BlockEdges.size());
+  writeArray(Out, EdgeTags.data(), EdgeTags.size());
+  writeArray(Out, EdgeTargets.data(), EdgeTargets.size());
+  writeArray(Out, InstrOpCodes.data(), InstrOpCodes.size());
+  writeArray(Out, InstrOps.data(), InstrOps.size());
+  writeArray(Out, Operands.data(), Operands.size());
+}
+
+bool FlatFunction::deserialize(std::string_view In, std::string &errMsg) {
+  if (In.size() < sizeof(FlatMagic) ||
+      std::memcmp(In.data(), FlatMagic, sizeof(FlatMagic))) {
+    errMsg = "not a flat function";
+    return false;
+  }
+  FlatReader R(In.substr(sizeof(FlatMagic)));
+  if (R.readValue<uint32_t>() != FlatVersion) {
+    errMsg = "unsupported version of the flat function";
+    return false;
+  }
+
+  // The arrays are read aside, so this is left as it is on failure.
+  FlatFunction Res;
+  Res.FnName = R.readValue<uint32_t>();
+  Res.EntryBlock = R.readValue<uint32_t>();
+  R.readArray(Res.NameChars);
+  R.readArray(Res.NameOffsets);
+  R.readArray(Res.BlockNames);
+  R.readArray(Res.BlockInstrs);
+  R.readArray(Res.BlockEdges);
+  R.readArray(Res.EdgeTags);
+  R.readArray(Res.EdgeTargets);
+  R.readArray(Res.InstrOpCodes);
+  R.readArray(Res.InstrOps);
+  R.readArray(Res.Operands);
+  if (R.failed() || !R.atEnd()) {
+    errMsg = "malformed flat function: unexpected size";
+    return false;
+  }
+
+  auto fail = [&errMsg](const char *what) {
+    errMsg = std::string("malformed flat function: ") + what;
+    return false;
+  };
+  if (Res.NameOffsets.empty() ||
+      !areRanges(Res.NameOffsets, Res.NameOffsets.size() - 1,
+                 Res.NameChars.size()))
+    return fail("bad name table");
+  size_t numOfNames = Res.NameOffsets.size() - 1;
+  size_t numOfBlocks = Res.BlockNames.size();
+  if (Res.FnName >= numOfNames)
+    return fail("bad function name");
+  if (Res.EntryBlock != InvalidIndex && Res.EntryBlock >= numOfBlocks)
+    return fail("bad entry bb");
+  if (!areRanges(Res.BlockInstrs, numOfBlocks, Res.InstrOpCodes.size()) ||
+      !areRanges(Res.BlockEdges, numOfBlocks, Res.EdgeTargets.size()) ||
+      Res.EdgeTags.size() != Res.EdgeTargets.size() ||
+      !areRanges(Res.InstrOps, Res.InstrOpCodes.size(),
+                 Res.Operands.size()))
+    return fail("bad ranges");
+
+  std::unordered_set<std::string_view> BBNames;
+  for (uint32_t b = 0; b < numOfBlocks; ++b) {
+    if (Res.BlockNames[b] >= numOfNames ||
+        !BBNames.insert(Res.getString(Res.BlockNames[b])).second)
+      return fail("bad bb name");
+    // The tags of a bb are sorted, and unique.
+    for (uint32_t e = Res.BlockEdges[b]; e < Res.BlockEdges[b + 1]; ++e) {
+      if (Res.EdgeTags[e] >= numOfNames || Res.EdgeTargets[e] >= numOfBlocks)
+        return fail("bad edge");
+      if (e > Res.BlockEdges[b] && Res.getString(Res.EdgeTags[e - 1]) >=
+                                       Res.getString(Res.EdgeTags[e]))
+        return fail("bad edge");
+    }
+  }
+  for (uint32_t i = 0; i < Res.InstrOpCodes.size(); ++i) {
+    size_t numOfOps = Res.InstrOps[i + 1] - Res.InstrOps[i];
+    bool goodArity = false;
+    switch (Res.InstrOpCodes[i]) {
+    case Instruction::OpCodeKind::Load:
+      goodArity = numOfOps == 1;
+      break;
+    case Instruction::OpCodeKind::Store:
+      goodArity = numOfOps == 2;
+      break;
+    case Instruction::OpCodeKind::Add:
+      goodArity = numOfOps >= 3;
+      break;
+    }
+    if (!goodArity)
+      return fail("bad instruction");
+  }
+
+  *this = std::move(Res);
+  return true;
+}
+
+bool FlatFunction::operator==(const FlatFunction &other) const {
+  return NameChars == other.NameChars && NameOffsets == other.NameOffsets &&
+         FnName == other.FnName && EntryBlock == other.EntryBlock &&
+         BlockNames == other.BlockNames &&
+         BlockInstrs == other.BlockInstrs &&
+         BlockEdges == other.BlockEdges && EdgeTags == other.EdgeTags &&
+         EdgeTargets == other.EdgeTargets &&
+         InstrOpCodes == other.InstrOpCodes && InstrOps == other.InstrOps &&
+         Operands == other.Operands;
+}
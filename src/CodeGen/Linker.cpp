@@ -0,0 +1,182 @@
+// === This contains the linking of the modules (see the Module::link()).
+
+#include "CodeGen.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// This is what is done with a src module, once the names are resolved.
+struct LinkPlan {
+  // The symbols of this module, by the symbols of the src.
+  std::vector<Symbol> SymMap;
+  // The functions moved into this module, and the dropped ones.
+  std::vector<Function *> Moved;
+  // The vars of the src to be merged into the vars of this module.
+  std::vector<std::pair<GlobalVariable *, GlobalVariable *>> Merges;
+};
+
+// Removes the instructions of the function, so it doesn't use the vars.
+void stripFunction(Function *F) {
+  for (auto &BB : F->getBasicBlocks())
+    BB.second->removeAllInstructions();
+}
+
+} // end anonymous namespace
+
+bool Module::link(Module &&Src, std::string &errMsg, const LinkOptions &Opts) {
+  return linkModules({&Src}, errMsg, Opts);
+}
+
+bool Module::link(std::vector<std::unique_ptr<Module>> Srcs,
+                  std::string &errMsg, const LinkOptions &Opts) {
+  std::vector<Module *> Ptrs;
+  Ptrs.reserve(Srcs.size());
+  for (auto &Src : Srcs)
+    Ptrs.push_back(Src.get());
+  return linkModules(Ptrs, errMsg, Opts);
+}
+
+bool Module::linkModules(const std::vector<Module *> &Srcs,
+                         std::string &errMsg, const LinkOptions &Opts) {
+  assert(!Locks && "Cannot link while the functions are changed");
+
+  // I) Check the names first, so nothing is changed on a clash.
+  if (Opts.Functions == LinkOptions::FnClash::Error) {
+    std::unordered_set<std::string_view> Names;
+    for (const Module *Src : Srcs) {
+      assert(Src != this && "Cannot link the module into itself");
+      for (const auto &Entry : Src->Functions) {
+        std::string_view Name = Src->Symbols.getString(Entry.first);
+        if (getFunction(Name) || !Names.insert(Name).second) {
+          errMsg = "function '" + std::string(Name) + "' of the module '" +
+                   Src->ModuleID + "' is already defined";
+          return false;
+        }
+      }
+    }
+  }
+
+  ThreadPool Pool(Opts.NumOfThreads ? Opts.NumOfThreads
+                                    : ThreadPool::getDefaultNumOfThreads());
+  std::vector<LinkPlan> Plans(Srcs.size());
+  // The next suffix to try for the renamed functions, by the name.
+  std::unordered_map<Symbol, unsigned> NextSuffix;
+
+  // II) Map the names of each src to the symbols of this module. Most of
+  // the names (e.g. the tags) are usually here already, so they are looked
+  // up in parallel, and only the new ones are added below (in the order
+  // of the srcs, so the symbols don't depend on the threads).
+  Pool.parallelFor(Srcs.size(), [&](size_t i) {
+    const StringInterner &SrcSymbols = Srcs[i]->Symbols;
+    auto &SymMap = Plans[i].SymMap;
+    SymMap.resize(SrcSymbols.size());
+    for (Symbol sym = 0; sym < SymMap.size(); ++sym)
+      SymMap[sym] = Symbols.lookup(SrcSymbols.getString(sym));
+  });
+
+  // III) Move the vars and the functions, resolving the clashes.
+  for (size_t i = 0; i < Srcs.size(); ++i) {
+    Module *Src = Srcs[i];
+    LinkPlan &Plan = Plans[i];
+    for (Symbol sym = 0; sym < Plan.SymMap.size(); ++sym)
+      if (Plan.SymMap[sym] == InvalidSymbol)
+        Plan.SymMap[sym] = Symbols.intern(Src->Symbols.getString(sym));
+
+    // The fresh IDs are above all the IDs of both of the modules, so they
+    // don't clash with the vars moved later. They are counted in the
+    // uint64_t, since the largest ID may be UINT32_MAX: past it, the gaps
+    // between the IDs of the modules are taken instead.
+    uint64_t nextID = 0;
+    if (!GlobalVariables.empty())
+      nextID = uint64_t(GlobalVariables.rbegin()->first) + 1;
+    if (!Src->GlobalVariables.empty())
+      nextID = std::max(nextID,
+                        uint64_t(Src->GlobalVariables.rbegin()->first) + 1);
+    auto getFreshID = [&]() {
+      if (nextID > UINT32_MAX)
+        nextID = 0;
+      while (GlobalVariables.count(nextID) ||
+             Src->GlobalVariables.count(nextID)) {
+        ++nextID;
+        assert(nextID <= UINT32_MAX && "Out of the var IDs");
+      }
+      return static_cast<unsigned>(nextID++);
+    };
+    for (const auto &Entry : Src->GlobalVariables) {
+      GlobalVariable *GV = Entry.second;
+      auto Existing = GlobalVariables.find(GV->ID);
+      if (Existing != GlobalVariables.end()) {
+        if (Opts.Vars == LinkOptions::VarClash::Merge) {
+          Plan.Merges.emplace_back(GV, Existing->second);
+          continue;
+        }
+        GV->ID = getFreshID();
+      }
+      GV->setParent(this);
+      GlobalVariables[GV->ID] = GV;
+    }
+    Src->GlobalVariables.clear();
+    ++VarsEpoch;
+    ++Src->VarsEpoch;
+
+    for (const auto &Entry : Src->Functions) {
+      Function *F = Entry.second;
+      Symbol Name = Plan.SymMap[F->FunctionID];
+      F->FunctionID = Name;
+      F->setParent(this);
+      Plan.Moved.push_back(F);
+      if (Function *Existing = Functions.lookup(Name)) {
+        switch (Opts.Functions) {
+        case LinkOptions::FnClash::Error:
+          assert(false && "The clashes are checked above");
+          break;
+        case LinkOptions::FnClash::KeepDest:
+          stripFunction(F);
+          continue;
+        case LinkOptions::FnClash::KeepSrc:
+          stripFunction(Existing);
+          Functions.erase(Name);
+          break;
+        case LinkOptions::FnClash::Rename: {
+          unsigned &n = NextSuffix.emplace(Name, 1).first->second;
+          std::string Base(Symbols.getString(Name));
+          while (Functions.count(Name))
+            Name = Symbols.intern(Base + "." + std::to_string(n++));
+          F->FunctionID = Name;
+          break;
+        }
+        }
+      }
+      Functions.insert(Name, F);
+    }
+    Src->Functions.clear();
+    takeArenas(*Src);
+  }
+
+  // IV) Remap the names and the operands of the moved functions. Each src
+  // is done by a single task, so only the use lists of the vars of this
+  // module are shared by the tasks.
+  bool concurrent = Pool.getNumOfThreads() > 1 && Srcs.size() > 1;
+  if (concurrent)
+    setConcurrent(true);
+  Pool.parallelFor(Srcs.size(), [&](size_t i) {
+    LinkPlan &Plan = Plans[i];
+    for (Function *F : Plan.Moved)
+      F->remapSymbols(Plan.SymMap);
+    for (auto &Merge : Plan.Merges) {
+      Merge.first->replaceAllUsesWith(Merge.second);
+      Merge.first->setParent(this);
+    }
+  });
+  if (concurrent)
+    setConcurrent(false);
+  return true;
+}
@@ -0,0 +1,45 @@
+// === This contains the implementation of the MappedFile.
+
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+  if (Data && Size)
+    munmap(const_cast<char *>(Data), Size);
+}
+
+bool MappedFile::open(const std::string &filename, std::string &errMsg) {
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    errMsg = filename + ": could not open the file";
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    errMsg = filename + ": could not stat the file";
+    close(fd);
+    return false;
+  }
+  Size = st.st_size;
+  // The mmap() doesn't like empty mappings.
+  if (!Size) {
+    close(fd);
+    Data = "";
+    return true;
+  }
+  void *mem = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    errMsg = filename + ": could not map the file";
+    Size = 0;
+    return false;
+  }
+  // The readers are going through the file once, from the start to the end.
+  madvise(mem, Size, MADV_SEQUENTIAL);
+  Data = static_cast<const char *>(mem);
+  return true;
+}
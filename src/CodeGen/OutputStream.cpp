@@ -0,0 +1,98 @@
+// === This contains the implementation of the output streams.
+
+#include "OutputStream.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <ostream>
+#include <unistd.h>
+
+OutputStream::OutputStream(size_t bufferSize)
+    : Buffer(new char[bufferSize]), Cur(Buffer.get()),
+      End(Buffer.get() + bufferSize) {}
+
+void OutputStream::writeSlow(const char *data, size_t size) {
+  flush();
+  // The big writes go straight to the sink.
+  if (size >= static_cast<size_t>(End - Cur)) {
+    if (!writeImpl(data, size))
+      Error = true;
+    return;
+  }
+  std::memcpy(Cur, data, size);
+  Cur += size;
+}
+
+void OutputStream::flush() {
+  size_t size = Cur - Buffer.get();
+  if (!size)
+    return;
+  if (!writeImpl(Buffer.get(), size))
+    Error = true;
+  Cur = Buffer.get();
+}
+
+OutputStream &OutputStream::operator<<(uint64_t value) {
+  // The digits are produced from the lowest one.
+  char digits[20];
+  char *first = digits + sizeof(digits);
+  do {
+    *--first = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  return write(first, digits + sizeof(digits) - first);
+}
+
+OutputStream &OutputStream::operator<<(int64_t value) {
+  if (value >= 0)
+    return *this << static_cast<uint64_t>(value);
+  *this << '-';
+  // Negate in the unsigned, so the INT64_MIN works too.
+  return *this << (~static_cast<uint64_t>(value) + 1);
+}
+
+bool StdOutputStream::writeImpl(const char *data, size_t size) {
+  OS.write(data, size);
+  return static_cast<bool>(OS);
+}
+
+FDOutputStream::FDOutputStream(const std::string &filename,
+                               std::string &errMsg)
+    : ShouldClose(true) {
+  FD = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (FD < 0)
+    errMsg = filename + ": could not open the file for writing";
+}
+
+FDOutputStream::~FDOutputStream() {
+  if (ShouldClose)
+    close();
+  else
+    flush();
+}
+
+bool FDOutputStream::writeImpl(const char *data, size_t size) {
+  if (FD < 0)
+    return false;
+  while (size) {
+    ssize_t written = ::write(FD, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool FDOutputStream::close() {
+  flush();
+  if (ShouldClose && FD >= 0) {
+    if (::close(FD) < 0)
+      setError();
+    FD = -1;
+  }
+  return !hasError();
+}
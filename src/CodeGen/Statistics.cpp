@@ -0,0 +1,164 @@
+// === This contains the implementation of the Statistics.
+
+#include "Statistics.h"
+#include "OutputStream.h"
+
+#include <algorithm>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// The values of the running threads, and the sums of the finished ones.
+struct Statistics::Registry {
+  std::mutex Lock;
+  std::vector<const ThreadStats *> Threads;
+  StatsReport Finished;
+};
+
+// NOTE: This is never destroyed, since the threads may exit after the
+// static objects are gone.
+Statistics::Registry &Statistics::getRegistry() {
+  static Registry *R = new Registry();
+  return *R;
+}
+
+namespace {
+
+// Prints the str padded with the spaces up to the width.
+void printPadded(OutputStream &OS, std::string_view str, size_t width) {
+  OS << str;
+  for (size_t i = str.size(); i < width; ++i)
+    OS << ' ';
+}
+
+} // end anonymous namespace
+
+Statistics::ThreadStats::ThreadStats() {
+  Registry &R = getRegistry();
+  std::lock_guard<std::mutex> Guard(R.Lock);
+  R.Threads.push_back(this);
+}
+
+Statistics::ThreadStats::~ThreadStats() {
+  Registry &R = getRegistry();
+  std::lock_guard<std::mutex> Guard(R.Lock);
+  addTo(R.Finished);
+  R.Threads.erase(std::find(R.Threads.begin(), R.Threads.end(), this));
+}
+
+void Statistics::ThreadStats::addTo(StatsReport &R) const {
+  for (size_t i = 0; i < StatsReport::NumOfCounters; ++i)
+    R.Counters[i] += Counters[i].load(std::memory_order_relaxed);
+  for (size_t i = 0; i < StatsReport::NumOfTimers; ++i) {
+    R.Timers[i].NumOfCalls += TimerCalls[i].load(std::memory_order_relaxed);
+    R.Timers[i].Nanoseconds +=
+        TimerNanoseconds[i].load(std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < StatsReport::NumOfGauges; ++i) {
+    R.Gauges[i].NumOfObjects +=
+        GaugeObjects[i].load(std::memory_order_relaxed);
+    R.Gauges[i].Bytes += GaugeBytes[i].load(std::memory_order_relaxed);
+  }
+}
+
+StatsReport Statistics::collect() {
+  Registry &R = getRegistry();
+  std::lock_guard<std::mutex> Guard(R.Lock);
+  StatsReport Report = R.Finished;
+  for (const ThreadStats *S : R.Threads)
+    S->addTo(Report);
+  return Report;
+}
+
+const char *Statistics::getName(StatCounter C) {
+  switch (C) {
+  case StatCounter::BBsCreated:
+    return "bbs-created";
+  case StatCounter::EdgesAdded:
+    return "edges-added";
+  case StatCounter::EdgesRemoved:
+    return "edges-removed";
+  case StatCounter::InstrsRemoved:
+    return "instrs-removed";
+  case StatCounter::DFSNodesVisited:
+    return "dfs-nodes-visited";
+  case StatCounter::NumOfCounters:
+    break;
+  }
+  return "";
+}
+
+const char *Statistics::getName(StatTimer T) {
+  switch (T) {
+  case StatTimer::IsValid:
+    return "isValid";
+  case StatTimer::Dump:
+    return "dump";
+  case StatTimer::PrintCFGAsDOT:
+    return "printCFGAsDOT";
+  case StatTimer::NumOfTimers:
+    break;
+  }
+  return "";
+}
+
+const char *Statistics::getName(StatGauge G) {
+  switch (G) {
+  case StatGauge::Module:
+    return "Module";
+  case StatGauge::Function:
+    return "Function";
+  case StatGauge::BasicBlock:
+    return "BasicBlock";
+  case StatGauge::Instruction:
+    return "Instruction";
+  case StatGauge::NumOfGauges:
+    break;
+  }
+  return "";
+}
+
+void StatsReport::print(OutputStream &OS) const {
+  const size_t Width = 20;
+  OS << "=== Counters ===\n";
+  for (size_t i = 0; i < NumOfCounters; ++i) {
+    printPadded(OS, Statistics::getName(static_cast<StatCounter>(i)), Width);
+    OS << Counters[i] << '\n';
+  }
+  OS << "=== Timers ===\n";
+  printPadded(OS, "", Width);
+  OS << "calls, total us\n";
+  for (size_t i = 0; i < NumOfTimers; ++i) {
+    printPadded(OS, Statistics::getName(static_cast<StatTimer>(i)), Width);
+    OS << Timers[i].NumOfCalls << ", " << Timers[i].Nanoseconds / 1000
+       << '\n';
+  }
+  OS << "=== Live objects ===\n";
+  printPadded(OS, "", Width);
+  OS << "objects, bytes\n";
+  for (size_t i = 0; i < NumOfGauges; ++i) {
+    printPadded(OS, Statistics::getName(static_cast<StatGauge>(i)), Width);
+    OS << Gauges[i].NumOfObjects << ", " << Gauges[i].Bytes << '\n';
+  }
+}
+
+void StatsReport::printJSON(OutputStream &OS) const {
+  OS << "{\n  \"counters\": {";
+  for (size_t i = 0; i < NumOfCounters; ++i)
+    OS << (i ? ", " : "") << '"'
+       << Statistics::getName(static_cast<StatCounter>(i))
+       << "\": " << Counters[i];
+  OS << "},\n  \"timers\": {";
+  for (size_t i = 0; i < NumOfTimers; ++i)
+    OS << (i ? ", " : "") << '"'
+       << Statistics::getName(static_cast<StatTimer>(i))
+       << "\": {\"calls\": " << Timers[i].NumOfCalls
+       << ", \"ns\": " << Timers[i].Nanoseconds << '}';
+  OS << "},\n  \"gauges\": {";
+  for (size_t i = 0; i < NumOfGauges; ++i)
+    OS << (i ? ", " : "") << '"'
+       << Statistics::getName(static_cast<StatGauge>(i))
+       << "\": {\"objects\": " << Gauges[i].NumOfObjects
+       << ", \"bytes\": " << Gauges[i].Bytes << '}';
+  OS << "}\n}\n";
+}
@@ -0,0 +1,99 @@
+// === This contains the implementation of the StringInterner.
+
+#include "SymbolTable.h"
+
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+static uint32_t hashString(std::string_view str) {
+  return static_cast<uint32_t>(std::hash<std::string_view>()(str));
+}
+
+size_t StringInterner::findSlot(std::string_view str, uint32_t hash) const {
+  size_t mask = Slots.size() - 1;
+  size_t slot = hash & mask;
+  while (Slots[slot] != InvalidSymbol &&
+         (Hashes[Slots[slot]] != hash || Strings[Slots[slot]] != str))
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+void StringInterner::grow() {
+  Slots.assign(std::max<size_t>(Slots.size() * 2, 64), InvalidSymbol);
+  size_t mask = Slots.size() - 1;
+  for (Symbol sym = 0; sym < Strings.size(); ++sym) {
+    size_t slot = Hashes[sym] & mask;
+    while (Slots[slot] != InvalidSymbol)
+      slot = (slot + 1) & mask;
+    Slots[slot] = sym;
+  }
+}
+
+std::string_view StringInterner::store(std::string_view str) {
+  static constexpr size_t MinChunkSize = 64 * 1024;
+  if (Chunks.empty() || ChunkUsed + str.size() > ChunkSize) {
+    ChunkSize = std::max(MinChunkSize, str.size());
+    Chunks.emplace_back(new char[ChunkSize]);
+    ChunkUsed = 0;
+  }
+  char *text = Chunks.back().get() + ChunkUsed;
+  if (!str.empty())
+    std::memcpy(text, str.data(), str.size());
+  ChunkUsed += str.size();
+  return std::string_view(text, str.size());
+}
+
+Symbol StringInterner::internImpl(std::string_view str) {
+  if ((Strings.size() + 1) * 2 > Slots.size())
+    grow();
+  uint32_t hash = hashString(str);
+  size_t slot = findSlot(str, hash);
+  if (Slots[slot] != InvalidSymbol)
+    return Slots[slot];
+
+  Symbol sym = Strings.size();
+  Strings.push_back(store(str));
+  Hashes.push_back(hash);
+  Slots[slot] = sym;
+  return sym;
+}
+
+Symbol StringInterner::lookupImpl(std::string_view str) const {
+  if (Slots.empty())
+    return InvalidSymbol;
+  return Slots[findSlot(str, hashString(str))];
+}
+
+Symbol StringInterner::intern(std::string_view str) {
+  if (!Lock)
+    return internImpl(str);
+  // Most of the names are there already, so look them up first.
+  {
+    std::shared_lock<std::shared_mutex> Reader(*Lock);
+    Symbol sym = lookupImpl(str);
+    if (sym != InvalidSymbol)
+      return sym;
+  }
+  std::unique_lock<std::shared_mutex> Writer(*Lock);
+  return internImpl(str);
+}
+
+Symbol StringInterner::lookup(std::string_view str) const {
+  if (!Lock)
+    return lookupImpl(str);
+  std::shared_lock<std::shared_mutex> Reader(*Lock);
+  return lookupImpl(str);
+}
+
+std::string_view StringInterner::getStringLocked(Symbol sym) const {
+  std::shared_lock<std::shared_mutex> Reader(*Lock);
+  return Strings[sym];
+}
+
+void StringInterner::setConcurrent(bool concurrent) {
+  if (concurrent && !Lock)
+    Lock = std::make_unique<std::shared_mutex>();
+  else if (!concurrent)
+    Lock.reset();
+}
@@ -0,0 +1,110 @@
+// === This contains the implementation of the ThreadPool.
+
+#include "ThreadPool.h"
+
+#include <cassert>
+
+ThreadPool::ThreadPool(unsigned numOfThreads) {
+  if (!numOfThreads)
+    numOfThreads = 1;
+  for (unsigned i = 0; i < numOfThreads; ++i)
+    Workers.push_back(std::make_unique<Worker>());
+  for (unsigned i = 1; i < numOfThreads; ++i)
+    Threads.emplace_back([this, i] { workerMain(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    ShuttingDown = true;
+  }
+  WakeUp.notify_all();
+  for (auto &T : Threads)
+    T.join();
+}
+
+unsigned ThreadPool::getDefaultNumOfThreads() {
+  unsigned n = std::thread::hardware_concurrency();
+  return n ? n : 1;
+}
+
+bool ThreadPool::takeTask(unsigned self, size_t &task) {
+  {
+    Worker &Own = *Workers[self];
+    std::lock_guard<std::mutex> Guard(Own.Lock);
+    if (!Own.Tasks.empty()) {
+      task = Own.Tasks.back();
+      Own.Tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < Workers.size(); ++i) {
+    Worker &Victim = *Workers[(self + i) % Workers.size()];
+    std::lock_guard<std::mutex> Guard(Victim.Lock);
+    if (!Victim.Tasks.empty()) {
+      task = Victim.Tasks.front();
+      Victim.Tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::runTasks(unsigned self) {
+  size_t task;
+  while (takeTask(self, task)) {
+    // NOTE: The Job stays set as long as any of its tasks is pending.
+    (*Job)(task);
+    if (NumOfPending.fetch_sub(1) == 1) {
+      std::lock_guard<std::mutex> Guard(Lock);
+      AllDone.notify_all();
+    }
+  }
+}
+
+void ThreadPool::workerMain(unsigned self) {
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> Guard(Lock);
+      WakeUp.wait(Guard,
+                  [&] { return ShuttingDown || Generation != seen; });
+      if (ShuttingDown)
+        return;
+      seen = Generation;
+    }
+    runTasks(self);
+  }
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)> &fn) {
+  if (!n)
+    return;
+  if (Workers.size() == 1 || n == 1) {
+    for (size_t i = 0; i < n; ++i)
+      fn(i);
+    return;
+  }
+
+  assert(!Job && "The parallelFor() is not reentrant");
+  Job = &fn;
+  NumOfPending = n;
+  // Each thread starts with a contiguous range of the iterations.
+  size_t numOfWorkers = Workers.size();
+  for (size_t w = 0; w < numOfWorkers; ++w) {
+    Worker &W = *Workers[w];
+    std::lock_guard<std::mutex> Guard(W.Lock);
+    for (size_t i = w * n / numOfWorkers; i < (w + 1) * n / numOfWorkers; ++i)
+      W.Tasks.push_back(i);
+  }
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    ++Generation;
+  }
+  WakeUp.notify_all();
+
+  runTasks(0);
+  std::unique_lock<std::mutex> Guard(Lock);
+  AllDone.wait(Guard, [&] { return NumOfPending == 0; });
+  Job = nullptr;
+}
@@ -0,0 +1,439 @@
+// === This contains the verifier of the modules (see the Module::verify()).
+//
+// Unlike the asserts, the verifier doesn't trust any pointer before it is
+// found among the objects of the module, so it reports the corrupted IR
+// instead of crashing on it.
+
+#include "CodeGen.h"
+#include "OutputStream.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Kind = VerifierDiagnostic::Kind;
+
+const char *getKindName(Kind K) {
+  switch (K) {
+  case Kind::BadParent:
+    return "bad-parent";
+  case Kind::BadName:
+    return "bad-name";
+  case Kind::BadNumber:
+    return "bad-number";
+  case Kind::NoEntry:
+    return "no-entry";
+  case Kind::DanglingSuccessor:
+    return "dangling-successor";
+  case Kind::BadPredecessors:
+    return "bad-predecessors";
+  case Kind::Unreachable:
+    return "unreachable";
+  case Kind::BadArity:
+    return "bad-arity";
+  case Kind::BadOperand:
+    return "bad-operand";
+  case Kind::BadUseList:
+    return "bad-use-list";
+  }
+  return "";
+}
+
+template <typename T> bool contains(const std::vector<T> &Sorted, T value) {
+  return std::binary_search(Sorted.begin(), Sorted.end(), value);
+}
+
+// This is a set of the instructions, for checking the users of the uses.
+// Those are looked up in a random order, so this is an open addressing hash
+// table (rather than a sorted vector, whose lookups would miss the cache at
+// each step).
+class InstructionSet {
+  std::vector<const Instruction *> Slots;
+  // The log2 of the number of the slots.
+  unsigned Shift = 1;
+
+  size_t slotFor(const Instruction *I) const {
+    return (reinterpret_cast<uintptr_t>(I) >> 4) * 0x9E3779B97F4A7C15ull >>
+           (64 - Shift);
+  }
+
+public:
+  explicit InstructionSet(size_t numOfInstrs) {
+    while ((size_t(1) << Shift) < numOfInstrs * 2)
+      ++Shift;
+    Slots.assign(size_t(1) << Shift, nullptr);
+  }
+  void insert(const Instruction *I) {
+    size_t slot = slotFor(I);
+    while (Slots[slot] && Slots[slot] != I)
+      slot = (slot + 1) & (Slots.size() - 1);
+    Slots[slot] = I;
+  }
+  bool count(const Instruction *I) const {
+    for (size_t slot = slotFor(I); Slots[slot];
+         slot = (slot + 1) & (Slots.size() - 1))
+      if (Slots[slot] == I)
+        return true;
+    return false;
+  }
+};
+
+// This checks a single function. The objects shared by the functions (the
+// vars and their use lists) are only looked at, not followed, so the
+// checkers of the different functions run in parallel.
+class FunctionVerifier {
+  const Module &M;
+  const Function &F;
+  // The vars of the module, sorted by the address.
+  const std::vector<const GlobalVariable *> &Vars;
+  std::string FnName;
+  std::vector<VerifierDiagnostic> &Diags;
+  // The bbs of the function, sorted by the address, and by the number.
+  std::vector<const BasicBlock *> BBs;
+  std::vector<const BasicBlock *> BBByNumber;
+
+  std::string getName(Symbol sym) const {
+    if (sym >= M.getSymbols().size())
+      return "<symbol " + std::to_string(sym) + ">";
+    return std::string(M.getSymbols().getString(sym));
+  }
+  void report(Kind K, const BasicBlock *BB, std::string Message) {
+    Diags.push_back({K, FnName, BB ? getName(BB->getBBSymbol()) : "",
+                     std::move(Message)});
+  }
+
+  void verifyBlocks();
+  void verifyEdges();
+  void verifyReachability();
+  void verifyInstructions(const BasicBlock *BB);
+
+public:
+  // The instructions owned by the function's bbs, and the number of their
+  // operands referring to the vars of the module (for the checks of the
+  // use lists).
+  std::vector<const Instruction *> Instrs;
+  size_t NumOfOps = 0;
+
+  FunctionVerifier(const Module &m, const Function &f,
+                   const std::vector<const GlobalVariable *> &vars,
+                   std::vector<VerifierDiagnostic> &diags)
+      : M(m), F(f), Vars(vars), Diags(diags) {
+    FnName = getName(F.getFnSymbol());
+  }
+
+  void run() {
+    if (F.getParent() != &M)
+      report(Kind::BadParent, nullptr, "the function is not of this module");
+    if (M.getFunctions().lookup(F.getFnSymbol()) != &F)
+      report(Kind::BadName, nullptr,
+             "the function is not found under its own name");
+    verifyBlocks();
+    verifyEdges();
+    verifyReachability();
+    for (const BasicBlock *BB : BBByNumber)
+      if (BB)
+        verifyInstructions(BB);
+  }
+};
+
+void FunctionVerifier::verifyBlocks() {
+  BBByNumber.assign(F.getMaxBBNumber(), nullptr);
+  for (const auto &Entry : F.getBasicBlocks()) {
+    const BasicBlock *BB = Entry.second;
+    BBs.push_back(BB);
+    if (BB->getParent() != &F)
+      report(Kind::BadParent, BB, "the bb is not of this function");
+    if (BB->getBBSymbol() != Entry.first)
+      report(Kind::BadName, BB,
+             "the bb is listed under the name '" + getName(Entry.first) +
+                 "'");
+    unsigned number = BB->getNumber();
+    if (number >= BBByNumber.size())
+      report(Kind::BadNumber, BB,
+             "the number " + std::to_string(number) + " is out of range");
+    else if (BBByNumber[number])
+      report(Kind::BadNumber, BB,
+             "the number " + std::to_string(number) +
+                 " is taken by the bb '" +
+                 getName(BBByNumber[number]->getBBSymbol()) + "'");
+    else
+      BBByNumber[number] = BB;
+  }
+  std::sort(BBs.begin(), BBs.end());
+
+  const BasicBlock *Entry = F.getEntryBB();
+  if (!BBs.empty() && !(Entry && contains(BBs, Entry)))
+    report(Kind::NoEntry, nullptr,
+           Entry ? "the entry bb is not of this function"
+                 : "the function has no entry bb");
+}
+
+void FunctionVerifier::verifyEdges() {
+  // The edges (by the source and the target) seen via the successors and
+  // via the predecessors, which must be the same multisets.
+  std::vector<std::pair<const BasicBlock *, const BasicBlock *>> Succs, Preds;
+  for (const BasicBlock *BB : BBByNumber) {
+    if (!BB)
+      continue;
+    for (const auto &Edge : BB->getSuccessors()) {
+      if (Edge.first >= M.getSymbols().size())
+        report(Kind::DanglingSuccessor, BB,
+               "the tag " + std::to_string(Edge.first) + " is unknown");
+      if (!contains(BBs, static_cast<const BasicBlock *>(Edge.second))) {
+        report(Kind::DanglingSuccessor, BB,
+               "the successor via the tag '" + getName(Edge.first) +
+                   "' is not a bb of this function");
+        continue;
+      }
+      Succs.emplace_back(BB, Edge.second);
+    }
+    for (const BasicBlock *Pred : BB->predecessors()) {
+      if (!contains(BBs, Pred)) {
+        report(Kind::BadPredecessors, BB,
+               "a predecessor is not a bb of this function");
+        continue;
+      }
+      Preds.emplace_back(Pred, BB);
+    }
+  }
+  std::sort(Succs.begin(), Succs.end());
+  std::sort(Preds.begin(), Preds.end());
+  if (Succs == Preds)
+    return;
+
+  // Report the targets whose predecessors differ, each one once.
+  std::vector<const BasicBlock *> Mismatched;
+  std::vector<std::pair<const BasicBlock *, const BasicBlock *>> Diff;
+  std::set_symmetric_difference(Succs.begin(), Succs.end(), Preds.begin(),
+                                Preds.end(), std::back_inserter(Diff));
+  for (const auto &Edge : Diff)
+    Mismatched.push_back(Edge.second);
+  std::sort(Mismatched.begin(), Mismatched.end());
+  Mismatched.erase(std::unique(Mismatched.begin(), Mismatched.end()),
+                   Mismatched.end());
+  std::stable_sort(Mismatched.begin(), Mismatched.end(),
+                   [](const BasicBlock *A, const BasicBlock *B) {
+                     return A->getNumber() < B->getNumber();
+                   });
+  for (const BasicBlock *BB : Mismatched)
+    report(Kind::BadPredecessors, BB,
+           "the predecessors don't match the successor edges");
+}
+
+void FunctionVerifier::verifyReachability() {
+  const BasicBlock *Entry = F.getEntryBB();
+  if (!Entry || !contains(BBs, Entry))
+    return;
+  // NOTE: This doesn't use the depth_first(), since it would follow the
+  // dangling successors.
+  std::vector<bool> Visited(BBByNumber.size());
+  std::vector<const BasicBlock *> Worklist;
+  auto visit = [&](const BasicBlock *BB) {
+    unsigned number = BB->getNumber();
+    if (number >= Visited.size() || BBByNumber[number] != BB ||
+        Visited[number])
+      return;
+    Visited[number] = true;
+    Worklist.push_back(BB);
+  };
+  visit(Entry);
+  while (!Worklist.empty()) {
+    const BasicBlock *BB = Worklist.back();
+    Worklist.pop_back();
+    for (const BasicBlock *Succ : BB->successors())
+      if (contains(BBs, Succ))
+        visit(Succ);
+  }
+  for (size_t i = 0; i < BBByNumber.size(); ++i)
+    if (BBByNumber[i] && !Visited[i])
+      report(Kind::Unreachable, BBByNumber[i],
+             "the bb is not reachable from the entry bb");
+}
+
+void FunctionVerifier::verifyInstructions(const BasicBlock *BB) {
+  const InstrustionList &List = BB->instructions();
+  for (size_t i = 0; i < List.size(); ++i) {
+    const Instruction *I = List[i];
+    // NOTE: The messages are built only for the problems found.
+    auto where = [i]() { return "the instruction #" + std::to_string(i); };
+    if (!I) {
+      report(Kind::BadParent, BB, where() + " is null");
+      continue;
+    }
+    // The instructions shared by a copy-on-write clone belong to the bb
+    // the clone was made from, so they are counted there.
+    bool owned = I->getParent() == BB;
+    if (!owned && !(BB->sharesInstructions() &&
+                    &I->getParent()->instructions() == &List)) {
+      report(Kind::BadParent, BB, where() + " is not of this bb");
+      continue;
+    }
+
+    size_t numOfOps = I->getNumOfOps();
+    bool goodArity = false;
+    switch (I->getOpCodeKind()) {
+    case Instruction::OpCodeKind::Load:
+      goodArity = numOfOps == 1;
+      break;
+    case Instruction::OpCodeKind::Store:
+      goodArity = numOfOps == 2;
+      break;
+    case Instruction::OpCodeKind::Add:
+      goodArity = numOfOps >= 3;
+      break;
+    }
+    if (!goodArity)
+      report(Kind::BadArity, BB,
+             where() + " (" + std::string(I->getOpCode()) + ") has " +
+                 std::to_string(numOfOps) + " operands");
+
+    for (unsigned k = 0; k < numOfOps; ++k) {
+      const Use &U = I->getOperandUse(k);
+      auto operand = [&]() {
+        return where() + ", operand #" + std::to_string(k);
+      };
+      if (U.getUser() != I)
+        report(Kind::BadUseList, BB, operand() + " has a wrong user");
+      if (!U.get())
+        report(Kind::BadOperand, BB, operand() + " is null");
+      else if (!contains(Vars, static_cast<const GlobalVariable *>(U.get())))
+        report(Kind::BadOperand, BB,
+               operand() + " is not a var of this module");
+      else if (owned)
+        ++NumOfOps;
+    }
+    if (owned)
+      Instrs.push_back(I);
+  }
+}
+
+// This checks a var and its use list, against the instructions of the
+// module.
+void verifyVar(const Module &M, unsigned id, const GlobalVariable *GV,
+               const InstructionSet &Instrs,
+               size_t maxNumOfUses, std::vector<VerifierDiagnostic> &Diags,
+               size_t &numOfUses) {
+  auto report = [&](Kind K, const std::string &Message) {
+    Diags.push_back(
+        {K, "", "", "the var !" + std::to_string(id) + " " + Message});
+  };
+  if (GV->getParent() != &M)
+    report(Kind::BadParent, "is not of this module");
+  if (GV->getID() != id)
+    report(Kind::BadName, "has the id " + std::to_string(GV->getID()));
+
+  numOfUses = 0;
+  for (const Use &U : GV->uses()) {
+    // A cycle would make the list longer than all the operands.
+    if (++numOfUses > maxNumOfUses) {
+      report(Kind::BadUseList, "has a cyclic use list");
+      return;
+    }
+    if (U.get() != GV) {
+      report(Kind::BadUseList, "has a use of another var");
+      continue;
+    }
+    const Instruction *User = U.getUser();
+    if (!User || !Instrs.count(User)) {
+      report(Kind::BadUseList, "has a use by an unknown instruction");
+      continue;
+    }
+    bool found = false;
+    for (unsigned k = 0; k < User->getNumOfOps() && !found; ++k)
+      found = &User->getOperandUse(k) == &U;
+    if (!found)
+      report(Kind::BadUseList, "has a use which is not an operand");
+  }
+}
+
+} // end anonymous namespace
+
+void VerifierDiagnostic::print(OutputStream &OS) const {
+  OS << "error: " << getKindName(K) << ": ";
+  if (!FnName.empty())
+    OS << "fn " << FnName << ": ";
+  if (!BBName.empty())
+    OS << "bb " << BBName << ": ";
+  OS << Message << '\n';
+}
+
+bool Module::verify(std::vector<VerifierDiagnostic> &Diags,
+                    unsigned numOfThreads) const {
+  size_t numOfDiags = Diags.size();
+  ThreadPool Pool(numOfThreads ? numOfThreads
+                               : ThreadPool::getDefaultNumOfThreads());
+
+  std::vector<const GlobalVariable *> Vars;
+  Vars.reserve(GlobalVariables.size());
+  for (const auto &Entry : GlobalVariables)
+    Vars.push_back(Entry.second);
+  std::sort(Vars.begin(), Vars.end());
+
+  // I) Check the functions in parallel. They are sorted by the name (as
+  // the printers do), so the diagnostics come in the same order each time.
+  std::vector<const Function *> Fns;
+  Fns.reserve(Functions.size());
+  for (const auto &Entry : Functions)
+    Fns.push_back(Entry.second);
+  std::sort(Fns.begin(), Fns.end(), [this](const Function *A,
+                                           const Function *B) {
+    return Symbols.getString(A->getFnSymbol()) <
+           Symbols.getString(B->getFnSymbol());
+  });
+  std::vector<std::vector<VerifierDiagnostic>> FnDiags(Fns.size());
+  std::vector<std::vector<const Instruction *>> FnInstrs(Fns.size());
+  std::vector<size_t> FnNumOfOps(Fns.size());
+  Pool.parallelFor(Fns.size(), [&](size_t i) {
+    FunctionVerifier FV(*this, *Fns[i], Vars, FnDiags[i]);
+    FV.run();
+    FnInstrs[i] = std::move(FV.Instrs);
+    FnNumOfOps[i] = FV.NumOfOps;
+  });
+
+  size_t numOfInstrs = 0, numOfOps = 0;
+  for (size_t i = 0; i < Fns.size(); ++i) {
+    Diags.insert(Diags.end(), FnDiags[i].begin(), FnDiags[i].end());
+    numOfInstrs += FnInstrs[i].size();
+    numOfOps += FnNumOfOps[i];
+  }
+  InstructionSet Instrs(numOfInstrs);
+  for (const auto &List : FnInstrs)
+    for (const Instruction *I : List)
+      Instrs.insert(I);
+
+  // II) Check the use lists of the vars, in parallel chunks (by the id).
+  std::vector<std::pair<unsigned, const GlobalVariable *>> VarList(
+      GlobalVariables.begin(), GlobalVariables.end());
+  const size_t ChunkSize = 1024;
+  size_t numOfChunks = (VarList.size() + ChunkSize - 1) / ChunkSize;
+  std::vector<std::vector<VerifierDiagnostic>> VarDiags(numOfChunks);
+  std::vector<size_t> ChunkNumOfUses(numOfChunks);
+  Pool.parallelFor(numOfChunks, [&](size_t c) {
+    size_t end = std::min(VarList.size(), (c + 1) * ChunkSize);
+    for (size_t i = c * ChunkSize; i < end; ++i) {
+      size_t numOfUses = 0;
+      verifyVar(*this, VarList[i].first, VarList[i].second, Instrs,
+                numOfOps, VarDiags[c], numOfUses);
+      ChunkNumOfUses[c] += numOfUses;
+    }
+  });
+
+  size_t numOfUses = 0;
+  for (size_t c = 0; c < numOfChunks; ++c) {
+    Diags.insert(Diags.end(), VarDiags[c].begin(), VarDiags[c].end());
+    numOfUses += ChunkNumOfUses[c];
+  }
+  // Each operand (of a var of this module) must be on a use list.
+  if (numOfUses != numOfOps)
+    Diags.push_back({Kind::BadUseList, "", "",
+                     "the use lists have " + std::to_string(numOfUses) +
+                         " uses, but the instructions have " +
+                         std::to_string(numOfOps) + " operands"});
+  return Diags.size() == numOfDiags;
+}
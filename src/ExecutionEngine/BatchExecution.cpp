@@ -0,0 +1,291 @@
+// === This contains the batch execution of the revLANG functions.
+//
+// The lanes of a tile go through the CFG together. Each bb keeps the mask
+// of the lanes waiting to run it, and the pending bb which comes first in
+// the reverse postorder is run next, so the lanes which took different
+// successors meet again as soon as possible. The instructions are run as
+// the loops over the columns of the tile, which the compiler turns into
+// the SIMD code. When only some of the lanes are active, the results are
+// blended in by the lane mask.
+
+#include "BatchFunction.h"
+#include "BitVector.h"
+#include "CFGTraversal.h"
+#include "ExecutionEngine.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace {
+
+constexpr size_t TileSize = ExecutionBatch::TileSize;
+
+// The sums wrap around, so they are done in the unsigned.
+inline int64_t add(int64_t a, int64_t b) {
+  return static_cast<int64_t>(static_cast<uint64_t>(a) +
+                              static_cast<uint64_t>(b));
+}
+
+// Returns the a where the mask is all ones, and the b where it is 0.
+inline int64_t select(int64_t mask, int64_t a, int64_t b) {
+  return (a & mask) | (b & ~mask);
+}
+
+// Lowers the function for the batch runs, with the vars at the Slots. The
+// unreachable bbs are dropped.
+std::unique_ptr<BatchFunction> lowerForBatch(const Function &F,
+                                             const VarSlots &Slots) {
+  auto BF = std::make_unique<BatchFunction>();
+  auto &Names = F.getParent()->getSymbols();
+  ReversePostOrderTraversal RPOT(F);
+
+  std::vector<uint32_t> Indices(F.getMaxBBNumber());
+  uint32_t numOfBlocks = 0;
+  for (BasicBlock *BB : RPOT)
+    Indices[BB->getNumber()] = numOfBlocks++;
+
+  for (BasicBlock *BB : RPOT) {
+    BatchBlock Block;
+    Block.BB = BB;
+    Block.FirstOp = BF->Ops.size();
+    Block.NumOfOps = BB->getNumOfInstrs();
+    for (const Instruction *I : BB->instructions()) {
+      BF->Ops.push_back({I->getOpCodeKind(),
+                         static_cast<uint32_t>(BF->Operands.size()),
+                         static_cast<uint32_t>(I->getNumOfOps())});
+      for (auto *Op : I->getOps()) {
+        assert(Slots.getSlot(*Op) < Slots.size() &&
+               "The var is not of the module");
+        BF->Operands.push_back(Slots.getSlot(*Op));
+      }
+    }
+    for (const auto *S : BB->getSuccessors().sorted(Names)) {
+      std::string_view tag = Names.getString(S->first);
+      if (tag == "true")
+        Block.TrueIdx = Block.Tags.size();
+      else if (tag == "false")
+        Block.FalseIdx = Block.Tags.size();
+      Block.Tags.push_back(tag);
+      Block.Succs.push_back(Indices[S->second->getNumber()]);
+    }
+    BF->Blocks.push_back(std::move(Block));
+  }
+  return BF;
+}
+
+// The state of a run of a tile.
+class TileRunner {
+  const BatchFunction &BF;
+  ExecutionBatch &Batch;
+  const BatchBranchDecision &Decide;
+  size_t FirstLane = 0;
+
+  // The masks of the lanes waiting for each bb, and the set of the bbs
+  // with any lane waiting.
+  std::vector<uint8_t> Pending;
+  BitVector PendingBlocks;
+
+  alignas(64) uint8_t Active[TileSize];
+  // The Active, widened to the masks for the select().
+  alignas(64) int64_t ActiveMask[TileSize];
+  alignas(64) int64_t LastLoaded[TileSize];
+  alignas(64) int64_t Sum[TileSize];
+  alignas(64) uint32_t Choices[TileSize];
+
+  int64_t *getColumn(uint32_t slot) {
+    return Batch.getSlotColumn(slot) + FirstLane;
+  }
+
+  void runOp(const BatchOp &Op, bool allActive);
+  void runTerminator(const BatchBlock &Block);
+  void addLanes(uint32_t succ, const uint8_t *Lanes);
+
+public:
+  TileRunner(const BatchFunction &bf, ExecutionBatch &batch,
+             const BatchBranchDecision &decide)
+      : BF(bf), Batch(batch), Decide(decide),
+        Pending(bf.Blocks.size() * TileSize), PendingBlocks(bf.Blocks.size()) {}
+
+  // Runs the tile. Returns false if it hits the block limit.
+  bool run(size_t firstLane, uint64_t maxBlocks, uint64_t &numOfLaneBlocks);
+};
+
+void TileRunner::runOp(const BatchOp &Op, bool allActive) {
+  const uint32_t *Slots = BF.Operands.data() + Op.FirstOperand;
+  switch (Op.Kind) {
+  case Instruction::OpCodeKind::Load: {
+    const int64_t *Src = getColumn(Slots[0]);
+    if (allActive) {
+      std::memcpy(LastLoaded, Src, sizeof(LastLoaded));
+      return;
+    }
+    for (size_t i = 0; i < TileSize; ++i)
+      LastLoaded[i] = select(ActiveMask[i], Src[i], LastLoaded[i]);
+    return;
+  }
+  case Instruction::OpCodeKind::Store: {
+    const int64_t *Src = getColumn(Slots[0]);
+    int64_t *Dst = getColumn(Slots[1]);
+    if (Src == Dst)
+      return;
+    if (allActive) {
+      std::memcpy(Dst, Src, TileSize * sizeof(int64_t));
+      return;
+    }
+    for (size_t i = 0; i < TileSize; ++i)
+      Dst[i] = select(ActiveMask[i], Src[i], Dst[i]);
+    return;
+  }
+  case Instruction::OpCodeKind::Add: {
+    int64_t *Dst = getColumn(Slots[0]);
+    const int64_t *A = getColumn(Slots[1]);
+    const int64_t *B = getColumn(Slots[2]);
+    for (size_t i = 0; i < TileSize; ++i)
+      Sum[i] = add(A[i], B[i]);
+    for (uint32_t op = 3; op < Op.NumOfOps; ++op) {
+      const int64_t *Src = getColumn(Slots[op]);
+      for (size_t i = 0; i < TileSize; ++i)
+        Sum[i] = add(Sum[i], Src[i]);
+    }
+    if (allActive) {
+      std::memcpy(Dst, Sum, sizeof(Sum));
+      return;
+    }
+    for (size_t i = 0; i < TileSize; ++i)
+      Dst[i] = select(ActiveMask[i], Sum[i], Dst[i]);
+    return;
+  }
+  }
+}
+
+void TileRunner::addLanes(uint32_t succ, const uint8_t *Lanes) {
+  uint8_t *Waiting = Pending.data() + succ * TileSize;
+  uint8_t any = 0;
+  for (size_t i = 0; i < TileSize; ++i) {
+    Waiting[i] |= Lanes[i];
+    any |= Lanes[i];
+  }
+  if (any)
+    PendingBlocks.set(succ);
+}
+
+void TileRunner::runTerminator(const BatchBlock &Block) {
+  switch (Block.Succs.size()) {
+  case 0:
+    return;
+  case 1:
+    addLanes(Block.Succs[0], Active);
+    return;
+  default:
+    break;
+  }
+
+  if (Decide) {
+    std::fill(std::begin(Choices), std::end(Choices), UINT32_MAX);
+    Decide(BatchBranchState{Block.BB, Block.Tags, FirstLane, Active,
+                            LastLoaded, &Batch},
+           Choices);
+  } else {
+    for (size_t i = 0; i < TileSize; ++i)
+      Choices[i] = LastLoaded[i] ? Block.TrueIdx : Block.FalseIdx;
+  }
+
+  // The lanes with the choice out of the range return.
+  alignas(64) uint8_t Taken[TileSize];
+  for (uint32_t succ = 0; succ < Block.Succs.size(); ++succ) {
+    for (size_t i = 0; i < TileSize; ++i)
+      Taken[i] = Active[i] & (Choices[i] == succ);
+    addLanes(Block.Succs[succ], Taken);
+  }
+}
+
+bool TileRunner::run(size_t firstLane, uint64_t maxBlocks,
+                     uint64_t &numOfLaneBlocks) {
+  FirstLane = firstLane;
+  std::fill(Pending.begin(), Pending.end(), 0);
+  PendingBlocks.assign(false);
+  std::fill(std::begin(LastLoaded), std::end(LastLoaded), 0);
+
+  // The padding lanes (past the end of the batch) never run.
+  size_t numOfLanes =
+      std::min(TileSize, Batch.getNumOfLanes() - firstLane);
+  std::fill(Pending.begin(), Pending.begin() + numOfLanes, 1);
+  PendingBlocks.set(0);
+
+  uint64_t numOfBlocks = 0;
+  for (ptrdiff_t b = PendingBlocks.findFirst(); b >= 0;
+       b = PendingBlocks.findFirst()) {
+    if (numOfBlocks++ == maxBlocks)
+      return false;
+    PendingBlocks.reset(b);
+    // A bb can be its own successor, so its mask is cleared first.
+    uint8_t *Waiting = Pending.data() + b * TileSize;
+    std::memcpy(Active, Waiting, TileSize);
+    std::memset(Waiting, 0, TileSize);
+
+    size_t numOfActive = 0;
+    for (size_t i = 0; i < TileSize; ++i)
+      numOfActive += Active[i];
+    numOfLaneBlocks += numOfActive;
+
+    const BatchBlock &Block = BF.Blocks[b];
+    bool allActive = numOfActive == TileSize;
+    if (!allActive && Block.NumOfOps)
+      for (size_t i = 0; i < TileSize; ++i)
+        ActiveMask[i] = -static_cast<int64_t>(Active[i]);
+    for (uint32_t op = 0; op < Block.NumOfOps; ++op)
+      runOp(BF.Ops[Block.FirstOp + op], allActive);
+    runTerminator(Block);
+  }
+  return true;
+}
+
+} // end anonymous namespace
+
+ExecutionBatch::ExecutionBatch(const Module &M, size_t numOfLanes)
+    : NumOfLanes(numOfLanes),
+      Stride((numOfLanes + TileSize - 1) / TileSize * TileSize), Slots(M) {
+  Values.assign(Slots.size() * Stride, 0);
+}
+
+const BatchFunction &
+ExecutionEngine::getBatchCompiled(const Function &F,
+                                  const VarSlots &BatchSlots) {
+  auto &BF = BatchCompiled[&F];
+  if (!BF || BF->Epoch != F.getEpoch() ||
+      BF->VarsEpoch != BatchSlots.getEpoch()) {
+    BF = lowerForBatch(F, BatchSlots);
+    BF->Epoch = F.getEpoch();
+    BF->VarsEpoch = BatchSlots.getEpoch();
+  }
+  return *BF;
+}
+
+bool ExecutionEngine::runBatch(const Function &F, ExecutionBatch &Batch,
+                               std::string &errMsg) {
+  assert(F.getParent() == &M && "The function is from another module");
+  NumOfExecutedBlocks = 0;
+  if (!F.getEntryBB()) {
+    errMsg = "function '" + std::string(F.getFnID()) + "' has no entry bb";
+    return false;
+  }
+  // The slots of the batch are the ones of the module as it is now.
+  if (Batch.getSlots().getEpoch() != M.getVarsEpoch()) {
+    errMsg = "the batch doesn't match the vars of the module";
+    return false;
+  }
+
+  const BatchFunction &BF = getBatchCompiled(F, Batch.getSlots());
+  // The runner has the tile-sized buffers, so it goes to the heap.
+  auto Runner = std::make_unique<TileRunner>(BF, Batch, BatchDecide);
+  for (size_t lane = 0; lane < Batch.getNumOfLanes(); lane += TileSize) {
+    if (!Runner->run(lane, MaxBlocks, NumOfExecutedBlocks)) {
+      errMsg = "function '" + std::string(F.getFnID()) +
+               "' hit the limit of " + std::to_string(MaxBlocks) +
+               " executed bbs";
+      return false;
+    }
+  }
+  return true;
+}
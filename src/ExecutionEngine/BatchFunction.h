@@ -0,0 +1,46 @@
+//=== The form of the functions used by the batch runs (internal to the
+//=== ExecutionEngine library).
+
+#ifndef REVLANG_BATCHFUNCTION_H
+#define REVLANG_BATCHFUNCTION_H
+
+#include "CodeGen.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// This represents an instruction. The operands are the slots of the vars
+// (see the VarSlots), i.e. their columns within the batch.
+struct BatchOp {
+  Instruction::OpCodeKind Kind;
+  uint32_t FirstOperand;
+  uint32_t NumOfOps;
+};
+
+// This represents a bb. The successors are the indices of the bbs.
+struct BatchBlock {
+  const BasicBlock *BB;
+  uint32_t FirstOp;
+  uint32_t NumOfOps;
+  // The tags are sorted, and the successors are in the same order.
+  std::vector<std::string_view> Tags;
+  std::vector<uint32_t> Succs;
+  // The default decision.
+  uint32_t TrueIdx = 0;
+  uint32_t FalseIdx = 0;
+};
+
+// The bbs are in the reverse postorder, so the entry bb is the first one.
+class BatchFunction {
+public:
+  std::vector<BatchOp> Ops;
+  std::vector<uint32_t> Operands;
+  std::vector<BatchBlock> Blocks;
+  // The epoch of the function this was lowered from, and the one of the
+  // vars of the module.
+  uint64_t Epoch = 0;
+  uint64_t VarsEpoch = 0;
+};
+
+#endif // REVLANG_BATCHFUNCTION_H
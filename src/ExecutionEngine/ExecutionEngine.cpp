@@ -0,0 +1,415 @@
+// === This contains the implementation of the revLANG interpreter.
+
+#include "ExecutionEngine.h"
+#include "BatchFunction.h"
+#include "CFGTraversal.h"
+#include "JIT.h"
+
+#include <algorithm>
+#include <cassert>
+
+// The computed gotos (the "labels as values") are a GNU extension. Define
+// the REVLANG_NO_DIRECT_THREADING to use the portable switch instead.
+#if defined(__GNUC__) && !defined(REVLANG_NO_DIRECT_THREADING)
+#define REVLANG_DIRECT_THREADED 1
+#endif
+
+namespace {
+
+// The layout of the bytecode is:
+//   OP_LOAD var
+//   OP_STORE src, dst
+//   OP_ADD2 dst, a, b
+//   OP_ADDN dst, numOfSrcs, src...
+//   OP_JUMP offset
+//   OP_BRANCH site
+//   OP_RET
+// The vars are their slots (see the VarSlots), and the offsets are
+// relative to the start of the code. When the code is direct-threaded, each
+// opcode is replaced by the address of its handler (as the offset from the
+// first handler, so the code stays 32-bit).
+enum OpCode : int32_t {
+  OP_LOAD,
+  OP_STORE,
+  OP_ADD2,
+  OP_ADDN,
+  OP_JUMP,
+  OP_BRANCH,
+  OP_RET,
+  NumOfOpCodes
+};
+
+} // end anonymous namespace
+
+// This represents a bb with two or more successors.
+struct BranchSite {
+  const BasicBlock *BB;
+  // The tags are sorted, and the targets are in the same order.
+  std::vector<std::string_view> Tags;
+  std::vector<uint32_t> Targets;
+  // The default decision.
+  uint32_t TrueIdx = 0;
+  uint32_t FalseIdx = 0;
+};
+
+class CompiledFunction {
+public:
+  std::vector<int32_t> Code;
+  std::vector<BranchSite> Sites;
+  // The epoch of the function this was lowered from, and the one of the
+  // vars of the module.
+  uint64_t Epoch = 0;
+  uint64_t VarsEpoch = 0;
+};
+
+namespace {
+
+enum class RunStatus { Done, BlockLimit };
+
+// The state of a single run.
+struct RunContext {
+  int64_t *Vars;
+  size_t NumOfVars;
+  const VarSlots *Slots;
+  const BranchDecision *Decide;
+  uint64_t MaxBlocks;
+  uint64_t NumOfBlocks = 0;
+};
+
+// Runs the code. If the CF is null, this just returns the table of the
+// handlers (see the OpCode).
+RunStatus interpret(const CompiledFunction *CF, RunContext *Ctx,
+                    const int32_t **Handlers) {
+#ifdef REVLANG_DIRECT_THREADED
+  const char *Base = static_cast<const char *>(&&Handle_OP_LOAD);
+  auto offsetOf = [Base](const void *Handler) {
+    return static_cast<int32_t>(static_cast<const char *>(Handler) - Base);
+  };
+  static const int32_t HandlerOffsets[NumOfOpCodes] = {
+      offsetOf(&&Handle_OP_LOAD),  offsetOf(&&Handle_OP_STORE),
+      offsetOf(&&Handle_OP_ADD2),  offsetOf(&&Handle_OP_ADDN),
+      offsetOf(&&Handle_OP_JUMP),  offsetOf(&&Handle_OP_BRANCH),
+      offsetOf(&&Handle_OP_RET),
+  };
+  if (!CF) {
+    *Handlers = HandlerOffsets;
+    return RunStatus::Done;
+  }
+#define HANDLER(op) Handle_##op:
+#define DISPATCH() goto *static_cast<const void *>(Base + *pc)
+#define DISPATCH_BEGIN() DISPATCH();
+#define DISPATCH_END()
+#else
+  static const int32_t Identity[NumOfOpCodes] = {
+      OP_LOAD, OP_STORE, OP_ADD2, OP_ADDN, OP_JUMP, OP_BRANCH, OP_RET};
+  if (!CF) {
+    *Handlers = Identity;
+    return RunStatus::Done;
+  }
+#define HANDLER(op) case op:
+#define DISPATCH() continue
+#define DISPATCH_BEGIN()                                                       \
+  for (;;) {                                                                   \
+    switch (*pc) {
+#define DISPATCH_END()                                                         \
+  }                                                                            \
+  }
+#endif
+
+  const int32_t *Code = CF->Code.data();
+  const int32_t *pc = Code;
+  int64_t *Vars = Ctx->Vars;
+  int64_t LastLoaded = 0;
+  uint64_t NumOfBlocks = Ctx->NumOfBlocks;
+  const uint64_t MaxBlocks = Ctx->MaxBlocks;
+  RunStatus Status = RunStatus::Done;
+
+  // The values wrap around, so the sums are done in the unsigned.
+  auto add = [](int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) +
+                                static_cast<uint64_t>(b));
+  };
+
+  DISPATCH_BEGIN()
+  HANDLER(OP_LOAD) {
+    LastLoaded = Vars[pc[1]];
+    pc += 2;
+    DISPATCH();
+  }
+  HANDLER(OP_STORE) {
+    Vars[pc[2]] = Vars[pc[1]];
+    pc += 3;
+    DISPATCH();
+  }
+  HANDLER(OP_ADD2) {
+    Vars[pc[1]] = add(Vars[pc[2]], Vars[pc[3]]);
+    pc += 4;
+    DISPATCH();
+  }
+  HANDLER(OP_ADDN) {
+    int64_t sum = 0;
+    for (int32_t i = 0; i < pc[2]; ++i)
+      sum = add(sum, Vars[pc[3 + i]]);
+    Vars[pc[1]] = sum;
+    pc += 3 + pc[2];
+    DISPATCH();
+  }
+  HANDLER(OP_JUMP) {
+    if (++NumOfBlocks >= MaxBlocks) {
+      Status = RunStatus::BlockLimit;
+      goto Exit;
+    }
+    pc = Code + pc[1];
+    DISPATCH();
+  }
+  HANDLER(OP_BRANCH) {
+    if (++NumOfBlocks >= MaxBlocks) {
+      Status = RunStatus::BlockLimit;
+      goto Exit;
+    }
+    const BranchSite &Site = CF->Sites[pc[1]];
+    size_t idx;
+    if (*Ctx->Decide)
+      idx = (*Ctx->Decide)(BranchState{
+          Site.BB, Site.Tags, LastLoaded,
+          ArrayRef<int64_t>(Vars, Ctx->NumOfVars), Ctx->Slots});
+    else
+      idx = LastLoaded ? Site.TrueIdx : Site.FalseIdx;
+    if (idx >= Site.Targets.size())
+      goto Exit;
+    pc = Code + Site.Targets[idx];
+    DISPATCH();
+  }
+  HANDLER(OP_RET) {
+    ++NumOfBlocks;
+    goto Exit;
+  }
+  DISPATCH_END()
+
+#undef HANDLER
+#undef DISPATCH
+#undef DISPATCH_BEGIN
+#undef DISPATCH_END
+
+Exit:
+  Ctx->NumOfBlocks = NumOfBlocks;
+  return Status;
+}
+
+const int32_t *getHandlers() {
+  static const int32_t *Handlers = [] {
+    const int32_t *Res = nullptr;
+    interpret(nullptr, nullptr, &Res);
+    return Res;
+  }();
+  return Handlers;
+}
+
+// Lowers the function into the bytecode. The bbs are laid out in the
+// reverse postorder, starting with the entry bb, and the unreachable
+// ones are dropped.
+std::unique_ptr<CompiledFunction> lower(const Function &F,
+                                        const VarSlots &Slots) {
+  auto CF = std::make_unique<CompiledFunction>();
+  auto &Code = CF->Code;
+  const int32_t *Handlers = getHandlers();
+  auto &Names = F.getParent()->getSymbols();
+
+  std::vector<uint32_t> Offsets(F.getMaxBBNumber());
+  // The places to be patched with the offset of the bb.
+  std::vector<std::pair<size_t, const BasicBlock *>> Fixups;
+
+  for (BasicBlock *BB : ReversePostOrderTraversal(F)) {
+    Offsets[BB->getNumber()] = Code.size();
+    for (const Instruction *I : BB->instructions()) {
+      auto Ops = I->getOps();
+      auto slotOf = [&Slots](const GlobalVariable *GV) {
+        uint32_t slot = Slots.getSlot(*GV);
+        assert(slot < Slots.size() && "The var is not of the module");
+        return static_cast<int32_t>(slot);
+      };
+      switch (I->getOpCodeKind()) {
+      case Instruction::OpCodeKind::Load:
+        Code.push_back(Handlers[OP_LOAD]);
+        Code.push_back(slotOf(Ops[0]));
+        break;
+      case Instruction::OpCodeKind::Store:
+        Code.push_back(Handlers[OP_STORE]);
+        Code.push_back(slotOf(Ops[0]));
+        Code.push_back(slotOf(Ops[1]));
+        break;
+      case Instruction::OpCodeKind::Add:
+        if (Ops.size() == 3) {
+          Code.push_back(Handlers[OP_ADD2]);
+        } else {
+          Code.push_back(Handlers[OP_ADDN]);
+          Code.push_back(slotOf(Ops.front()));
+          Code.push_back(Ops.size() - 1);
+          for (size_t i = 1; i < Ops.size(); ++i)
+            Code.push_back(slotOf(Ops[i]));
+          break;
+        }
+        for (auto *Op : Ops)
+          Code.push_back(slotOf(Op));
+        break;
+      }
+    }
+
+    switch (BB->getNumOfSuccessors()) {
+    case 0:
+      Code.push_back(Handlers[OP_RET]);
+      break;
+    case 1:
+      Code.push_back(Handlers[OP_JUMP]);
+      Fixups.push_back({Code.size(), *BB->succ_begin()});
+      Code.push_back(0);
+      break;
+    default: {
+      Code.push_back(Handlers[OP_BRANCH]);
+      Code.push_back(CF->Sites.size());
+      BranchSite Site;
+      Site.BB = BB;
+      for (const auto *S : BB->getSuccessors().sorted(Names)) {
+        std::string_view tag = Names.getString(S->first);
+        if (tag == "true")
+          Site.TrueIdx = Site.Tags.size();
+        else if (tag == "false")
+          Site.FalseIdx = Site.Tags.size();
+        Site.Tags.push_back(tag);
+        // The targets are patched below, once all the bbs are placed.
+        Site.Targets.push_back(S->second->getNumber());
+      }
+      CF->Sites.push_back(std::move(Site));
+      break;
+    }
+    }
+  }
+
+  for (const auto &Fixup : Fixups)
+    Code[Fixup.first] = Offsets[Fixup.second->getNumber()];
+  for (auto &Site : CF->Sites)
+    for (auto &Target : Site.Targets)
+      Target = Offsets[Target];
+  return CF;
+}
+
+} // end anonymous namespace
+
+VarSlots::VarSlots(const Module &M)
+    : NumOfSlots(M.getGlobalVars().size()), Epoch(M.getVarsEpoch()) {
+  auto &GVs = M.getGlobalVars();
+  if (GVs.empty() || GVs.rbegin()->first == NumOfSlots - 1)
+    return;
+  IDs.reserve(NumOfSlots);
+  for (const auto &Entry : GVs)
+    IDs.push_back(Entry.first);
+}
+
+uint32_t VarSlots::getSlot(unsigned id) const {
+  if (IDs.empty())
+    return id < NumOfSlots ? id : NumOfSlots;
+  auto It = std::lower_bound(IDs.begin(), IDs.end(), id);
+  return It != IDs.end() && *It == id ? It - IDs.begin() : NumOfSlots;
+}
+
+ExecutionEngine::ExecutionEngine(Module &m) : M(m) { resetValues(); }
+
+// NOTE: This is out of line, since the CompiledFunction and the
+// BatchFunction are complete here.
+ExecutionEngine::~ExecutionEngine() {}
+
+void ExecutionEngine::resetValues() {
+  Slots = VarSlots(M);
+  Vars.assign(Slots.size(), 0);
+}
+
+void ExecutionEngine::updateSlots() {
+  if (Slots.getEpoch() == M.getVarsEpoch())
+    return;
+  // The values are kept by the var ids, and the new vars are set to 0.
+  VarSlots NewSlots(M);
+  std::vector<int64_t> NewVars(NewSlots.size(), 0);
+  for (uint32_t slot = 0; slot < Slots.size(); ++slot) {
+    uint32_t newSlot = NewSlots.getSlot(Slots.getID(slot));
+    if (newSlot < NewSlots.size())
+      NewVars[newSlot] = Vars[slot];
+  }
+  Slots = std::move(NewSlots);
+  Vars = std::move(NewVars);
+}
+
+int64_t ExecutionEngine::getValue(const GlobalVariable &GV) const {
+  // The Slots may be behind the module, but they still describe the Vars.
+  uint32_t slot = Slots.getSlot(GV);
+  return slot < Vars.size() ? Vars[slot] : 0;
+}
+
+void ExecutionEngine::setValue(const GlobalVariable &GV, int64_t value) {
+  assert(GV.getParent() == &M && "The var is from another module");
+  updateSlots();
+  uint32_t slot = Slots.getSlot(GV);
+  assert(slot < Vars.size() && "The var is not of the module");
+  if (slot < Vars.size())
+    Vars[slot] = value;
+}
+
+const CompiledFunction &ExecutionEngine::getCompiled(const Function &F) {
+  auto &CF = Compiled[&F];
+  if (!CF || CF->Epoch != F.getEpoch() ||
+      CF->VarsEpoch != Slots.getEpoch()) {
+    CF = lower(F, Slots);
+    CF->Epoch = F.getEpoch();
+    CF->VarsEpoch = Slots.getEpoch();
+  }
+  return *CF;
+}
+
+void ExecutionEngine::setJIT(JITCache *jit) {
+  assert((!jit || &jit->getModule() == &M) &&
+         "The JIT is of another module");
+  JIT = jit;
+}
+
+void ExecutionEngine::invalidate(const Function &F) {
+  Compiled.erase(&F);
+  BatchCompiled.erase(&F);
+}
+
+bool ExecutionEngine::run(const Function &F, std::string &errMsg) {
+  assert(F.getParent() == &M && "The function is from another module");
+  NumOfExecutedBlocks = 0;
+  if (!F.getEntryBB()) {
+    errMsg = "function '" + std::string(F.getFnID()) + "' has no entry bb";
+    return false;
+  }
+
+  // The vars might have been added (or removed) since the last run.
+  updateSlots();
+
+  RunStatus Status;
+  if (JIT) {
+    const JITFunction *Fn = JIT->getCompiled(F, errMsg);
+    if (!Fn)
+      return false;
+    JITContext Ctx;
+    Ctx.Vars = Vars.data();
+    Ctx.NumOfVars = Vars.size();
+    Ctx.Slots = &Slots;
+    Ctx.MaxBlocks = MaxBlocks;
+    Ctx.Decide = &Decide;
+    Status = Fn->run(Ctx) ? RunStatus::Done : RunStatus::BlockLimit;
+    NumOfExecutedBlocks = Ctx.NumOfBlocks;
+  } else {
+    const CompiledFunction &CF = getCompiled(F);
+    RunContext Ctx{Vars.data(), Vars.size(), &Slots, &Decide, MaxBlocks};
+    Status = interpret(&CF, &Ctx, nullptr);
+    NumOfExecutedBlocks = Ctx.NumOfBlocks;
+  }
+  if (Status == RunStatus::BlockLimit) {
+    errMsg = "function '" + std::string(F.getFnID()) +
+             "' hit the limit of " + std::to_string(MaxBlocks) +
+             " executed bbs";
+    return false;
+  }
+  return true;
+}
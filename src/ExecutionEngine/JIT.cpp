@@ -0,0 +1,399 @@
+// === This contains the x86-64 native code generator (see the JIT.h).
+
+#include "JIT.h"
+#include "CFGTraversal.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define REVLANG_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// The registers, by their encoding.
+enum Reg : uint8_t {
+  RAX = 0,
+  RBX = 3,
+  RSI = 6,
+  RDI = 7,
+  R12 = 12,
+  R13 = 13,
+  R14 = 14,
+  R15 = 15
+};
+
+// While the code runs, the registers hold:
+//   RBX  the base of the vars
+//   R12  the JITContext
+//   R13  the number of the executed bbs
+//   R14  the block limit
+//   R15  the value read by the last LOAD
+// They are all callee-saved, so they survive the calls of the hooks.
+constexpr Reg VarsReg = RBX;
+constexpr Reg CtxReg = R12;
+constexpr Reg BlocksReg = R13;
+constexpr Reg LimitReg = R14;
+constexpr Reg LoadedReg = R15;
+
+// The vars are addressed by the 32-bit displacements.
+constexpr uint64_t MaxNumOfVars = (uint64_t(1) << 31) / sizeof(int64_t);
+
+// This emits the x86-64 instructions the lowering needs.
+class X86Emitter {
+public:
+  std::vector<uint8_t> Bytes;
+
+  void byte(uint8_t b) { Bytes.push_back(b); }
+  void imm32(uint32_t v) {
+    for (unsigned i = 0; i < 4; ++i)
+      byte(v >> (8 * i));
+  }
+  void imm64(uint64_t v) {
+    for (unsigned i = 0; i < 8; ++i)
+      byte(v >> (8 * i));
+  }
+  void rex(Reg reg, Reg rm) {
+    byte(0x48 | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0));
+  }
+
+  // The "op reg, [base + disp]" (or "op [base + disp], reg") forms.
+  void memOp(uint8_t opcode, Reg reg, Reg base, int32_t disp) {
+    rex(reg, base);
+    byte(opcode);
+    byte(0x80 | ((reg & 7) << 3) | (base & 7));
+    // The RSP and the R12 bases need the SIB byte.
+    if ((base & 7) == 4)
+      byte(0x24);
+    imm32(disp);
+  }
+  void load(Reg dst, Reg base, int32_t disp) { memOp(0x8B, dst, base, disp); }
+  void store(Reg base, int32_t disp, Reg src) { memOp(0x89, src, base, disp); }
+  void addFrom(Reg dst, Reg base, int32_t disp) {
+    memOp(0x03, dst, base, disp);
+  }
+
+  // The "op rm, reg" forms.
+  void regOp(uint8_t opcode, Reg rm, Reg reg) {
+    rex(reg, rm);
+    byte(opcode);
+    byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+  }
+  void mov(Reg dst, Reg src) { regOp(0x89, dst, src); }
+  // Sets the flags by the lhs - rhs.
+  void cmp(Reg lhs, Reg rhs) { regOp(0x39, lhs, rhs); }
+  void test(Reg lhs, Reg rhs) { regOp(0x85, lhs, rhs); }
+  void inc(Reg r) {
+    rex(RAX, r);
+    byte(0xFF);
+    byte(0xC0 | (r & 7));
+  }
+
+  void movImm32(Reg dst, uint32_t v) {
+    assert(dst < 8 && "Not supported");
+    byte(0xB8 + dst);
+    imm32(v);
+  }
+  void movImm64(Reg dst, uint64_t v) {
+    rex(RAX, dst);
+    byte(0xB8 + (dst & 7));
+    imm64(v);
+  }
+  void callReg(Reg r) {
+    assert(r < 8 && "Not supported");
+    byte(0xFF);
+    byte(0xD0 + r);
+  }
+  void jmpReg(Reg r) {
+    assert(r < 8 && "Not supported");
+    byte(0xFF);
+    byte(0xE0 + r);
+  }
+  void push(Reg r) {
+    if (r >= 8)
+      byte(0x41);
+    byte(0x50 + (r & 7));
+  }
+  void pop(Reg r) {
+    if (r >= 8)
+      byte(0x41);
+    byte(0x58 + (r & 7));
+  }
+  void ret() { byte(0xC3); }
+
+  // The jumps to the labels return the place of the rel32 to be patched
+  // (see the patch()).
+  size_t jmp() {
+    byte(0xE9);
+    imm32(0);
+    return Bytes.size() - 4;
+  }
+  // The "jae" (the unsigned >=) and the "je".
+  size_t jae() {
+    byte(0x0F);
+    byte(0x83);
+    imm32(0);
+    return Bytes.size() - 4;
+  }
+  size_t je() {
+    byte(0x0F);
+    byte(0x84);
+    imm32(0);
+    return Bytes.size() - 4;
+  }
+  void patch(size_t at, size_t target) {
+    int32_t rel = static_cast<int32_t>(target - (at + 4));
+    std::memcpy(&Bytes[at], &rel, sizeof(rel));
+  }
+};
+
+int32_t varOffset(const VarSlots &Slots, const GlobalVariable *GV) {
+  uint32_t slot = Slots.getSlot(*GV);
+  assert(slot < Slots.size() && "The var is not of the module");
+  return static_cast<int32_t>(slot * sizeof(int64_t));
+}
+
+// Picks the successor of the branch site, for the code. Returns the
+// address of its code, or nullptr to return from the function.
+const void *branchHook(JITContext *Ctx, uint32_t siteIdx) {
+  const JITBranchSite &Site = Ctx->Fn->getSite(siteIdx);
+  size_t idx;
+  if (Ctx->Decide && *Ctx->Decide)
+    idx = (*Ctx->Decide)(
+        BranchState{Site.BB, Site.Tags, Ctx->LastLoaded,
+                    ArrayRef<int64_t>(Ctx->Vars, Ctx->NumOfVars),
+                    Ctx->Slots});
+  else
+    idx = Ctx->LastLoaded ? Site.TrueIdx : Site.FalseIdx;
+  return idx < Site.Targets.size() ? Site.Targets[idx] : nullptr;
+}
+
+} // end anonymous namespace
+
+JITFunction::~JITFunction() {
+#ifdef REVLANG_JIT_X86_64
+  if (Code)
+    munmap(Code, MappedSize);
+#endif
+}
+
+bool JITFunction::run(JITContext &Ctx) const {
+  Ctx.Fn = this;
+  auto Entry = reinterpret_cast<uint64_t (*)(JITContext *)>(Code);
+  return Entry(&Ctx) == 0;
+}
+
+JITCache::JITCache(Module &m) : M(m) {}
+
+// NOTE: This is out of line, since the JITFunction is complete here.
+JITCache::~JITCache() {}
+
+bool JITCache::isSupported() {
+#ifdef REVLANG_JIT_X86_64
+  return true;
+#else
+  return false;
+#endif
+}
+
+const JITFunction *JITCache::getCompiled(const Function &F,
+                                         std::string &errMsg) {
+  assert(F.getParent() == &M && "The function is from another module");
+  if (Slots.getEpoch() != M.getVarsEpoch())
+    Slots = VarSlots(M);
+  auto &Fn = Functions[&F];
+  if (!Fn || Fn->Epoch != F.getEpoch() ||
+      Fn->VarsEpoch != Slots.getEpoch()) {
+    Fn = compile(F, errMsg);
+    if (!Fn) {
+      Functions.erase(&F);
+      return nullptr;
+    }
+    Fn->Epoch = F.getEpoch();
+    Fn->VarsEpoch = Slots.getEpoch();
+    ++NumOfCompilations;
+  }
+  return Fn.get();
+}
+
+void JITCache::invalidate(const Function &F) { Functions.erase(&F); }
+
+size_t JITCache::getCodeSize() const {
+  size_t size = 0;
+  for (const auto &Entry : Functions)
+    size += Entry.second->CodeSize;
+  return size;
+}
+
+// Lowers the function. The bbs are laid out in the reverse postorder,
+// starting with the entry bb, so the jumps to the next bb fall through,
+// and the unreachable bbs are dropped. The code returns 0 when the
+// function returns, and 1 when it hits the block limit.
+std::unique_ptr<JITFunction> JITCache::compile(const Function &F,
+                                               std::string &errMsg) {
+  std::string fnName(F.getFnID());
+  if (!isSupported()) {
+    errMsg = "function '" + fnName +
+             "' cannot be compiled: the JIT is not supported on this host";
+    return nullptr;
+  }
+  if (!F.getEntryBB()) {
+    errMsg = "function '" + fnName + "' has no entry bb";
+    return nullptr;
+  }
+  if (Slots.size() > MaxNumOfVars) {
+    errMsg = "function '" + fnName +
+             "' cannot be compiled: the module has too many vars";
+    return nullptr;
+  }
+
+  auto Fn = std::make_unique<JITFunction>();
+  auto &Names = M.getSymbols();
+  X86Emitter E;
+
+  // The prologue saves the registers (so the stack stays 16-byte aligned
+  // for the calls), and loads the state.
+  const Reg Saved[] = {RBX, R12, R13, R14, R15};
+  for (Reg R : Saved)
+    E.push(R);
+  E.mov(CtxReg, RDI);
+  E.load(VarsReg, CtxReg, offsetof(JITContext, Vars));
+  E.load(BlocksReg, CtxReg, offsetof(JITContext, NumOfBlocks));
+  E.load(LimitReg, CtxReg, offsetof(JITContext, MaxBlocks));
+  E.load(LoadedReg, CtxReg, offsetof(JITContext, LastLoaded));
+
+  std::vector<BasicBlock *> Order;
+  for (BasicBlock *BB : ReversePostOrderTraversal(F))
+    Order.push_back(BB);
+  std::vector<size_t> Offsets(F.getMaxBBNumber());
+  // The jumps to the bbs, and to the exits, to be patched.
+  std::vector<std::pair<size_t, const BasicBlock *>> Fixups;
+  std::vector<size_t> DoneFixups, LimitFixups;
+  // The bbs of the branch sites, whose targets are set below.
+  std::vector<std::vector<const BasicBlock *>> SiteTargets;
+
+  // Counts the bb, and leaves if it hits the block limit.
+  auto countBlock = [&E, &LimitFixups]() {
+    E.inc(BlocksReg);
+    E.cmp(BlocksReg, LimitReg);
+    LimitFixups.push_back(E.jae());
+  };
+
+  for (size_t b = 0; b < Order.size(); ++b) {
+    const BasicBlock *BB = Order[b];
+    const BasicBlock *Next = b + 1 < Order.size() ? Order[b + 1] : nullptr;
+    Offsets[BB->getNumber()] = E.Bytes.size();
+
+    for (const Instruction *I : BB->instructions()) {
+      auto Ops = I->getOps();
+      switch (I->getOpCodeKind()) {
+      case Instruction::OpCodeKind::Load:
+        E.load(LoadedReg, VarsReg, varOffset(Slots, Ops[0]));
+        break;
+      case Instruction::OpCodeKind::Store:
+        E.load(RAX, VarsReg, varOffset(Slots, Ops[0]));
+        E.store(VarsReg, varOffset(Slots, Ops[1]), RAX);
+        break;
+      case Instruction::OpCodeKind::Add:
+        // The sum wraps around, as the 64-bit add does.
+        E.load(RAX, VarsReg, varOffset(Slots, Ops[1]));
+        for (size_t i = 2; i < Ops.size(); ++i)
+          E.addFrom(RAX, VarsReg, varOffset(Slots, Ops[i]));
+        E.store(VarsReg, varOffset(Slots, Ops[0]), RAX);
+        break;
+      }
+    }
+
+    switch (BB->getNumOfSuccessors()) {
+    case 0:
+      E.inc(BlocksReg);
+      DoneFixups.push_back(E.jmp());
+      break;
+    case 1: {
+      countBlock();
+      const BasicBlock *Succ = *BB->succ_begin();
+      if (Succ != Next)
+        Fixups.push_back({E.jmp(), Succ});
+      break;
+    }
+    default: {
+      countBlock();
+      JITBranchSite Site;
+      Site.BB = BB;
+      SiteTargets.emplace_back();
+      for (const auto *S : BB->getSuccessors().sorted(Names)) {
+        std::string_view tag = Names.getString(S->first);
+        if (tag == "true")
+          Site.TrueIdx = Site.Tags.size();
+        else if (tag == "false")
+          Site.FalseIdx = Site.Tags.size();
+        Site.Tags.push_back(tag);
+        SiteTargets.back().push_back(S->second);
+      }
+      // The hook reads the last loaded value from the context.
+      E.store(CtxReg, offsetof(JITContext, LastLoaded), LoadedReg);
+      E.mov(RDI, CtxReg);
+      E.movImm32(RSI, Fn->Sites.size());
+      E.movImm64(RAX, reinterpret_cast<uint64_t>(&branchHook));
+      E.callReg(RAX);
+      E.test(RAX, RAX);
+      DoneFixups.push_back(E.je());
+      E.jmpReg(RAX);
+      Fn->Sites.push_back(std::move(Site));
+      break;
+    }
+    }
+  }
+
+  // The epilogue stores the state back, and returns the status.
+  size_t Limit = E.Bytes.size();
+  E.movImm32(RAX, 1);
+  size_t AfterStatus = E.jmp();
+  size_t Done = E.Bytes.size();
+  E.movImm32(RAX, 0);
+  E.patch(AfterStatus, E.Bytes.size());
+  E.store(CtxReg, offsetof(JITContext, NumOfBlocks), BlocksReg);
+  E.store(CtxReg, offsetof(JITContext, LastLoaded), LoadedReg);
+  for (size_t i = sizeof(Saved) / sizeof(Saved[0]); i-- > 0;)
+    E.pop(Saved[i]);
+  E.ret();
+
+  for (const auto &Fixup : Fixups)
+    E.patch(Fixup.first, Offsets[Fixup.second->getNumber()]);
+  for (size_t at : DoneFixups)
+    E.patch(at, Done);
+  for (size_t at : LimitFixups)
+    E.patch(at, Limit);
+
+#ifdef REVLANG_JIT_X86_64
+  // The code is written, and then made executable (but not writable).
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t mappedSize = (E.Bytes.size() + pageSize - 1) / pageSize * pageSize;
+  void *Code = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (Code == MAP_FAILED) {
+    errMsg = "function '" + fnName + "' cannot be compiled: out of memory";
+    return nullptr;
+  }
+  std::memcpy(Code, E.Bytes.data(), E.Bytes.size());
+  if (mprotect(Code, mappedSize, PROT_READ | PROT_EXEC)) {
+    munmap(Code, mappedSize);
+    errMsg = "function '" + fnName +
+             "' cannot be compiled: the code cannot be made executable";
+    return nullptr;
+  }
+  Fn->Code = Code;
+  Fn->CodeSize = E.Bytes.size();
+  Fn->MappedSize = mappedSize;
+#endif
+
+  const char *Base = static_cast<const char *>(Fn->Code);
+  for (size_t s = 0; s < Fn->Sites.size(); ++s)
+    for (const BasicBlock *Target : SiteTargets[s])
+      Fn->Sites[s].Targets.push_back(Base + Offsets[Target->getNumber()]);
+  return Fn;
+}
@@ -0,0 +1,490 @@
+// === This contains the implementation of the revLANG IR parser.
+
+#include "Parser.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+//
+// The lexer. The tokens are just views into the input buffer, so there is
+// no allocation per token.
+//
+
+enum class TokenKind {
+  Eof,
+  Error,
+  Name,
+  Colon,
+  Comma,
+  Equal,
+  Bang,
+  Semicolon,
+  LParen,
+  RParen
+};
+
+struct Token {
+  TokenKind Kind = TokenKind::Eof;
+  std::string_view Text;
+
+  bool is(TokenKind k) const { return Kind == k; }
+  bool isName(std::string_view name) const {
+    return Kind == TokenKind::Name && Text == name;
+  }
+};
+
+// Any char that is not a whitespace nor a punctuation can be used in a name
+// (e.g. "bb.0", "fn1", "42").
+struct NameCharTable {
+  bool Table[256];
+  constexpr NameCharTable() : Table() {
+    for (int c = 0; c < 256; ++c)
+      Table[c] = c > ' ' && c != ':' && c != ',' && c != '=' && c != '!' &&
+                 c != ';' && c != '(' && c != ')' && c != 127;
+  }
+};
+constexpr NameCharTable NameChars;
+
+class Lexer {
+  const char *Cur;
+  const char *End;
+
+  void skipWhitespace() {
+    while (Cur != End &&
+           (*Cur == ' ' || *Cur == '\t' || *Cur == '\n' || *Cur == '\r'))
+      ++Cur;
+  }
+
+public:
+  Lexer(std::string_view buffer)
+      : Cur(buffer.data()), End(buffer.data() + buffer.size()) {}
+
+  const char *getLoc() const { return Cur; }
+
+  Token lex() {
+    skipWhitespace();
+    Token tok;
+    if (Cur == End) {
+      tok.Text = std::string_view(Cur, 0);
+      return tok;
+    }
+
+    const char *start = Cur;
+    switch (*Cur++) {
+    case ':': tok.Kind = TokenKind::Colon; break;
+    case ',': tok.Kind = TokenKind::Comma; break;
+    case '=': tok.Kind = TokenKind::Equal; break;
+    case '!': tok.Kind = TokenKind::Bang; break;
+    case ';': tok.Kind = TokenKind::Semicolon; break;
+    case '(': tok.Kind = TokenKind::LParen; break;
+    case ')': tok.Kind = TokenKind::RParen; break;
+    default:
+      if (!NameChars.Table[static_cast<unsigned char>(*start)]) {
+        tok.Kind = TokenKind::Error;
+        break;
+      }
+      while (Cur != End && NameChars.Table[static_cast<unsigned char>(*Cur)])
+        ++Cur;
+      tok.Kind = TokenKind::Name;
+      break;
+    }
+    tok.Text = std::string_view(start, Cur - start);
+    return tok;
+  }
+
+  // Returns the next token without consuming it.
+  Token peek() {
+    const char *saved = Cur;
+    Token tok = lex();
+    Cur = saved;
+    return tok;
+  }
+
+  // Returns the rest of the current line (used for the ModuleID).
+  std::string_view lexRestOfLine() {
+    while (Cur != End && (*Cur == ' ' || *Cur == '\t'))
+      ++Cur;
+    const char *start = Cur;
+    while (Cur != End && *Cur != '\n')
+      ++Cur;
+    const char *end = Cur;
+    if (end != start && end[-1] == '\r')
+      --end;
+    return std::string_view(start, end - start);
+  }
+
+  // Lexes the "tag: <tag>" part of a successor (right after the '(').
+  // The tag is everything up to the ')', since the printer doesn't quote it.
+  bool lexTag(std::string_view &tag) {
+    static constexpr std::string_view prefix = "tag:";
+    if (std::string_view(Cur, End - Cur).substr(0, prefix.size()) != prefix)
+      return false;
+    Cur += prefix.size();
+    if (Cur != End && *Cur == ' ')
+      ++Cur;
+    const char *start = Cur;
+    while (Cur != End && *Cur != ')' && *Cur != '\n')
+      ++Cur;
+    if (Cur == End || *Cur != ')')
+      return false;
+    tag = std::string_view(start, Cur - start);
+    return true;
+  }
+};
+
+//
+// The parser. It creates the IR objects while going through the tokens.
+//
+
+class IRParser {
+  std::string_view Buffer;
+  const std::string &BufferName;
+  std::string &ErrMsg;
+  Lexer Lex;
+  Token Tok;
+
+  std::unique_ptr<Module> M;
+
+  // The vars with small IDs are looked up here, the rest within the Module.
+  static constexpr unsigned MaxDenseVarID = 1 << 20;
+  std::vector<GlobalVariable *> DenseVars;
+
+  // The per-function state.
+  struct BlockInfo {
+    BasicBlock *BB;
+    bool Defined;
+  };
+  Function *CurFn = nullptr;
+  BasicBlock *CurBB = nullptr;
+  std::unordered_map<std::string_view, BlockInfo> Blocks;
+  std::vector<BasicBlock *> BlocksInOrder;
+  std::vector<std::pair<std::string_view, BasicBlock *>> PendingSuccessors;
+  // The bb marked with the '; Entry'.
+  BasicBlock *MarkedEntry = nullptr;
+
+  // Reused for each instruction, to avoid the allocations.
+  OperandsTy Ops;
+
+  void next() { Tok = Lex.lex(); }
+
+  bool error(const char *loc, const std::string &msg) {
+    // Compute the line and the column lazily, since it is needed on
+    // errors only.
+    unsigned line = 1, col = 1;
+    for (const char *p = Buffer.data(); p != loc; ++p) {
+      if (*p == '\n') {
+        ++line;
+        col = 1;
+      } else {
+        ++col;
+      }
+    }
+    ErrMsg = BufferName + ":" + std::to_string(line) + ":" +
+             std::to_string(col) + ": error: " + msg;
+    return false;
+  }
+  bool error(const std::string &msg) { return error(Tok.Text.data(), msg); }
+
+  bool expect(TokenKind kind, const char *what) {
+    if (!Tok.is(kind))
+      return error(std::string("expected ") + what);
+    next();
+    return true;
+  }
+
+  bool expectName(std::string_view name) {
+    if (!Tok.isName(name))
+      return error("expected '" + std::string(name) + "'");
+    next();
+    return true;
+  }
+
+  bool parseID(unsigned &id) {
+    if (!Tok.is(TokenKind::Name))
+      return error("expected a variable ID");
+    uint64_t value = 0;
+    for (char c : Tok.Text) {
+      if (c < '0' || c > '9')
+        return error("expected a variable ID");
+      value = value * 10 + (c - '0');
+      if (value > UINT32_MAX)
+        return error("revLANG supports 2^32 variables only");
+    }
+    id = static_cast<unsigned>(value);
+    next();
+    return true;
+  }
+
+  GlobalVariable *lookupVar(unsigned id) const {
+    if (id < DenseVars.size())
+      return DenseVars[id];
+    auto &GVs = M->getGlobalVars();
+    auto GV = GVs.find(id);
+    return GV == GVs.end() ? nullptr : GV->second;
+  }
+
+  // var := 'var' '!' ID
+  bool parseVarDecl() {
+    const char *loc = Tok.Text.data();
+    next();
+    unsigned id;
+    if (!expect(TokenKind::Bang, "'!'") || !parseID(id))
+      return false;
+    if (M->getGlobalVars().count(id))
+      return error(loc, "redefinition of var !" + std::to_string(id));
+    auto *GV = GlobalVariable::create(id, M.get()).release();
+    if (id < MaxDenseVarID) {
+      if (id >= DenseVars.size())
+        DenseVars.resize(id + 1, nullptr);
+      DenseVars[id] = GV;
+    }
+    return true;
+  }
+
+  bool parseVarRef(GlobalVariable *&GV) {
+    const char *loc = Tok.Text.data();
+    if (!expectName("var"))
+      return false;
+    unsigned id;
+    if (!expect(TokenKind::Bang, "'!'") || !parseID(id))
+      return false;
+    GV = lookupVar(id);
+    if (!GV)
+      return error(loc, "use of undefined var !" + std::to_string(id));
+    return true;
+  }
+
+  BlockInfo &getOrCreateBlock(std::string_view name) {
+    auto BI = Blocks.find(name);
+    if (BI != Blocks.end())
+      return BI->second;
+    // The handle doesn't own the bb, since the Module uses the arena.
+    auto *BB = BasicBlock::create(name, CurFn).release();
+    return Blocks.emplace(name, BlockInfo{BB, false}).first->second;
+  }
+
+  // successors := ';' 'Successors' ':' (name '(' 'tag:' tag ')')*
+  bool parseSuccessors() {
+    next();
+    if (!expectName("Successors") || !expect(TokenKind::Colon, "':'"))
+      return false;
+    PendingSuccessors.clear();
+    // The list ends with the label of the bb it belongs to.
+    while (Tok.is(TokenKind::Name) && Lex.peek().is(TokenKind::LParen)) {
+      auto &Succ = getOrCreateBlock(Tok.Text);
+      next();
+      std::string_view tag;
+      if (!Lex.lexTag(tag))
+        return error(Lex.getLoc(), "expected 'tag: <tag>)'");
+      next();
+      if (!expect(TokenKind::RParen, "')'"))
+        return false;
+      PendingSuccessors.push_back({tag, Succ.BB});
+    }
+    if (!Tok.is(TokenKind::Name) || !Lex.peek().is(TokenKind::Colon))
+      return error("expected a basic block label after the successors");
+    return true;
+  }
+
+  // label := name ':' (';' 'Entry')?
+  bool parseLabel() {
+    auto &BI = getOrCreateBlock(Tok.Text);
+    if (BI.Defined)
+      return error("redefinition of basic block '" + std::string(Tok.Text) +
+                   "'");
+    BI.Defined = true;
+    BlocksInOrder.push_back(BI.BB);
+    CurBB = BI.BB;
+    next();
+    next();
+
+    if (Tok.is(TokenKind::Semicolon) && Lex.peek().isName("Entry")) {
+      if (MarkedEntry)
+        return error("more than one entry basic block in '" +
+                     std::string(CurFn->getFnID()) + "'");
+      MarkedEntry = CurBB;
+      next();
+      next();
+    }
+
+    for (const auto &S : PendingSuccessors) {
+      if (CurBB->getSuccessor(S.first))
+        return error("the successor with the tag '" + std::string(S.first) +
+                     "' already exists");
+      CurBB->addSuccessor(S.first, S.second);
+    }
+    PendingSuccessors.clear();
+    return true;
+  }
+
+  // instr := 'LOAD' var | 'STORE' var ',' var | var '=' 'ADD' var (',' var)+
+  bool parseInstruction() {
+    if (!CurBB)
+      return error("instruction outside of a basic block");
+
+    Ops.clear();
+    GlobalVariable *GV;
+    if (Tok.isName("LOAD")) {
+      next();
+      if (!parseVarRef(GV))
+        return false;
+      Ops.push_back(GV);
+      Load::create(Ops, CurBB);
+      return true;
+    }
+
+    if (Tok.isName("STORE")) {
+      next();
+      if (!parseVarRef(GV))
+        return false;
+      Ops.push_back(GV);
+      if (!expect(TokenKind::Comma, "','") || !parseVarRef(GV))
+        return false;
+      Ops.push_back(GV);
+      Store::create(Ops, CurBB);
+      return true;
+    }
+
+    if (!parseVarRef(GV))
+      return false;
+    Ops.push_back(GV);
+    if (!expect(TokenKind::Equal, "'='") || !expectName("ADD") ||
+        !parseVarRef(GV))
+      return false;
+    Ops.push_back(GV);
+    while (Tok.is(TokenKind::Comma)) {
+      next();
+      if (!parseVarRef(GV))
+        return false;
+      Ops.push_back(GV);
+    }
+    if (Ops.size() < 3)
+      return error("ADD must have 2+ source operands");
+    Add::create(Ops, CurBB);
+    return true;
+  }
+
+  // function := 'def' name '(' ')' ':' ('empty' 'function' | block*)
+  bool parseFunction() {
+    next();
+    if (!Tok.is(TokenKind::Name))
+      return error("expected a function name");
+    std::string_view name = Tok.Text;
+    if (M->getFunction(name))
+      return error("redefinition of function '" + std::string(name) + "'");
+    next();
+    if (!expect(TokenKind::LParen, "'('") ||
+        !expect(TokenKind::RParen, "')'") || !expect(TokenKind::Colon, "':'"))
+      return false;
+
+    CurFn = Function::create(name, M.get()).release();
+    CurBB = nullptr;
+    Blocks.clear();
+    BlocksInOrder.clear();
+    MarkedEntry = nullptr;
+
+    if (Tok.isName("empty")) {
+      next();
+      return expectName("function");
+    }
+
+    while (true) {
+      if (Tok.is(TokenKind::Semicolon)) {
+        if (!parseSuccessors() || !parseLabel())
+          return false;
+      } else if (Tok.is(TokenKind::Name) &&
+                 Lex.peek().is(TokenKind::Colon)) {
+        if (!parseLabel())
+          return false;
+      } else if (Tok.isName("LOAD") || Tok.isName("STORE") ||
+                 Tok.isName("var")) {
+        if (!parseInstruction())
+          return false;
+      } else {
+        break;
+      }
+    }
+
+    for (const auto &BI : Blocks)
+      if (!BI.second.Defined)
+        return error("use of undefined basic block '" +
+                     std::string(BI.first) + "' in '" + std::string(name) +
+                     "'");
+
+    // Pick the entry bb (see the NOTE in the Parser.h).
+    if (BlocksInOrder.empty())
+      return true;
+    BasicBlock *Entry = MarkedEntry;
+    if (!Entry) {
+      for (auto *BB : BlocksInOrder) {
+        if (BB->getNumOfPredecessors())
+          continue;
+        if (Entry) {
+          Entry = nullptr;
+          break;
+        }
+        Entry = BB;
+      }
+      if (!Entry)
+        return error(name.data(), "cannot tell the entry basic block of '" +
+                                      std::string(name) +
+                                      "'; mark it with '; Entry'");
+    }
+    CurFn->setEntryBB(Entry);
+    return true;
+  }
+
+public:
+  IRParser(std::string_view buffer, const std::string &bufferName,
+           std::string &errMsg)
+      : Buffer(buffer), BufferName(bufferName), ErrMsg(errMsg),
+        Lex(buffer) {}
+
+  // module := 'ModuleID' ':' rest-of-line (var | function)*
+  std::unique_ptr<Module> parseModule() {
+    next();
+    if (!expectName("ModuleID"))
+      return nullptr;
+    if (!Tok.is(TokenKind::Colon)) {
+      error("expected ':'");
+      return nullptr;
+    }
+    M = Module::create(std::string(Lex.lexRestOfLine()), /*useArena=*/true);
+    next();
+
+    while (!Tok.is(TokenKind::Eof)) {
+      bool ok;
+      if (Tok.isName("var"))
+        ok = parseVarDecl();
+      else if (Tok.isName("def"))
+        ok = parseFunction();
+      else
+        ok = error("expected 'var' or 'def'");
+      if (!ok)
+        return nullptr;
+    }
+    return std::move(M);
+  }
+};
+
+} // end anonymous namespace
+
+std::unique_ptr<Module> parseRevLangBuffer(std::string_view buffer,
+                                           std::string &errMsg,
+                                           const std::string &bufferName) {
+  IRParser P(buffer, bufferName, errMsg);
+  return P.parseModule();
+}
+
+std::unique_ptr<Module> parseRevLangFile(const std::string &filename,
+                                         std::string &errMsg) {
+  MappedFile File;
+  if (!File.open(filename, errMsg))
+    return nullptr;
+  return parseRevLangBuffer(File.getBuffer(), errMsg, filename);
+}
@@ -0,0 +1,171 @@
+// === This contains the cleanup passes (see the Passes.h).
+
+#include "BitVector.h"
+#include "CFGTraversal.h"
+#include "Passes.h"
+
+#include <vector>
+
+namespace {
+
+// Removes the bb, which must not have any edges or instructions left.
+void eraseBlock(Function &F, BasicBlock *BB) {
+  F.removeBasicBlock(IRPtr<BasicBlock>(BB, IRDeleter<BasicBlock>(true)));
+}
+
+class UnreachableBlockElim : public FunctionPass {
+public:
+  std::string_view getName() const override { return "unreachable-bbs"; }
+
+  bool runOnFunction(Function &F, ModuleUpdates &) override {
+    // Without the entry bb, there is nothing to tell the reachability by.
+    if (!F.getEntryBB())
+      return false;
+
+    BitVector Reachable(F.getMaxBBNumber());
+    size_t numOfReachable = 0;
+    for (BasicBlock *BB : depth_first(F)) {
+      Reachable.set(BB->getNumber());
+      ++numOfReachable;
+    }
+    if (numOfReachable == F.getNumberOfBBs())
+      return false;
+
+    std::vector<BasicBlock *> Dead;
+    for (const auto &BB : F.getBasicBlocks())
+      if (!Reachable.test(BB.second->getNumber()))
+        Dead.push_back(BB.second);
+    // The dead bbs may branch to each other, and the removeBasicBlock()
+    // drops the edges of each of them.
+    for (BasicBlock *BB : Dead) {
+      BB->removeAllInstructions();
+      eraseBlock(F, BB);
+    }
+    return true;
+  }
+};
+
+class MergeBlocks : public FunctionPass {
+public:
+  std::string_view getName() const override { return "merge-bbs"; }
+
+  bool runOnFunction(Function &F, ModuleUpdates &) override {
+    Symbol Untagged = F.getParent()->getSymbols().lookup("");
+    if (Untagged == InvalidSymbol || !F.getEntryBB())
+      return false;
+
+    // In the reverse postorder, a chain is merged into its first bb, so
+    // each instruction and edge moves only once.
+    std::vector<BasicBlock *> Order;
+    for (BasicBlock *BB : ReversePostOrderTraversal(F))
+      Order.push_back(BB);
+    BitVector Merged(F.getMaxBBNumber());
+    std::vector<SuccessorBBList::Entry> Edges;
+    bool changed = false;
+
+    for (BasicBlock *BB : Order) {
+      if (Merged.test(BB->getNumber()))
+        continue;
+      while (BB->getNumOfSuccessors() == 1) {
+        const auto &Edge = *BB->getSuccessors().begin();
+        BasicBlock *Succ = Edge.second;
+        if (Edge.first != Untagged || Succ == BB ||
+            Succ->getNumOfPredecessors() != 1 || Succ == F.getEntryBB())
+          break;
+
+        BB->removeSuccessor(Succ);
+        BB->moveInstructionsFrom(Succ);
+        Edges.assign(Succ->getSuccessors().begin(),
+                     Succ->getSuccessors().end());
+        for (const auto &E : Edges)
+          Succ->removeSuccessor(E.second);
+        auto &Names = F.getParent()->getSymbols();
+        for (const auto &E : Edges)
+          BB->addSuccessor(Names.getString(E.first), E.second);
+        Merged.set(Succ->getNumber());
+        eraseBlock(F, Succ);
+        changed = true;
+      }
+    }
+    return changed;
+  }
+};
+
+class EmptyBlockElim : public FunctionPass {
+public:
+  std::string_view getName() const override { return "empty-bbs"; }
+
+  bool runOnFunction(Function &F, ModuleUpdates &) override {
+    if (!F.getEntryBB())
+      return false;
+
+    // In the postorder, the successor of a chain of the empty bbs is
+    // forwarded to first, so each edge is forwarded only once.
+    std::vector<BasicBlock *> Order;
+    for (BasicBlock *BB : post_order(F))
+      Order.push_back(BB);
+    bool changed = false;
+
+    for (BasicBlock *BB : Order) {
+      if (BB == F.getEntryBB() || BB->getNumOfInstrs() ||
+          BB->getNumOfSuccessors() != 1)
+        continue;
+      BasicBlock *Succ = *BB->succ_begin();
+      if (Succ == BB)
+        continue;
+      while (BB->getNumOfPredecessors())
+        BB->getPredecessors().back()->replaceSuccessor(BB, Succ);
+      BB->removeSuccessor(Succ);
+      eraseBlock(F, BB);
+      changed = true;
+    }
+    return changed;
+  }
+};
+
+class EmptyFunctionElim : public FunctionPass {
+public:
+  std::string_view getName() const override { return "empty-fns"; }
+
+  bool runOnFunction(Function &F, ModuleUpdates &Updates) override {
+    if (!F.empty()) {
+      BasicBlock *Entry = F.getEntryBB();
+      if (F.getNumberOfBBs() != 1 || !Entry || Entry->getNumOfInstrs() ||
+          Entry->getNumOfSuccessors())
+        return false;
+      eraseBlock(F, Entry);
+    }
+    // The function list belongs to the module.
+    Updates.defer([&F](Module &M) {
+      M.removeFunction(IRPtr<Function>(&F, IRDeleter<Function>(true)));
+    });
+    return true;
+  }
+};
+
+} // end anonymous namespace
+
+std::unique_ptr<FunctionPass> createUnreachableBlockElimPass() {
+  return std::make_unique<UnreachableBlockElim>();
+}
+
+std::unique_ptr<FunctionPass> createMergeBlocksPass() {
+  return std::make_unique<MergeBlocks>();
+}
+
+std::unique_ptr<FunctionPass> createEmptyBlockElimPass() {
+  return std::make_unique<EmptyBlockElim>();
+}
+
+std::unique_ptr<FunctionPass> createEmptyFunctionElimPass() {
+  return std::make_unique<EmptyFunctionElim>();
+}
+
+void addCleanupPasses(PassManager &PM) {
+  // The empty bbs are forwarded over before the merging, so the chains
+  // they were splitting are merged, too.
+  PM.addPass(createUnreachableBlockElimPass());
+  PM.addPass(createEmptyBlockElimPass());
+  PM.addPass(createMergeBlocksPass());
+  PM.addPass(createEmptyFunctionElimPass());
+}
@@ -0,0 +1,63 @@
+// === This contains the dead store elimination (see the Passes.h).
+
+#include "Casting.h"
+#include "DataFlow.h"
+#include "Passes.h"
+
+#include <vector>
+
+namespace {
+
+class DeadStoreElim : public FunctionPass {
+public:
+  std::string_view getName() const override { return "dse"; }
+
+  bool runOnFunction(Function &F, ModuleUpdates &) override {
+    if (!F.getEntryBB())
+      return false;
+
+    LiveVariables LV(F);
+    // The indices of the dead instructions within the bb (a copy-on-write
+    // clone gets the copies once they are removed).
+    std::vector<uint32_t> Dead;
+    bool changed = false;
+    for (const auto &Entry : F.getBasicBlocks()) {
+      BasicBlock *BB = Entry.second;
+      if (!LV.isReachable(BB))
+        continue;
+
+      // The dead writes don't read their operands, so the writes feeding
+      // them (within the bb) are dead as well.
+      BitVector Live = LV.getLiveOut(BB);
+      const auto &Instrs = BB->instructions();
+      for (uint32_t idx = Instrs.size(); idx-- > 0;) {
+        const Instruction *I = Instrs[idx];
+        GlobalVariable *GV = getWrittenVar(I);
+        bool isNoOp = isa<Store>(I) && I->getOperand(0) == GV;
+        if (GV && (isNoOp || !Live.test(LV.getVarIndex(GV))))
+          Dead.push_back(idx);
+        else
+          LV.stepBackward(I, Live);
+      }
+      if (Dead.empty())
+        continue;
+
+      // The Dead is in the reverse order of the instructions.
+      uint32_t idx = 0;
+      BB->removeInstructionsIf([&Dead, &idx](const Instruction *) {
+        if (Dead.empty() || Dead.back() != idx++)
+          return false;
+        Dead.pop_back();
+        return true;
+      });
+      changed = true;
+    }
+    return changed;
+  }
+};
+
+} // end anonymous namespace
+
+std::unique_ptr<FunctionPass> createDeadStoreElimPass() {
+  return std::make_unique<DeadStoreElim>();
+}
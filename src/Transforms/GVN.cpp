@@ -0,0 +1,275 @@
+// === This contains the value numbering pass (see the Passes.h).
+
+#include "Casting.h"
+#include "Dominators.h"
+#include "Passes.h"
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// This maps the ADD expressions, i.e. the sorted lists of the value numbers
+// of the summands, to the value numbers of the sums. The lists are stored
+// back to back in a single vector, each after its length, and they are
+// found via an open addressing (linear probing) hash table, so the lookups
+// don't allocate.
+class ExpressionTable {
+  static constexpr uint32_t EmptySlot = ~0u;
+
+  struct Entry {
+    // The index of the length of the list within the Operands.
+    uint32_t Offset;
+    uint32_t Hash;
+    uint32_t Value;
+  };
+  std::vector<uint32_t> Operands;
+  std::vector<Entry> Entries;
+  // The indices into the Entries.
+  std::vector<uint32_t> Slots;
+
+  static uint32_t hashOperands(const std::vector<uint32_t> &Ops) {
+    uint64_t hash = Ops.size();
+    for (uint32_t op : Ops)
+      hash = (hash ^ op) * 0x9E3779B97F4A7C15ull;
+    return static_cast<uint32_t>(hash >> 32);
+  }
+
+  bool matches(const Entry &E, uint32_t hash,
+               const std::vector<uint32_t> &Ops) const {
+    if (E.Hash != hash || Operands[E.Offset] != Ops.size())
+      return false;
+    return std::equal(Ops.begin(), Ops.end(),
+                      Operands.begin() + E.Offset + 1);
+  }
+
+  size_t findSlot(uint32_t hash, const std::vector<uint32_t> &Ops) const {
+    size_t mask = Slots.size() - 1;
+    size_t slot = hash & mask;
+    while (Slots[slot] != EmptySlot &&
+           !matches(Entries[Slots[slot]], hash, Ops))
+      slot = (slot + 1) & mask;
+    return slot;
+  }
+
+  void grow() {
+    Slots.assign(std::max<size_t>(Slots.size() * 2, 64), EmptySlot);
+    size_t mask = Slots.size() - 1;
+    for (uint32_t i = 0; i < Entries.size(); ++i) {
+      size_t slot = Entries[i].Hash & mask;
+      while (Slots[slot] != EmptySlot)
+        slot = (slot + 1) & mask;
+      Slots[slot] = i;
+    }
+  }
+
+public:
+  // Returns the value of the expression, making it the newValue if it is
+  // not there yet.
+  uint32_t getOrInsert(const std::vector<uint32_t> &Ops, uint32_t newValue) {
+    if ((Entries.size() + 1) * 2 > Slots.size())
+      grow();
+    uint32_t hash = hashOperands(Ops);
+    size_t slot = findSlot(hash, Ops);
+    if (Slots[slot] != EmptySlot)
+      return Entries[Slots[slot]].Value;
+
+    Slots[slot] = Entries.size();
+    Entries.push_back({static_cast<uint32_t>(Operands.size()), hash, newValue});
+    Operands.push_back(Ops.size());
+    Operands.insert(Operands.end(), Ops.begin(), Ops.end());
+    return newValue;
+  }
+};
+
+// This holds the value numbers of the vars (and of the last loaded value)
+// at a point of the function. The changes are logged, so they can be
+// undone when the walk goes back up the dominator tree. A new generation
+// forgets all the values at once: the slots set in an older one get the
+// new value numbers on their first use.
+class ValueNumbering {
+  std::vector<uint32_t> Values;
+  std::vector<uint32_t> Generations;
+  uint32_t Generation = 0;
+  uint32_t NextValue = 0;
+
+  struct Change {
+    uint32_t Slot;
+    uint32_t Value;
+    uint32_t Generation;
+  };
+  std::vector<Change> Log;
+
+public:
+  explicit ValueNumbering(size_t numOfSlots)
+      : Values(numOfSlots), Generations(numOfSlots, ~0u) {}
+
+  uint32_t getNewValue() { return NextValue++; }
+
+  uint32_t get(uint32_t slot) {
+    if (Generations[slot] != Generation)
+      set(slot, getNewValue());
+    return Values[slot];
+  }
+  void set(uint32_t slot, uint32_t value) {
+    Log.push_back({slot, Values[slot], Generations[slot]});
+    Values[slot] = value;
+    Generations[slot] = Generation;
+  }
+
+  uint32_t getGeneration() const { return Generation; }
+  void setGeneration(uint32_t generation) { Generation = generation; }
+
+  size_t getLogSize() const { return Log.size(); }
+  // Undoes the changes made since the log had the size.
+  void undo(size_t logSize) {
+    while (Log.size() > logSize) {
+      const Change &C = Log.back();
+      Values[C.Slot] = C.Value;
+      Generations[C.Slot] = C.Generation;
+      Log.pop_back();
+    }
+  }
+};
+
+// Returns true if the bb has a single predecessor (maybe via many tags).
+bool hasSinglePredecessor(const BasicBlock *BB) {
+  const auto &Preds = BB->getPredecessors();
+  if (Preds.empty())
+    return false;
+  for (BasicBlock *Pred : Preds)
+    if (Pred != Preds.front())
+      return false;
+  return true;
+}
+
+// This maps the vars used by a function to the dense slots, so the tables
+// are sized by the vars of the function rather than by the largest var id
+// of the module.
+using VarSlotMap = std::unordered_map<const GlobalVariable *, uint32_t>;
+
+class GVN : public FunctionPass {
+  // Numbers the values of the bb, and finds the instructions writing a
+  // value that is already there (by their index within the bb, since a
+  // copy-on-write clone gets the copies once they are removed). The
+  // LastLoaded is the slot of the last loaded value. The Summands is a
+  // scratch buffer; it is not a member, since the functions are run in
+  // parallel by the same pass.
+  void numberBlock(const BasicBlock *BB, ValueNumbering &VN,
+                   ExpressionTable &Sums, const VarSlotMap &Slots,
+                   uint32_t LastLoaded, std::vector<uint32_t> &Summands,
+                   std::vector<uint32_t> &Redundant) {
+    auto getSlot = [&Slots](const GlobalVariable *GV) {
+      return Slots.find(GV)->second;
+    };
+    const auto &Instrs = BB->instructions();
+    for (uint32_t idx = 0; idx < Instrs.size(); ++idx) {
+      const Instruction *I = Instrs[idx];
+      uint32_t Dst, value;
+      switch (I->getOpCodeKind()) {
+      case Instruction::OpCodeKind::Load:
+        Dst = LastLoaded;
+        value = VN.get(getSlot(I->getOperand(0)));
+        break;
+      case Instruction::OpCodeKind::Store:
+        Dst = getSlot(I->getOperand(1));
+        value = VN.get(getSlot(I->getOperand(0)));
+        break;
+      case Instruction::OpCodeKind::Add:
+        Dst = getSlot(I->getOperand(0));
+        Summands.clear();
+        for (unsigned i = 1; i < I->getNumOfOps(); ++i)
+          Summands.push_back(VN.get(getSlot(I->getOperand(i))));
+        // The sum doesn't depend on the order of the summands.
+        std::sort(Summands.begin(), Summands.end());
+        value = Sums.getOrInsert(Summands, VN.getNewValue());
+        break;
+      default:
+        assert(false && "Unknown opcode");
+        continue;
+      }
+      if (VN.get(Dst) == value)
+        Redundant.push_back(idx);
+      else
+        VN.set(Dst, value);
+    }
+  }
+
+public:
+  std::string_view getName() const override { return "gvn"; }
+
+  bool runOnFunction(Function &F, ModuleUpdates &) override {
+    if (!F.getEntryBB())
+      return false;
+
+    VarSlotMap Slots;
+    for (const auto &Entry : F.getBasicBlocks())
+      for (const Instruction *I : Entry.second->instructions())
+        for (const GlobalVariable *GV : I->getOps())
+          Slots.emplace(GV, Slots.size());
+    // The last loaded value takes the slot after the vars.
+    uint32_t LastLoaded = Slots.size();
+    ValueNumbering VN(Slots.size() + 1);
+    ExpressionTable Sums;
+    DominatorTree DT(F);
+
+    // The values flow down the dominator tree into the bbs having their
+    // idom as the only predecessor. The other bbs start a new generation,
+    // since the vars may be written on the other paths into them.
+    struct Frame {
+      BasicBlock *BB;
+      size_t NextChild;
+      size_t LogSize;
+    };
+    std::vector<Frame> Stack;
+    std::vector<uint32_t> Generations;
+    std::vector<uint32_t> Summands;
+    std::vector<uint32_t> Redundant;
+    bool changed = false;
+    uint32_t nextGeneration = 0;
+    auto enter = [&](BasicBlock *BB, bool inherit) {
+      Stack.push_back({BB, 0, VN.getLogSize()});
+      Generations.push_back(inherit ? VN.getGeneration() : ++nextGeneration);
+      VN.setGeneration(Generations.back());
+
+      Redundant.clear();
+      numberBlock(BB, VN, Sums, Slots, LastLoaded, Summands, Redundant);
+      if (Redundant.empty())
+        return;
+      size_t next = 0;
+      uint32_t idx = 0;
+      BB->removeInstructionsIf([&](const Instruction *) {
+        if (next == Redundant.size() || Redundant[next] != idx++)
+          return false;
+        ++next;
+        return true;
+      });
+      changed = true;
+    };
+
+    enter(DT.getRoot(), /*inherit=*/false);
+    while (!Stack.empty()) {
+      Frame &Top = Stack.back();
+      const auto &Children = DT.getChildren(Top.BB);
+      if (Top.NextChild == Children.size()) {
+        VN.undo(Top.LogSize);
+        Stack.pop_back();
+        Generations.pop_back();
+        if (!Generations.empty())
+          VN.setGeneration(Generations.back());
+        continue;
+      }
+      BasicBlock *Child = Children[Top.NextChild++];
+      enter(Child, hasSinglePredecessor(Child));
+    }
+    return changed;
+  }
+};
+
+} // end anonymous namespace
+
+std::unique_ptr<FunctionPass> createGVNPass() {
+  return std::make_unique<GVN>();
+}
@@ -0,0 +1,95 @@
+// === This contains the implementation of the PassManager.
+
+#include "PassManager.h"
+#include "Casting.h"
+#include "OutputStream.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstdio>
+
+using Clock = std::chrono::steady_clock;
+
+void ModuleUpdates::apply(Module &M) {
+  for (auto &Update : Updates)
+    Update(M);
+  Updates.clear();
+}
+
+PassManager::PassManager(unsigned numOfThreads)
+    : Pool(std::make_unique<ThreadPool>(
+          numOfThreads ? numOfThreads : ThreadPool::getDefaultNumOfThreads())) {
+}
+
+// NOTE: This is out of line, since the ThreadPool is complete here only.
+PassManager::~PassManager() {}
+
+unsigned PassManager::getNumOfThreads() const {
+  return Pool->getNumOfThreads();
+}
+
+bool PassManager::runFunctionPass(FunctionPass &P, Module &M) {
+  // The functions are taken by their names, so the updates are applied in
+  // the same order on each run.
+  std::vector<Function *> Fns;
+  for (const auto *F : M.getFunctions().sorted(M.getSymbols()))
+    Fns.push_back(F->second);
+
+  std::vector<ModuleUpdates> Updates(Fns.size());
+  // NOTE: This is not the std::vector<bool>, so the threads don't share
+  // the words.
+  std::vector<char> Changed(Fns.size(), false);
+  bool concurrent = Pool->getNumOfThreads() > 1 && Fns.size() > 1;
+  // The functions sharing the instructions (see the Function::clone())
+  // would change each other, so they get their own copies first.
+  if (concurrent) {
+    for (Function *F : Fns)
+      F->unshareInstructions();
+    M.setConcurrent(true);
+  }
+  Pool->parallelFor(Fns.size(), [&](size_t i) {
+    Changed[i] = P.runOnFunction(*Fns[i], Updates[i]);
+  });
+  if (concurrent)
+    M.setConcurrent(false);
+
+  bool changed = false;
+  for (size_t i = 0; i < Fns.size(); ++i) {
+    changed |= Changed[i] || !Updates[i].empty();
+    Updates[i].apply(M);
+  }
+  return changed;
+}
+
+bool PassManager::run(Module &M) {
+  Timings.clear();
+  bool changed = false;
+  for (auto &P : Passes) {
+    auto start = Clock::now();
+    bool passChanged;
+    if (auto *MP = dyn_cast<ModulePass>(P.get()))
+      passChanged = MP->runOnModule(M);
+    else
+      passChanged = runFunctionPass(*cast<FunctionPass>(P.get()), M);
+    double ms =
+        std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    Timings.push_back({P->getName(), ms, passChanged});
+    changed |= passChanged;
+  }
+  return changed;
+}
+
+void PassManager::printTimings(OutputStream &OS) const {
+  OS << "=== Pass execution timing (" << getNumOfThreads()
+     << " threads) ===\n";
+  double total = 0;
+  char Buf[32];
+  for (const auto &T : Timings) {
+    std::snprintf(Buf, sizeof(Buf), "%10.3f ms  ", T.WallMs);
+    OS << Buf << T.Name << (T.Changed ? " (changed)" : "") << '\n';
+    total += T.WallMs;
+  }
+  std::snprintf(Buf, sizeof(Buf), "%10.3f ms  ", total);
+  OS << Buf << "total\n";
+}
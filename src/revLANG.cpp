@@ -1,13 +1,153 @@
 // === This file contains an implementaion for the driver that will be used
 // as an interpreter for the revLANG language.
 
+#include "Bitcode.h"
 #include "CodeGen.h"
+#include "ExecutionEngine.h"
+#include "JIT.h"
+#include "MappedFile.h"
+#include "OutputStream.h"
+#include "Parser.h"
+#include "Passes.h"
+#include "Statistics.h"
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <unistd.h>
 
-int main() {
+// Runs the function (as the native code, if the native is set), and prints
+// the values of the vars afterwards.
+static int runFunction(Module &M, const std::string &fnName, bool native) {
+  Function *F = M.getFunction(fnName);
+  if (!F) {
+    std::cerr << "no function named '" << fnName << "'\n";
+    return 1;
+  }
+  JITCache JIT(M);
+  ExecutionEngine EE(M);
+  if (native)
+    EE.setJIT(&JIT);
+  // The default branch decision may loop forever.
+  EE.setBlockLimit(100000000);
+  std::string errMsg;
+  bool ok = EE.run(*F, errMsg);
+  std::cout << "executed " << EE.getNumOfExecutedBlocks() << " bbs\n";
+  for (const auto &GV : M.getGlobalVars())
+    std::cout << "var !" << GV.first << " = " << EE.getValue(*GV.second)
+              << '\n';
+  if (!ok) {
+    std::cerr << errMsg << '\n';
+    return 1;
+  }
+  return 0;
+}
+
+// Verifies the module, and prints the problems found to the stderr.
+static int verifyModule(const Module &M) {
+  std::vector<VerifierDiagnostic> Diags;
+  if (M.verify(Diags)) {
+    std::cout << "the module is valid\n";
+    return 0;
+  }
+  std::cout.flush();
+  FDOutputStream OS(STDERR_FILENO);
+  for (const auto &D : Diags)
+    D.print(OS);
+  return 1;
+}
+
+// Reads the .revLang (or the bitcode) file in, and prints the module back.
+// If the outFilename is set, the module is written there as bitcode instead,
+// and if the runFnName is set, that function is run instead (as the native
+// code, if the native is set). If the verify
+// is set, the module is only verified. If the optimize is set, the cleanup
+// passes are run on the module first.
+static int runOnFile(const std::string &filename,
+                     const std::string &outFilename,
+                     const std::string &runFnName, bool native,
+                     bool optimize, bool verify) {
+  std::string errMsg;
+  MappedFile File;
+  if (!File.open(filename, errMsg)) {
+    std::cerr << errMsg << '\n';
+    return 1;
+  }
+
+  auto Buffer = File.getBuffer();
+  bool isBitcode =
+      Buffer.size() >= sizeof(BitcodeMagic) &&
+      !std::memcmp(Buffer.data(), BitcodeMagic, sizeof(BitcodeMagic));
+  auto M = isBitcode ? readBitcodeBuffer(Buffer, errMsg)
+                     : parseRevLangBuffer(Buffer, errMsg, filename);
+  if (!M) {
+    if (isBitcode)
+      std::cerr << filename << ": ";
+    std::cerr << errMsg << '\n';
+    return 1;
+  }
+
+  if (optimize) {
+    PassManager PM(/*numOfThreads=*/0);
+    addCleanupPasses(PM);
+    PM.run(*M);
+  }
+
+  if (verify)
+    return verifyModule(*M);
+
+  if (!runFnName.empty())
+    return runFunction(*M, runFnName, native);
+
+  if (!outFilename.empty()) {
+    if (!M->writeBitcode(outFilename)) {
+      std::cerr << outFilename << ": could not write the bitcode\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  // The module can be big, so it goes straight to the stdout.
+  std::cout.flush();
+  FDOutputStream OS(STDOUT_FILENO);
+  M->print(OS);
+  OS.flush();
+  if (OS.hasError()) {
+    std::cerr << "could not write the output\n";
+    return 1;
+  }
+  return 0;
+}
+
+static int runDriver(int argc, char **argv) {
   std::cout << "=== revLang interpreter ===\n";
 
+  // Usage:
+  //   revLANG [<file> [-O] [-o <out.rvbc> | -run <fn> | -jit <fn> | -verify]]
+  if (argc > 1) {
+    std::string outFilename, runFnName;
+    bool optimize = argc > 2 && std::string(argv[2]) == "-O";
+    int arg = optimize ? 3 : 2;
+    bool native = false, verify = false;
+    if (argc == arg + 1 && std::string(argv[arg]) == "-verify") {
+      verify = true;
+    } else if (argc == arg + 2 && std::string(argv[arg]) == "-o") {
+      outFilename = argv[arg + 1];
+    } else if (argc == arg + 2 && (std::string(argv[arg]) == "-run" ||
+                                   std::string(argv[arg]) == "-jit")) {
+      runFnName = argv[arg + 1];
+      native = std::string(argv[arg]) == "-jit";
+    } else if (argc != arg) {
+      std::cerr
+          << "usage: revLANG [--stats[=json]] "
+             "[<file> [-O] [-o <out.rvbc> | -run <fn> | -jit <fn> | "
+             "-verify]]\n";
+      return 1;
+    }
+    return runOnFile(argv[1], outFilename, runFnName, native, optimize,
+                     verify);
+  }
+
   // Here we simulate/test adding of the language objects.
   // NOTE: Please find more cases in the tests/ directory.
 
@@ -64,21 +204,11 @@ int main() {
   std::cout << "*** Module before the optimizations ***\n";
   M->dump();
 
-  // This is an empty function, lets delete it.
-  M->removeFunction(std::move(Func4));
-
-  // Delete the fn2.
-  Func2->removeBasicBlock(std::move(F2BB1));
-  Func2->removeBasicBlock(std::move(F2BB2));
-  Func2->removeBasicBlock(std::move(F2BB3));
-  M->removeFunction(std::move(Func2));
-
-  // Delete the fn3.
-  F3BB1->removeInstruction(std::move(I4));
-  Func3->removeBasicBlock(std::move(F3BB1));
-  Func3->removeBasicBlock(std::move(F3BB2));
-  Func3->removeBasicBlock(std::move(F3BB3));
-  M->removeFunction(std::move(Func3));
+  // The fn4 is empty, the fn2 doesn't do anything, and the fn3 has the
+  // unreachable bbs. The cleanup passes take care of all of them.
+  PassManager PM;
+  addCleanupPasses(PM);
+  PM.run(*M);
 
   // Print the module again.
   std::cout << "*** Module after the optimizations ***\n";
@@ -96,7 +226,42 @@ int main() {
   F5BB3->addSuccessor("", F5BB4.get());
 
   // Print the function in terms of DOT.
-  Func5->printCFGAsDOT("revLang-cfg.dot");
+  if (!Func5->printCFGAsDOT("revLang-cfg.dot")) {
+    std::cerr << "revLang-cfg.dot: could not write the file\n";
+    return 1;
+  }
 
   return 0;
 }
+
+int main(int argc, char **argv) {
+  // The --stats (or --stats=json) may come anywhere, and the report is
+  // printed to the stderr at the end.
+  std::vector<char *> Args;
+  const char *statsFormat = nullptr;
+  for (int i = 0; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--stats"))
+      statsFormat = "table";
+    else if (!std::strcmp(argv[i], "--stats=json"))
+      statsFormat = "json";
+    else
+      Args.push_back(argv[i]);
+  }
+
+  int result = runDriver(static_cast<int>(Args.size()), Args.data());
+  if (!statsFormat)
+    return result;
+  if (!Statistics::isEnabled()) {
+    std::cerr << "the statistics are not built in (see the "
+                 "REVLANG_ENABLE_STATS option)\n";
+    return result;
+  }
+  std::cout.flush();
+  FDOutputStream OS(STDERR_FILENO);
+  StatsReport Report = Statistics::collect();
+  if (!std::strcmp(statsFormat, "json"))
+    Report.printJSON(OS);
+  else
+    Report.print(OS);
+  return result;
+}
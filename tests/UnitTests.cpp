@@ -1,6 +1,39 @@
 // === This file implements UnitTesting for the CodeGen.
 
+#include "AnalysisManager.h"
+#include "Bitcode.h"
+#include "CFGTraversal.h"
+#include "DataFlow.h"
+#include "ExecutionEngine.h"
+#include "FlatFunction.h"
 #include "CodeGen.h"
+#include "InstVisitor.h"
+#include "JIT.h"
+#include "LoopInfo.h"
+#include "OutputStream.h"
+#include "Parser.h"
+#include "PassManager.h"
+#include "Passes.h"
+#include "Statistics.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <utility>
+
+// Returns the Module::dump() output as a string.
+static std::string dumpToString(const Module &M) {
+  std::ostringstream OS;
+  auto *OldBuf = std::cout.rdbuf(OS.rdbuf());
+  M.dump();
+  std::cout.rdbuf(OldBuf);
+  return OS.str();
+}
 
 // This should be valid function.
 bool testFunctionValidation1() {
@@ -60,6 +93,1940 @@ bool testBasicModuleCreationAndDeletion() {
   return true;
 }
 
+// The handles outlive the module here, and nothing is removed explicitly,
+// since the module arena owns all the objects.
+bool testArenaModuleCreation() {
+  IRPtr<Function> F;
+  IRPtr<BasicBlock> F1BB1, F1BB2;
+  IRPtr<Load> I1;
+  {
+    auto M = Module::create("m3.revLang", /*useArena=*/true);
+    if (!M->getArena())
+      return false;
+    auto GV1 = GlobalVariable::create(0, M.get());
+    F = Function::create("f1", M.get());
+    F1BB1 = BasicBlock::create("bb.0", F.get(), true);
+    F1BB2 = BasicBlock::create("bb.1", F.get());
+    F1BB1->addSuccessor("true", F1BB2.get());
+    OperandsTy LoadOps{GV1.get()};
+    I1 = Load::create(LoadOps, F1BB2.get());
+    if (!F->isValid() || F1BB2->getNumOfInstrs() != 1)
+      return false;
+  }
+  return true;
+}
+
+// Parse the Module::dump() output back, and check it prints the same.
+bool testParserRoundTrip() {
+  auto M = Module::create("m4.revLang", /*useArena=*/true);
+  auto GV1 = GlobalVariable::create(0, M.get());
+  auto GV2 = GlobalVariable::create(1, M.get());
+  auto GV3 = GlobalVariable::create(7, M.get());
+  auto F = Function::create("foo", M.get());
+  auto Entry = BasicBlock::create("entry", F.get(), true);
+  auto H = BasicBlock::create("H", F.get());
+  auto I = BasicBlock::create("I", F.get());
+  // The entry bb has a predecessor, like all the others.
+  Entry->addSuccessor("true", H.get());
+  Entry->addSuccessor("false", I.get());
+  I->addSuccessor("", H.get());
+  H->addSuccessor("loop", Entry.get());
+  OperandsTy AddOps{GV1.get(), GV2.get(), GV3.get(), GV2.get()};
+  Add::create(AddOps, H.get());
+  OperandsTy StoreOps{GV2.get(), GV3.get()};
+  Store::create(StoreOps, I.get());
+  OperandsTy LoadOps{GV1.get()};
+  Load::create(LoadOps, I.get());
+  Function::create("bar", M.get());
+
+  std::string Text = dumpToString(*M);
+  std::string ErrMsg;
+  auto ParsedM = parseRevLangBuffer(Text, ErrMsg);
+  if (!ParsedM || dumpToString(*ParsedM) != Text)
+    return false;
+
+  // The entry bb is marked, so it is not guessed from the CFG.
+  auto *ParsedF = ParsedM->getFunction("foo");
+  return Text.find(" entry: ; Entry\n") != std::string::npos &&
+         ParsedF->getEntryBB()->getBBID() == "entry" && ParsedF->isValid();
+}
+
+// The parser should report the errors instead of crashing.
+bool testParserErrors() {
+  std::string ErrMsg;
+  if (parseRevLangBuffer("ModuleID: m\ndef f():\n bb.0:\n    LOAD var !3\n",
+                         ErrMsg))
+    return false;
+  if (ErrMsg != "<buffer>:4:10: error: use of undefined var !3")
+    return false;
+  if (parseRevLangBuffer("ModuleID: m\ndef f():\n ; Successors: "
+                         "bb.9(tag: x) \n bb.0:\n",
+                         ErrMsg))
+    return false;
+
+  // Without the mark, the entry bb is the only one without predecessors.
+  auto M = parseRevLangBuffer("ModuleID: m\ndef f():\n ; Successors: "
+                              "a(tag: ) \n b:\n a:\n",
+                              ErrMsg);
+  if (!M || M->getFunction("f")->getEntryBB()->getBBID() != "b")
+    return false;
+  if (parseRevLangBuffer("ModuleID: m\ndef f():\n ; Successors: "
+                         "b(tag: ) \n a:\n b:\n c:\n",
+                         ErrMsg) ||
+      ErrMsg != "<buffer>:2:5: error: cannot tell the entry basic block of "
+                "'f'; mark it with '; Entry'")
+    return false;
+  return !parseRevLangBuffer(
+             "ModuleID: m\ndef f():\n a: ; Entry\n b: ; Entry\n", ErrMsg) &&
+         ErrMsg == "<buffer>:4:5: error: more than one entry basic block in "
+                   "'f'";
+}
+
+// Write the module as bitcode and read it back.
+bool testBitcodeRoundTrip() {
+  auto M = Module::create("m5.revLang", /*useArena=*/true);
+  auto GV1 = GlobalVariable::create(3, M.get());
+  auto GV2 = GlobalVariable::create(1000, M.get());
+  auto F = Function::create("f1", M.get());
+  auto BB1 = BasicBlock::create("bb.1", F.get());
+  auto BB0 = BasicBlock::create("bb.0", F.get(), true);
+  BB1->addSuccessor("", BB0.get());
+  BB0->addSuccessor("loop", BB1.get());
+  OperandsTy AddOps{GV1.get(), GV2.get(), GV2.get()};
+  Add::create(AddOps, BB0.get());
+  OperandsTy StoreOps{GV2.get(), GV1.get()};
+  Store::create(StoreOps, BB1.get());
+  Function::create("f2", M.get());
+
+  std::ostringstream OS;
+  if (!M->writeBitcode(OS))
+    return false;
+  std::string Bitcode = OS.str();
+
+  std::string ErrMsg;
+  BitcodeView View;
+  if (!View.init(Bitcode, ErrMsg) || View.getFunctions().size() != 2 ||
+      View.getFunctions()[0].Name != "f1" ||
+      View.getFunctions()[0].NumOfBBs != 2)
+    return false;
+
+  auto ReadM = readBitcodeBuffer(Bitcode, ErrMsg);
+  if (!ReadM || dumpToString(*ReadM) != dumpToString(*M))
+    return false;
+  // Unlike the textual form, the bitcode keeps the entry bb.
+  if (ReadM->getFunction("f1")->getEntryBB()->getBBID() != "bb.0")
+    return false;
+
+  // A truncated file must be rejected.
+  if (readBitcodeBuffer(Bitcode.substr(0, Bitcode.size() - 1), ErrMsg))
+    return false;
+
+  // So must be the var ids wrapping around: the vars !5 and !6 are stored
+  // as the deltas 5 and 1, and the delta of 2^64 - 4 takes the !5 to !1.
+  auto M2 = Module::create("m5b.revLang", /*useArena=*/true);
+  GlobalVariable::create(5, M2.get()).release();
+  GlobalVariable::create(6, M2.get()).release();
+  std::ostringstream OS2;
+  if (!M2->writeBitcode(OS2))
+    return false;
+  Bitcode = OS2.str();
+  size_t pos = Bitcode.rfind(std::string("\x02\x05\x01", 3));
+  if (pos == std::string::npos)
+    return false;
+  Bitcode.replace(pos + 2, 1, "\xfc\xff\xff\xff\xff\xff\xff\xff\xff\x01");
+  return !readBitcodeBuffer(Bitcode, ErrMsg) &&
+         ErrMsg == "malformed bitcode: invalid var ID";
+}
+
+// Add and remove many blocks, so the symbol tables do grow and shrink.
+bool testSymbolTables() {
+  auto M = Module::create("m6.revLang", /*useArena=*/true);
+  auto F = Function::create("f1", M.get());
+  std::vector<IRPtr<BasicBlock>> BBs;
+  for (unsigned i = 0; i < 1000; ++i)
+    BBs.push_back(BasicBlock::create("bb." + std::to_string(i), F.get(), !i));
+  for (unsigned i = 1; i < 1000; ++i)
+    BBs[0]->addSuccessor("t" + std::to_string(i), BBs[i].get());
+
+  // Remove every third block.
+  for (unsigned i = 1; i < 1000; i += 3)
+    F->removeBasicBlock(std::move(BBs[i]));
+
+  for (unsigned i = 0; i < 1000; ++i) {
+    bool removed = i % 3 == 1;
+    auto *BB = F->getBasicBlock("bb." + std::to_string(i));
+    if (removed != !BB || (BB && BB->getBBID() != "bb." + std::to_string(i)))
+      return false;
+    if (i && removed != !BBs[0]->getSuccessor("t" + std::to_string(i)))
+      return false;
+  }
+  return F->getNumberOfBBs() == 667 && BBs[0]->getNumOfSuccessors() == 666 &&
+         !M->getFunction("f2") && M->getFunction("f1") == F.get();
+}
+
+// Counts the instructions of each kind.
+struct OpCodeCounter : public InstVisitor<OpCodeCounter> {
+  unsigned NumOfLoads = 0, NumOfStores = 0, NumOfOthers = 0;
+  void visitLoad(Load &) { ++NumOfLoads; }
+  void visitStore(Store &) { ++NumOfStores; }
+  void visitInstruction(Instruction &) { ++NumOfOthers; }
+};
+
+bool testOpCodesAndCasting() {
+  auto M = Module::create("m7.revLang", /*useArena=*/true);
+  auto GV1 = GlobalVariable::create(0, M.get());
+  auto GV2 = GlobalVariable::create(1, M.get());
+  auto F = Function::create("f1", M.get());
+  auto BB = BasicBlock::create("bb.0", F.get(), true);
+  OperandsTy LoadOps{GV1.get()};
+  Instruction *I1 = Load::create(LoadOps, BB.get()).get();
+  OperandsTy StoreOps{GV1.get(), GV2.get()};
+  Instruction *I2 = Store::create(StoreOps, BB.get()).get();
+  OperandsTy AddOps{GV1.get(), GV2.get(), GV2.get()};
+  const Instruction *I3 = Add::create(AddOps, BB.get()).get();
+
+  if (!isa<Load>(I1) || isa<Store>(I1) || dyn_cast<Add>(I2) ||
+      cast<Store>(I2)->getOpCode() != "STORE" || !dyn_cast<Add>(I3) ||
+      I3->getOpCodeKind() != Instruction::OpCodeKind::Add ||
+      I3->getOpCode() != "ADD")
+    return false;
+
+  OpCodeCounter Counter;
+  Counter.visit(*F);
+  return Counter.NumOfLoads == 1 && Counter.NumOfStores == 1 &&
+         Counter.NumOfOthers == 1;
+}
+
+// The operands are stored inline, or on the side for the big ADDs.
+bool testInstructionOperands() {
+  for (bool useArena : {false, true}) {
+    auto M = Module::create("m8.revLang", useArena);
+    std::vector<IRPtr<GlobalVariable>> GVs;
+    for (unsigned i = 0; i < 6; ++i)
+      GVs.push_back(GlobalVariable::create(i, M.get()));
+    auto F = Function::create("f1", M.get());
+    auto BB = BasicBlock::create("bb.0", F.get(), true);
+
+    auto I1 = Load::create({GVs[4].get()}, BB.get());
+    auto I2 = Store::create({GVs[1].get(), GVs[2].get()}, BB.get());
+    OperandsTy AddOps;
+    for (auto &GV : GVs)
+      AddOps.push_back(GV.get());
+    auto I3 = Add::create(AddOps, BB.get());
+    std::unique_ptr<Instruction> I4 = std::make_unique<Add>(
+        OperandsTy{GVs[0].get(), GVs[1].get(), GVs[2].get()}, BB.get());
+
+    if (I1->getNumOfOps() != 1 || I1->getOperand(0) != GVs[4].get() ||
+        I2->getOps().back() != GVs[2].get() || I3->getNumOfOps() != 6 ||
+        I4->getNumOfOps() != 3)
+      return false;
+    unsigned id = 0;
+    for (auto *Op : I3->getOps())
+      if (Op->getID() != id++)
+        return false;
+
+    I3->setOperand(5, GVs[0].get());
+    if (I3->getOperand(5) != GVs[0].get())
+      return false;
+
+    BB->removeInstruction(std::move(I4));
+  }
+  return true;
+}
+
+// The vars know the instructions using them.
+bool testUseLists() {
+  for (bool useArena : {false, true}) {
+    auto M = Module::create("m9.revLang", useArena);
+    std::vector<IRPtr<GlobalVariable>> GVs;
+    for (unsigned i = 0; i < 4; ++i)
+      GVs.push_back(GlobalVariable::create(i, M.get()));
+    auto F = Function::create("f1", M.get());
+    auto BB = BasicBlock::create("bb.0", F.get(), true);
+
+    auto I1 = Load::create({GVs[0].get()}, BB.get());
+    auto I2 = Store::create({GVs[1].get(), GVs[0].get()}, BB.get());
+    auto I3 = Add::create({GVs[1].get(), GVs[0].get(), GVs[0].get(),
+                           GVs[1].get(), GVs[0].get()},
+                          BB.get());
+
+    if (GVs[0]->getNumUses() != 5 || GVs[1]->getNumUses() != 3 ||
+        GVs[2]->hasUses() || GVs[3]->hasUses())
+      return false;
+    for (auto &U : GVs[1]->uses())
+      if (U.get() != GVs[1].get() ||
+          U.getUser()->getOperand(U.getUser()->getOperandNo(U)) !=
+              GVs[1].get())
+        return false;
+
+    I3->setOperand(4, GVs[2].get());
+    if (GVs[0]->getNumUses() != 4 || GVs[2]->getNumUses() != 1 ||
+        GVs[2]->use_begin()->getUser() != I3.get())
+      return false;
+
+    GVs[0]->replaceAllUsesWith(GVs[3].get());
+    if (GVs[0]->hasUses() || GVs[3]->getNumUses() != 4 ||
+        I1->getOperand(0) != GVs[3].get() || I2->getOperand(1) != GVs[3].get())
+      return false;
+
+    BB->removeInstruction(std::move(I3));
+    BB->removeInstruction(std::move(I1));
+    if (GVs[2]->hasUses() || GVs[3]->getNumUses() != 1 ||
+        GVs[1]->getNumUses() != 1)
+      return false;
+
+    // The dead vars can go away now.
+    M->removeGlobalVar(std::move(GVs[0]));
+    M->removeGlobalVar(std::move(GVs[2]));
+    if (M->getGlobalVars().size() != 2)
+      return false;
+
+    // The instructions freed by their handles unlink their uses, too.
+    if (!useArena) {
+      Add::create({GVs[1].get(), GVs[3].get(), GVs[3].get(), GVs[3].get(),
+                   GVs[3].get()},
+                  BB.get());
+      Store::create({GVs[3].get(), GVs[1].get()}, BB.get());
+      if (GVs[1]->getNumUses() != 1 || GVs[3]->getNumUses() != 1)
+        return false;
+      GVs[3]->replaceAllUsesWith(GVs[1].get());
+      if (GVs[1]->getNumUses() != 2 || GVs[3]->hasUses())
+        return false;
+    }
+  }
+  return true;
+}
+
+// The predecessors are kept in sync with the successors.
+bool testPredecessors() {
+  for (bool useArena : {false, true}) {
+    auto M = Module::create("m10.revLang", useArena);
+    auto F = Function::create("f1", M.get());
+    auto BB0 = BasicBlock::create("bb.0", F.get(), true);
+    auto BB1 = BasicBlock::create("bb.1", F.get());
+    auto BB2 = BasicBlock::create("bb.2", F.get());
+    auto BB3 = BasicBlock::create("bb.3", F.get());
+    BB0->addSuccessor("true", BB1.get());
+    BB0->addSuccessor("false", BB2.get());
+    BB1->addSuccessor("", BB3.get());
+    BB2->addSuccessor("true", BB3.get());
+    BB2->addSuccessor("false", BB3.get());
+    BB3->addSuccessor("loop", BB3.get());
+
+    if (BB0->getNumOfPredecessors() || BB1->getNumOfPredecessors() != 1 ||
+        BB1->getPredecessors()[0] != BB0.get() ||
+        BB3->getNumOfPredecessors() != 4)
+      return false;
+    size_t numOfEdges = 0;
+    for (auto *BB : {BB0.get(), BB1.get(), BB2.get(), BB3.get()}) {
+      for (auto *Succ : BB->successors())
+        if (std::find(Succ->pred_begin(), Succ->pred_end(), BB) ==
+            Succ->pred_end())
+          return false;
+      numOfEdges += BB->getNumOfPredecessors();
+    }
+    if (numOfEdges != 6)
+      return false;
+
+    // Both of the edges go away.
+    BB2->removeSuccessor(BB3.get());
+    if (BB2->getNumOfSuccessors() || BB3->getNumOfPredecessors() != 2)
+      return false;
+
+    F->removeBasicBlock(std::move(BB3));
+    if (BB1->getNumOfSuccessors() || BB0->getNumOfSuccessors() != 2)
+      return false;
+    F->removeBasicBlock(std::move(BB0));
+    if (BB1->getNumOfPredecessors() || BB2->getNumOfPredecessors() ||
+        F->getEntryBB() || F->getNumberOfBBs() != 2)
+      return false;
+  }
+  return true;
+}
+
+// The walks visit each reachable bb once, in the expected order.
+bool testCFGTraversal() {
+  auto M = Module::create("m11.revLang", /*useArena=*/true);
+  auto *F = Function::create("f1", M.get()).release();
+  auto *BB0 = BasicBlock::create("bb.0", F, true).release();
+  auto *BB1 = BasicBlock::create("bb.1", F).release();
+  auto *BB2 = BasicBlock::create("bb.2", F).release();
+  auto *BB3 = BasicBlock::create("bb.3", F).release();
+  auto *BB4 = BasicBlock::create("bb.4", F).release();
+  BB0->addSuccessor("true", BB1);
+  BB0->addSuccessor("false", BB2);
+  BB1->addSuccessor("", BB3);
+  BB2->addSuccessor("", BB3);
+  BB3->addSuccessor("loop", BB0);
+
+  std::vector<BasicBlock *> Pre, Post, RPO;
+  for (auto *BB : depth_first(*F))
+    Pre.push_back(BB);
+  for (auto *BB : post_order(*F))
+    Post.push_back(BB);
+  for (auto *BB : ReversePostOrderTraversal(*F))
+    RPO.push_back(BB);
+  if (Pre != std::vector<BasicBlock *>{BB0, BB1, BB3, BB2} ||
+      Post != std::vector<BasicBlock *>{BB3, BB1, BB2, BB0} ||
+      RPO != std::vector<BasicBlock *>{BB0, BB2, BB1, BB3})
+    return false;
+  // The bb.4 is unreachable.
+  if (F->isValid())
+    return false;
+
+  F->removeBasicBlock(IRPtr<BasicBlock>(BB4, IRDeleter<BasicBlock>(true)));
+  F->renumberBlocks();
+  if (!F->isValid() || F->getMaxBBNumber() != 4)
+    return false;
+  BitVector Numbers(F->getMaxBBNumber());
+  for (auto &BB : F->getBasicBlocks())
+    Numbers.set(BB.second->getNumber());
+  return Numbers.count() == 4;
+}
+
+// The walks handle the huge CFGs, without recursion.
+bool testCFGStress() {
+  const unsigned NumOfBBs = 1000000;
+  std::vector<std::string> Names;
+  for (unsigned b = 0; b < NumOfBBs; ++b)
+    Names.push_back("bb." + std::to_string(b));
+
+  // A linear chain.
+  {
+    auto M = Module::create("m12.revLang", /*useArena=*/true);
+    auto *F = Function::create("f1", M.get()).release();
+    BasicBlock *Prev = nullptr;
+    for (unsigned b = 0; b < NumOfBBs; ++b) {
+      auto *BB = BasicBlock::create(Names[b], F, !Prev).release();
+      if (Prev)
+        Prev->addSuccessor("", BB);
+      Prev = BB;
+    }
+    if (!F->isValid())
+      return false;
+    unsigned expected = NumOfBBs;
+    for (auto *BB : post_order(*F))
+      if (BB->getNumber() != --expected)
+        return false;
+  }
+
+  // A wide one, where the entry bb branches to all the others.
+  {
+    auto M = Module::create("m13.revLang", /*useArena=*/true);
+    auto *F = Function::create("f1", M.get()).release();
+    auto *Entry = BasicBlock::create("entry", F, true).release();
+    for (unsigned b = 0; b < NumOfBBs; ++b)
+      Entry->addSuccessor(Names[b],
+                          BasicBlock::create(Names[b], F).release());
+    if (!F->isValid() || ReversePostOrderTraversal(*F).size() != NumOfBBs + 1)
+      return false;
+  }
+  return true;
+}
+
+// The printers go through the buffered streams.
+bool testOutputStreams() {
+  std::string Str;
+  {
+    StringOutputStream OS(Str);
+    OS << 0u << ' ' << -42 << ' ' << UINT64_MAX << ' ' << INT64_MIN << ' '
+       << std::string(100000, 'x');
+  }
+  if (Str != "0 -42 18446744073709551615 -9223372036854775808 " +
+                 std::string(100000, 'x'))
+    return false;
+
+  auto M = Module::create("m14.revLang", /*useArena=*/true);
+  auto *GV = GlobalVariable::create(7, M.get()).release();
+  auto *F = Function::create("foo", M.get()).release();
+  auto *BB0 = BasicBlock::create("entry", F, true).release();
+  auto *BB1 = BasicBlock::create("exit", F).release();
+  BB0->addSuccessor("true", BB1);
+  Store::create({GV, GV}, BB1);
+
+  std::string Printed;
+  StringOutputStream OS(Printed);
+  M->print(OS);
+  if (OS.str() != dumpToString(*M))
+    return false;
+
+  std::string Dot;
+  StringOutputStream DotOS(Dot);
+  if (!F->printCFGAsDOT(DotOS) ||
+      Dot != "digraph foo {\n  entry -> exit[ label = \"true\"];\n}\n")
+    return false;
+  // The I/O errors are reported.
+  return !F->printCFGAsDOT("/nonexistent-dir/revLang-cfg.dot");
+}
+
+// The interpreter runs the functions, with the branches decided by a
+// callback.
+bool testExecutionEngine() {
+  auto M = Module::create("m15.revLang", /*useArena=*/true);
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 0; i < 5; ++i)
+    GVs.push_back(GlobalVariable::create(i, M.get()).release());
+  auto *F = Function::create("loop", M.get()).release();
+  auto *Entry = BasicBlock::create("entry", F, true).release();
+  auto *Body = BasicBlock::create("body", F).release();
+  auto *Exit = BasicBlock::create("exit", F).release();
+  Entry->addSuccessor("", Body);
+  Body->addSuccessor("loop", Body);
+  Body->addSuccessor("exit", Exit);
+  // !0 = !3; do { !0 += !1 } while (...); !4 = 3 * !0 + 2 * !1
+  Store::create({GVs[3], GVs[0]}, Entry);
+  Add::create({GVs[0], GVs[0], GVs[1]}, Body);
+  Load::create({GVs[0]}, Body);
+  Add::create({GVs[4], GVs[0], GVs[0], GVs[0], GVs[1], GVs[1]}, Exit);
+
+  ExecutionEngine EE(*M);
+  EE.setValue(*GVs[1], 1);
+  EE.setValue(*GVs[3], 5);
+  EE.setBranchDecision([&GVs](const BranchState &S) -> size_t {
+    // The tags are sorted: "exit", "loop".
+    return S.getValue(*GVs[0]) < 10 ? 1 : 0;
+  });
+  std::string errMsg;
+  if (!EE.run(*F, errMsg) || EE.getValue(*GVs[0]) != 10 ||
+      EE.getValue(*GVs[4]) != 32 || EE.getNumOfExecutedBlocks() != 7)
+    return false;
+
+  // The block limit stops the runaway loops.
+  EE.setBlockLimit(4);
+  if (EE.run(*F, errMsg) ||
+      errMsg != "function 'loop' hit the limit of 4 executed bbs")
+    return false;
+  EE.setBlockLimit(UINT64_MAX);
+
+  // The bytecode is rebuilt after the function changes.
+  Store::create({GVs[4], GVs[2]}, Exit);
+  if (!EE.run(*F, errMsg) || EE.getValue(*GVs[2]) != 32)
+    return false;
+
+  // By default, the tag is picked by the last loaded value.
+  auto *G = Function::create("cond", M.get()).release();
+  auto *GEntry = BasicBlock::create("entry", G, true).release();
+  auto *GTrue = BasicBlock::create("t", G).release();
+  auto *GFalse = BasicBlock::create("f", G).release();
+  GEntry->addSuccessor("true", GTrue);
+  GEntry->addSuccessor("false", GFalse);
+  Load::create({GVs[2]}, GEntry);
+  Store::create({GVs[1], GVs[3]}, GTrue);
+  Store::create({GVs[2], GVs[3]}, GFalse);
+  EE.setBranchDecision(nullptr);
+  EE.resetValues();
+  EE.setValue(*GVs[1], 7);
+  EE.setValue(*GVs[2], 1);
+  if (!EE.run(*G, errMsg) || EE.getValue(*GVs[3]) != 7)
+    return false;
+  EE.setValue(*GVs[2], 0);
+  if (!EE.run(*G, errMsg) || EE.getValue(*GVs[3]) != 0)
+    return false;
+
+  // The functions without the entry bb cannot be run.
+  auto *Empty = Function::create("empty", M.get()).release();
+  if (EE.run(*Empty, errMsg) || errMsg != "function 'empty' has no entry bb")
+    return false;
+
+  // The values are indexed by the slots of the vars, so the sparse ids
+  // don't make them any larger. The values are kept when a var is added.
+  auto *Far = GlobalVariable::create(UINT32_MAX, M.get()).release();
+  auto *H = Function::create("far", M.get()).release();
+  Store::create({Far, GVs[0]}, BasicBlock::create("entry", H, true).release());
+  EE.setValue(*Far, 42);
+  if (EE.getValues().size() != GVs.size() + 1 || EE.getValue(*GVs[3]) != 0 ||
+      EE.getValue(*GVs[2]) != 0 || EE.getValue(*GVs[1]) != 7 ||
+      !EE.run(*H, errMsg) || EE.getValue(*GVs[0]) != 42)
+    return false;
+  EE.resetValues();
+  return EE.getValues().size() == GVs.size() + 1 && EE.run(*H, errMsg) &&
+         EE.getValue(*GVs[0]) == 0;
+}
+
+// The batch runs give the same results as the single runs, including the
+// lanes taking different successors.
+bool testBatchExecution() {
+  auto M = Module::create("m16.revLang", /*useArena=*/true);
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 0; i < 5; ++i)
+    GVs.push_back(GlobalVariable::create(i, M.get()).release());
+  auto *F = Function::create("loop", M.get()).release();
+  auto *Entry = BasicBlock::create("entry", F, true).release();
+  auto *Body = BasicBlock::create("body", F).release();
+  auto *Odd = BasicBlock::create("odd", F).release();
+  auto *Latch = BasicBlock::create("latch", F).release();
+  auto *Exit = BasicBlock::create("exit", F).release();
+  // !0 = !3; do { if (!2) !4 += !1; !0 += !1 } while (...);
+  // !4 = !0 + !4 + !4 + !1
+  Entry->addSuccessor("", Body);
+  Body->addSuccessor("true", Odd);
+  Body->addSuccessor("false", Latch);
+  Odd->addSuccessor("", Latch);
+  Latch->addSuccessor("loop", Body);
+  Latch->addSuccessor("exit", Exit);
+  Store::create({GVs[3], GVs[0]}, Entry);
+  Load::create({GVs[2]}, Body);
+  Add::create({GVs[4], GVs[4], GVs[1]}, Odd);
+  Add::create({GVs[0], GVs[0], GVs[1]}, Latch);
+  Add::create({GVs[4], GVs[0], GVs[4], GVs[4], GVs[1]}, Exit);
+
+  // The lanes differ in the trip counts and the branches inside the loop.
+  const size_t NumOfLanes = 1000;
+  auto initLane = [&](auto &&set, size_t lane) {
+    set(*GVs[1], 1);
+    set(*GVs[2], lane % 3 == 0);
+    set(*GVs[3], lane % 13);
+  };
+  ExecutionEngine EE(*M);
+  ExecutionBatch Batch(*M, NumOfLanes);
+  for (size_t lane = 0; lane < NumOfLanes; ++lane)
+    initLane([&](const GlobalVariable &GV,
+                 int64_t v) { Batch.setValue(GV, lane, v); },
+             lane);
+  EE.setBatchBranchDecision(
+      [&](const BatchBranchState &S, uint32_t *Choices) {
+        if (S.BB != Latch) {
+          for (size_t i = 0; i < ExecutionBatch::TileSize; ++i)
+            Choices[i] = S.LastLoaded[i] ? 1 : 0;
+          return;
+        }
+        // The tags are sorted: "exit", "loop".
+        const int64_t *I = S.Batch->getColumn(0) + S.FirstLane;
+        for (size_t i = 0; i < ExecutionBatch::TileSize; ++i)
+          Choices[i] = I[i] < 10 ? 1 : 0;
+      });
+  std::string errMsg;
+  if (!EE.runBatch(*F, Batch, errMsg))
+    return false;
+  uint64_t numOfLaneBlocks = EE.getNumOfExecutedBlocks();
+
+  EE.setBranchDecision([&](const BranchState &S) -> size_t {
+    if (S.BB != Latch)
+      return S.LastLoaded ? 1 : 0;
+    return S.getValue(*GVs[0]) < 10 ? 1 : 0;
+  });
+  uint64_t numOfBlocks = 0;
+  for (size_t lane = 0; lane < NumOfLanes; ++lane) {
+    EE.resetValues();
+    initLane([&](const GlobalVariable &GV,
+                 int64_t v) { EE.setValue(GV, v); },
+             lane);
+    if (!EE.run(*F, errMsg))
+      return false;
+    numOfBlocks += EE.getNumOfExecutedBlocks();
+    for (auto *GV : GVs)
+      if (Batch.getValue(*GV, lane) != EE.getValue(*GV))
+        return false;
+  }
+  if (numOfBlocks != numOfLaneBlocks)
+    return false;
+
+  // The default decision goes by the last loaded value, and the latch
+  // (without the "true" and "false" tags) takes its first successor.
+  ExecutionBatch Batch2(*M, 3);
+  Batch2.setValue(*GVs[1], 1, 1);
+  Batch2.setValue(*GVs[2], 1, 1);
+  EE.setBatchBranchDecision(nullptr);
+  if (!EE.runBatch(*F, Batch2, errMsg) || Batch2.getValue(*GVs[4], 0) != 0 ||
+      Batch2.getValue(*GVs[4], 1) != 4 || EE.getNumOfExecutedBlocks() != 13)
+    return false;
+
+  // The block limit applies to the bbs executed for a tile.
+  EE.setBlockLimit(4);
+  if (EE.runBatch(*F, Batch2, errMsg) ||
+      errMsg != "function 'loop' hit the limit of 4 executed bbs")
+    return false;
+
+  EE.setBlockLimit(UINT64_MAX);
+
+  // There is a column per var, whatever the ids are. The batches made
+  // before a var is added don't have its column.
+  auto *Far = GlobalVariable::create(UINT32_MAX, M.get()).release();
+  if (EE.runBatch(*F, Batch2, errMsg) ||
+      errMsg != "the batch doesn't match the vars of the module")
+    return false;
+  ExecutionBatch Batch3(*M, 3);
+  for (size_t lane = 0; lane < 3; ++lane)
+    Batch3.setValue(*Far, lane, 7);
+  return Batch3.getNumOfVars() == GVs.size() + 1 &&
+         Batch3.getColumn(UINT32_MAX) == Batch3.getSlotColumn(GVs.size()) &&
+         EE.runBatch(*F, Batch3, errMsg) && Batch3.getValue(*Far, 2) == 7;
+}
+
+// Removes the LOADs, and adds a new bb (with a STORE) after the entry bb.
+class LoadsToStoresPass : public FunctionPass {
+public:
+  std::string_view getName() const override { return "loads-to-stores"; }
+
+  bool runOnFunction(Function &F, ModuleUpdates &) override {
+    BasicBlock *Entry = F.getEntryBB();
+    if (!Entry)
+      return false;
+    std::vector<Instruction *> Loads;
+    for (const auto &BB : F.getBasicBlocks())
+      for (auto *I : BB.second->getInstructions())
+        if (isa<Load>(I))
+          Loads.push_back(I);
+    for (auto *I : Loads)
+      I->getParent()->removeInstruction(
+          IRPtr<Instruction>(I, IRDeleter<Instruction>(true)));
+
+    auto *New = BasicBlock::create(std::string(F.getFnID()) + ".new", &F)
+                    .release();
+    Entry->addSuccessor("to." + std::string(F.getFnID()), New);
+    auto *GV = F.getParent()->getVarWithID(0);
+    Store::create({GV, GV}, New);
+    return true;
+  }
+};
+
+// Removes the empty functions.
+class RemoveEmptyFnsPass : public FunctionPass {
+public:
+  std::string_view getName() const override { return "remove-empty-fns"; }
+
+  bool runOnFunction(Function &F, ModuleUpdates &Updates) override {
+    if (!F.empty())
+      return false;
+    Updates.defer([&F](Module &M) {
+      M.removeFunction(IRPtr<Function>(&F, IRDeleter<Function>(true)));
+    });
+    return false;
+  }
+};
+
+class CountFnsPass : public ModulePass {
+public:
+  size_t &NumOfFns;
+  explicit CountFnsPass(size_t &numOfFns) : NumOfFns(numOfFns) {}
+  std::string_view getName() const override { return "count-fns"; }
+  bool runOnModule(Module &M) override {
+    NumOfFns = M.getNumberOfFns();
+    return false;
+  }
+};
+
+// The function passes give the same module on any number of the threads.
+bool testPassManager() {
+  auto build = [] {
+    auto M = Module::create("m17.revLang", /*useArena=*/true);
+    std::vector<GlobalVariable *> GVs;
+    for (unsigned i = 0; i < 16; ++i)
+      GVs.push_back(GlobalVariable::create(i, M.get()).release());
+    for (unsigned f = 0; f < 64; ++f) {
+      auto *F = Function::create("fn" + std::to_string(f), M.get()).release();
+      // Every 4th function is empty.
+      unsigned numOfBBs = f % 4 ? 50 + f : 0;
+      BasicBlock *Prev = nullptr;
+      for (unsigned b = 0; b < numOfBBs; ++b) {
+        auto *BB = BasicBlock::create("bb." + std::to_string(b), F, !Prev)
+                       .release();
+        if (Prev)
+          Prev->addSuccessor("true", BB);
+        Add::create({GVs[b % 16], GVs[(b + 1) % 16], GVs[(b + 2) % 16],
+                     GVs[(b + 3) % 16], GVs[(b + 4) % 16]},
+                    BB);
+        Load::create({GVs[(b + f) % 16]}, BB);
+        Prev = BB;
+      }
+    }
+    return M;
+  };
+
+  std::string Expected;
+  for (unsigned numOfThreads : {1, 4}) {
+    auto M = build();
+    size_t numOfFns = 0;
+    PassManager PM(numOfThreads);
+    PM.addPass(std::make_unique<LoadsToStoresPass>());
+    PM.addPass(std::make_unique<RemoveEmptyFnsPass>());
+    PM.addPass(std::make_unique<CountFnsPass>(numOfFns));
+    if (PM.getNumOfThreads() != numOfThreads || !PM.run(*M) ||
+        numOfFns != 48)
+      return false;
+
+    auto &Timings = PM.getTimings();
+    if (Timings.size() != 3 || Timings[0].Name != "loads-to-stores" ||
+        !Timings[0].Changed || !Timings[1].Changed || Timings[2].Changed)
+      return false;
+
+    // There are no LOADs left, so each var is used by the ADDs and by the
+    // new STOREs only.
+    size_t numOfUses = 0;
+    for (const auto &GV : M->getGlobalVars())
+      numOfUses += GV.second->getNumUses();
+    size_t numOfBBs = 0;
+    for (unsigned f = 0; f < 64; ++f)
+      numOfBBs += f % 4 ? 50 + f : 0;
+    if (numOfUses != numOfBBs * 5 + 48 * 2)
+      return false;
+
+    std::string Str;
+    {
+      StringOutputStream OS(Str);
+      M->print(OS);
+    }
+    if (Expected.empty())
+      Expected = Str;
+    else if (Str != Expected)
+      return false;
+  }
+  return true;
+}
+
+// The cleanup passes remove the debris, and keep the uses up to date.
+bool testCleanupPasses() {
+  auto M = Module::create("m18.revLang", /*useArena=*/true);
+  auto *GV0 = GlobalVariable::create(0, M.get()).release();
+  auto *GV1 = GlobalVariable::create(1, M.get()).release();
+  auto *GV2 = GlobalVariable::create(2, M.get()).release();
+  auto *F = Function::create("f", M.get()).release();
+  auto *Entry = BasicBlock::create("entry", F, true).release();
+  auto *A = BasicBlock::create("a", F).release();
+  auto *B = BasicBlock::create("b", F).release();
+  auto *C = BasicBlock::create("c", F).release();
+  auto *D = BasicBlock::create("d", F).release();
+  auto *U = BasicBlock::create("u", F).release();
+  Entry->addSuccessor("", A);
+  A->addSuccessor("", B);
+  B->addSuccessor("true", C);
+  B->addSuccessor("false", D);
+  C->addSuccessor("", D);
+  U->addSuccessor("", D);
+  U->addSuccessor("loop", U);
+  Add::create({GV0, GV1, GV1}, A);
+  Load::create({GV0}, B);
+  Store::create({GV0, GV1}, D);
+  Load::create({GV1}, U);
+  // The g has no bbs, and the h doesn't do anything.
+  Function::create("g", M.get());
+  auto *H = Function::create("h", M.get()).release();
+  BasicBlock::create("entry", H, true);
+
+  // The chain of the bbs with the ADDs, split by the empty bbs, becomes a
+  // single bb.
+  const unsigned NumOfBBs = 200000;
+  auto *Chain = Function::create("chain", M.get()).release();
+  BasicBlock *Prev = BasicBlock::create("bb.0", Chain, true).release();
+  for (unsigned b = 1; b < NumOfBBs; ++b) {
+    auto *BB =
+        BasicBlock::create("bb." + std::to_string(b), Chain).release();
+    Prev->addSuccessor("", BB);
+    if (b % 2)
+      Add::create({GV2, GV2, GV2}, BB);
+    Prev = BB;
+  }
+
+  PassManager PM(4);
+  addCleanupPasses(PM);
+  if (!PM.run(*M) || M->getNumberOfFns() != 2 || M->getFunction("g") ||
+      M->getFunction("h"))
+    return false;
+
+  // The f is now: entry { ADD; LOAD } -> d (by both the tags).
+  if (F->getNumberOfBBs() != 2 || Entry->getNumOfInstrs() != 2 ||
+      Entry->getSuccessor("true") != D || Entry->getSuccessor("false") != D ||
+      D->getNumOfPredecessors() != 2 || !F->isValid())
+    return false;
+  for (auto *I : Entry->getInstructions())
+    if (I->getParent() != Entry)
+      return false;
+  // The LOAD of the unreachable bb is gone.
+  if (GV0->getNumUses() != 3 || GV1->getNumUses() != 3)
+    return false;
+
+  if (Chain->getNumberOfBBs() != 1 ||
+      Chain->getEntryBB()->getNumOfInstrs() != NumOfBBs / 2)
+    return false;
+
+  // There is nothing left to clean up.
+  return !PM.run(*M);
+}
+
+// Builds a function of numOfBBs bbs over the vars of the pseudo-random
+// ids, where each 8th bb may loop back (see the runFirstVisitLoops()).
+// Some of the ADDs are repeated. The var 0 is never written, so the values
+// don't overflow.
+static Function *buildLoopyFunction(Module &M, unsigned numOfBBs,
+                                    unsigned numOfVars) {
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 0; i < numOfVars; ++i)
+    GVs.push_back(GlobalVariable::create(i, &M).release());
+  auto *F = Function::create("loopy", &M).release();
+  std::vector<BasicBlock *> BBs;
+  uint32_t seed = 1;
+  auto nextVar = [&]() {
+    seed = seed * 1103515245 + 12345;
+    return GVs[1 + (seed >> 8) % (numOfVars - 1)];
+  };
+  for (unsigned b = 0; b < numOfBBs; ++b) {
+    auto *BB = BasicBlock::create("bb." + std::to_string(b), F, !b).release();
+    if (b)
+      BBs.back()->addSuccessor(b % 8 == 0 ? "false" : "", BB);
+    if (b % 8 == 7 && b + 1 < numOfBBs) {
+      BB->addSuccessor("true", BBs[b - 4]);
+      Load::create({nextVar()}, BB);
+    }
+    BBs.push_back(BB);
+    Store::create({nextVar(), nextVar()}, BB);
+    OperandsTy AddOps{nextVar(), nextVar(), GVs[0]};
+    Add::create(AddOps, BB);
+    Store::create({nextVar(), nextVar()}, BB);
+    if (b % 4 == 1)
+      Add::create(AddOps, BB);
+  }
+  return F;
+}
+
+// Runs the F, where each var starts as its id, and each bb with the back
+// edge takes it on its first visit only. Returns the values of the vars.
+// The native code of the JIT is run instead of the bytecode, if it is set.
+static bool runFirstVisitLoops(Function &F, std::vector<int64_t> &Values,
+                               JITCache *JIT = nullptr) {
+  ExecutionEngine EE(*F.getParent());
+  EE.setJIT(JIT);
+  for (const auto &GV : F.getParent()->getGlobalVars())
+    EE.setValue(*GV.second, GV.first);
+  std::vector<char> Visited(F.getMaxBBNumber(), false);
+  EE.setBranchDecision([&](const BranchState &S) -> size_t {
+    // The tags are sorted: "false", "true".
+    return !std::exchange(Visited[S.BB->getNumber()], true);
+  });
+  std::string errMsg;
+  if (!EE.run(F, errMsg))
+    return false;
+  Values.assign(EE.getValues().begin(), EE.getValues().end());
+  return true;
+}
+
+// The liveness and the reaching stores are exact on a small loop, and the
+// DSE keeps the results of the runs on a large function.
+bool testDataFlow() {
+  auto M = Module::create("m19.revLang", /*useArena=*/true);
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 0; i < 4; ++i)
+    GVs.push_back(GlobalVariable::create(i, M.get()).release());
+  auto *F = Function::create("f", M.get()).release();
+  auto *Entry = BasicBlock::create("entry", F, true).release();
+  auto *Loop = BasicBlock::create("loop", F).release();
+  auto *Exit = BasicBlock::create("exit", F).release();
+  auto *U = BasicBlock::create("u", F).release();
+  Entry->addSuccessor("", Loop);
+  Loop->addSuccessor("true", Loop);
+  Loop->addSuccessor("false", Exit);
+  U->addSuccessor("", Exit);
+  // entry: !1 = !0; !3 = !1 (dead); !2 = !0 + !0
+  // loop:  LOAD !2; !3 = !0 (dead); !3 = !1
+  // exit:  !3 = !3 (no-op); !2 = !0
+  auto *E1 = Store::create({GVs[0], GVs[1]}, Entry).release();
+  auto *E2 = Store::create({GVs[1], GVs[3]}, Entry).release();
+  Add::create({GVs[2], GVs[0], GVs[0]}, Entry);
+  auto *LLoad = Load::create({GVs[2]}, Loop).release();
+  auto *L1 = Store::create({GVs[0], GVs[3]}, Loop).release();
+  auto *L2 = Store::create({GVs[1], GVs[3]}, Loop).release();
+  auto *X1 = Store::create({GVs[3], GVs[3]}, Exit).release();
+  auto *X2 = Store::create({GVs[0], GVs[2]}, Exit).release();
+  Store::create({GVs[0], GVs[1]}, U);
+
+  auto asSet = [](const BitVector &BV) {
+    std::vector<unsigned> Set;
+    for (ptrdiff_t i = BV.findFirst(); i >= 0; i = BV.findNext(i))
+      Set.push_back(i);
+    return Set;
+  };
+  using Set = std::vector<unsigned>;
+  {
+    LiveVariables LV(*F);
+    if (LV.isReachable(U) || asSet(LV.getLiveIn(U)) != Set{} ||
+        asSet(LV.getLiveOut(Exit)) != Set({0, 1, 2, 3}) ||
+        asSet(LV.getLiveIn(Exit)) != Set({0, 1, 3}) ||
+        asSet(LV.getLiveIn(Loop)) != Set({0, 1, 2}) ||
+        asSet(LV.getLiveOut(Loop)) != Set({0, 1, 2, 3}) ||
+        asSet(LV.getLiveOut(Entry)) != Set({0, 1, 2}) ||
+        asSet(LV.getLiveIn(Entry)) != Set({0}))
+      return false;
+
+    ReachingStores RS(*F);
+    using Stores = std::vector<const Store *>;
+    auto sorted = [](Stores S) {
+      std::sort(S.begin(), S.end());
+      return S;
+    };
+    if (RS.getNumOfStores() != 7 ||
+        sorted(RS.getReachingStores(LLoad, GVs[3])) != sorted({E2, L2}) ||
+        RS.getReachingStores(L2, GVs[3]) != Stores{L1} ||
+        RS.getReachingStores(X1, GVs[1]) != Stores{E1} ||
+        !RS.getReachingStores(X2, GVs[2]).empty() ||
+        RS.getReachingStores(X2, GVs[3]) != Stores{X1} ||
+        RS.getReachingOut(U).count())
+      return false;
+  }
+
+  PassManager PM(4);
+  PM.addPass(createDeadStoreElimPass());
+  if (!PM.run(*M) || Entry->getNumOfInstrs() != 2 ||
+      Loop->getNumOfInstrs() != 2 || Exit->getNumOfInstrs() != 1 ||
+      U->getNumOfInstrs() != 1 || GVs[3]->getNumUses() != 1 ||
+      Loop->getInstructions().back() != L2)
+    return false;
+  if (PM.run(*M))
+    return false;
+
+  // The sparse var ids don't take the bits.
+  auto Sparse = Module::create("m19b.revLang", /*useArena=*/true);
+  auto *Low = GlobalVariable::create(0, Sparse.get()).release();
+  auto *High = GlobalVariable::create(UINT32_MAX, Sparse.get()).release();
+  auto *SF = Function::create("f", Sparse.get()).release();
+  auto *SEntry = BasicBlock::create("entry", SF, true).release();
+  // !4294967295 = !0 (dead); !4294967295 = !0 + !0; LOAD !4294967295
+  auto *SDead = Store::create({Low, High}, SEntry).release();
+  auto *SAdd = Add::create({High, Low, Low}, SEntry).release();
+  auto *SLoad = Load::create({High}, SEntry).release();
+  {
+    LiveVariables LV(*SF);
+    ReachingStores RS(*SF);
+    if (LV.getNumOfFacts() != 2 || LV.getVarIndex(High) != 1 ||
+        asSet(LV.getLiveIn(SEntry)) != Set({0}) ||
+        RS.getReachingStores(SAdd, High) != std::vector<const Store *>{SDead} ||
+        !RS.getReachingStores(SLoad, High).empty())
+      return false;
+  }
+  if (!PM.run(*Sparse) || SEntry->getNumOfInstrs() != 2 ||
+      SEntry->instructions().front() != SAdd)
+    return false;
+
+  // The liveness of a large function is a fixed point of the transfer over
+  // the instructions.
+  const unsigned NumOfBBs = 20000, NumOfVars = 2000;
+  auto Big = Module::create("m20.revLang", /*useArena=*/true);
+  auto *G = buildLoopyFunction(*Big, NumOfBBs, NumOfVars);
+  std::vector<BasicBlock *> BBs;
+  for (auto *BB : depth_first(*G))
+    BBs.push_back(BB);
+
+  LiveVariables LV(*G);
+  for (auto *BB : BBs) {
+    BitVector Live = LV.getLiveOut(BB);
+    const auto &Instrs = BB->getInstructions();
+    for (auto I = Instrs.rbegin(); I != Instrs.rend(); ++I)
+      LV.stepBackward(*I, Live);
+    if (Live != LV.getLiveIn(BB))
+      return false;
+  }
+
+  std::vector<int64_t> Before, After;
+  size_t numOfInstrs = 0;
+  for (auto *BB : BBs)
+    numOfInstrs += BB->getNumOfInstrs();
+  if (!runFirstVisitLoops(*G, Before) || !PM.run(*Big) ||
+      !runFirstVisitLoops(*G, After) || Before != After || !G->isValid())
+    return false;
+  size_t numOfInstrsLeft = 0;
+  for (auto *BB : BBs)
+    numOfInstrsLeft += BB->getNumOfInstrs();
+  return numOfInstrsLeft < numOfInstrs;
+}
+
+// The dominators, the frontiers and the loops of a nest of two loops, and
+// of a self loop after it. The cache recomputes them after the CFG changes.
+bool testDominatorsAndLoops() {
+  auto M = Module::create("m21.revLang", /*useArena=*/true);
+  auto *GV = GlobalVariable::create(0, M.get()).release();
+  auto *F = Function::create("f", M.get()).release();
+  std::map<std::string, BasicBlock *> BBs;
+  for (const char *Name : {"entry", "a", "b", "c", "d", "exit", "f", "g", "u"})
+    BBs[Name] =
+        BasicBlock::create(Name, F, !std::strcmp(Name, "entry")).release();
+  for (const auto &Edge : std::vector<std::array<const char *, 3>>{
+           {"entry", "", "a"},
+           {"a", "true", "b"},
+           {"a", "false", "exit"},
+           {"b", "", "c"},
+           {"c", "true", "b"},
+           {"c", "false", "d"},
+           {"d", "true", "a"},
+           {"d", "false", "exit"},
+           {"exit", "", "f"},
+           {"f", "loop", "f"},
+           {"f", "done", "g"},
+           {"u", "", "a"}})
+    BBs[Edge[0]]->addSuccessor(Edge[1], BBs[Edge[2]]);
+
+  AnalysisManager AM;
+  const DominatorTree &DT = AM.getResult<DominatorTreeAnalysis>(*F);
+  auto IDomOf = [&](const char *Name) {
+    BasicBlock *IDom = DT.getIDom(BBs[Name]);
+    return IDom ? std::string(IDom->getBBID()) : std::string();
+  };
+  if (IDomOf("entry") != "" || IDomOf("a") != "entry" || IDomOf("b") != "a" ||
+      IDomOf("c") != "b" || IDomOf("d") != "c" || IDomOf("exit") != "a" ||
+      IDomOf("f") != "exit" || IDomOf("g") != "f" || IDomOf("u") != "" ||
+      DT.isReachable(BBs["u"]) || DT.getReversePostOrder().size() != 8)
+    return false;
+  if (!DT.dominates(BBs["a"], BBs["d"]) || !DT.dominates(BBs["d"], BBs["d"]) ||
+      DT.properlyDominates(BBs["d"], BBs["d"]) ||
+      DT.dominates(BBs["b"], BBs["exit"]) ||
+      DT.dominates(BBs["u"], BBs["a"]) ||
+      DT.findNearestCommonDominator(BBs["c"], BBs["exit"]) != BBs["a"] ||
+      DT.findNearestCommonDominator(BBs["g"], BBs["d"]) != BBs["a"])
+    return false;
+
+  const DominanceFrontier &DF = AM.getResult<DominanceFrontierAnalysis>(*F);
+  auto FrontierOf = [&](const char *Name) {
+    std::vector<std::string> Names;
+    for (auto *BB : DF.getFrontier(BBs[Name]))
+      Names.emplace_back(BB->getBBID());
+    std::sort(Names.begin(), Names.end());
+    return Names;
+  };
+  using Names = std::vector<std::string>;
+  if (FrontierOf("entry") != Names{} || FrontierOf("a") != Names{"a"} ||
+      FrontierOf("b") != Names({"a", "b", "exit"}) ||
+      FrontierOf("c") != Names({"a", "b", "exit"}) ||
+      FrontierOf("d") != Names({"a", "exit"}) ||
+      FrontierOf("exit") != Names{} || FrontierOf("f") != Names{"f"})
+    return false;
+
+  const LoopInfo &LI = AM.getResult<LoopAnalysis>(*F);
+  Loop *Outer = LI.getLoopFor(BBs["a"]);
+  Loop *Inner = LI.getLoopFor(BBs["c"]);
+  Loop *Self = LI.getLoopFor(BBs["f"]);
+  if (LI.getNumOfLoops() != 3 || LI.getTopLevelLoops().size() != 2 ||
+      !Outer || !Inner || !Self || Outer->getHeader() != BBs["a"] ||
+      Inner->getHeader() != BBs["b"] || Inner->getParentLoop() != Outer ||
+      Outer->getSubLoops() != std::vector<Loop *>{Inner} ||
+      Outer->getBlocks() !=
+          std::vector<BasicBlock *>{BBs["a"], BBs["b"], BBs["c"], BBs["d"]} ||
+      Inner->getLatches() != std::vector<BasicBlock *>{BBs["c"]} ||
+      Self->getLatches() != std::vector<BasicBlock *>{BBs["f"]} ||
+      LI.getLoopDepth(BBs["c"]) != 2 || LI.getLoopDepth(BBs["d"]) != 1 ||
+      LI.getLoopDepth(BBs["exit"]) != 0 || LI.getLoopFor(BBs["u"]) ||
+      !LI.isLoopHeader(BBs["b"]) || LI.isLoopHeader(BBs["c"]) ||
+      !LI.contains(Outer, BBs["c"]) || LI.contains(Inner, BBs["d"]))
+    return false;
+
+  // The instructions don't change the CFG, but the edges do.
+  Load::create({GV}, BBs["g"]);
+  if (&AM.getResult<DominatorTreeAnalysis>(*F) != &DT ||
+      &AM.getResult<LoopAnalysis>(*F) != &LI)
+    return false;
+  uint64_t epoch = F->getCFGEpoch();
+  BBs["g"]->addSuccessor("", BBs["exit"]);
+  if (F->getCFGEpoch() == epoch ||
+      AM.getResult<DominatorTreeAnalysis>(*F).getCFGEpoch() !=
+          F->getCFGEpoch() ||
+      AM.getResult<LoopAnalysis>(*F).getNumOfLoops() != 4 ||
+      !AM.getResult<LoopAnalysis>(*F).isLoopHeader(BBs["exit"]) ||
+      AM.getResult<LoopAnalysis>(*F).getLoopFor(BBs["f"])->getParentLoop() !=
+          AM.getResult<LoopAnalysis>(*F).getLoopFor(BBs["exit"]))
+    return false;
+
+  // A long chain looping back to its start makes a deep dominator tree.
+  const unsigned NumOfBBs = 200000;
+  auto *Chain = Function::create("chain", M.get()).release();
+  std::vector<BasicBlock *> ChainBBs;
+  for (unsigned b = 0; b < NumOfBBs; ++b) {
+    ChainBBs.push_back(
+        BasicBlock::create("bb." + std::to_string(b), Chain, !b).release());
+    if (b)
+      ChainBBs[b - 1]->addSuccessor("", ChainBBs[b]);
+  }
+  ChainBBs.back()->addSuccessor("loop", ChainBBs.front());
+  const DominatorTree &ChainDT = AM.getResult<DominatorTreeAnalysis>(*Chain);
+  const LoopInfo &ChainLI = AM.getResult<LoopAnalysis>(*Chain);
+  if (!ChainDT.dominates(ChainBBs[1], ChainBBs.back()) ||
+      ChainDT.dominates(ChainBBs.back(), ChainBBs[1]) ||
+      ChainDT.getIDom(ChainBBs.back()) != ChainBBs[NumOfBBs - 2] ||
+      ChainLI.getNumOfLoops() != 1 ||
+      ChainLI.getLoopFor(ChainBBs[NumOfBBs / 2])->getNumOfBlocks() !=
+          NumOfBBs ||
+      AM.getResult<DominanceFrontierAnalysis>(*Chain)
+              .getFrontier(ChainBBs.back())
+              .size() != 1)
+    return false;
+
+  // A header with many latches, each branching to it via two tags.
+  const unsigned NumOfLatches = 50000;
+  auto *Fan = Function::create("fan", M.get()).release();
+  auto *FanHeader = BasicBlock::create("header", Fan, true).release();
+  for (unsigned l = 0; l < NumOfLatches; ++l) {
+    auto *Latch =
+        BasicBlock::create("latch." + std::to_string(l), Fan).release();
+    FanHeader->addSuccessor("l." + std::to_string(l), Latch);
+    Latch->addSuccessor("true", FanHeader);
+    Latch->addSuccessor("false", FanHeader);
+  }
+  const LoopInfo &FanLI = AM.getResult<LoopAnalysis>(*Fan);
+  return FanLI.getNumOfLoops() == 1 &&
+         FanLI.getLoopFor(FanHeader)->getLatches().size() == NumOfLatches &&
+         FanLI.getLoopFor(FanHeader)->getNumOfBlocks() == NumOfLatches + 1;
+}
+
+// The repeated values are found within the bbs, and down the paths of the
+// bbs with a single predecessor, but not after the joins or the writes.
+bool testGVN() {
+  auto M = Module::create("m22.revLang", /*useArena=*/true);
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 0; i < 5; ++i)
+    GVs.push_back(GlobalVariable::create(i, M.get()).release());
+  auto *F = Function::create("f", M.get()).release();
+  auto *Entry = BasicBlock::create("entry", F, true).release();
+  auto *A = BasicBlock::create("a", F).release();
+  auto *B = BasicBlock::create("b", F).release();
+  auto *Join = BasicBlock::create("join", F).release();
+  Entry->addSuccessor("true", A);
+  Entry->addSuccessor("false", B);
+  A->addSuccessor("", Join);
+  B->addSuccessor("", Join);
+  // The redundant ones are marked with the (r).
+  // entry: !0 = !1 + !2; !0 = !2 + !1 (r); LOAD !0; LOAD !0 (r);
+  //        !3 = !0; LOAD !3 (r); !0 = !3 (r)
+  // a:     !4 = !1 + !2; !0 = !1 + !2 (r); !2 = !1; !0 = !1 + !2
+  // b:     LOAD !0 (r)
+  // join:  !0 = !1 + !2; LOAD !0
+  Add::create({GVs[0], GVs[1], GVs[2]}, Entry);
+  Add::create({GVs[0], GVs[2], GVs[1]}, Entry);
+  Load::create({GVs[0]}, Entry);
+  Load::create({GVs[0]}, Entry);
+  Store::create({GVs[0], GVs[3]}, Entry);
+  Load::create({GVs[3]}, Entry);
+  Store::create({GVs[3], GVs[0]}, Entry);
+  Add::create({GVs[4], GVs[1], GVs[2]}, A);
+  Add::create({GVs[0], GVs[1], GVs[2]}, A);
+  auto *AStore = Store::create({GVs[1], GVs[2]}, A).release();
+  Add::create({GVs[0], GVs[1], GVs[2]}, A);
+  Load::create({GVs[0]}, B);
+  Add::create({GVs[0], GVs[1], GVs[2]}, Join);
+  Load::create({GVs[0]}, Join);
+
+  PassManager PM;
+  PM.addPass(createGVNPass());
+  if (!PM.run(*M) || Entry->getNumOfInstrs() != 3 ||
+      A->getNumOfInstrs() != 3 || A->getInstructions()[1] != AStore ||
+      B->getNumOfInstrs() != 0 || Join->getNumOfInstrs() != 2 ||
+      GVs[3]->getNumUses() != 1)
+    return false;
+  if (PM.run(*M))
+    return false;
+
+  // The tables are sized by the vars of the function, not by their ids.
+  auto Far = Module::create("m22b.revLang", /*useArena=*/true);
+  auto *FarGV = GlobalVariable::create(UINT32_MAX, Far.get()).release();
+  auto *FarF = Function::create("f", Far.get()).release();
+  auto *FarEntry = BasicBlock::create("entry", FarF, true).release();
+  Load::create({FarGV}, FarEntry);
+  Load::create({FarGV}, FarEntry);
+  if (!PM.run(*Far) || FarEntry->getNumOfInstrs() != 1)
+    return false;
+
+  // The runs of a large function give the same results after the pass.
+  auto Big = Module::create("m23.revLang", /*useArena=*/true);
+  auto *G = buildLoopyFunction(*Big, 20000, 16);
+  size_t numOfInstrs = 0;
+  for (const auto &BB : G->getBasicBlocks())
+    numOfInstrs += BB.second->getNumOfInstrs();
+  std::vector<int64_t> Before, After;
+  PassManager BigPM(4);
+  BigPM.addPass(createGVNPass());
+  if (!runFirstVisitLoops(*G, Before) || !BigPM.run(*Big) ||
+      !runFirstVisitLoops(*G, After) || Before != After)
+    return false;
+  for (const auto &BB : G->getBasicBlocks())
+    numOfInstrs -= BB.second->getNumOfInstrs();
+  return numOfInstrs >= 20000 / 4;
+}
+
+// The results are kept until the parts of the function they depend on
+// change, and the isValid() is checked again after the CFG changes only.
+bool testAnalysisManager() {
+  auto M = Module::create("m24.revLang", /*useArena=*/true);
+  auto *GV0 = GlobalVariable::create(0, M.get()).release();
+  auto *GV1 = GlobalVariable::create(1, M.get()).release();
+  auto *F = Function::create("f", M.get()).release();
+  auto *Entry = BasicBlock::create("entry", F, true).release();
+  auto *Body = BasicBlock::create("body", F).release();
+  auto *Exit = BasicBlock::create("exit", F).release();
+  Entry->addSuccessor("", Body);
+  Body->addSuccessor("true", Body);
+  Body->addSuccessor("false", Exit);
+  Load::create({GV1}, Body);
+
+  AnalysisManager AM;
+  const LoopInfo *LI = &AM.getResult<LoopAnalysis>(*F);
+  const LiveVariables *LV = &AM.getResult<LiveVariablesAnalysis>(*F);
+  if (AM.getNumOfRuns() != 3 || LI->getNumOfLoops() != 1 ||
+      !LV->getLiveIn(Body).test(LV->getVarIndex(GV1)) || !F->isValid())
+    return false;
+
+  // The edits of the instructions keep the CFG results.
+  uint64_t epoch = F->getEpoch(), cfgEpoch = F->getCFGEpoch();
+  uint64_t bodyEpoch = Body->getEpoch(), exitEpoch = Exit->getEpoch();
+  auto *S = Store::create({GV1, GV0}, Body).release();
+  if (F->getEpoch() == epoch || F->getCFGEpoch() != cfgEpoch ||
+      Body->getEpoch() == bodyEpoch || Exit->getEpoch() != exitEpoch ||
+      AM.getCachedResult<LiveVariablesAnalysis>(*F) ||
+      AM.getCachedResult<DominatorTreeAnalysis>(*F) == nullptr ||
+      &AM.getResult<LoopAnalysis>(*F) != LI || AM.getNumOfRuns() != 3)
+    return false;
+  LV = &AM.getResult<LiveVariablesAnalysis>(*F);
+  if (!LV->getLiveIn(Body).test(LV->getVarIndex(GV1)) || AM.getNumOfRuns() != 4)
+    return false;
+  epoch = F->getEpoch();
+  S->setOperand(0, GV1);
+  if (F->getEpoch() == epoch || AM.getCachedResult<LiveVariablesAnalysis>(*F))
+    return false;
+
+  // The edits of the edges invalidate all of them.
+  auto *Dead = BasicBlock::create("dead", F).release();
+  if (F->getCFGEpoch() == cfgEpoch || F->isValid() ||
+      AM.getCachedResult<DominatorTreeAnalysis>(*F) ||
+      AM.getCachedResult<LoopAnalysis>(*F))
+    return false;
+  Exit->addSuccessor("", Dead);
+  cfgEpoch = F->getCFGEpoch();
+  if (!F->isValid() || F->getCFGEpoch() != cfgEpoch ||
+      AM.getResult<LoopAnalysis>(*F).getNumOfLoops() != 1 ||
+      !AM.getResult<DominatorTreeAnalysis>(*F).isReachable(Dead))
+    return false;
+  Body->removeSuccessor(Body);
+  if (AM.getCachedResult<LoopAnalysis>(*F) ||
+      AM.getResult<LoopAnalysis>(*F).getNumOfLoops() != 0)
+    return false;
+
+  // The execution engine notices the changes on its own.
+  ExecutionEngine EE(*M);
+  std::string errMsg;
+  EE.setValue(*GV1, 7);
+  if (!EE.run(*F, errMsg) || EE.getValue(*GV0) != 7)
+    return false;
+  Add::create({GV0, GV1, GV1}, Exit);
+  if (!EE.run(*F, errMsg) || EE.getValue(*GV0) != 14)
+    return false;
+
+  // The results of the other functions are kept apart.
+  auto *G = Function::create("g", M.get()).release();
+  BasicBlock::create("entry", G, true).release();
+  size_t numOfRuns = AM.getNumOfRuns();
+  if (AM.getResult<LoopAnalysis>(*G).getNumOfLoops() != 0 ||
+      AM.getNumOfRuns() != numOfRuns + 2 ||
+      !AM.getCachedResult<LoopAnalysis>(*F))
+    return false;
+  AM.invalidate(*F);
+  return !AM.getCachedResult<LoopAnalysis>(*F) &&
+         AM.getCachedResult<LoopAnalysis>(*G);
+}
+
+// The functions and the vars are moved (not copied) by the linking, and
+// the clashes are resolved by the policies.
+bool testModuleLinking() {
+  auto buildModule = [](const std::string &Name, unsigned firstVar) {
+    auto M = Module::create(Name, /*useArena=*/true);
+    auto *GV0 = GlobalVariable::create(firstVar, M.get()).release();
+    auto *GV1 = GlobalVariable::create(firstVar + 1, M.get()).release();
+    for (const char *FnName : {"main", Name == "a" ? "a.only" : "b.only"}) {
+      auto *F = Function::create(FnName, M.get()).release();
+      auto *Entry = BasicBlock::create("entry", F, true).release();
+      auto *Exit = BasicBlock::create(Name + ".exit", F).release();
+      Entry->addSuccessor("true", Exit);
+      Entry->addSuccessor("false", Exit);
+      Store::create({GV0, GV1}, Entry);
+      Add::create({GV0, GV1, GV1}, Exit);
+    }
+    return M;
+  };
+
+  // The name clash fails the linking, without changing the modules.
+  auto A = buildModule("a", 0);
+  auto B = buildModule("b", 1);
+  std::string errMsg;
+  if (A->link(std::move(*B), errMsg) ||
+      errMsg != "function 'main' of the module 'b' is already defined" ||
+      A->getNumberOfFns() != 2 || B->getNumberOfFns() != 2 ||
+      A->getGlobalVars().size() != 2)
+    return false;
+
+  // The var 1 is in both of the modules, so its uses are merged.
+  Function *BMain = B->getFunction("main");
+  GlobalVariable *AVar1 = A->getVarWithID(1);
+  GlobalVariable *BVar2 = B->getVarWithID(2);
+  LinkOptions Opts;
+  Opts.Functions = LinkOptions::FnClash::Rename;
+  if (!A->link(std::move(*B), errMsg, Opts) || A->getNumberOfFns() != 4 ||
+      B->getNumberOfFns() != 0 || !B->getGlobalVars().empty() ||
+      A->getFunction("main.1") != BMain || BMain->getParent() != A.get() ||
+      !A->getFunction("b.only") || A->getVarWithID(2) != BVar2 ||
+      BVar2->getParent() != A.get() || AVar1->getNumUses() != 10 ||
+      BMain->getEntryBB()->getSuccessor("true") !=
+          BMain->getBasicBlock("b.exit") ||
+      BMain->getBasicBlock("b.exit")->getBBID() != "b.exit")
+    return false;
+  // !1 = !0 in the a, !2 = !1 in the b, and then each of them doubles.
+  ExecutionEngine EE(*A);
+  EE.setValue(*A->getVarWithID(0), 3);
+  if (!EE.run(*BMain, errMsg) || EE.getValue(*BVar2) != 0 ||
+      !EE.run(*A->getFunction("main"), errMsg) ||
+      EE.getValue(*AVar1) != 3 || EE.getValue(*A->getVarWithID(0)) != 6 ||
+      !EE.run(*BMain, errMsg) || EE.getValue(*BVar2) != 3 ||
+      EE.getValue(*AVar1) != 6)
+    return false;
+
+  // The other policies: the vars get fresh IDs, and one of the functions
+  // is dropped (so the var 1 of the b has the uses within the b.only only,
+  // or the var 1 of the a within the a.only).
+  for (auto Policy :
+       {LinkOptions::FnClash::KeepDest, LinkOptions::FnClash::KeepSrc}) {
+    A = buildModule("a", 0);
+    B = buildModule("b", 1);
+    Function *AMain = A->getFunction("main");
+    BMain = B->getFunction("main");
+    Opts.Functions = Policy;
+    Opts.Vars = LinkOptions::VarClash::Rename;
+    bool keepDest = Policy == LinkOptions::FnClash::KeepDest;
+    if (!A->link(std::move(*B), errMsg, Opts) || A->getNumberOfFns() != 3 ||
+        A->getGlobalVars().size() != 4 ||
+        A->getVarWithID(3)->getNumUses() != (keepDest ? 2u : 4u) ||
+        A->getVarWithID(1)->getNumUses() != (keepDest ? 6u : 3u))
+      return false;
+    Function *Kept = keepDest ? AMain : BMain;
+    Function *Dropped = Kept == AMain ? BMain : AMain;
+    if (A->getFunction("main") != Kept ||
+        Dropped->getEntryBB()->getNumOfInstrs() != 0)
+      return false;
+  }
+
+  // Past the UINT32_MAX, the fresh IDs are the gaps of both modules.
+  {
+    auto Far = Module::create("far", /*useArena=*/true);
+    auto Near = Module::create("near", /*useArena=*/true);
+    GlobalVariable::create(0, Far.get()).release();
+    GlobalVariable::create(UINT32_MAX, Far.get()).release();
+    auto *Renamed = GlobalVariable::create(0, Near.get()).release();
+    GlobalVariable::create(1, Near.get()).release();
+    LinkOptions RenameVars;
+    RenameVars.Vars = LinkOptions::VarClash::Rename;
+    if (!Far->link(std::move(*Near), errMsg, RenameVars) ||
+        Far->getGlobalVars().size() != 4 || Renamed->getID() != 2 ||
+        Far->getVarWithID(2) != Renamed)
+      return false;
+  }
+
+  // Many modules are linked in parallel, as they would be one by one.
+  auto buildShards = [](std::vector<std::unique_ptr<Module>> &Shards,
+                        std::vector<Function *> &Fns) {
+    for (unsigned i = 0; i < 16; ++i) {
+      Shards.push_back(
+          Module::create("shard" + std::to_string(i), /*useArena=*/true));
+      Fns.push_back(buildLoopyFunction(*Shards.back(), 100 + 10 * i, 16));
+    }
+  };
+  std::vector<std::unique_ptr<Module>> Shards;
+  std::vector<Function *> Fns;
+  buildShards(Shards, Fns);
+  std::vector<std::vector<int64_t>> Before(Fns.size());
+  for (size_t i = 0; i < Fns.size(); ++i)
+    if (!runFirstVisitLoops(*Fns[i], Before[i]))
+      return false;
+
+  Opts.Functions = LinkOptions::FnClash::Rename;
+  Opts.Vars = LinkOptions::VarClash::Merge;
+  Opts.NumOfThreads = 4;
+  auto Linked = Module::create("linked", /*useArena=*/true);
+  if (!Linked->link(std::move(Shards), errMsg, Opts) ||
+      Linked->getNumberOfFns() != 16 || Linked->getGlobalVars().size() != 16 ||
+      Linked->getFunction("loopy.15") != Fns[15])
+    return false;
+  for (size_t i = 0; i < Fns.size(); ++i) {
+    std::vector<int64_t> After;
+    if (Fns[i]->getParent() != Linked.get() ||
+        !runFirstVisitLoops(*Fns[i], After) || After != Before[i])
+      return false;
+  }
+
+  std::vector<std::unique_ptr<Module>> SeqShards;
+  std::vector<Function *> SeqFns;
+  buildShards(SeqShards, SeqFns);
+  auto SeqLinked = Module::create("linked", /*useArena=*/true);
+  for (auto &Shard : SeqShards)
+    if (!SeqLinked->link(std::move(*Shard), errMsg, Opts))
+      return false;
+  std::string Parallel, Sequential;
+  {
+    StringOutputStream OS(Parallel);
+    Linked->print(OS);
+  }
+  {
+    StringOutputStream OS(Sequential);
+    SeqLinked->print(OS);
+  }
+  return Parallel == Sequential;
+}
+
+// Makes all the operands of the instructions the given var.
+struct OperandSetter : public InstVisitor<OperandSetter> {
+  GlobalVariable *GV;
+  explicit OperandSetter(GlobalVariable *gv) : GV(gv) {}
+  void visitInstruction(Instruction &I) {
+    for (unsigned i = 0; i < I.getNumOfOps(); ++i)
+      I.setOperand(i, GV);
+  }
+};
+
+// The clones behave as the original, and the copy-on-write ones share its
+// instructions until either of them changes them.
+bool testCloning() {
+  auto M = Module::create("m25.revLang", /*useArena=*/true);
+  Function *F = buildLoopyFunction(*M, 2000, 16);
+  std::vector<int64_t> Expected, Values;
+  if (!runFirstVisitLoops(*F, Expected))
+    return false;
+  auto printFn = [](const Function *Fn) {
+    std::string Str;
+    StringOutputStream OS(Str);
+    Fn->print(OS);
+    OS.flush();
+    return Str.substr(Str.find('\n'));
+  };
+
+  // The deep copy has its own bbs and instructions.
+  GlobalVariable *GV0 = M->getVarWithID(0);
+  size_t numOfUses = GV0->getNumUses();
+  Function *Copy = F->clone("copy").release();
+  BasicBlock *CopyBB = Copy->getBasicBlock("bb.7");
+  if (M->getFunction("copy") != Copy || printFn(Copy) != printFn(F) ||
+      GV0->getNumUses() != 2 * numOfUses ||
+      CopyBB == F->getBasicBlock("bb.7") ||
+      CopyBB->getSuccessor("true") != Copy->getBasicBlock("bb.3") ||
+      CopyBB->instructions().front()->getParent() != CopyBB ||
+      !runFirstVisitLoops(*Copy, Values) || Values != Expected)
+    return false;
+  CopyBB->removeAllInstructions();
+  if (!runFirstVisitLoops(*F, Values) || Values != Expected)
+    return false;
+
+  // The copy-on-write clones share the instructions, even the clones of
+  // the clones.
+  numOfUses = GV0->getNumUses();
+  Function *Cow = F->clone("cow", /*copyOnWrite=*/true).release();
+  Function *CowOfCow = Cow->clone("cow.cow", /*copyOnWrite=*/true).release();
+  BasicBlock *BB = F->getBasicBlock("bb.9");
+  BasicBlock *CowBB = Cow->getBasicBlock("bb.9");
+  BasicBlock *CowOfCowBB = CowOfCow->getBasicBlock("bb.9");
+  if (GV0->getNumUses() != numOfUses || !CowBB->sharesInstructions() ||
+      &CowBB->instructions() != &BB->instructions() ||
+      &CowOfCowBB->instructions() != &BB->instructions() ||
+      printFn(Cow) != printFn(F) || !runFirstVisitLoops(*Cow, Values) ||
+      Values != Expected)
+    return false;
+
+  // The change of the original copies its instructions for the clones
+  // first, so they are not changed.
+  uint64_t epoch = Cow->getEpoch();
+  std::string Text = printFn(F);
+  Store::create({GV0, M->getVarWithID(1)}, BB);
+  if (CowBB->sharesInstructions() || CowOfCowBB->sharesInstructions() ||
+      BB->sharesInstructions() || Cow->getEpoch() == epoch ||
+      CowBB->getNumOfInstrs() + 1 != BB->getNumOfInstrs() ||
+      CowBB->instructions().front()->getParent() != CowBB ||
+      !runFirstVisitLoops(*Cow, Values) || Values != Expected ||
+      !runFirstVisitLoops(*CowOfCow, Values) || Values != Expected ||
+      printFn(CowOfCow) != Text || printFn(F) == Text)
+    return false;
+  // So does the change of an operand, and the getInstructions() of a clone
+  // takes the copies, since they may be changed.
+  BasicBlock *Cow5 = Cow->getBasicBlock("bb.5");
+  Instruction *I = F->getBasicBlock("bb.5")->getInstructions().front();
+  I->setOperand(0, I->getOperand(1));
+  if (Cow5->sharesInstructions() ||
+      Cow5->instructions().front()->getOperand(0) == I->getOperand(0) ||
+      Cow->getBasicBlock("bb.6")->getInstructions().front()->getParent() !=
+          Cow->getBasicBlock("bb.6") ||
+      !CowOfCow->getBasicBlock("bb.6")->sharesInstructions())
+    return false;
+
+  // The replaceAllUsesWith() changes the clones, as it would change the
+  // deep copies.
+  GlobalVariable *GV15 = M->getVarWithID(15);
+  GlobalVariable *GV16 = GlobalVariable::create(16, M.get()).release();
+  epoch = CowOfCow->getEpoch();
+  GV15->replaceAllUsesWith(GV16);
+  if (CowOfCow->getEpoch() == epoch || GV15->hasUses() ||
+      printFn(CowOfCow).find("var !15") != std::string::npos)
+    return false;
+
+  // The analyses only read the shared instructions, and the removal of a
+  // shared instruction from a clone removes the copy of the clone.
+  Function *Cow2 = F->clone("cow2", /*copyOnWrite=*/true).release();
+  BasicBlock *Cow2BB = Cow2->getBasicBlock("bb.9");
+  epoch = Cow2->getEpoch();
+  ReachingStores CowRS(*Cow2), RS(*F);
+  RS.getReachingStores(BB->instructions().back(), GV0);
+  if (!Cow2BB->sharesInstructions() || Cow2->getEpoch() != epoch)
+    return false;
+  Instruction *Shared = Cow2BB->instructions()[1];
+  size_t numOfInstrs = BB->getNumOfInstrs();
+  Cow2BB->removeInstruction(
+      IRPtr<Instruction>(Shared, IRDeleter<Instruction>(true)));
+  std::vector<VerifierDiagnostic> Diags;
+  if (Cow2BB->sharesInstructions() || BB->getNumOfInstrs() != numOfInstrs ||
+      Cow2BB->getNumOfInstrs() + 1 != numOfInstrs ||
+      BB->instructions()[1] != Shared || Shared->getParent() != BB ||
+      !M->verify(Diags))
+    return false;
+
+  // The visitors may change the instructions, so they don't get the shared
+  // ones.
+  Function *Cow3 = F->clone("cow3", /*copyOnWrite=*/true).release();
+  std::string Before = printFn(F);
+  OperandSetter(GV0).visit(*Cow3->getBasicBlock("bb.9"));
+  if (Cow3->getBasicBlock("bb.9")->sharesInstructions() ||
+      printFn(F) != Before || printFn(Cow3) == Before || !M->verify(Diags))
+    return false;
+
+  // The passes change the clones as they change the deep copies, even if
+  // the functions sharing the instructions are run in parallel.
+  Function *Ref = CowOfCow->clone("ref").release();
+  PassManager PM(4);
+  PM.addPass(createGVNPass());
+  if (!PM.run(*M) || F->getBasicBlock("bb.1")->sharesInstructions() ||
+      printFn(CowOfCow) != printFn(Ref) || printFn(Cow) != printFn(Ref))
+    return false;
+
+  // The module copy doesn't share anything.
+  auto MCopy = M->clone();
+  std::string CopyText;
+  Text.clear();
+  {
+    StringOutputStream OS(Text);
+    M->print(OS);
+  }
+  {
+    StringOutputStream OS(CopyText);
+    MCopy->print(OS);
+  }
+  Function *FCopy = MCopy->getFunction("loopy");
+  const Instruction *CopyI = FCopy->getEntryBB()->instructions().front();
+  std::vector<int64_t> CopyValues;
+  if (Text != CopyText || MCopy->getVarWithID(0) == GV0 ||
+      MCopy->getVarWithID(0)->getNumUses() != GV0->getNumUses() ||
+      CopyI->getOperand(0)->getParent() != MCopy.get() ||
+      !runFirstVisitLoops(*F, Values) ||
+      !runFirstVisitLoops(*FCopy, CopyValues) || Values != CopyValues)
+    return false;
+
+  // The vars are mapped whatever their ids are.
+  auto Far = Module::create("far.revLang", /*useArena=*/true);
+  auto *FarGV = GlobalVariable::create(UINT32_MAX, Far.get()).release();
+  auto *FarF = Function::create("f", Far.get()).release();
+  Load::create({FarGV}, BasicBlock::create("entry", FarF, true).release());
+  auto FarCopy = Far->clone();
+  const Instruction *FarI =
+      FarCopy->getFunction("f")->getEntryBB()->instructions().front();
+  return FarI->getOperand(0) == FarCopy->getVarWithID(UINT32_MAX) &&
+         FarI->getOperand(0) != FarGV;
+}
+
+// The counters, the timers and the gauges follow the changes, and the
+// values of all the threads are summed up.
+bool testStatistics() {
+  if (!Statistics::isEnabled())
+    return true;
+  StatsReport Before = Statistics::collect();
+  auto counted = [&Before](StatCounter C) {
+    return Statistics::collect().get(C) - Before.get(C);
+  };
+  auto live = [&Before](StatGauge G) {
+    return Statistics::collect().get(G).NumOfObjects -
+           Before.get(G).NumOfObjects;
+  };
+  {
+    auto M = Module::create("m26.revLang", /*useArena=*/true);
+    // The chain of 64 bbs, and the back edges from the bbs 7, 15, ..., 55.
+    Function *F = buildLoopyFunction(*M, 64, 8);
+    int64_t numOfInstrs = 0;
+    for (const auto &BB : F->getBasicBlocks())
+      numOfInstrs += BB.second->getNumOfInstrs();
+    if (counted(StatCounter::BBsCreated) != 64 ||
+        counted(StatCounter::EdgesAdded) != 70 ||
+        live(StatGauge::Module) != 1 || live(StatGauge::Function) != 1 ||
+        live(StatGauge::BasicBlock) != 64 ||
+        live(StatGauge::Instruction) != numOfInstrs ||
+        Statistics::collect().get(StatGauge::BasicBlock).Bytes -
+                Before.get(StatGauge::BasicBlock).Bytes !=
+            int64_t(64 * sizeof(BasicBlock)))
+      return false;
+
+    // The second isValid() takes the cached result.
+    if (!F->isValid() || !F->isValid() ||
+        counted(StatCounter::DFSNodesVisited) != 64 ||
+        Statistics::collect().get(StatTimer::IsValid).NumOfCalls !=
+            Before.get(StatTimer::IsValid).NumOfCalls + 2)
+      return false;
+
+    BasicBlock *BB = F->getBasicBlock("bb.7");
+    size_t numOfRemoved = BB->getNumOfInstrs();
+    BB->removeAllInstructions();
+    BB->removeSuccessor(F->getBasicBlock("bb.3"));
+    if (counted(StatCounter::InstrsRemoved) != numOfRemoved ||
+        counted(StatCounter::EdgesRemoved) != 1)
+      return false;
+
+    // The bbs created by the other threads count too.
+    ThreadPool Pool(4);
+    Pool.parallelFor(8, [](size_t) {
+      auto Shard = Module::create("shard.revLang", /*useArena=*/true);
+      buildLoopyFunction(*Shard, 10, 4);
+    });
+    if (counted(StatCounter::BBsCreated) != 64 + 8 * 10)
+      return false;
+  }
+
+  // Nothing is left alive.
+  for (StatGauge G : {StatGauge::Module, StatGauge::Function,
+                      StatGauge::BasicBlock, StatGauge::Instruction})
+    if (live(G) || Statistics::collect().get(G).Bytes != Before.get(G).Bytes)
+      return false;
+
+  std::string Str;
+  {
+    StringOutputStream OS(Str);
+    Statistics::collect().printJSON(OS);
+  }
+  return Str.find("\"bbs-created\": ") != std::string::npos;
+}
+
+// Returns the diagnostics of the M, checked on the numOfThreads threads.
+static std::vector<VerifierDiagnostic> verifyModule(const Module &M,
+                                                    unsigned numOfThreads) {
+  std::vector<VerifierDiagnostic> Diags;
+  if (M.verify(Diags, numOfThreads) != Diags.empty())
+    Diags.push_back({VerifierDiagnostic::Kind::BadName, "", "",
+                     "the result doesn't match the diagnostics"});
+  return Diags;
+}
+
+bool testVerifier() {
+  // NOTE: The Other outlives the M, whose instruction uses its var.
+  auto Other = Module::create("other.revLang", /*useArena=*/true);
+  auto *Foreign = GlobalVariable::create(100, Other.get()).release();
+  auto M = Module::create("m27.revLang", /*useArena=*/true);
+  Function *F = buildLoopyFunction(*M, 64, 8);
+  // The copy-on-write clone shares the instructions of the F.
+  F->clone("loopy.copy", /*copyOnWrite=*/true).release();
+  if (!verifyModule(*M, 1).empty() || !verifyModule(*M, 4).empty())
+    return false;
+
+  // Break the module in a few ways.
+  BasicBlock::create("dead", F).release();
+  auto *G = Function::create("noentry", M.get()).release();
+  BasicBlock::create("a", G).release();
+  Store::create({Foreign, M->getVarWithID(1)}, F->getBasicBlock("bb.5"))
+      .release();
+  GlobalVariable *GV = M->getVarWithID(3);
+  GV->setParent(Other.get());
+
+  auto Diags = verifyModule(*M, 1);
+  auto has = [&Diags](VerifierDiagnostic::Kind K, std::string_view FnName,
+                      std::string_view BBName) {
+    return std::any_of(Diags.begin(), Diags.end(),
+                       [&](const VerifierDiagnostic &D) {
+                         return D.K == K && D.FnName == FnName &&
+                                D.BBName == BBName;
+                       });
+  };
+  using Kind = VerifierDiagnostic::Kind;
+  if (Diags.size() != 4 || !has(Kind::Unreachable, "loopy", "dead") ||
+      !has(Kind::NoEntry, "noentry", "") ||
+      !has(Kind::BadOperand, "loopy", "bb.5") ||
+      !has(Kind::BadParent, "", ""))
+    return false;
+
+  // The diagnostics don't depend on the threads.
+  auto ParallelDiags = verifyModule(*M, 4);
+  if (ParallelDiags.size() != Diags.size())
+    return false;
+  for (size_t i = 0; i < Diags.size(); ++i)
+    if (ParallelDiags[i].K != Diags[i].K ||
+        ParallelDiags[i].FnName != Diags[i].FnName ||
+        ParallelDiags[i].BBName != Diags[i].BBName ||
+        ParallelDiags[i].Message != Diags[i].Message)
+      return false;
+
+  std::string Str;
+  {
+    StringOutputStream OS(Str);
+    for (const auto &D : Diags)
+      D.print(OS);
+  }
+  GV->setParent(M.get());
+  return Str.find("error: unreachable: fn loopy: bb dead: ") !=
+             std::string::npos &&
+         Str.find("error: bad-parent: the var !3 is not of this module") !=
+             std::string::npos;
+}
+
+// The native code gives the same results as the interpreter, and it is
+// compiled once per change of the function.
+bool testJIT() {
+  if (!JITCache::isSupported())
+    return true;
+  auto M = Module::create("m28.revLang", /*useArena=*/true);
+  Function *F = buildLoopyFunction(*M, 200, 16);
+  JITCache JIT(*M);
+  std::vector<int64_t> Expected, Values;
+  if (!runFirstVisitLoops(*F, Expected) ||
+      !runFirstVisitLoops(*F, Values, &JIT) || Values != Expected ||
+      JIT.getNumOfCompilations() != 1)
+    return false;
+
+  // The other engines take the cached code, until the function changes.
+  if (!runFirstVisitLoops(*F, Values, &JIT) || Values != Expected ||
+      JIT.getNumOfCompilations() != 1)
+    return false;
+  F->getBasicBlock("bb.9")->removeAllInstructions();
+  if (!runFirstVisitLoops(*F, Expected) ||
+      !runFirstVisitLoops(*F, Values, &JIT) || Values != Expected ||
+      JIT.getNumOfCompilations() != 2 || !JIT.getCodeSize())
+    return false;
+
+  // The same loop as in the testExecutionEngine(), with the sums wrapping
+  // around, the block limit, and the default branch decision.
+  std::vector<GlobalVariable *> GVs;
+  for (unsigned i = 16; i < 21; ++i)
+    GVs.push_back(GlobalVariable::create(i, M.get()).release());
+  auto *G = Function::create("loop", M.get()).release();
+  auto *Entry = BasicBlock::create("entry", G, true).release();
+  auto *Body = BasicBlock::create("body", G).release();
+  auto *Exit = BasicBlock::create("exit", G).release();
+  Entry->addSuccessor("", Body);
+  Body->addSuccessor("true", Body);
+  Body->addSuccessor("false", Exit);
+  Store::create({GVs[3], GVs[0]}, Entry);
+  Add::create({GVs[0], GVs[0], GVs[1]}, Body);
+  Add::create({GVs[2], GVs[2], GVs[1]}, Body);
+  Load::create({GVs[2]}, Body);
+  Add::create({GVs[4], GVs[0], GVs[0], GVs[0], GVs[1], GVs[1]}, Exit);
+
+  ExecutionEngine Ref(*M), EE(*M);
+  EE.setJIT(&JIT);
+  std::string RefErrMsg, errMsg;
+  for (uint64_t limit : {uint64_t(4), UINT64_MAX}) {
+    for (ExecutionEngine *E : {&Ref, &EE}) {
+      E->resetValues();
+      E->setBlockLimit(limit);
+      E->setValue(*GVs[1], 1);
+      E->setValue(*GVs[2], -6);
+      E->setValue(*GVs[3], INT64_MAX - 1);
+    }
+    bool RefOk = Ref.run(*G, RefErrMsg);
+    bool Ok = EE.run(*G, errMsg);
+    auto RefValues = Ref.getValues(), Values = EE.getValues();
+    if (Ok != RefOk ||
+        !std::equal(RefValues.begin(), RefValues.end(), Values.begin(),
+                    Values.end()) ||
+        Ref.getNumOfExecutedBlocks() != EE.getNumOfExecutedBlocks())
+      return false;
+    if (!Ok && errMsg != RefErrMsg)
+      return false;
+  }
+  // The !0 wraps around to INT64_MIN + 4 after the 6 iterations.
+  if (EE.getValue(*GVs[0]) != INT64_MIN + 4 ||
+      EE.getNumOfExecutedBlocks() != 8)
+    return false;
+
+  // The code addresses the vars by their slots, so the large ids are fine,
+  // and a new var gets the functions recompiled.
+  auto *Far = GlobalVariable::create(UINT32_MAX, M.get()).release();
+  auto *H = Function::create("far", M.get()).release();
+  Store::create({Far, GVs[0]}, BasicBlock::create("entry", H, true).release());
+  EE.setValue(*Far, 42);
+  uint64_t numOfCompilations = JIT.getNumOfCompilations();
+  if (!EE.run(*H, errMsg) || EE.getValue(*GVs[0]) != 42)
+    return false;
+  EE.setBlockLimit(4);
+  EE.run(*G, errMsg);
+  if (JIT.getNumOfCompilations() != numOfCompilations + 2)
+    return false;
+
+  // The functions without the entry bb cannot be compiled.
+  auto *Empty = Function::create("empty", M.get()).release();
+  return !EE.run(*Empty, errMsg) &&
+         errMsg == "function 'empty' has no entry bb";
+}
+
+// The flat form keeps the function as it is, through the copies and the
+// serialization, and the function built back from it runs the same.
+bool testFlatFunction() {
+  auto M = Module::create("m29.revLang", /*useArena=*/true);
+  Function *F = buildLoopyFunction(*M, 64, 8);
+  // The removed bb leaves a hole in the numbering.
+  auto *Gone = BasicBlock::create("gone", F).release();
+  F->removeBasicBlock(IRPtr<BasicBlock>(Gone, IRDeleter<BasicBlock>(true)));
+
+  FlatFunction Flat = FlatFunction::build(*F);
+  size_t numOfInstrs = 0, numOfOps = 0;
+  for (const auto &BB : F->getBasicBlocks())
+    for (const Instruction *I : BB.second->instructions()) {
+      ++numOfInstrs;
+      numOfOps += I->getNumOfOps();
+    }
+  if (Flat.getName() != "loopy" || Flat.getNumOfBlocks() != 64 ||
+      Flat.getNumOfInstrs() != numOfInstrs ||
+      Flat.getNumOfOps() != numOfOps || Flat.getNumOfEdges() != 70 ||
+      Flat.getEntryBlock().getBBID() != "bb.0")
+    return false;
+
+  // The views mirror the bbs and the instructions.
+  FlatBlock Latch = Flat.getBlock(7);
+  const BasicBlock *BB = F->getBasicBlock("bb.7");
+  if (Latch.getBBID() != "bb.7" ||
+      Latch.getNumOfInstrs() != BB->getNumOfInstrs() ||
+      Latch.getNumOfSuccessors() != 2 || Latch.getSuccessorTag(1) != "true" ||
+      Latch.getSuccessor(1).getBBID() != "bb.3")
+    return false;
+  for (size_t i = 0; i < BB->getNumOfInstrs(); ++i) {
+    const Instruction *I = BB->instructions()[i];
+    FlatInstr FI = Latch.getInstr(i);
+    if (FI.getOpCodeKind() != I->getOpCodeKind() ||
+        FI.getNumOfOps() != I->getNumOfOps() ||
+        FI.getOperandID(0) != I->getOperand(0)->getID())
+      return false;
+  }
+
+  // The copies and the serialized forms are the same.
+  FlatFunction Copy = Flat;
+  std::string Bytes, errMsg;
+  Flat.serialize(Bytes);
+  FlatFunction Read;
+  if (Copy != Flat || !Read.deserialize(Bytes, errMsg) || Read != Flat)
+    return false;
+
+  // The function built back (in another module) runs the same, and it has
+  // the same flat form.
+  auto Other = Module::create("other.revLang", /*useArena=*/true);
+  Function *G = Read.materialize(*Other).release();
+  std::vector<int64_t> Expected, Values;
+  if (!G->isValid() || FlatFunction::build(*G) != Flat ||
+      !runFirstVisitLoops(*F, Expected) || !runFirstVisitLoops(*G, Values))
+    return false;
+  for (const auto &GV : Other->getGlobalVars())
+    if (Values[GV.first] != Expected[GV.first])
+      return false;
+
+  // The broken forms are rejected, and they leave the function as it is.
+  FlatFunction Empty;
+  if (Read.deserialize(std::string_view(Bytes).substr(0, Bytes.size() - 1),
+                       errMsg) ||
+      errMsg != "malformed flat function: unexpected size" || Read != Flat)
+    return false;
+  // The entry bb index follows the magic, the version and the name.
+  std::string Bad = Bytes;
+  uint32_t badEntry = 1000;
+  std::memcpy(&Bad[12], &badEntry, sizeof(badEntry));
+  return !Empty.deserialize(Bad, errMsg) &&
+         errMsg == "malformed flat function: bad entry bb" &&
+         Empty.getNumOfBlocks() == 0;
+}
+
 int main()
 {
   if (!testBasicModuleCreationAndDeletion())
@@ -76,5 +2043,83 @@ int main()
   if (testFunctionValidation3())
     return 1;
 
+  if (!testArenaModuleCreation())
+    return 1;
+
+  if (!testParserRoundTrip())
+    return 1;
+
+  if (!testParserErrors())
+    return 1;
+
+  if (!testBitcodeRoundTrip())
+    return 1;
+
+  if (!testSymbolTables())
+    return 1;
+
+  if (!testOpCodesAndCasting())
+    return 1;
+
+  if (!testInstructionOperands())
+    return 1;
+
+  if (!testUseLists())
+    return 1;
+
+  if (!testPredecessors())
+    return 1;
+
+  if (!testCFGTraversal())
+    return 1;
+
+  if (!testCFGStress())
+    return 1;
+
+  if (!testOutputStreams())
+    return 1;
+
+  if (!testExecutionEngine())
+    return 1;
+
+  if (!testBatchExecution())
+    return 1;
+
+  if (!testPassManager())
+    return 1;
+
+  if (!testCleanupPasses())
+    return 1;
+
+  if (!testDataFlow())
+    return 1;
+
+  if (!testDominatorsAndLoops())
+    return 1;
+
+  if (!testGVN())
+    return 1;
+
+  if (!testAnalysisManager())
+    return 1;
+
+  if (!testModuleLinking())
+    return 1;
+
+  if (!testCloning())
+    return 1;
+
+  if (!testStatistics())
+    return 1;
+
+  if (!testVerifier())
+    return 1;
+
+  if (!testJIT())
+    return 1;
+
+  if (!testFlatFunction())
+    return 1;
+
   return 0;
 }